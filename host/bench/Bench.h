@@ -0,0 +1,187 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Bench.h
+  *
+  * Micro-benchmark harness of the host benchmarks.
+  * Measures ns/op and counts the heap allocations/op by wrapping malloc.
+  * The results can be written as baseline and compared with one:
+  * one more allocation per call than the baseline always fails, a slower
+  * time only with a given factor because the times depend on the machine.
+  *
+  *   <bench> [-n iterations] [-b baseline] [-t factor] [-w file] [filter]
+  *
+  * Include it once per benchmark executable after the sketch.
+  */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void  __libc_free(void *ptr);
+
+static bool     g_benchCounting = false; //!< Count only inside the measured loops.
+static uint64_t g_benchAllocs   = 0;     //!< Allocations since the last reset.
+
+/** Counting replacements of the heap functions. */
+extern "C" void *malloc(size_t size)                { if (g_benchCounting) g_benchAllocs++; return __libc_malloc(size); }
+extern "C" void *realloc(void *ptr, size_t size)    { if (g_benchCounting) g_benchAllocs++; return __libc_realloc(ptr, size); }
+extern "C" void *calloc(size_t count, size_t size)  { if (g_benchCounting) g_benchAllocs++; return __libc_calloc(count, size); }
+extern "C" void  free(void *ptr)                    { __libc_free(ptr); }
+
+/** Result of one benchmark. */
+struct BenchResult
+{
+   std::string name;        //!< 'group/operation' without spaces.
+   double      nsPerOp;     //!< Mean time of one call.
+   double      allocsPerOp; //!< Mean heap allocations of one call.
+};
+
+/** Command line options and results of the running benchmark executable. */
+struct BenchRun
+{
+   long                     iterations = 100000; //!< Calls per benchmark.
+   std::string              filter;              //!< Only benchmarks containing this text.
+   std::string              baseline;            //!< Baseline file to compare with.
+   std::string              output;              //!< File to write the results as new baseline.
+   double                   timeFactor = 0.0;    //!< Allowed slow down against the baseline, 0 = no time check.
+   std::vector<BenchResult> results;             //!< Results so far.
+};
+
+static BenchRun        g_bench;     //!< The current run.
+static volatile size_t g_benchSink; //!< Keeps the results of the measured calls alive.
+
+/** Runs fn g_bench.iterations / divisor times and records ns/op and allocs/op.
+  * fn gets the iteration index. One warm up call is not measured.
+  * The divisor keeps the slow file operations short.
+  */
+template <typename Fn>
+static void bench(const char *name, Fn fn, long divisor = 1)
+{
+   long iterations = max(g_bench.iterations / divisor, 1L);
+
+   if (g_bench.filter.size() && !strstr(name, g_bench.filter.c_str())) {
+      return;
+   }
+   fn(0);
+   g_benchAllocs   = 0;
+   g_benchCounting = true;
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   for (long i = 0; i < iterations; i++) {
+      fn(i);
+   }
+
+   double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+   g_benchCounting = false;
+
+   BenchResult result = { name, ns / iterations, (double) g_benchAllocs / iterations };
+
+   printf("  %-36s %10.1f ns/op %8.2f allocs/op\n", name, result.nsPerOp, result.allocsPerOp);
+   g_bench.results.push_back(result);
+}
+
+/** Parses the command line. Returns false on an unknown option. */
+static bool benchBegin(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:b:t:w:")) != -1) {
+      switch (opt) {
+         case 'n': g_bench.iterations = atol(optarg); break;
+         case 'b': g_bench.baseline   = optarg;       break;
+         case 't': g_bench.timeFactor = atof(optarg); break;
+         case 'w': g_bench.output     = optarg;       break;
+         default:
+            fprintf(stderr, "usage: %s [-n iterations] [-b baseline] [-t factor] [-w file] [filter]\n", argv[0]);
+            return false;
+      }
+   }
+   if (optind < argc) {
+      g_bench.filter = argv[optind];
+   }
+   if (g_bench.iterations <= 0) {
+      g_bench.iterations = 1;
+   }
+   printf("%ld iterations\n", g_bench.iterations);
+   return true;
+}
+
+/** Writes the results and compares them with the baseline.
+  * Returns the number of regressions as exit code.
+  */
+static int benchEnd()
+{
+   int regressions = 0;
+
+   if (g_bench.output.size()) {
+      FILE *file = fopen(g_bench.output.c_str(), "w");
+
+      if (!file) {
+         fprintf(stderr, "Cannot write %s\n", g_bench.output.c_str());
+         return 1;
+      }
+      fprintf(file, "# name ns/op allocs/op\n");
+      for (const BenchResult &result : g_bench.results) {
+         fprintf(file, "%s %.1f %.2f\n", result.name.c_str(), result.nsPerOp, result.allocsPerOp);
+      }
+      fclose(file);
+   }
+   if (g_bench.baseline.size()) {
+      FILE *file = fopen(g_bench.baseline.c_str(), "r");
+      char  line[256];
+
+      if (!file) {
+         fprintf(stderr, "Cannot read %s\n", g_bench.baseline.c_str());
+         return 1;
+      }
+      while (fgets(line, sizeof(line), file)) {
+         char   name[128];
+         double ns     = 0.0;
+         double allocs = 0.0;
+
+         if (line[0] == '#' || sscanf(line, "%127s %lf %lf", name, &ns, &allocs) != 3) {
+            continue;
+         }
+         for (const BenchResult &result : g_bench.results) {
+            if (result.name != name) {
+               continue;
+            }
+            // Half an allocation of tolerance for the amortized growth of the log list.
+            if (result.allocsPerOp > allocs + 0.5) {
+               printf("REGRESSION %s: %.2f allocs/op, baseline %.2f\n", name, result.allocsPerOp, allocs);
+               regressions++;
+            }
+            if (g_bench.timeFactor > 0.0 && result.nsPerOp > ns * g_bench.timeFactor) {
+               printf("REGRESSION %s: %.1f ns/op, baseline %.1f x %.2f\n", name, result.nsPerOp, ns, g_bench.timeFactor);
+               regressions++;
+            }
+         }
+      }
+      fclose(file);
+      printf("%d regressions against %s\n", regressions, g_bench.baseline.c_str());
+   }
+   return regressions;
+}
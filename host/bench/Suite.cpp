@@ -0,0 +1,186 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Suite.cpp
+  *
+  * Benchmark suite of the hot operations of the firmware: the log list,
+  * the options, the RTC data, the Utils.h helpers and the HTML/JSON builders
+  * of the web server. bench/baseline.txt holds the accepted results,
+  * `make bench-check` fails on more allocations than there.
+  *
+  *   benchsuite [-n iterations] [-b baseline] [-t factor] [-w file] [filter]
+  */
+
+#include <Arduino.h>
+#include "solarweather.ino"
+#include "Bench.h"
+
+/**
+  * Opens the protected HTML and JSON builders of the web server.
+  */
+class BenchWebServer : public MyWebServer
+{
+public:
+   using MyWebServer::AddTableTr;
+   using MyWebServer::AddOption;
+   using MyWebServer::AddMainData;
+   using MyWebServer::AddInfoData;
+};
+
+/**
+  * Writer which only calculates the crc of the built content,
+  * so the builders run without a client.
+  */
+class CrcWriter : public ChunkedWriter
+{
+protected:
+   long crc; //!< Crc of the content so far.
+
+   virtual void send() { crc = crc32(crc, (unsigned char *) buffer, length); }
+
+public:
+   CrcWriter() : crc(0) { }
+
+   long getCrc() { flush(); return crc; }
+};
+
+/** The debug output only costs the formatting, no console and no waiting. */
+static void benchDelay(unsigned long)
+{
+}
+
+/** Log list as it is filled by MyDbg. */
+static void benchStringList()
+{
+   StringList list;
+   String     item = F("1234: Attempting MQTT connection... [name]");
+
+   while (list.infos.length() + item.length() + 1 <= MAX_LOG_INFOS_SIZE) {
+      list.addTail(item);
+   }
+   bench("StringList/addTail-full",  [&](long) { list.addTail(item); });
+   bench("StringList/getAt-middle",  [&](long) { g_benchSink += list.getAt(list.count() / 2).length(); });
+   bench("StringList/getAt-last",    [&](long) { g_benchSink += list.getAt(list.count() - 1).length(); });
+}
+
+/** Option table lookups, accessors and the settings file. */
+static void benchOptions()
+{
+   OptionInfo port;
+   OptionInfo name;
+   const char *keys[OPTION_COUNT];
+
+   MyOptions::getInfo(MyOptions::find("mqttPort"), port);
+   MyOptions::getInfo(MyOptions::find("mqttName"), name);
+   for (int i = 0; i < MyOptions::count(); i++) {
+      keys[i] = optionTable[i].key;
+   }
+   myOptions.setValue(port, 1883L);
+   myOptions.save();
+
+   bench("MyOptions/find",           [&](long i) { g_benchSink += MyOptions::find(keys[i % MyOptions::count()]); });
+   bench("MyOptions/getInfo",        [&](long i) { OptionInfo info; MyOptions::getInfo(i % MyOptions::count(), info); g_benchSink += info.type; });
+   bench("MyOptions/getValue-long",  [&](long)   { g_benchSink += myOptions.getValue(port).length(); });
+   bench("MyOptions/getValue-text",  [&](long)   { g_benchSink += myOptions.getValue(name).length(); });
+   bench("MyOptions/setValue-long",  [&](long i) { myOptions.setValue(port, 1883L + (i & 1)); });
+   myOptions.setValue(port, 1883L);
+   myOptions.save();
+   bench("MyOptions/save-unchanged", [&](long)   { g_benchSink += myOptions.save(); });
+   bench("MyOptions/save-changed",   [&](long i) { myOptions.setValue(port, 1883L + (i & 1)); g_benchSink += myOptions.save(); }, 100);
+   bench("MyOptions/load",           [&](long)   { g_benchSink += myOptions.load(); }, 100);
+}
+
+/** Check and store of the RTC data before every deep sleep. */
+static void benchRtcData()
+{
+   MyData::RtcData &rtcData = myData.rtcData;
+
+   bench("RtcData/getCRC",           [&](long)   { g_benchSink += rtcData.getCRC(); });
+   bench("RtcData/write-read",       [&](long i) {
+      MyData::RtcData copy;
+
+      rtcData.mqttSendCount = i;
+      rtcData.setCRC();
+      ESP.rtcUserMemoryWrite(0, (uint32_t *) &rtcData, sizeof(MyData::RtcData));
+      ESP.rtcUserMemoryRead(0, (uint32_t *) &copy, sizeof(MyData::RtcData));
+      g_benchSink += copy.isValid();
+   });
+}
+
+/** Text helpers of the pages and the MQTT values. */
+static void benchUtils()
+{
+   const char    *text = "<b>\"Temp\" & humidity</b> 100% > 50%";
+   char           buff[128];
+   unsigned char  block[1024];
+
+   memset(block, 0x5A, sizeof(block));
+   bench("Utils/TextToXml-buffer",   [&](long)   { g_benchSink += TextToXml(buff, sizeof(buff), text); });
+   bench("Utils/TextToUrl-buffer",   [&](long)   { g_benchSink += TextToUrl(buff, sizeof(buff), text); });
+   bench("Utils/formatInterval",     [&](long i) { g_benchSink += formatInterval(buff, sizeof(buff), i * 7919); });
+   bench("Utils/formatDateTime",     [&](long i) { g_benchSink += formatDateTime(buff, sizeof(buff), 1600000000L + i * 7919); });
+   bench("Utils/formatLong",         [&](long i) { g_benchSink += formatLong(buff, i * 7919 - 100000); });
+   bench("Utils/scanInterval",       [&](long)   { long secs = 0; g_benchSink += scanInterval(" 1 02:03:04 ", secs) + secs; });
+   bench("Utils/crc32-1KB",          [&](long)   { g_benchSink += crc32(0, block, sizeof(block)); });
+}
+
+/** Page and JSON builders into a writer which only sums the crc. */
+static void benchHtml()
+{
+   OptionInfo port;
+
+   MyOptions::getInfo(MyOptions::find("mqttPort"), port);
+   bench("Html/AddTableTr-String",   [&](long)   { CrcWriter w; BenchWebServer::AddTableTr(w, F("Status"), myData.softAPmacAddress); g_benchSink += w.getCrc(); });
+   bench("Html/AddTableTr-number",   [&](long i) { CrcWriter w; BenchWebServer::AddTableTr(w, F("Free Heap Memory"), i, F(" Byte")); g_benchSink += w.getCrc(); });
+   bench("Html/AddOption-bool",      [&](long)   { CrcWriter w; BenchWebServer::AddOption(w, port.key, port.label, true); g_benchSink += w.getCrc(); });
+   bench("Html/AddOption-text",      [&](long)   { CrcWriter w; BenchWebServer::AddOption(w, port.key, port.label, myOptions.getValue(port)); g_benchSink += w.getCrc(); });
+   bench("Html/HtmlTag",             [&](long)   { CrcWriter w; { HtmlTag tag(w, F("fieldset")); w += F("text"); } g_benchSink += w.getCrc(); });
+   bench("Json/AddMainData",         [&](long)   { CrcWriter w; BenchWebServer::AddMainData(w); g_benchSink += w.getCrc(); });
+   bench("Json/AddInfoData",         [&](long)   { CrcWriter w; BenchWebServer::AddInfoData(w); g_benchSink += w.getCrc(); });
+}
+
+int main(int argc, char *argv[])
+{
+   char root[] = "/tmp/benchsuiteXXXXXX";
+
+   if (!benchBegin(argc, argv)) {
+      return 1;
+   }
+   if (!mkdtemp(root)) {
+      perror("mkdtemp");
+      return 1;
+   }
+   HostRuntime::get().delay = benchDelay;
+   Serial.enabled           = false;
+   SPIFFS.setRoot(root);
+   SPIFFS.begin();
+
+   myData.softAPmacAddress = F("5E:CF:7F:00:00:01");
+   myData.stationIP        = F("192.168.1.10");
+
+   benchStringList();
+   benchOptions();
+   benchRtcData();
+   benchUtils();
+   benchHtml();
+
+   SPIFFS.remove(OPTION_FILE_NAME);
+   SPIFFS.remove(OPTION_TEMP_FILE_NAME);
+   SPIFFS.remove(OPTION_BACKUP_FILE_NAME);
+   rmdir(root);
+   return benchEnd();
+}
@@ -0,0 +1,270 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TextBench.cpp
+  *
+  * Micro-benchmarks of the text helpers in Utils.h.
+  * Compares the former String based implementations (copied below) with
+  * the buffer based ones and prints ns/op and heap allocations/op.
+  * Every pair is checked for the same output first.
+  *
+  *   textbench [-n iterations] [filter]
+  */
+
+#include <Arduino.h>
+#include "solarweather.ino"
+#include "Bench.h"
+
+/* ******************************************** */
+/* Former implementations                       */
+
+String oldWifiGetRssiAsQuality(int rssi)
+{
+   int quality = 0;
+
+   if (rssi <= -100) {
+      quality = 0;
+   } else if (rssi >= -50) {
+      quality = 100;
+   } else {
+      quality = 2 * (rssi + 100);
+   }
+   return String(quality);
+}
+
+String oldTextToUrl(String data)
+{
+   data.replace(F("%"), F("%25"));
+   data.replace(F("&"), F("%26"));
+   data.replace(F("<"), F("%3C"));
+   data.replace(F(">"), F("%3E"));
+
+   // Signed like the char of the firmware, so the bytes from 0x80 are invalid.
+   for (int i = 0; i < (int) data.length(); i++) {
+      bool validChar = (data[i] == 0x09 || data[i] == 0x0A || data[i] == 0x0D || ((signed char) data[i] >= 0x20));
+
+      if (!validChar) {
+         data[i] = '?';
+      }
+   }
+   return data;
+}
+
+String oldTextToXml(String data)
+{
+   data.replace(F("&"),  F("&amp;"));
+   data.replace(F("<"),  F("&lt;"));
+   data.replace(F(">"),  F("&gt;"));
+   data.replace(F("\""), F("&quot;"));
+   return data;
+}
+
+String oldTrim(const String &data, const String &chars)
+{
+   String ret = data;
+
+   for (int i = 0; i < (int) ret.length(); i++) {
+      if (chars.indexOf(ret[i]) != -1) {
+         ret.remove(i, 1);
+         i--;
+         continue;
+      }
+      break;
+   }
+   for (int i = ret.length() - 1; i >= 0; i--) {
+      if (chars.indexOf(ret[i]) != -1) {
+         ret.remove(i, 1);
+         continue;
+      }
+      break;
+   }
+   return ret;
+}
+
+String oldFormatInterval(long secs)
+{
+   char buff[255];
+
+   int days    =  secs / 60 / 60 / 24;
+   int hours   = (secs / 60 / 60) % 24;
+   int minutes = (secs / 60) % 60;
+   int seconds =  secs % 60;
+
+   buff[0] = '\0';
+   if (days <= 0) {
+      sprintf(buff, "%02d:%02d:%02d", hours, minutes, seconds);
+   } else {
+      sprintf(buff, "%d %02d:%02d:%02d", days, hours, minutes, seconds);
+   }
+   return buff;
+}
+
+bool oldScanInterval(String interval, long &secs)
+{
+   int first = -1;
+
+   interval = oldTrim(interval, F(" "));
+   first    = interval.indexOf(F(":"));
+   if (first != -1) {
+      String daysString;
+      String hoursString;
+      String minutesString;
+      String secondsString;
+      long   days    = 0;
+      long   hours   = 0;
+      long   minutes = 0;
+      long   seconds = 0;
+
+      int second = interval.indexOf(F(":"), first + 1);
+
+      if (second != -1) {
+         int space = interval.indexOf(F(" "));
+
+         if (space != -1 && space < first) {
+            daysString  = interval.substring(0, space);
+            hoursString = interval.substring(space + 1, first);
+         } else {
+            hoursString = interval.substring(0, first);
+         }
+         minutesString = interval.substring(first + 1, second);
+         secondsString = interval.substring(second + 1);
+
+         days    = atol(daysString.c_str());
+         hours   = atol(hoursString.c_str());
+         minutes = atol(minutesString.c_str());
+         seconds = atol(secondsString.c_str());
+
+         if (days    >= 0 &&
+             hours   >= 0 && hours   <= 23 &&
+             minutes >= 0 && minutes <= 59 &&
+             seconds >= 0 && seconds <= 59) {
+            secs = 0;
+            secs += days    * 24 * 60 * 60;
+            secs += hours   * 60 * 60;
+            secs += minutes * 60;
+            secs += seconds;
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+/* ******************************************** */
+/* Benchmark driver                             */
+
+static int g_failed = 0; //!< Number of output mismatches.
+
+/** Prints a mismatch between the former and the new implementation. */
+static void check(const char *name, const String &expected, const String &actual)
+{
+   if (expected != actual) {
+      printf("MISMATCH %s: [%s] != [%s]\n", name, expected.c_str(), actual.c_str());
+      g_failed++;
+   }
+}
+
+static const char *texts[] = {
+   "Solar weather box",
+   "<b>\"Temp\" & humidity</b> 100% > 50%",
+   "ctrl\x01\x02 chars\ttab",
+   "22.5 \xB0" "C",
+   "",
+};
+
+static const char *intervals[] = {
+   "00:00:10",
+   "  1 02:03:04 ",
+   "23:59:59",
+   "7 00:00:00",
+   "24:00:00",
+   "10",
+   "1:2",
+};
+
+static const long seconds[] = { 0, 59, 3600, 86399, 86400, 90061, 604800, 2147483647L };
+
+/** Compares the outputs of both implementations for all samples. */
+static void verify()
+{
+   char buff[256];
+
+   for (const char *text : texts) {
+      TextToXml(buff, sizeof(buff), text);
+      check("TextToXml(buff)",   oldTextToXml(text), buff);
+      check("TextToXml(String)", oldTextToXml(text), TextToXml(String(text)));
+      TextToUrl(buff, sizeof(buff), text);
+      check("TextToUrl(buff)",   oldTextToUrl(text), buff);
+      check("TextToUrl(String)", oldTextToUrl(text), TextToUrl(String(text)));
+      check("Trim",              oldTrim(text, F(" <>%")), Trim(String(text), F(" <>%")));
+   }
+   for (long secs : seconds) {
+      formatInterval(buff, sizeof(buff), secs);
+      check("formatInterval", oldFormatInterval(secs), buff);
+   }
+   for (const char *interval : intervals) {
+      long oldSecs = -1;
+      long newSecs = -1;
+      bool oldRet  = oldScanInterval(interval, oldSecs);
+      bool newRet  = scanInterval(interval, newSecs);
+
+      check("scanInterval", String(oldRet) + " " + String(oldSecs), String(newRet) + " " + String(newSecs));
+   }
+   for (int rssi = -110; rssi <= -40; rssi++) {
+      check("WifiGetRssiQuality", oldWifiGetRssiAsQuality(rssi), String(WifiGetRssiQuality(rssi)));
+   }
+   // Truncation keeps whole escape sequences.
+   TextToXml(buff, 7, "a&b");
+   check("TextToXml(truncated)", "a&amp;", buff);
+   TextToXml(buff, 6, "a&b");
+   check("TextToXml(truncated)", "a", buff);
+}
+
+int main(int argc, char *argv[])
+{
+   if (!benchBegin(argc, argv)) {
+      return 1;
+   }
+   verify();
+
+   const String xmlText = texts[1];
+   const String trimText = "   <b>padded text</b>   ";
+   char         buff[128];
+
+   bench("TextToXml/old-String",         [&](long) { g_benchSink += oldTextToXml(xmlText).length(); });
+   bench("TextToXml/String",             [&](long) { g_benchSink += TextToXml(xmlText).length(); });
+   bench("TextToXml/buffer",             [&](long) { g_benchSink += TextToXml(buff, sizeof(buff), xmlText.c_str()); });
+   bench("TextToUrl/old-String",         [&](long) { g_benchSink += oldTextToUrl(xmlText).length(); });
+   bench("TextToUrl/String",             [&](long) { g_benchSink += TextToUrl(xmlText).length(); });
+   bench("TextToUrl/buffer",             [&](long) { g_benchSink += TextToUrl(buff, sizeof(buff), xmlText.c_str()); });
+   bench("Trim/old-String",              [&](long) { g_benchSink += oldTrim(trimText, F(" ")).length(); });
+   bench("Trim/String",                  [&](long) { g_benchSink += Trim(trimText, F(" ")).length(); });
+   bench("Trim/buffer",                  [&](long) { size_t len; Trim(trimText.c_str(), " ", len); g_benchSink += len; });
+   bench("formatInterval/old-String",    [&](long i) { g_benchSink += oldFormatInterval(i * 7919).length(); });
+   bench("formatInterval/String",        [&](long i) { g_benchSink += formatInterval(i * 7919).length(); });
+   bench("formatInterval/buffer",        [&](long i) { g_benchSink += formatInterval(buff, sizeof(buff), i * 7919); });
+   bench("scanInterval/old-String",      [&](long) { long secs; g_benchSink += oldScanInterval(intervals[1], secs) ? secs : 0; });
+   bench("scanInterval/buffer",          [&](long) { long secs; g_benchSink += scanInterval(intervals[1], secs) ? secs : 0; });
+   bench("WifiGetRssiQuality/old-String", [&](long i) { g_benchSink += oldWifiGetRssiAsQuality(-40 - i % 70).length(); });
+   bench("WifiGetRssiQuality/int",       [&](long i) { g_benchSink += WifiGetRssiQuality(-40 - i % 70); });
+
+   if (g_failed) {
+      printf("%d mismatches\n", g_failed);
+      return 1;
+   }
+   return benchEnd();
+}
@@ -0,0 +1,562 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Collector.h
+  *
+  * Ingest of the box values from the MQTT broker.
+  * Every subscription runs in its own ingest thread which parses the
+  * PUBLISH packets in place and pushes fixed size records into the lock-free
+  * queue of the worker owning the box (hash of mqttName/mqttId). So one box
+  * is always handled by the same worker, in order and without locks.
+  * A binary telemetry record (TelemetryDecoder.h) becomes the same records
+  * as the text topics, its stored readings first with their own times.
+  * The workers keep the latest values per box and hand every record to the
+  * registered sinks.
+  */
+
+#pragma once
+
+#include "MqttWire.h"
+#include "Metrics.h"
+#include "MpscQueue.h"
+#include "TelemetryDecoder.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define COLLECTOR_BOX_SIZE     48 //!< Longest "mqttName/mqttId".
+#define COLLECTOR_TICK_MS     100 //!< Interval of the sink ticks.
+#define COLLECTOR_RECONNECT_MS 1000 //!< Wait before a new broker connection.
+
+/** Wall clock in ms. */
+inline int64_t collectorNowMs()
+{
+   return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+  * One parsed value, copied through the queues.
+  */
+struct Record
+{
+   uint64_t boxHash;                 //!< hashBox(box).
+   int64_t  timeMs;                  //!< Receive time (unix ms), the reading time of a stored value.
+   double   value;                   //!< Parsed value.
+   uint8_t  metric;                  //!< Metric
+   uint8_t  stored;                  //!< Reading of an earlier wake from the telemetry backlog.
+   uint8_t  boxLength;               //!< Length of box.
+   char     box[COLLECTOR_BOX_SIZE]; //!< "mqttName/mqttId", not terminated.
+
+   std::string_view boxName() const { return std::string_view(box, boxLength); }
+};
+
+/**
+  * Latest values of one box, owned by one worker.
+  */
+struct BoxState
+{
+   std::string name;                   //!< "mqttName/mqttId".
+   uint32_t    index;                  //!< Position in the worker.
+   uint64_t    records;                //!< Received values.
+   int64_t     lastMs;                 //!< Time of the last value.
+   double      values[METRIC_COUNT];   //!< Latest value per metric.
+   int64_t     timesMs[METRIC_COUNT];  //!< Time of the latest value, 0 = none.
+};
+
+/**
+  * Consumer of the records. add() and tick() run in the worker thread,
+  * the same sink is called from all workers. control() gets the settings
+  * mqttName/subTopic the firmware subscribes (/SendEverySec, /DeepSleep)
+  * in the ingest threads.
+  */
+class RecordSink
+{
+public:
+   virtual ~RecordSink() { }
+
+   virtual void add(int worker, BoxState &box, const Record &record) = 0;
+   virtual void tick(int, int64_t) { }
+   virtual void control(std::string_view, std::string_view, std::string_view) { }
+};
+
+/** Settings of the collector. */
+struct CollectorOptions
+{
+   std::string              host      = "127.0.0.1"; //!< Broker host.
+   std::string              port      = "1883";      //!< Broker port.
+   std::vector<std::string> filters;                 //!< One ingest thread per topic filter.
+   std::string              clientId  = "collector"; //!< Client id prefix.
+   std::string              user;                    //!< Broker user.
+   std::string              password;                //!< Broker password.
+   int                      workers   = 4;           //!< Worker threads.
+   size_t                   queueSize = 65536;       //!< Records per worker queue.
+};
+
+/** Counters of one ingest thread. */
+struct IngestCounters
+{
+   std::atomic<uint64_t> messages{0};   //!< Received PUBLISH packets.
+   std::atomic<uint64_t> records{0};    //!< Queued values, more than one per telemetry record.
+   std::atomic<uint64_t> ignored{0};    //!< Not a metric (/Trace, heap sites, other topics) or a retained replay.
+   std::atomic<uint64_t> errors{0};     //!< Unparsable values.
+   std::atomic<uint64_t> fullWaits{0};  //!< Waits for a full worker queue.
+   std::atomic<uint64_t> reconnects{0}; //!< Broker connections.
+};
+
+class Collector;
+
+/**
+  * Consumer of one queue.
+  */
+class CollectorWorker
+{
+protected:
+   Collector                               &collector; //!< Owner.
+   int                                      index;     //!< Worker number.
+   std::unordered_map<uint64_t, uint32_t>   lookup;    //!< Box hash -> index.
+   std::vector<std::unique_ptr<BoxState> >  boxes;     //!< Boxes of this worker.
+   std::thread                              thread;    //!< Runs run().
+
+   void      run();
+   BoxState *findBox(const Record &record);
+
+public:
+   MpscQueue<Record>     queue;       //!< Records of the ingest threads.
+   std::atomic<uint64_t> records{0};  //!< Handled records.
+   std::atomic<uint64_t> boxCount{0}; //!< Known boxes.
+   std::atomic<uint64_t> collisions{0}; //!< Different boxes with the same hash (dropped).
+
+   CollectorWorker(Collector &c, int i, size_t queueSize) : collector(c), index(i), queue(queueSize) { }
+
+   void start() { thread = std::thread(&CollectorWorker::run, this); }
+   void join()  { if (thread.joinable()) thread.join(); }
+};
+
+/**
+  * Broker connection of one topic filter.
+  */
+class CollectorIngest
+{
+protected:
+   Collector  &collector; //!< Owner.
+   std::string filter;    //!< Subscribed topic filter.
+   int         index;     //!< Ingest number, part of the client id.
+   std::thread thread;    //!< Runs run().
+
+   void run();
+   int  connectBroker();
+
+public:
+   IngestCounters counters; //!< Statistics.
+
+   CollectorIngest(Collector &c, const std::string &f, int i) : collector(c), filter(f), index(i) { }
+
+   void start() { thread = std::thread(&CollectorIngest::run, this); }
+   void join()  { if (thread.joinable()) thread.join(); }
+};
+
+/**
+  * Workers, ingest threads and sinks.
+  */
+class Collector
+{
+public:
+   CollectorOptions                               options; //!< Settings.
+   std::vector<std::unique_ptr<CollectorWorker> > workers; //!< Queue consumers.
+   std::vector<std::unique_ptr<CollectorIngest> > ingests; //!< Broker connections.
+   std::vector<RecordSink *>                      sinks;   //!< Called for every record.
+   std::atomic<bool>                              stop{false};
+
+   explicit Collector(const CollectorOptions &o);
+
+   void addSink(RecordSink *sink) { sinks.push_back(sink); }
+   void startWorkers();
+   void startIngests();
+   void shutdown();
+   bool dispatch(std::string_view topic, std::string_view payload, int64_t nowMs, IngestCounters &counters, bool retained = false);
+   bool dispatchTelemetry(std::string_view box, std::string_view payload, int64_t nowMs, IngestCounters &counters);
+   void push(const Record &record, IngestCounters &counters);
+   void printStats(double seconds);
+};
+
+/* ******************************************** */
+
+/** Metric of a telemetry field, the same value as text. */
+inline int telemetryMetric(int field)
+{
+   static const std::vector<int> metrics = [] {
+      std::vector<int> table(TELEMETRY_FIELD_COUNT);
+
+      for (int i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+         table[i] = findMetric(telemetryTable[i].topic);
+      }
+      return table;
+   }();
+
+   return metrics[field];
+}
+
+/** Box of the record, created on the first value. */
+BoxState *CollectorWorker::findBox(const Record &record)
+{
+   auto found = lookup.find(record.boxHash);
+
+   if (found != lookup.end()) {
+      BoxState *box = boxes[found->second].get();
+
+      if (box->name != record.boxName()) {
+         collisions++;
+         return NULL;
+      }
+      return box;
+   }
+
+   std::unique_ptr<BoxState> box(new BoxState());
+
+   box->name.assign(record.box, record.boxLength);
+   box->index   = boxes.size();
+   box->records = 0;
+   box->lastMs  = 0;
+   memset(box->timesMs, 0, sizeof(box->timesMs));
+   lookup[record.boxHash] = box->index;
+   boxes.push_back(std::move(box));
+   boxCount++;
+   return boxes.back().get();
+}
+
+/** Handles the records until the collector stops and the queue is empty. */
+void CollectorWorker::run()
+{
+   Record  record;
+   int     idle   = 0;
+   int64_t tickMs = collectorNowMs();
+
+   for (;;) {
+      if (queue.pop(record)) {
+         BoxState *box = findBox(record);
+
+         idle = 0;
+         if (box) {
+            box->records++;
+            if (!record.stored) {
+               box->lastMs                  = record.timeMs;
+               box->values[record.metric]   = record.value;
+               box->timesMs[record.metric]  = record.timeMs;
+            }
+            for (RecordSink *sink : collector.sinks) {
+               sink->add(index, *box, record);
+            }
+         }
+         records.fetch_add(1, std::memory_order_relaxed);
+         if ((records.load(std::memory_order_relaxed) & 1023) != 0) {
+            continue;
+         }
+      } else if (collector.stop) {
+         break;
+      } else if (++idle < 64) {
+         std::this_thread::yield();
+         continue;
+      } else {
+         std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+
+      int64_t nowMs = collectorNowMs();
+
+      if (nowMs - tickMs >= COLLECTOR_TICK_MS) {
+         tickMs = nowMs;
+         for (RecordSink *sink : collector.sinks) {
+            sink->tick(index, nowMs);
+         }
+      }
+   }
+}
+
+/** Connects, subscribes and returns the socket or -1. */
+int CollectorIngest::connectBroker()
+{
+   addrinfo    hints   = {};
+   addrinfo   *address = NULL;
+   std::string out;
+   timeval     tv      = { 0, 200000 };
+   int         fd      = -1;
+
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   if (getaddrinfo(collector.options.host.c_str(), collector.options.port.c_str(), &hints, &address) != 0) {
+      return -1;
+   }
+   fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+   if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+   }
+   freeaddrinfo(address);
+   if (fd < 0) {
+      return -1;
+   }
+   setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   mqttAddConnect(out, collector.options.clientId + "-" + std::to_string(index),
+                  collector.options.user, collector.options.password, 60);
+   mqttAddSubscribe(out, 1, filter);
+   if (send(fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t) out.size()) {
+      close(fd);
+      return -1;
+   }
+   counters.reconnects++;
+   return fd;
+}
+
+/** Receives and dispatches until the collector stops, reconnects on errors. */
+void CollectorIngest::run()
+{
+   std::vector<char> buf(256 * 1024);
+
+   while (!collector.stop) {
+      int        fd = connectBroker();
+      MqttReader reader;
+      time_t     lastPing = time(NULL);
+
+      if (fd < 0) {
+         fprintf(stderr, "Ingest %s: no connection to %s:%s\n", filter.c_str(),
+                 collector.options.host.c_str(), collector.options.port.c_str());
+         std::this_thread::sleep_for(std::chrono::milliseconds(COLLECTOR_RECONNECT_MS));
+         continue;
+      }
+      while (!collector.stop) {
+         ssize_t    n = recv(fd, buf.data(), buf.size(), 0);
+         MqttPacket packet;
+
+         if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            fprintf(stderr, "Ingest %s: connection lost\n", filter.c_str());
+            break;
+         }
+         if (time(NULL) - lastPing >= 30) {
+            std::string ping;
+
+            mqttAddEmpty(ping, MQTT_PINGREQ);
+            send(fd, ping.data(), ping.size(), MSG_NOSIGNAL);
+            lastPing = time(NULL);
+         }
+         if (n < 0) {
+            continue;
+         }
+
+         int64_t nowMs = collectorNowMs();
+
+         reader.append(buf.data(), n);
+         while (reader.next(packet)) {
+            MqttPublish publish;
+
+            if (mqttParsePublish(packet, publish)) {
+               collector.dispatch(publish.topic, publish.payload, nowMs, counters, publish.retained);
+            }
+         }
+         if (reader.error()) {
+            fprintf(stderr, "Ingest %s: protocol error\n", filter.c_str());
+            break;
+         }
+      }
+      close(fd);
+      if (!collector.stop) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(COLLECTOR_RECONNECT_MS));
+      }
+   }
+}
+
+Collector::Collector(const CollectorOptions &o)
+   : options(o)
+{
+   for (int i = 0; i < options.workers; i++) {
+      workers.push_back(std::unique_ptr<CollectorWorker>(new CollectorWorker(*this, i, options.queueSize)));
+   }
+   for (size_t i = 0; i < options.filters.size(); i++) {
+      ingests.push_back(std::unique_ptr<CollectorIngest>(new CollectorIngest(*this, options.filters[i], i)));
+   }
+}
+
+void Collector::startWorkers()
+{
+   for (auto &worker : workers) {
+      worker->start();
+   }
+}
+
+void Collector::startIngests()
+{
+   for (auto &ingest : ingests) {
+      ingest->start();
+   }
+}
+
+/** Stops the ingest threads, the workers empty their queues. */
+void Collector::shutdown()
+{
+   stop = true;
+   for (auto &ingest : ingests) {
+      ingest->join();
+   }
+   for (auto &worker : workers) {
+      worker->join();
+   }
+}
+
+/** Parses one message and queues it at the worker of the box.
+  * Settings below mqttName go to control() of the sinks. Retained messages
+  * are only the last values the broker replays after the subscribe, no
+  * wake of the box, so they only reach control().
+  */
+bool Collector::dispatch(std::string_view topic, std::string_view payload, int64_t nowMs, IngestCounters &counters, bool retained)
+{
+   std::string_view box;
+   std::string_view subTopic;
+   Record           record;
+   int              metric;
+   size_t           slash = topic.find('/');
+
+   counters.messages.fetch_add(1, std::memory_order_relaxed);
+   if (slash != std::string_view::npos && topic.find('/', slash + 1) == std::string_view::npos) {
+      for (RecordSink *sink : sinks) {
+         sink->control(topic.substr(0, slash), topic.substr(slash), payload);
+      }
+   }
+   if (retained) {
+      counters.ignored.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   if (!splitTopic(topic, box, subTopic) || box.size() > COLLECTOR_BOX_SIZE) {
+      counters.ignored.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   if (subTopic == topic_telemetry) {
+      return dispatchTelemetry(box, payload, nowMs, counters);
+   }
+   if ((metric = findMetric(subTopic)) < 0) {
+      counters.ignored.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   if (!parseMetric(metric, payload, record.value)) {
+      counters.errors.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   record.boxHash   = hashBox(box);
+   record.timeMs    = nowMs;
+   record.metric    = metric;
+   record.stored    = 0;
+   record.boxLength = box.size();
+   memcpy(record.box, box.data(), box.size());
+   push(record, counters);
+   return true;
+}
+
+/** Queues the values of a binary record: the stored readings with their
+  * times, then the values of the wake at the time of the box. A box without
+  * a valid time yet gets the arrival time like the text topics.
+  */
+bool Collector::dispatchTelemetry(std::string_view box, std::string_view payload, int64_t nowMs, IngestCounters &counters)
+{
+   TelemetryDecoder      decoder;
+   const TelemetryPoint *sample;
+   Record                record;
+
+   if (!decoder.parse(payload)) {
+      counters.errors.fetch_add(1, std::memory_order_relaxed);
+      return false;
+   }
+   record.boxHash   = hashBox(box);
+   record.boxLength = box.size();
+   memcpy(record.box, box.data(), box.size());
+
+   record.stored = 1;
+   while ((sample = decoder.nextSample()) != NULL) {
+      record.timeMs = sample->timeSec * 1000LL;
+      for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+         if (sample->has(field) && telemetryMetric(field) >= 0) {
+            record.metric = telemetryMetric(field);
+            record.value  = sample->value(field);
+            push(record, counters);
+         }
+      }
+   }
+
+   record.stored = 0;
+   record.timeMs = decoder.head.timeSec ? decoder.head.timeSec * 1000LL : nowMs;
+   if (decoder.head.timeSec) {
+      record.metric = METRIC_SAMPLE_TIME;
+      record.value  = decoder.head.timeSec;
+      push(record, counters);
+   }
+   for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+      if (decoder.head.has(field) && telemetryMetric(field) >= 0) {
+         record.metric = telemetryMetric(field);
+         record.value  = decoder.head.value(field);
+         push(record, counters);
+      }
+   }
+   return true;
+}
+
+/** Queues a record at the worker of its box.
+  * Waits while the queue is full, so a slow worker slows the TCP stream of
+  * the broker instead of losing values.
+  */
+void Collector::push(const Record &record, IngestCounters &counters)
+{
+   MpscQueue<Record> &queue = workers[record.boxHash % workers.size()]->queue;
+
+   while (!queue.push(record)) {
+      counters.fullWaits.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+   }
+   counters.records.fetch_add(1, std::memory_order_relaxed);
+}
+
+/** One line of counters since the start. */
+void Collector::printStats(double seconds)
+{
+   uint64_t messages  = 0;
+   uint64_t ignored   = 0;
+   uint64_t errors    = 0;
+   uint64_t fullWaits = 0;
+   uint64_t records   = 0;
+   uint64_t boxes     = 0;
+
+   for (auto &ingest : ingests) {
+      messages  += ingest->counters.messages;
+      ignored   += ingest->counters.ignored;
+      errors    += ingest->counters.errors;
+      fullWaits += ingest->counters.fullWaits;
+   }
+   for (auto &worker : workers) {
+      records += worker->records;
+      boxes   += worker->boxCount;
+   }
+   printf("%.0f s: %llu messages (%.0f/s), %llu records, %llu boxes, %llu ignored, %llu errors, %llu full queue waits\n",
+          seconds, (unsigned long long) messages, seconds > 0 ? messages / seconds : 0.0, (unsigned long long) records,
+          (unsigned long long) boxes, (unsigned long long) ignored, (unsigned long long) errors, (unsigned long long) fullWaits);
+   fflush(stdout);
+}
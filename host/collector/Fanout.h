@@ -0,0 +1,412 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Fanout.h
+  *
+  * Live values for the dashboards (server-sent events). The workers encode
+  * every value once into a shared frame, but only while somebody streams,
+  * and pass it to the server thread of QueryServer.h through one queue and
+  * an eventfd. The server looks up the streams of the box, of its mqttName
+  * and of all boxes (StreamRouter), puts a reference of the frame into
+  * their queues and writes them with one sendmsg() per batch, so the bytes
+  * are neither encoded nor copied per client and a value costs only the
+  * streams that want it.
+  * The stream queue holds the newest frame of each box and metric: a
+  * client that does not keep up skips the older values of a series
+  * (coalesced) and, with more pending series than STREAM_MAX_SERIES, the
+  * oldest series (dropped). A slow client never holds back the others.
+  */
+
+#pragma once
+
+#include "Collector.h"
+#include "JsonText.h"
+
+#include <algorithm>
+#include <deque>
+#include <math.h>
+#include <unordered_set>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#define FANOUT_QUEUE        65536 //!< Frames between the workers and the server.
+#define STREAM_MAX_SERIES   4096  //!< Pending series of one stream.
+#define STREAM_BATCH        64    //!< Frames per sendmsg().
+#define STREAM_HEARTBEAT_MS 15000 //!< Comment line to keep idle streams open.
+
+typedef std::shared_ptr<const std::string> FrameData; //!< Encoded event, shared by the streams.
+
+/**
+  * One value as event, the series key coalesces in the stream queues.
+  */
+struct Frame
+{
+   uint64_t  key;      //!< Odd series key of box and metric, 0 = not coalesced.
+   uint64_t  boxHash;  //!< hashBox("mqttName/mqttId").
+   uint64_t  nameHash; //!< hashBox("mqttName").
+   uint8_t   metric;   //!< Metric of the value.
+   FrameData data;     //!< "data: {...}\n\n".
+};
+
+/**
+  * Boxes and metrics of one stream: box=* (or none), "mqttName/" followed
+  * by "*" or mqttName/mqttId and metric=name, both repeatable.
+  */
+struct StreamFilter
+{
+   bool                         anyBox  = false; //!< box=*.
+   std::unordered_set<uint64_t> boxes;           //!< Hashes of the selected boxes.
+   std::unordered_set<uint64_t> names;           //!< Hashes of the selected mqttNames.
+   uint32_t                     metrics = ~0u;   //!< Bit per selected metric.
+
+   void addBox(const std::string &box);
+   bool addMetric(const std::string &name);
+   bool allBoxes() const { return anyBox || (boxes.empty() && names.empty()); }
+   bool wants(int metric) const { return (metrics >> metric) & 1; }
+};
+
+/**
+  * Pending frames of one stream, only used by the server thread.
+  */
+class StreamQueue
+{
+protected:
+   std::deque<uint64_t>                    order;   //!< Series keys, oldest first.
+   std::unordered_map<uint64_t, FrameData> latest;  //!< Newest frame per pending series.
+   FrameData                               sending; //!< Partly sent frame.
+   size_t                                  sent;    //!< Sent bytes of it.
+
+   void pushFront(uint64_t key, FrameData data);
+
+public:
+   uint64_t delivered = 0; //!< Completely sent frames.
+   uint64_t coalesced = 0; //!< Frames replaced by a newer one of the series.
+   uint64_t dropped   = 0; //!< Frames of the oldest series over the limit.
+   uint64_t sequence  = 0; //!< Even keys of the frames without series.
+
+   StreamQueue() : sent(0) { }
+
+   void   push(const Frame &frame);
+   int    write(int fd);
+   bool   empty() const { return order.empty() && !sending; }
+   size_t size() const { return order.size(); }
+};
+
+/**
+  * One event stream of the server thread.
+  */
+struct LiveStream
+{
+   int          fd;        //!< Socket of the connection.
+   StreamFilter filter;    //!< Selected boxes and metrics.
+   StreamQueue  queue;     //!< Frames not sent.
+   uint64_t     lastFrame; //!< Last routed frame, against doubles.
+
+   explicit LiveStream(int f) : fd(f), lastFrame(0) { }
+};
+
+/**
+  * Streams by selected box, mqttName and all boxes, only used by the
+  * server thread.
+  */
+class StreamRouter
+{
+protected:
+   typedef std::unordered_map<uint64_t, std::vector<LiveStream *> > Index;
+
+   std::vector<LiveStream *> all;     //!< Streams of all boxes.
+   Index                     byBox;   //!< Streams by box hash.
+   Index                     byName;  //!< Streams by mqttName hash.
+   uint64_t                  frames;  //!< Routed frames.
+
+   static void erase(std::vector<LiveStream *> &list, LiveStream *stream);
+
+   template <typename Fn> void visit(const std::vector<LiveStream *> &list, const Frame &frame, Fn &fn);
+
+public:
+   StreamRouter() : frames(0) { }
+
+   void add(LiveStream *stream);
+   void remove(LiveStream *stream);
+
+   template <typename Fn> void route(const Frame &frame, Fn fn);
+};
+
+/**
+  * Sink encoding the values for the streams of the server thread.
+  */
+class LiveFanout : public RecordSink
+{
+protected:
+   MpscQueue<Frame>  queue;     //!< Frames for the server thread.
+   int               eventFd;   //!< Wakes the server thread.
+   std::atomic<bool> signalled; //!< eventFd written, not yet read.
+   std::atomic<int>  streams;   //!< Open streams, 0 = nothing to encode.
+
+public:
+   std::atomic<uint64_t> encoded{0}; //!< Encoded values.
+   std::atomic<uint64_t> lost{0};    //!< Frames over a full queue.
+
+   LiveFanout() : queue(FANOUT_QUEUE), eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), signalled(false), streams(0) { }
+   ~LiveFanout() { ::close(eventFd); }
+
+   virtual void add(int worker, BoxState &box, const Record &record);
+
+   int  fd() const { return eventFd; }
+   void subscribe(int delta) { streams += delta; }
+   int  subscribers() const { return streams; }
+   void wake();
+   bool pop(Frame &frame) { return queue.pop(frame); }
+};
+
+/* ******************************************** */
+
+void StreamFilter::addBox(const std::string &box)
+{
+   if (box == "*") {
+      anyBox = true;
+   } else if (box.size() > 2 && box.compare(box.size() - 2, 2, "/*") == 0) {
+      names.insert(hashBox(std::string_view(box).substr(0, box.size() - 2)));
+   } else {
+      boxes.insert(hashBox(box));
+   }
+}
+
+/** The first metric replaces the default of all metrics. */
+bool StreamFilter::addMetric(const std::string &name)
+{
+   int metric = findMetricName(name);
+
+   if (metric < 0) {
+      return false;
+   }
+   if (metrics == ~0u) {
+      metrics = 0;
+   }
+   metrics |= 1u << metric;
+   return true;
+}
+
+void StreamRouter::add(LiveStream *stream)
+{
+   if (stream->filter.allBoxes()) {
+      all.push_back(stream);
+   }
+   for (uint64_t hash : stream->filter.boxes) {
+      byBox[hash].push_back(stream);
+   }
+   for (uint64_t hash : stream->filter.names) {
+      byName[hash].push_back(stream);
+   }
+}
+
+void StreamRouter::erase(std::vector<LiveStream *> &list, LiveStream *stream)
+{
+   list.erase(std::remove(list.begin(), list.end(), stream), list.end());
+}
+
+void StreamRouter::remove(LiveStream *stream)
+{
+   if (stream->filter.allBoxes()) {
+      erase(all, stream);
+   }
+   for (uint64_t hash : stream->filter.boxes) {
+      erase(byBox[hash], stream);
+      if (byBox[hash].empty()) {
+         byBox.erase(hash);
+      }
+   }
+   for (uint64_t hash : stream->filter.names) {
+      erase(byName[hash], stream);
+      if (byName[hash].empty()) {
+         byName.erase(hash);
+      }
+   }
+}
+
+template <typename Fn>
+void StreamRouter::visit(const std::vector<LiveStream *> &list, const Frame &frame, Fn &fn)
+{
+   for (LiveStream *stream : list) {
+      if (stream->lastFrame != frames && stream->filter.wants(frame.metric)) {
+         stream->lastFrame = frames;
+         fn(*stream);
+      }
+   }
+}
+
+/** Calls fn(stream) once for every stream selecting the frame. */
+template <typename Fn>
+void StreamRouter::route(const Frame &frame, Fn fn)
+{
+   auto found = byBox.find(frame.boxHash);
+
+   frames++;
+   visit(all, frame, fn);
+   if (found != byBox.end()) {
+      visit(found->second, frame, fn);
+   }
+   found = byName.find(frame.nameHash);
+   if (found != byName.end()) {
+      visit(found->second, frame, fn);
+   }
+}
+
+/** Replaces the pending frame of the series or appends it, drops the oldest series over the limit. */
+void StreamQueue::push(const Frame &frame)
+{
+   uint64_t key   = frame.key ? frame.key : ++sequence << 1;
+   auto     found = latest.find(key);
+
+   if (found != latest.end()) {
+      found->second = frame.data;
+      coalesced++;
+      return;
+   }
+   if (order.size() >= STREAM_MAX_SERIES) {
+      latest.erase(order.front());
+      order.pop_front();
+      dropped++;
+   }
+   order.push_back(key);
+   latest.emplace(key, frame.data);
+}
+
+/** Puts back a frame the socket did not take. */
+void StreamQueue::pushFront(uint64_t key, FrameData data)
+{
+   order.push_front(key);
+   latest.emplace(key, std::move(data));
+}
+
+/** Sends what the socket takes. Returns 1 if all is sent, 0 if the socket is full, -1 on errors. */
+int StreamQueue::write(int fd)
+{
+   for (;;) {
+      iovec     iov[STREAM_BATCH];
+      uint64_t  keys[STREAM_BATCH];
+      FrameData frames[STREAM_BATCH];
+      int       n = 0;
+
+      if (sending) {
+         iov[0].iov_base = (void *) (sending->data() + sent);
+         iov[0].iov_len  = sending->size() - sent;
+         keys[0]         = 0;
+         frames[0]       = std::move(sending);
+         n               = 1;
+      }
+      while (n < STREAM_BATCH && order.size()) {
+         auto found = latest.find(order.front());
+
+         keys[n]   = order.front();
+         frames[n] = std::move(found->second);
+         latest.erase(found);
+         order.pop_front();
+         iov[n].iov_base = (void *) frames[n]->data();
+         iov[n].iov_len  = frames[n]->size();
+         n++;
+      }
+      if (!n) {
+         return 1;
+      }
+
+      msghdr  msg = {};
+      ssize_t written;
+
+      msg.msg_iov    = iov;
+      msg.msg_iovlen = n;
+      written        = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (written < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+         }
+         written = 0;
+      }
+
+      int i = 0;
+
+      for (; i < n && (size_t) written >= iov[i].iov_len; i++) {
+         written -= iov[i].iov_len;
+         delivered++;
+      }
+      if (i == n) {
+         sent = 0;
+         continue;
+      }
+      // Frames behind the partly sent one go back in order.
+      for (int j = n - 1; j > i; j--) {
+         pushFront(keys[j], std::move(frames[j]));
+      }
+      sent    = (const char *) iov[i].iov_base - frames[i]->data() + written;
+      sending = std::move(frames[i]);
+      return 0;
+   }
+}
+
+/** Encodes the value once if anybody streams. Worker threads. */
+void LiveFanout::add(int, BoxState &box, const Record &record)
+{
+   if (!streams.load(std::memory_order_relaxed)) {
+      return;
+   }
+
+   std::string_view name = box.name;
+   std::string      data = "data: {\"box\":";
+   Frame            frame;
+
+   appendJsonString(data, name);
+   data += ",\"metric\":\"";
+   data += metricTable[record.metric].name;
+   data += "\",\"t\":";
+   appendNumber(data, record.timeMs);
+   data += ",\"v\":";
+   if (isfinite(record.value)) {
+      appendNumber(data, record.value);
+   } else {
+      data += "null";
+   }
+   data += "}\n\n";
+
+   frame.key      = (record.boxHash ^ (uint64_t) record.metric * 0x9E3779B97F4A7C15ULL) | 1;
+   frame.boxHash  = record.boxHash;
+   frame.nameHash = hashBox(name.substr(0, name.find('/')));
+   frame.metric   = record.metric;
+   frame.data     = std::make_shared<const std::string>(std::move(data));
+   encoded++;
+   if (!queue.push(frame)) {
+      lost++;
+      return;
+   }
+   if (!signalled.exchange(true)) {
+      uint64_t one = 1;
+
+      if (::write(eventFd, &one, sizeof(one)) < 0) {
+         signalled = false;
+      }
+   }
+}
+
+/** Server thread: reads the eventfd before the queue is drained, so no frame waits for the next wake. */
+void LiveFanout::wake()
+{
+   uint64_t count;
+
+   if (::read(eventFd, &count, sizeof(count)) < 0) {
+      count = 0;
+   }
+   signalled = false;
+}
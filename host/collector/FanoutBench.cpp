@@ -0,0 +1,268 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FanoutBench.cpp
+  *
+  * Streams -r values per second of -n boxes for -t seconds to -c event
+  * stream clients of the query server on port -p. -w percent of the
+  * clients are wall displays (all boxes, temperature and voltage), the
+  * others phones (all metrics of one box). The first -s walls never read.
+  * Prints the delivered frames, the latency of the readers, the frames
+  * coalesced and dropped for the slow clients and the memory, and checks
+  * that every value was encoded exactly once.
+  *
+  *   fanbench [-c clients] [-w wallPercent] [-s slow] [-n boxes] [-r valuesPerSec] [-t seconds] [-p port]
+  */
+
+#include "QueryServer.h"
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+/** One stream client of the bench. */
+struct BenchClient
+{
+   int         fd;     //!< Socket.
+   bool        wall;   //!< All boxes, two metrics.
+   int         box;    //!< Box of a phone.
+   std::string in;     //!< Bytes of an incomplete frame.
+   uint64_t    frames; //!< Received events.
+};
+
+/** Opens a stream, returns the socket or -1. */
+static int openStream(int port, const std::string &target)
+{
+   int         fd   = socket(AF_INET, SOCK_STREAM, 0);
+   sockaddr_in addr = {};
+
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (connect(fd, (sockaddr *) &addr, sizeof(addr)) != 0) {
+      ::close(fd);
+      return -1;
+   }
+
+   std::string request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+   if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t) request.size()) {
+      ::close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+/** Reads the fast clients until stop, counts the events and their delay. */
+static void readStreams(std::vector<BenchClient> *clients, std::atomic<bool> *stop, std::vector<int> *latencies)
+{
+   int epollFd = epoll_create1(0);
+
+   for (size_t i = 0; i < clients->size(); i++) {
+      epoll_event ev = {};
+
+      ev.events   = EPOLLIN;
+      ev.data.u64 = i;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, (*clients)[i].fd, &ev);
+   }
+   while (!*stop) {
+      epoll_event events[64];
+      int         n = epoll_wait(epollFd, events, 64, 50);
+
+      for (int i = 0; i < n; i++) {
+         BenchClient &client = (*clients)[events[i].data.u64];
+         char         buffer[65536];
+         ssize_t      length = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+         int64_t      nowMs  = collectorNowMs();
+         size_t       pos    = 0;
+         size_t       end;
+
+         if (length <= 0) {
+            continue;
+         }
+         client.in.append(buffer, length);
+         while ((end = client.in.find("\n\n", pos)) != std::string::npos) {
+            size_t t = client.in.find("\"t\":", pos);
+
+            if (client.in.compare(pos, 6, "data: ") == 0 && t < end) {
+               client.frames++;
+               latencies->push_back((int) (nowMs - strtoll(client.in.c_str() + t + 4, NULL, 10)));
+            }
+            pos = end + 2;
+         }
+         client.in.erase(0, pos);
+      }
+   }
+   ::close(epollFd);
+}
+
+int main(int argc, char *argv[])
+{
+   int clientCount = 500;
+   int wallPercent = 10;
+   int slowCount   = 5;
+   int boxCount    = 1000;
+   int rate        = 20000;
+   int seconds     = 10;
+   int port        = 18880;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "c:w:s:n:r:t:p:")) != -1) {
+      switch (opt) {
+         case 'c': clientCount = atoi(optarg); break;
+         case 'w': wallPercent = atoi(optarg); break;
+         case 's': slowCount   = atoi(optarg); break;
+         case 'n': boxCount    = atoi(optarg); break;
+         case 'r': rate        = atoi(optarg); break;
+         case 't': seconds     = atoi(optarg); break;
+         case 'p': port        = atoi(optarg); break;
+         default:
+            fprintf(stderr, "usage: %s [-c clients] [-w wallPercent] [-s slow] [-n boxes] [-r valuesPerSec] [-t seconds] [-p port]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   int wallCount = clientCount * wallPercent / 100;
+
+   if (clientCount <= 0 || wallPercent < 0 || wallPercent > 100 || slowCount < 0 || slowCount > wallCount ||
+       boxCount <= 0 || rate <= 0 || seconds <= 0) {
+      fprintf(stderr, "Invalid arguments (at most all walls slow)\n");
+      return 1;
+   }
+
+   TimeSeriesStore                         store("/nonexistent", 1, 0);
+   LiveFanout                              fanout;
+   QueryServer                             server(store, port);
+   std::vector<std::unique_ptr<BoxState> > boxes;
+   std::vector<BenchClient>                fast;
+   std::vector<int>                        slow;
+   std::vector<int>                        latencies;
+   std::atomic<bool>                       stop(false);
+
+   server.setFanout(&fanout);
+   if (!server.start()) {
+      return 1;
+   }
+   for (int i = 0; i < boxCount; i++) {
+      char name[COLLECTOR_BOX_SIZE];
+
+      snprintf(name, sizeof(name), "SolarWeatherBox/%04d", i + 1);
+      boxes.push_back(std::unique_ptr<BoxState>(new BoxState()));
+      boxes.back()->name  = name;
+      boxes.back()->index = i;
+   }
+   for (int i = 0; i < clientCount; i++) {
+      BenchClient client = { -1, i < wallCount, (i * 7919) % boxCount, "", 0 };
+      std::string target = client.wall ? "/stream?box=*&metric=temperature&metric=voltage"
+                                       : "/stream?box=" + boxes[client.box]->name;
+
+      client.fd = openStream(port, target);
+      if (client.fd < 0) {
+         perror("stream");
+         return 1;
+      }
+      if (i < slowCount) {
+         slow.push_back(client.fd);
+      } else {
+         fast.push_back(client);
+      }
+   }
+   while (fanout.subscribers() < clientCount) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   latencies.reserve((size_t) rate * seconds * 8);
+
+   std::thread           reader(readStreams, &fast, &stop, &latencies);
+   int                   temperature = findMetricName("temperature");
+   int                   voltage     = findMetricName("voltage");
+   uint64_t              produced    = 0;
+   uint64_t              expected    = 0;
+   std::vector<uint64_t> perBox(boxCount * METRIC_COUNT, 0);
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   // Values in 1 ms batches, all metrics of a box in a row like a wake.
+   while (std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds)) {
+      double   elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      uint64_t due     = (uint64_t) (elapsed * rate);
+
+      while (produced < due) {
+         BoxState &box = *boxes[(produced / METRIC_COUNT) % boxCount];
+         Record    record;
+
+         record.boxHash = hashBox(box.name);
+         record.timeMs  = collectorNowMs();
+         record.metric  = produced % METRIC_COUNT;
+         record.value   = 10.0 + (produced % 1000) / 100.0;
+         record.stored  = 0;
+         fanout.add(0, box, record);
+         perBox[box.index * METRIC_COUNT + record.metric]++;
+         produced++;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+
+   double producedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(500));
+   stop = true;
+   reader.join();
+
+   uint64_t received = 0;
+
+   for (const BenchClient &client : fast) {
+      received += client.frames;
+      for (int box = 0; box < boxCount; box++) {
+         for (int metric = 0; metric < METRIC_COUNT; metric++) {
+            if (client.wall ? metric == temperature || metric == voltage : box == client.box) {
+               expected += perBox[box * METRIC_COUNT + metric];
+            }
+         }
+      }
+   }
+   std::sort(latencies.begin(), latencies.end());
+
+   rusage usage;
+   size_t heapKB = mallinfo2().uordblks / 1024;
+
+   getrusage(RUSAGE_SELF, &usage);
+   for (int fd : slow) {
+      ::close(fd);
+   }
+   for (const BenchClient &client : fast) {
+      ::close(client.fd);
+   }
+   server.shutdown();
+
+   printf("%d streams (%d walls, %d of them slow, %d phones), %d boxes, %.0f values/s for %.1f s\n",
+          clientCount, wallCount, slowCount, clientCount - wallCount, boxCount, produced / producedSec, producedSec);
+   printf("  %llu values, %llu encoded (%.2f per value), %llu lost, %llu frames sent = %.0f frames/s\n",
+          (unsigned long long) produced, (unsigned long long) fanout.encoded, (double) fanout.encoded / produced,
+          (unsigned long long) fanout.lost, (unsigned long long) server.streamFrames, server.streamFrames / producedSec);
+   printf("  fast readers: %llu of %llu expected events, latency p50 %d ms, p99 %d ms, max %d ms\n",
+          (unsigned long long) received, (unsigned long long) expected,
+          latencies.empty() ? 0 : latencies[latencies.size() / 2],
+          latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100],
+          latencies.empty() ? 0 : latencies.back());
+   printf("  coalesced %llu, dropped %llu frames, heap in use %zu KB, max resident set %ld KB\n",
+          (unsigned long long) server.streamCoalesced, (unsigned long long) server.streamDropped, heapKB, usage.ru_maxrss);
+   if (fanout.encoded != produced) {
+      printf("  ENCODE MISMATCH\n");
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,363 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Gorilla.h
+  *
+  * Compressed blocks of (time, value) points as in Facebook's Gorilla:
+  * the times as delta-of-delta with variable bit buckets, the values as
+  * XOR with the previous value, reusing the last leading/trailing zero
+  * window. The block header carries the aggregates of the block, so scans
+  * over whole blocks do not have to decode them.
+  */
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+
+#define BLOCK_MAGIC  0x31425354 //!< "TSB1"
+#define BLOCK_POINTS 1024       //!< Points of a sealed block.
+
+/**
+  * Header in front of every encoded block in the series file.
+  */
+struct BlockHeader
+{
+   uint32_t magic;   //!< BLOCK_MAGIC
+   uint32_t count;   //!< Points.
+   uint32_t bytes;   //!< Encoded bytes after the header.
+   uint32_t flags;   //!< Reserved, 0.
+   int64_t  firstMs; //!< Time of the first point.
+   int64_t  lastMs;  //!< Time of the last point.
+   double   min;     //!< Aggregates of the block.
+   double   max;
+   double   sum;
+   double   last;
+};
+
+/**
+  * Appends bits MSB first.
+  */
+class BitWriter
+{
+protected:
+   std::string data;    //!< Complete bytes.
+   uint64_t    acc;     //!< Pending bits, MSB aligned.
+   int         accBits; //!< Number of pending bits.
+
+public:
+   BitWriter() : acc(0), accBits(0) { }
+
+   void write(uint64_t value, int bits);
+   void clear() { data.clear(); acc = 0; accBits = 0; }
+   void copyTo(std::string &out) const;
+   size_t bitCount() const { return data.size() * 8 + accBits; }
+};
+
+/**
+  * Reads bits MSB first, 64 bit window loads.
+  */
+class BitReader
+{
+protected:
+   const uint8_t *data; //!< Encoded bytes.
+   size_t         size; //!< Number of bytes.
+   size_t         pos;  //!< Bit position.
+
+   uint64_t window() const;
+
+public:
+   BitReader(const uint8_t *d, size_t s) : data(d), size(s), pos(0) { }
+
+   uint64_t read(int bits);
+   bool     overrun() const { return pos > size * 8; }
+};
+
+/**
+  * Streaming encoder of one block. Keeps the aggregates of the header.
+  */
+class BlockEncoder
+{
+protected:
+   BitWriter bits;      //!< Encoded points.
+   int64_t   prevMs;    //!< Time of the last point.
+   int64_t   prevDelta; //!< Last time delta.
+   uint64_t  prevValue; //!< Bits of the last value.
+   int       leading;   //!< Leading zeros of the last XOR window, 64 = none.
+   int       trailing;  //!< Trailing zeros of the last XOR window.
+
+public:
+   BlockHeader header;  //!< Header of the points so far.
+
+   BlockEncoder() { clear(); }
+
+   void clear();
+   bool append(int64_t timeMs, double value);
+   void encode(std::string &out) const;
+   uint32_t count() const { return header.count; }
+};
+
+/**
+  * Decoder of one block.
+  */
+class BlockDecoder
+{
+protected:
+   BitReader reader;    //!< Encoded points.
+   uint32_t  left;      //!< Points not decoded.
+   bool      first;     //!< Next is the first point.
+   int64_t   prevMs;    //!< Time of the last point.
+   int64_t   prevDelta; //!< Last time delta.
+   uint64_t  prevValue; //!< Bits of the last value.
+   int       leading;   //!< Leading zeros of the XOR window.
+   int       trailing;  //!< Trailing zeros of the XOR window.
+
+public:
+   BlockDecoder(const uint8_t *data, size_t size, uint32_t count);
+
+   bool     next(int64_t &timeMs, double &value);
+   uint32_t decode(int64_t *times, double *values, uint32_t max);
+};
+
+/* ******************************************** */
+
+inline void BitWriter::write(uint64_t value, int bits)
+{
+   while (bits > 0) {
+      int      take = std::min(bits, 64 - accBits);
+      uint64_t part = bits - take < 64 ? value >> (bits - take) : 0;
+
+      if (take < 64) {
+         part &= (1ULL << take) - 1;
+      }
+      acc     |= take == 64 ? part : part << (64 - accBits - take);
+      accBits += take;
+      bits    -= take;
+      if (accBits == 64) {
+         for (int i = 7; i >= 0; i--) {
+            data += (char) (acc >> (i * 8));
+         }
+         acc     = 0;
+         accBits = 0;
+      }
+   }
+}
+
+/** Complete and pending bytes, the last byte padded with zeros. */
+inline void BitWriter::copyTo(std::string &out) const
+{
+   out = data;
+   for (int i = 0; i < (accBits + 7) / 8; i++) {
+      out += (char) (acc >> (56 - i * 8));
+   }
+}
+
+/** 64 bits from the bit position on, zeros after the end. */
+inline uint64_t BitReader::window() const
+{
+   size_t   byte  = pos >> 3;
+   uint64_t value = 0;
+
+   if (byte + 8 <= size) {
+      memcpy(&value, data + byte, 8);
+      value = __builtin_bswap64(value);
+   } else {
+      for (size_t i = 0; i < 8; i++) {
+         value = (value << 8) | (byte + i < size ? data[byte + i] : 0);
+      }
+   }
+   return value << (pos & 7);
+}
+
+inline uint64_t BitReader::read(int bits)
+{
+   if (bits <= 0) {
+      return 0;
+   }
+   if (bits > 56) {
+      uint64_t high = read(32);
+
+      return (high << (bits - 32)) | read(bits - 32);
+   }
+
+   uint64_t value = window() >> (64 - bits);
+
+   pos += bits;
+   return value;
+}
+
+inline void BlockEncoder::clear()
+{
+   bits.clear();
+   memset(&header, 0, sizeof(header));
+   header.magic = BLOCK_MAGIC;
+   prevMs       = 0;
+   prevDelta    = 0;
+   prevValue    = 0;
+   leading      = 64;
+   trailing     = 0;
+}
+
+/** Appends a point, false for a time before the last one (the block stays unchanged). */
+inline bool BlockEncoder::append(int64_t timeMs, double value)
+{
+   uint64_t valueBits;
+
+   if (header.count && timeMs < prevMs) {
+      return false;
+   }
+   memcpy(&valueBits, &value, sizeof(valueBits));
+   if (header.count == 0) {
+      bits.write((uint64_t) timeMs, 64);
+      bits.write(valueBits, 64);
+      header.firstMs = timeMs;
+      header.min     = value;
+      header.max     = value;
+   } else {
+      int64_t delta = timeMs - prevMs;
+      int64_t dod   = delta - prevDelta;
+
+      if (dod == 0) {
+         bits.write(0, 1);
+      } else if (dod >= -63 && dod <= 64) {
+         bits.write(0x2, 2);
+         bits.write(dod + 63, 7);
+      } else if (dod >= -255 && dod <= 256) {
+         bits.write(0x6, 3);
+         bits.write(dod + 255, 9);
+      } else if (dod >= -2047 && dod <= 2048) {
+         bits.write(0xE, 4);
+         bits.write(dod + 2047, 12);
+      } else {
+         bits.write(0xF, 4);
+         bits.write((uint64_t) dod, 64);
+      }
+      prevDelta = delta;
+
+      uint64_t diff = valueBits ^ prevValue;
+
+      if (diff == 0) {
+         bits.write(0, 1);
+      } else {
+         int lz = std::min(__builtin_clzll(diff), 31);
+         int tz = __builtin_ctzll(diff);
+
+         bits.write(1, 1);
+         if (leading < 64 && lz >= leading && tz >= trailing) {
+            bits.write(0, 1);
+            bits.write(diff >> trailing, 64 - leading - trailing);
+         } else {
+            leading  = lz;
+            trailing = tz;
+            bits.write(1, 1);
+            bits.write(lz, 5);
+            bits.write(64 - lz - tz - 1, 6);
+            bits.write(diff >> tz, 64 - lz - tz);
+         }
+      }
+      header.min = std::min(header.min, value);
+      header.max = std::max(header.max, value);
+   }
+   prevMs          = timeMs;
+   prevValue       = valueBits;
+   header.lastMs   = timeMs;
+   header.sum     += value;
+   header.last     = value;
+   header.count++;
+   return true;
+}
+
+/** Header and encoded points as written to the series file. */
+inline void BlockEncoder::encode(std::string &out) const
+{
+   std::string payload;
+   BlockHeader h = header;
+
+   bits.copyTo(payload);
+   h.bytes = payload.size();
+   out.assign((const char *) &h, sizeof(h));
+   out += payload;
+}
+
+inline BlockDecoder::BlockDecoder(const uint8_t *data, size_t size, uint32_t count)
+   : reader(data, size)
+   , left(count)
+   , first(true)
+   , prevMs(0)
+   , prevDelta(0)
+   , prevValue(0)
+   , leading(0)
+   , trailing(0)
+{
+}
+
+/** Next point, false at the end or on corrupt data. */
+inline bool BlockDecoder::next(int64_t &timeMs, double &value)
+{
+   if (!left) {
+      return false;
+   }
+   if (first) {
+      first     = false;
+      prevMs    = (int64_t) reader.read(64);
+      prevValue = reader.read(64);
+   } else {
+      int64_t dod;
+
+      if (!reader.read(1)) {
+         dod = 0;
+      } else if (!reader.read(1)) {
+         dod = (int64_t) reader.read(7) - 63;
+      } else if (!reader.read(1)) {
+         dod = (int64_t) reader.read(9) - 255;
+      } else if (!reader.read(1)) {
+         dod = (int64_t) reader.read(12) - 2047;
+      } else {
+         dod = (int64_t) reader.read(64);
+      }
+      prevDelta += dod;
+      prevMs    += prevDelta;
+      if (reader.read(1)) {
+         if (reader.read(1)) {
+            leading  = reader.read(5);
+            trailing = 64 - leading - ((int) reader.read(6) + 1);
+         }
+         prevValue ^= reader.read(64 - leading - trailing) << trailing;
+      }
+   }
+   if (reader.overrun()) {
+      left = 0;
+      return false;
+   }
+   left--;
+   timeMs = prevMs;
+   memcpy(&value, &prevValue, sizeof(value));
+   return true;
+}
+
+/** Decodes up to max points into the arrays. */
+inline uint32_t BlockDecoder::decode(int64_t *times, double *values, uint32_t max)
+{
+   uint32_t n = 0;
+
+   while (n < max && next(times[n], values[n])) {
+      n++;
+   }
+   return n;
+}
@@ -0,0 +1,60 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file JsonText.h
+  *
+  * The few JSON writers of the collector answers and streams: numbers in
+  * their shortest exact form and escaped strings.
+  */
+
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Appends the shortest form of a number that reads back the same. */
+template <typename T>
+inline void appendNumber(std::string &out, T value)
+{
+   char buffer[32];
+   auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+   out.append(buffer, result.ptr);
+}
+
+/** Appends a JSON string, the box names come from the topics. */
+inline void appendJsonString(std::string &out, std::string_view text)
+{
+   out += '"';
+   for (char c : text) {
+      if (c == '"' || c == '\\') {
+         out += '\\';
+         out += c;
+      } else if ((uint8_t) c < 0x20) {
+         char escape[8];
+
+         snprintf(escape, sizeof(escape), "\\u%04x", c);
+         out += escape;
+      } else {
+         out += c;
+      }
+   }
+   out += '"';
+}
@@ -0,0 +1,261 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Liveness.h
+  *
+  * Liveness of the boxes. Every box reports once per mqttSendEverySec, so
+  * every value moves the timer of the box in the wheel of its worker
+  * (TimerWheel.h) to the expected next report plus a tolerance. A timer
+  * that expires raises an overdue event, the next value of the box a
+  * recovered event. Both are O(1), the tick only touches the expired
+  * timers, never all boxes.
+  * The interval comes from the retained mqttName/SendEverySec which the
+  * firmware subscribes, else from the default of the tracker.
+  */
+
+#pragma once
+
+#include "Collector.h"
+#include "TimerWheel.h"
+
+#include <map>
+#include <mutex>
+
+#define LIVENESS_WAKE_GAP_MS 10000 //!< Values closer than this (or half the interval) are one wake.
+#define LIVENESS_FACTOR      1.5   //!< Tolerated part of the interval.
+#define LIVENESS_SLACK_SEC   60    //!< Tolerated WiFi and broker retries.
+
+/**
+  * Liveness and gap statistics of one box, owned by its worker.
+  */
+struct BoxLiveness
+{
+   const BoxState *box;          //!< Box of the worker, NULL = unused.
+   int64_t         everySec;     //!< Expected interval.
+   uint32_t        version;      //!< Interval table version of everySec.
+   bool            overdue;      //!< No report within the deadline.
+   int64_t         wakeMs;       //!< First value of the last wake.
+   int64_t         lastMs;       //!< Last value.
+   uint64_t        wakes;        //!< Reports.
+   int64_t         gapMinMs;     //!< Shortest gap between two wakes.
+   int64_t         gapMaxMs;     //!< Longest gap.
+   int64_t         gapLastMs;    //!< Last gap.
+   double          gapSumMs;     //!< Sum of the gaps for the mean.
+   uint64_t        overdues;     //!< Overdue events.
+   int64_t         downMs;       //!< Sum of the overdue gaps.
+   double          connErrors;   //!< Last /ConnErrorCount, -1 = none.
+   double          sendErrors;   //!< Last /SendErrorCount, -1 = none.
+   uint64_t        errorRises;   //!< Wakes with a grown error counter.
+
+   double gapAvgMs() const { return wakes > 1 ? gapSumMs / (wakes - 1) : 0.0; }
+   int64_t deadlineSec() const { return (lastMs + 999) / 1000 + (int64_t) (everySec * LIVENESS_FACTOR) + LIVENESS_SLACK_SEC; }
+};
+
+/**
+  * Receiver of the liveness events, called in the worker threads.
+  */
+class LivenessListener
+{
+public:
+   virtual ~LivenessListener() { }
+
+   virtual void onOverdue(const BoxLiveness &box, int64_t nowMs) = 0;
+   virtual void onRecovered(const BoxLiveness &box, int64_t nowMs) = 0;
+};
+
+/**
+  * Sink of the collector with one timer wheel per worker.
+  */
+class LivenessTracker : public RecordSink
+{
+protected:
+   /** State of one worker, the lock only guards against the readers. */
+   struct Worker
+   {
+      std::mutex               lock;    //!< Guards the members.
+      TimerWheel               wheel;   //!< Deadlines by box index.
+      std::vector<BoxLiveness> boxes;   //!< By box index.
+      uint64_t                 overdue; //!< Boxes overdue now.
+
+      explicit Worker(int64_t nowSec) : wheel(nowSec), overdue(0) { }
+   };
+
+   std::vector<std::unique_ptr<Worker> >        workers;         //!< By worker number.
+   int64_t                                      defaultEverySec; //!< Interval without SendEverySec.
+   std::map<std::string, int64_t, std::less<> > intervals;       //!< mqttName -> SendEverySec.
+   std::mutex                                   intervalLock;    //!< Guards intervals.
+   std::atomic<uint32_t>                        version;         //!< Changes of intervals.
+   std::vector<LivenessListener *>              listeners;       //!< Event receivers.
+
+   int64_t everySec(const std::string &box);
+
+public:
+   LivenessTracker(int workerCount, int64_t everySec, int64_t nowMs);
+
+   void addListener(LivenessListener *listener) { listeners.push_back(listener); }
+   void setEvery(std::string_view mqttName, int64_t sec);
+   uint64_t overdueCount();
+
+   virtual void add(int worker, BoxState &box, const Record &record);
+   virtual void tick(int worker, int64_t nowMs);
+   virtual void control(std::string_view mqttName, std::string_view subTopic, std::string_view payload);
+
+   template <typename Fn> void forEach(Fn fn);
+};
+
+/* ******************************************** */
+
+LivenessTracker::LivenessTracker(int workerCount, int64_t every, int64_t nowMs)
+   : defaultEverySec(every)
+   , version(1)
+{
+   for (int i = 0; i < workerCount; i++) {
+      workers.push_back(std::unique_ptr<Worker>(new Worker(nowMs / 1000)));
+   }
+}
+
+/** Interval of the mqttName of the box. */
+int64_t LivenessTracker::everySec(const std::string &box)
+{
+   std::lock_guard<std::mutex> guard(intervalLock);
+   auto                        found = intervals.find(std::string_view(box).substr(0, box.find('/')));
+
+   return found == intervals.end() ? defaultEverySec : found->second;
+}
+
+void LivenessTracker::setEvery(std::string_view mqttName, int64_t sec)
+{
+   std::lock_guard<std::mutex> guard(intervalLock);
+
+   intervals[std::string(mqttName)] = sec;
+   version++;
+}
+
+/** The interval the firmware subscribes, in the range of the option. */
+void LivenessTracker::control(std::string_view mqttName, std::string_view subTopic, std::string_view payload)
+{
+   long sec;
+
+   if (subTopic == topic_send_every &&
+       (sec = strtol(std::string(payload).c_str(), NULL, 10)) >= 10 && sec <= 7 * 24 * 3600) {
+      setEvery(mqttName, sec);
+   }
+}
+
+uint64_t LivenessTracker::overdueCount()
+{
+   uint64_t count = 0;
+
+   for (auto &w : workers) {
+      std::lock_guard<std::mutex> guard(w->lock);
+
+      count += w->overdue;
+   }
+   return count;
+}
+
+/** Recovers an overdue box, counts the wakes and moves the deadline. */
+void LivenessTracker::add(int worker, BoxState &box, const Record &record)
+{
+   if (record.stored) {
+      return; // Reading of an earlier wake, says nothing about the box now.
+   }
+
+   Worker                     &w = *workers[worker];
+   std::lock_guard<std::mutex> guard(w.lock);
+
+   if (box.index >= w.boxes.size()) {
+      w.boxes.resize(box.index + 1, BoxLiveness());
+   }
+
+   BoxLiveness &b = w.boxes[box.index];
+
+   if (!b.box) {
+      memset(&b, 0, sizeof(b));
+      b.box        = &box;
+      b.gapMinMs   = INT64_MAX;
+      b.connErrors = -1.0;
+      b.sendErrors = -1.0;
+   }
+   if (b.overdue) {
+      b.overdue  = false;
+      b.downMs  += record.timeMs - b.lastMs;
+      w.overdue--;
+      for (LivenessListener *listener : listeners) {
+         listener->onRecovered(b, record.timeMs);
+      }
+   }
+   if (b.version != version) {
+      b.version  = version;
+      b.everySec = everySec(box.name);
+   }
+   if (!b.wakes || record.timeMs - b.lastMs >= std::min((int64_t) LIVENESS_WAKE_GAP_MS, b.everySec * 500)) {
+      if (b.wakes) {
+         int64_t gap = record.timeMs - b.wakeMs;
+
+         b.gapMinMs  = std::min(b.gapMinMs, gap);
+         b.gapMaxMs  = std::max(b.gapMaxMs, gap);
+         b.gapLastMs = gap;
+         b.gapSumMs += gap;
+      }
+      b.wakes++;
+      b.wakeMs = record.timeMs;
+   }
+   b.lastMs = record.timeMs;
+   w.wheel.schedule(box.index, b.deadlineSec());
+   if (record.metric == METRIC_CONN_ERRORS || record.metric == METRIC_SEND_ERRORS) {
+      double &last = record.metric == METRIC_CONN_ERRORS ? b.connErrors : b.sendErrors;
+
+      if (last >= 0.0 && record.value > last) {
+         b.errorRises++;
+      }
+      last = record.value;
+   }
+}
+
+/** Raises the overdue events of the expired deadlines. */
+void LivenessTracker::tick(int worker, int64_t nowMs)
+{
+   Worker                     &w = *workers[worker];
+   std::lock_guard<std::mutex> guard(w.lock);
+
+   w.wheel.advance(nowMs / 1000, [&](uint32_t index) {
+      BoxLiveness &b = w.boxes[index];
+
+      b.overdue = true;
+      b.overdues++;
+      w.overdue++;
+      for (LivenessListener *listener : listeners) {
+         listener->onOverdue(b, nowMs);
+      }
+   });
+}
+
+/** Calls fn(liveness) for all boxes, holding the lock of one worker at a time. */
+template <typename Fn>
+void LivenessTracker::forEach(Fn fn)
+{
+   for (auto &w : workers) {
+      std::lock_guard<std::mutex> guard(w->lock);
+
+      for (const BoxLiveness &b : w->boxes) {
+         if (b.box) {
+            fn(b);
+         }
+      }
+   }
+}
@@ -0,0 +1,181 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file LivenessBench.cpp
+  *
+  * Runs the liveness tracker on a virtual clock: -n boxes wake every -e
+  * seconds, late by up to a tenth of it (at most 30 s), and send five
+  * values each. Every -x th box is silent from 1/4 to 1/2 of the -t
+  * hours. In the middle of the silence the collector reconnects and the
+  * broker replays the retained values of every box, which must not reach
+  * the tracker. Checks that exactly these boxes are reported overdue and
+  * recovered, and prints the time per value and per one second tick.
+  *
+  *   livebench [-n boxes] [-e everySec] [-t hours] [-x deadEvery]
+  */
+
+#include "Liveness.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/** Counts the events. */
+class EventCounter : public LivenessListener
+{
+public:
+   uint64_t overdue   = 0; //!< Overdue events.
+   uint64_t recovered = 0; //!< Recovered events.
+   uint64_t wrong     = 0; //!< Events of boxes which did not die.
+   int      deadEvery = 0; //!< Every deadEvery th box dies.
+
+   virtual void onOverdue(const BoxLiveness &box, int64_t)
+   {
+      overdue++;
+      wrong += box.box->index % deadEvery != 0;
+   }
+   virtual void onRecovered(const BoxLiveness &box, int64_t)
+   {
+      recovered++;
+      wrong += box.box->index % deadEvery != 0;
+   }
+};
+
+int main(int argc, char *argv[])
+{
+   int  boxes     = 100000;
+   int  everySec  = 1800;
+   int  hours     = 48;
+   int  deadEvery = 100;
+   int  opt;
+
+   while ((opt = getopt(argc, argv, "n:e:t:x:")) != -1) {
+      switch (opt) {
+         case 'n': boxes     = atoi(optarg); break;
+         case 'e': everySec  = atoi(optarg); break;
+         case 't': hours     = atoi(optarg); break;
+         case 'x': deadEvery = atoi(optarg); break;
+         default:
+            fprintf(stderr, "usage: %s [-n boxes] [-e everySec] [-t hours] [-x deadEvery]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (boxes <= 0 || everySec < 10 || hours <= 0 || deadEvery <= 0) {
+      fprintf(stderr, "Invalid arguments\n");
+      return 1;
+   }
+
+   int64_t                                  startMs  = 1609459200000LL;
+   int64_t                                  endSec   = hours * 3600LL;
+   int64_t                                  jitterMs = std::min(30000LL, everySec * 100LL);
+   LivenessTracker                          tracker(1, everySec, startMs);
+   EventCounter                             events;
+   std::vector<std::unique_ptr<BoxState> >  states;
+   std::vector<std::vector<int> >           wakes(everySec);
+   uint64_t                                 random   = 0x9E3779B97F4A7C15ULL;
+   uint64_t                                 values   = 0;
+   double                                   addMs    = 0.0;
+   double                                   tickMs   = 0.0;
+   double                                   maxTick  = 0.0;
+   int64_t                                  replaySec = endSec * 3 / 8;
+   uint64_t                                 replayed = 0;
+   CollectorOptions                         options;
+   IngestCounters                           counters;
+
+   options.workers   = 1;
+   options.queueSize = 1024;
+
+   Collector collector(options);
+
+   events.deadEvery = deadEvery;
+   tracker.addListener(&events);
+   collector.addSink(&tracker);
+   for (int i = 0; i < boxes; i++) {
+      states.push_back(std::unique_ptr<BoxState>(new BoxState()));
+      states.back()->name  = "SolarWeatherBox/" + std::to_string(i + 1);
+      states.back()->index = i;
+      wakes[i % everySec].push_back(i);
+   }
+
+   static const int metrics[] = { METRIC_ALIVE, METRIC_CONN_ERRORS, METRIC_SEND_ERRORS, METRIC_TEMPERATURE, METRIC_VOLTAGE };
+
+   for (int64_t sec = 0; sec < endSec; sec++) {
+      int64_t           nowMs = startMs + sec * 1000;
+      Clock::time_point start = Clock::now();
+
+      for (int i : wakes[sec % everySec]) {
+         if (i % deadEvery == 0 && sec >= endSec / 4 && sec < endSec / 2) {
+            continue;
+         }
+         random ^= random << 13;
+         random ^= random >> 7;
+         random ^= random << 17;
+
+         Record record;
+
+         record.timeMs = nowMs + (int64_t) (random % jitterMs);
+         record.stored = 0;
+         for (int metric : metrics) {
+            record.metric = metric;
+            record.value  = 0.0;
+            tracker.add(0, *states[i], record);
+            record.timeMs += 50;
+            values++;
+         }
+      }
+      addMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      start  = Clock::now();
+      tracker.tick(0, nowMs);
+
+      double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+      tickMs  += ms;
+      maxTick  = std::max(maxTick, ms);
+
+      if (sec == replaySec) {
+         // Reconnect: the retained values of all boxes, queued ones go to the tracker like in the worker.
+         for (int i = 0; i < boxes; i++) {
+            for (int metric : metrics) {
+               std::string topic = states[i]->name + metricTable[metric].topic;
+
+               collector.dispatch(topic, metricTable[metric].format == FORMAT_INTERVAL ? "00:30:00" : "0", nowMs, counters, true);
+            }
+
+            Record record;
+
+            while (collector.workers[0]->queue.pop(record)) {
+               tracker.add(0, *states[atoi(record.boxName().data() + strlen("SolarWeatherBox/")) - 1], record);
+               replayed++;
+            }
+         }
+      }
+   }
+
+   uint64_t dead = (boxes + deadEvery - 1) / deadEvery;
+
+   printf("%d boxes every %d s for %d h: %llu values, %.1f ns/value, %.2f us/tick (max %.2f ms)\n",
+          boxes, everySec, hours, (unsigned long long) values, addMs * 1e6 / values, tickMs * 1e3 / endSec, maxTick);
+   printf("  %llu overdue, %llu recovered events, %llu boxes silent, %llu overdue at the end\n",
+          (unsigned long long) events.overdue, (unsigned long long) events.recovered, (unsigned long long) dead,
+          (unsigned long long) tracker.overdueCount());
+   printf("  %llu retained values replayed at %lld h, %llu ingested\n",
+          (unsigned long long) counters.messages.load(), (long long) replaySec / 3600, (unsigned long long) replayed);
+   if (events.wrong || events.overdue != dead || events.recovered != dead || replayed) {
+      printf("  WRONG EVENTS: %llu of living boxes, %llu retained values ingested\n",
+             (unsigned long long) events.wrong, (unsigned long long) replayed);
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,298 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Main.cpp
+  *
+  * Collector daemon of the box values. Subscribes the topic filters (one
+  * ingest thread each, default +/+/#) and prints the counters every -i
+  * seconds until SIGINT/SIGTERM.
+  * -d stores the values in a time series store below the directory, head
+  * blocks older than -f seconds are sealed to the files. -H serves the
+  * HTTP queries of the store (QueryServer.h) on the port, with the live
+  * values of /stream (Fanout.h).
+  * -L tracks the liveness of the boxes (Liveness.h) and prints the overdue
+  * and recovered boxes, the interval is mqttName/SendEverySec or everySec.
+  * -b runs the ingest path without broker: -P producer threads feed -b
+  * prepared PUBLISH packets of 1000 boxes through the parser and the queues,
+  * with -T one binary telemetry record per wake with that many stored readings
+  * instead of the text topics.
+  *
+  *   collector [-h host] [-p port] [-s filter]... [-W workers] [-q queueSize] [-i statsSec]
+  *             [-c clientId] [-u user] [-w password] [-d storeDir [-f sealSec] [-H httpPort]] [-L everySec]
+  *             [-b messages [-P producers] [-T samples]]
+  */
+
+#include "QueryServer.h"
+
+#include <signal.h>
+#include <stdlib.h>
+
+#define BENCH_BOXES 1000 //!< Boxes of the prepared packets.
+
+static volatile sig_atomic_t stopSignal = 0;
+
+/** Prints the liveness events. */
+class LivenessPrinter : public LivenessListener
+{
+public:
+   virtual void onOverdue(const BoxLiveness &box, int64_t nowMs)
+   {
+      printf("Overdue %s: no value for %lld s, every %lld s\n", box.box->name.c_str(),
+             (long long) (nowMs - box.lastMs) / 1000, (long long) box.everySec);
+      fflush(stdout);
+   }
+   virtual void onRecovered(const BoxLiveness &box, int64_t nowMs)
+   {
+      printf("Recovered %s after %lld s\n", box.box->name.c_str(), (long long) (nowMs - box.lastMs) / 1000);
+      fflush(stdout);
+   }
+};
+
+static void onSignal(int)
+{
+   stopSignal = 1;
+}
+
+/** PUBLISH packets of one wake of every box, like the firmware sends them.
+  * samples >= 0: one telemetry record with the stored readings instead of the values.
+  */
+static std::string benchPackets(int samples)
+{
+   std::string packets;
+   char        value[32];
+
+   for (int box = 0; box < BENCH_BOXES; box++) {
+      std::string prefix = "SolarWeatherBox/" + std::to_string(box + 1);
+
+      if (samples >= 0) {
+         uint32_t                     timeSec = 1609459200 + box;
+         TelemetryEncoder             encoder(timeSec);
+         std::vector<TelemetrySample> backlog;
+         uint8_t                      record[TELEMETRY_MAX_SIZE * 8];
+         size_t                       length;
+
+         for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+            encoder.set(field, 10 + box % 20 + (box % 100) / 100.0);
+         }
+         for (int i = samples; i > 0; i--) {
+            backlog.push_back(telemetrySample(timeSec - i * 1800, 10 + i % 7, 50 + i % 13, 1013.2 - i % 5, 4.1));
+         }
+         encoder.setSamples(backlog.data(), backlog.size());
+         length = encoder.encode(record, sizeof(record));
+         mqttAddPublish(packets, prefix + topic_telemetry, std::string_view((const char *) record, length), true);
+         mqttAddPublish(packets, prefix + topic_trace, "Setup=1004 Spiffs=31 Options=12 WiFi=2714", true);
+         continue;
+      }
+      for (int metric = 0; metric < METRIC_COUNT; metric++) {
+         if (metricTable[metric].format == FORMAT_INTERVAL) {
+            snprintf(value, sizeof(value), "00:01:%02d", box % 60);
+         } else {
+            snprintf(value, sizeof(value), "%d.%02d", 10 + box % 20, box % 100);
+         }
+         mqttAddPublish(packets, prefix + metricTable[metric].topic, value, true);
+      }
+      mqttAddPublish(packets, prefix + topic_trace, "Setup=1004 Spiffs=31 Options=12 WiFi=2714", true);
+   }
+   return packets;
+}
+
+/** Feeds the packets in TCP sized chunks until count messages are dispatched. */
+static void benchProducer(Collector *collector, const std::string *packets, uint64_t count, IngestCounters *counters)
+{
+   MqttReader reader;
+   size_t     pos   = 0;
+
+   while (counters->messages < count) {
+      size_t     chunk = std::min((size_t) 16384, packets->size() - pos);
+      int64_t    nowMs = collectorNowMs();
+      MqttPacket packet;
+
+      reader.append(packets->data() + pos, chunk);
+      pos = (pos + chunk) % packets->size();
+      while (counters->messages < count && reader.next(packet)) {
+         MqttPublish publish;
+
+         if (mqttParsePublish(packet, publish)) {
+            collector->dispatch(publish.topic, publish.payload, nowMs, *counters);
+         }
+      }
+   }
+}
+
+/** Throughput of the ingest path without network. */
+static int runBench(Collector &collector, uint64_t messages, int producers, int samples)
+{
+   std::string                                  packets = benchPackets(samples);
+   std::vector<std::unique_ptr<IngestCounters> > counters;
+   std::vector<std::thread>                     threads;
+   uint64_t                                     queued  = 0;
+   uint64_t                                     handled = 0;
+
+   collector.startWorkers();
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   for (int i = 0; i < producers; i++) {
+      counters.push_back(std::unique_ptr<IngestCounters>(new IngestCounters()));
+      threads.push_back(std::thread(benchProducer, &collector, &packets, messages / producers, counters.back().get()));
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+   for (auto &c : counters) {
+      queued += c->records;
+   }
+   while (handled < queued) {
+      handled = 0;
+      for (auto &worker : collector.workers) {
+         handled += worker->records;
+      }
+   }
+
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   collector.shutdown();
+
+   uint64_t total = 0;
+   uint64_t waits = 0;
+
+   for (auto &c : counters) {
+      total += c->messages;
+      waits += c->fullWaits;
+   }
+   printf("%d producers, %d workers: %llu messages, %llu records in %.3f s = %.0f messages/s, %.0f records/s, %llu full queue waits\n",
+          producers, (int) collector.workers.size(), (unsigned long long) total, (unsigned long long) handled,
+          seconds, total / seconds, handled / seconds, (unsigned long long) waits);
+   printf("%.0f bytes of PUBLISH packets per wake\n", (double) packets.size() / BENCH_BOXES);
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   CollectorOptions options;
+   uint64_t         benchMessages = 0;
+   int              producers     = 2;
+   int              samples       = -1;
+   int              statsSec      = 10;
+   std::string      storeDir;
+   int              sealSec       = 86400;
+   int              httpPort      = 0;
+   int              everySec      = 0;
+   int              opt;
+
+   while ((opt = getopt(argc, argv, "h:p:s:W:q:i:c:u:w:d:f:H:L:b:P:T:")) != -1) {
+      switch (opt) {
+         case 'h': options.host      = optarg;              break;
+         case 'p': options.port      = optarg;              break;
+         case 's': options.filters.push_back(optarg);       break;
+         case 'W': options.workers   = atoi(optarg);        break;
+         case 'q': options.queueSize = atol(optarg);        break;
+         case 'i': statsSec          = atoi(optarg);        break;
+         case 'c': options.clientId  = optarg;              break;
+         case 'u': options.user      = optarg;              break;
+         case 'w': options.password  = optarg;              break;
+         case 'd': storeDir          = optarg;              break;
+         case 'f': sealSec           = atoi(optarg);        break;
+         case 'H': httpPort          = atoi(optarg);        break;
+         case 'L': everySec          = atoi(optarg);        break;
+         case 'b': benchMessages     = strtoull(optarg, NULL, 10); break;
+         case 'P': producers         = atoi(optarg);        break;
+         case 'T': samples           = atoi(optarg);        break;
+         default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-s filter]... [-W workers] [-q queueSize] [-i statsSec]\n"
+                            "          [-c clientId] [-u user] [-w password] [-d storeDir [-f sealSec] [-H httpPort]] [-L everySec]\n"
+                            "          [-b messages [-P producers] [-T samples]]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (options.workers <= 0 || options.queueSize < 2 || producers <= 0) {
+      fprintf(stderr, "Invalid worker count, queue size or producers\n");
+      return 1;
+   }
+   if (options.filters.empty()) {
+      options.filters.push_back("+/+/#");
+   }
+
+   Collector                        collector(options);
+   std::unique_ptr<TimeSeriesStore> store;
+   std::unique_ptr<LiveFanout>      fanout;
+   std::unique_ptr<QueryServer>     server;
+   std::unique_ptr<LivenessTracker> liveness;
+   LivenessPrinter                  printer;
+
+   if (everySec > 0) {
+      liveness.reset(new LivenessTracker(options.workers, everySec, collectorNowMs()));
+      liveness->addListener(&printer);
+      collector.addSink(liveness.get());
+   }
+   if (!storeDir.empty()) {
+      store.reset(new TimeSeriesStore(storeDir, options.workers, sealSec * 1000LL));
+      if (!store->open()) {
+         fprintf(stderr, "Cannot open the store in %s\n", storeDir.c_str());
+         return 1;
+      }
+      collector.addSink(store.get());
+      if (httpPort) {
+         fanout.reset(new LiveFanout());
+         collector.addSink(fanout.get());
+         server.reset(new QueryServer(*store, httpPort));
+         server->setLiveness(liveness.get());
+         server->setFanout(fanout.get());
+         if (!server->start()) {
+            return 1;
+         }
+      }
+   }
+   if (benchMessages) {
+      return runBench(collector, benchMessages, producers, samples);
+   }
+   signal(SIGINT,  onSignal);
+   signal(SIGTERM, onSignal);
+   signal(SIGPIPE, SIG_IGN);
+   collector.startWorkers();
+   collector.startIngests();
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   int                                   ticks = 0;
+
+   while (!stopSignal) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      if (statsSec > 0 && ++ticks >= statsSec * 10) {
+         ticks = 0;
+         collector.printStats(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+         if (liveness) {
+            printf("%llu boxes overdue\n", (unsigned long long) liveness->overdueCount());
+         }
+      }
+   }
+   collector.shutdown();
+   if (server) {
+      server->shutdown();
+      printf("%llu queries, %.2f ms on average\n", (unsigned long long) server->requests,
+             server->requests ? server->totalMicros / 1000.0 / server->requests : 0.0);
+      printf("%llu streams: %llu values encoded, %llu frames sent, %llu coalesced, %llu dropped, %llu lost\n",
+             (unsigned long long) server->streamCount, (unsigned long long) fanout->encoded,
+             (unsigned long long) server->streamFrames, (unsigned long long) server->streamCoalesced,
+             (unsigned long long) server->streamDropped, (unsigned long long) fanout->lost);
+   }
+   if (store) {
+      store->close();
+      printf("%llu values out of order dropped\n", (unsigned long long) store->outOfOrder);
+   }
+   collector.printStats(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+   return 0;
+}
@@ -0,0 +1,249 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Metrics.h
+  *
+  * Metrics of the box topics and the parsers of their text values.
+  * Nothing here allocates: topics and payloads are string_views into the
+  * received MQTT packet.
+  */
+
+#pragma once
+
+#include "MqttTopics.h"
+
+#include <string_view>
+#include <stdint.h>
+
+/** Numeric values published by MyMqtt::handleClient. */
+enum Metric
+{
+   METRIC_TEMPERATURE,   //!< Degree celsius.
+   METRIC_HUMIDITY,      //!< Percent.
+   METRIC_PRESSURE,      //!< hPa.
+   METRIC_SAMPLE_TIME,   //!< Unix time of the BME280 values.
+   METRIC_VOLTAGE,       //!< Supply voltage.
+   METRIC_MAH,           //!< Power consumption.
+   METRIC_ALIVE,         //!< Awake seconds of the wake.
+   METRIC_RSSI,          //!< dBm.
+   METRIC_CONN_ERRORS,   //!< mqttConnErrorCount.
+   METRIC_SEND_ERRORS,   //!< mqttSendErrorCount.
+   METRIC_OVERRUN_WIFI,  //!< Awake budget overruns per phase.
+   METRIC_OVERRUN_TIME,
+   METRIC_OVERRUN_MQTT,
+   METRIC_OVERRUN_WEB,
+   METRIC_HEAP_FREE,     //!< Byte.
+   METRIC_HEAP_MAX_BLOCK,//!< Byte.
+   METRIC_HEAP_FRAG,     //!< Percent.
+   METRIC_HEAP_LOW_WATER,//!< Byte.
+   METRIC_TLS_HANDSHAKE, //!< ms of the last TLS connect.
+   METRIC_TLS_RESUMED,   //!< 1 = resumed TLS session.
+   METRIC_COUNT          //!< Number of metrics
+};
+
+/** Text format of a value. */
+enum MetricFormat
+{
+   FORMAT_DECIMAL,  //!< "-12.34"
+   FORMAT_INTERVAL, //!< formatInterval(): "[d ]hh:mm:ss"
+};
+
+/** Sub topic, name and format of a metric. */
+struct MetricInfo
+{
+   const char *topic;  //!< Sub topic after mqttName/mqttId.
+   const char *name;   //!< Short name for the query and the output.
+   int         format; //!< MetricFormat
+};
+
+static const MetricInfo metricTable[METRIC_COUNT] = {
+   { topic_temperature,       "temperature",  FORMAT_DECIMAL  },
+   { topic_humidity,          "humidity",     FORMAT_DECIMAL  },
+   { topic_pressure,          "pressure",     FORMAT_DECIMAL  },
+   { topic_time,              "sampleTime",   FORMAT_DECIMAL  },
+   { topic_voltage,           "voltage",      FORMAT_DECIMAL  },
+   { topic_mAh,               "mAh",          FORMAT_DECIMAL  },
+   { topic_alive,             "alive",        FORMAT_INTERVAL },
+   { topic_rssi,              "rssi",         FORMAT_DECIMAL  },
+   { topic_conn_error_count,  "connErrors",   FORMAT_DECIMAL  },
+   { topic_send_error_count,  "sendErrors",   FORMAT_DECIMAL  },
+   { topic_overrun "WiFi",    "overrunWiFi",  FORMAT_DECIMAL  },
+   { topic_overrun "Time",    "overrunTime",  FORMAT_DECIMAL  },
+   { topic_overrun "Mqtt",    "overrunMqtt",  FORMAT_DECIMAL  },
+   { topic_overrun "Web",     "overrunWeb",   FORMAT_DECIMAL  },
+   { topic_heap_free,         "heapFree",     FORMAT_DECIMAL  },
+   { topic_heap_max_block,    "heapMaxBlock", FORMAT_DECIMAL  },
+   { topic_heap_frag,         "heapFrag",     FORMAT_DECIMAL  },
+   { topic_heap_low_water,    "heapLowWater", FORMAT_DECIMAL  },
+   { topic_tls_handshake,     "tlsHandshakeMs", FORMAT_DECIMAL },
+   { topic_tls_resumed,       "tlsResumed",   FORMAT_DECIMAL  },
+};
+
+/** Metric of a sub topic or -1 (/Trace, /Heap/Allocs/..., unknown). */
+inline int findMetric(std::string_view subTopic)
+{
+   for (int i = 0; i < METRIC_COUNT; i++) {
+      if (subTopic == metricTable[i].topic) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+/** Metric of a short name or -1. */
+inline int findMetricName(std::string_view name)
+{
+   for (int i = 0; i < METRIC_COUNT; i++) {
+      if (name == metricTable[i].name) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+/** Splits mqttName/mqttId/subTopic. The box is "mqttName/mqttId". */
+inline bool splitTopic(std::string_view topic, std::string_view &box, std::string_view &subTopic)
+{
+   size_t first = topic.find('/');
+
+   if (first == std::string_view::npos || first == 0) {
+      return false;
+   }
+
+   size_t second = topic.find('/', first + 1);
+
+   if (second == std::string_view::npos || second == first + 1) {
+      return false;
+   }
+   box      = topic.substr(0, second);
+   subTopic = topic.substr(second);
+   return true;
+}
+
+/** Parses the String(float)/String(long) output: optional sign, digits, optional fraction. */
+inline bool parseDecimal(std::string_view text, double &value)
+{
+   size_t   i        = 0;
+   bool     negative = false;
+   uint64_t mantissa = 0;
+   int      digits   = 0;
+   int      scale    = 0;
+
+   while (i < text.size() && text[i] == ' ') {
+      i++;
+   }
+   if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+      negative = text[i++] == '-';
+   }
+   for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++, digits++) {
+      if (digits < 18) {
+         mantissa = mantissa * 10 + (text[i] - '0');
+      } else {
+         scale++;
+      }
+   }
+   if (i < text.size() && text[i] == '.') {
+      for (i++; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++, digits++) {
+         if (digits < 18) {
+            mantissa = mantissa * 10 + (text[i] - '0');
+            scale--;
+         }
+      }
+   }
+   while (i < text.size() && text[i] == ' ') {
+      i++;
+   }
+   if (!digits || i != text.size()) {
+      return false;
+   }
+
+   static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+   value = (double) mantissa;
+   if (scale < 0) {
+      value /= powers[-scale];
+   } else if (scale > 0) {
+      value *= powers[scale < 18 ? scale : 18];
+   }
+   if (negative) {
+      value = -value;
+   }
+   return true;
+}
+
+/** Parses the formatInterval() output "[d ]hh:mm:ss" to seconds. */
+inline bool parseInterval(std::string_view text, double &value)
+{
+   long   parts[4] = { 0 };
+   int    count    = 0;
+   bool   days     = false;
+   size_t i        = 0;
+
+   while (i < text.size() && count < 4) {
+      long part   = 0;
+      int  digits = 0;
+
+      for (; i < text.size() && text[i] >= '0' && text[i] <= '9' && digits < 9; i++, digits++) {
+         part = part * 10 + (text[i] - '0');
+      }
+      if (!digits) {
+         return false;
+      }
+      parts[count++] = part;
+      if (i == text.size()) {
+         break;
+      }
+      if (text[i] == ' ' && count == 1) {
+         days = true;
+      } else if (text[i] != ':') {
+         return false;
+      }
+      i++;
+   }
+   if (i != text.size() || count != (days ? 4 : 3)) {
+      return false;
+   }
+   if (!days) {
+      parts[3] = parts[2];
+      parts[2] = parts[1];
+      parts[1] = parts[0];
+      parts[0] = 0;
+   }
+   value = ((parts[0] * 24.0 + parts[1]) * 60.0 + parts[2]) * 60.0 + parts[3];
+   return true;
+}
+
+/** Parses the value of a metric. */
+inline bool parseMetric(int metric, std::string_view text, double &value)
+{
+   if (metricTable[metric].format == FORMAT_INTERVAL) {
+      return parseInterval(text, value);
+   }
+   return parseDecimal(text, value);
+}
+
+/** FNV-1a hash of a box name. */
+inline uint64_t hashBox(std::string_view box)
+{
+   uint64_t hash = 0xCBF29CE484222325ULL;
+
+   for (char c : box) {
+      hash = (hash ^ (uint8_t) c) * 0x100000001B3ULL;
+   }
+   return hash;
+}
@@ -0,0 +1,120 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MpscQueue.h
+  *
+  * Bounded lock-free queue with many producers and one consumer.
+  * Every cell carries a sequence number (D. Vyukov's bounded queue): a
+  * producer claims a position with one compare-exchange and publishes the
+  * cell with a release store, the single consumer needs no atomic
+  * read-modify-write at all. The items are copied into preallocated cells
+  * and moved out, so a cell holds no reference once popped.
+  */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T>
+class MpscQueue
+{
+protected:
+   struct Cell
+   {
+      std::atomic<size_t> sequence; //!< pos: free for the producer of pos, pos + 1: filled.
+      T                   item;     //!< Item, moved out by pop().
+   };
+
+   std::unique_ptr<Cell[]>         cells;      //!< Ring of capacity cells.
+   size_t                          mask;       //!< capacity - 1.
+   alignas(64) std::atomic<size_t> enqueuePos; //!< Next position of the producers.
+   alignas(64) size_t              dequeuePos; //!< Next position of the consumer.
+
+public:
+   explicit MpscQueue(size_t capacity);
+
+   bool push(const T &item);
+   bool pop(T &item);
+   size_t capacity() const { return mask + 1; }
+};
+
+/* ******************************************** */
+
+/** The capacity is rounded up to a power of two. */
+template <typename T>
+MpscQueue<T>::MpscQueue(size_t capacity)
+   : enqueuePos(0)
+   , dequeuePos(0)
+{
+   size_t size = 2;
+
+   while (size < capacity) {
+      size *= 2;
+   }
+   cells.reset(new Cell[size]);
+   mask = size - 1;
+   for (size_t i = 0; i < size; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+   }
+}
+
+/** Any thread. Returns false if the queue is full. */
+template <typename T>
+bool MpscQueue<T>::push(const T &item)
+{
+   size_t pos = enqueuePos.load(std::memory_order_relaxed);
+   Cell  *cell;
+
+   for (;;) {
+      cell = &cells[pos & mask];
+
+      size_t   sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff     = (intptr_t) sequence - (intptr_t) pos;
+
+      if (diff == 0) {
+         if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+         }
+      } else if (diff < 0) {
+         return false;
+      } else {
+         pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+   }
+   cell->item = item;
+   cell->sequence.store(pos + 1, std::memory_order_release);
+   return true;
+}
+
+/** Only the consumer thread. Returns false if the queue is empty. */
+template <typename T>
+bool MpscQueue<T>::pop(T &item)
+{
+   Cell *cell = &cells[dequeuePos & mask];
+
+   if ((intptr_t) cell->sequence.load(std::memory_order_acquire) - (intptr_t) (dequeuePos + 1) < 0) {
+      return false;
+   }
+   item = std::move(cell->item);
+   cell->sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+   dequeuePos++;
+   return true;
+}
@@ -0,0 +1,613 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file QueryServer.h
+  *
+  * HTTP query endpoint of the time series store. One epoll thread with
+  * keep-alive connections:
+  *
+  *   GET /boxes
+  *   GET /query?box=mqttName/mqttId&metric=temperature&from=ms&to=ms&step=ms
+  *   GET /liveness[?overdue=1]
+  *   GET /stream?box=mqttName/mqttId&metric=temperature
+  *
+  * box may be repeated, "*" selects all boxes and "mqttName/" followed by
+  * "*" all boxes of a name. from and to are unix ms (default the last day), the buckets are
+  * aligned to multiples of step (default about 300 buckets), so a step of
+  * whole hours or days is served from the rollup tiers.
+  * The answer has per series the columns t, min, max, avg, last and count
+  * of the buckets with values.
+  * /liveness lists the gap statistics of all (or the overdue) boxes of the
+  * liveness tracker, the gaps in seconds.
+  * /stream keeps the connection open as text/event-stream and sends every
+  * new value of the selected boxes and metrics (all without box or metric)
+  * as event {"box","metric","t","v"} (Fanout.h).
+  */
+
+#pragma once
+
+#include "Fanout.h"
+#include "Liveness.h"
+#include "Store.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+
+#define QUERY_DEFAULT_BUCKETS   300   //!< Buckets without step.
+#define QUERY_MAX_REQUEST_BYTES 8192  //!< Longest request head.
+
+/**
+  * The HTTP server thread.
+  */
+class QueryServer
+{
+protected:
+   /** One client connection. */
+   struct Connection
+   {
+      int                         fd;     //!< Socket.
+      uint32_t                    events; //!< Watched epoll events.
+      std::string                 in;     //!< Received, not handled bytes.
+      std::string                 out;    //!< Response bytes not sent.
+      std::unique_ptr<LiveStream> stream; //!< Event stream or NULL.
+   };
+
+   typedef std::multimap<std::string, std::string> Params; //!< Query parameters.
+
+   TimeSeriesStore                             &store;     //!< Queried store.
+   LivenessTracker                             *liveness;  //!< Tracker of /liveness or NULL.
+   LiveFanout                                  *fanout;    //!< Frames of /stream or NULL.
+   int                                          port;      //!< Listen port.
+   int                                          listenFd;  //!< Listen socket.
+   int                                          epollFd;   //!< Poll set.
+   std::map<int, std::unique_ptr<Connection> >  clients;   //!< By socket.
+   std::thread                                  thread;    //!< Server thread.
+   std::atomic<bool>                            stop;      //!< Ends the thread.
+   std::vector<Connection *>                    streams;   //!< Connections with a stream.
+   StreamRouter                                 router;    //!< Streams by selection.
+   std::vector<int>                             touched;   //!< Streams with new frames.
+   FrameData                                    heartbeat; //!< Comment line of idle streams.
+
+   void run();
+   void onInput(Connection &client);
+   bool flush(Connection &client);
+   void close(int fd);
+   void handle(const std::string &target, std::string &status, std::string &body);
+   bool startStream(Connection &client, const std::string &target);
+   void distribute();
+   void beat();
+   void query(const Params &params, std::string &status, std::string &body);
+   void listLiveness(bool overdueOnly, std::string &body);
+
+public:
+   std::atomic<uint64_t> requests;            //!< Handled requests.
+   std::atomic<uint64_t> totalMicros;         //!< Time of the handling.
+   uint64_t              streamCount     = 0; //!< Opened streams.
+   uint64_t              streamFrames    = 0; //!< Frames sent by the closed streams.
+   uint64_t              streamCoalesced = 0; //!< Frames coalesced by the closed streams.
+   uint64_t              streamDropped   = 0; //!< Frames dropped by the closed streams.
+
+   QueryServer(TimeSeriesStore &s, int p)
+      : store(s), liveness(NULL), fanout(NULL), port(p), listenFd(-1), epollFd(-1), stop(false)
+      , heartbeat(std::make_shared<const std::string>(":\n\n")), requests(0), totalMicros(0) { }
+   ~QueryServer() { shutdown(); }
+
+   void setLiveness(LivenessTracker *tracker) { liveness = tracker; }
+   void setFanout(LiveFanout *f) { fanout = f; }
+   bool start();
+   void shutdown();
+};
+
+/* ******************************************** */
+
+/** Decodes %XX and '+' of a query parameter. */
+inline std::string urlDecode(std::string_view text)
+{
+   std::string result;
+
+   for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '%' && i + 2 < text.size() && isxdigit(text[i + 1]) && isxdigit(text[i + 2])) {
+         result += (char) strtol(std::string(text.substr(i + 1, 2)).c_str(), NULL, 16);
+         i += 2;
+      } else {
+         result += text[i] == '+' ? ' ' : text[i];
+      }
+   }
+   return result;
+}
+
+/** Splits the request target into the path and the decoded parameters. */
+inline std::string parseTarget(const std::string &target, std::multimap<std::string, std::string> &params)
+{
+   size_t mark = target.find('?');
+
+   if (mark != std::string::npos) {
+      std::string_view text(target);
+
+      text.remove_prefix(mark + 1);
+      while (text.size()) {
+         std::string_view pair  = text.substr(0, text.find('&'));
+         size_t           equal = pair.find('=');
+
+         if (equal != std::string_view::npos) {
+            params.emplace(urlDecode(pair.substr(0, equal)), urlDecode(pair.substr(equal + 1)));
+         }
+         text.remove_prefix(std::min(text.size(), pair.size() + 1));
+      }
+   }
+   return target.substr(0, mark);
+}
+
+bool QueryServer::start()
+{
+   int         one  = 1;
+   sockaddr_in addr = {};
+
+   listenFd             = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   if (bind(listenFd, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenFd, 256) != 0) {
+      perror("query server");
+      return false;
+   }
+
+   epoll_event ev = {};
+
+   epollFd    = epoll_create1(0);
+   ev.events  = EPOLLIN;
+   ev.data.fd = listenFd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+   if (fanout) {
+      ev.data.fd = fanout->fd();
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, fanout->fd(), &ev);
+   }
+   thread = std::thread(&QueryServer::run, this);
+   return true;
+}
+
+void QueryServer::shutdown()
+{
+   stop = true;
+   if (thread.joinable()) {
+      thread.join();
+   }
+   while (clients.size()) {
+      close(clients.begin()->first);
+   }
+   if (listenFd >= 0) {
+      ::close(listenFd);
+      listenFd = -1;
+   }
+   if (epollFd >= 0) {
+      ::close(epollFd);
+      epollFd = -1;
+   }
+}
+
+void QueryServer::run()
+{
+   int64_t beatMs = collectorNowMs() + STREAM_HEARTBEAT_MS;
+
+   while (!stop) {
+      epoll_event events[64];
+      int         n = epoll_wait(epollFd, events, 64, 200);
+
+      for (int i = 0; i < n; i++) {
+         int fd = events[i].data.fd;
+
+         if (fanout && fd == fanout->fd()) {
+            distribute();
+         } else if (fd == listenFd) {
+            for (int c; (c = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0; ) {
+               std::unique_ptr<Connection> client(new Connection());
+               epoll_event                 ev = {};
+               int                         one = 1;
+
+               setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+               client->fd     = c;
+               client->events = EPOLLIN;
+               ev.events      = EPOLLIN;
+               ev.data.fd = c;
+               epoll_ctl(epollFd, EPOLL_CTL_ADD, c, &ev);
+               clients[c] = std::move(client);
+            }
+         } else if (clients.count(fd)) {
+            Connection &client = *clients[fd];
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+               onInput(client);
+            } else if (events[i].events & EPOLLOUT && !flush(client)) {
+               close(fd);
+            }
+         }
+      }
+      if (streams.size() && collectorNowMs() >= beatMs) {
+         beatMs = collectorNowMs() + STREAM_HEARTBEAT_MS;
+         beat();
+      }
+   }
+}
+
+void QueryServer::close(int fd)
+{
+   auto found = clients.find(fd);
+
+   if (found == clients.end()) {
+      return;
+   }
+   if (found->second->stream) {
+      StreamQueue &queue = found->second->stream->queue;
+
+      streamFrames    += queue.delivered;
+      streamCoalesced += queue.coalesced;
+      streamDropped   += queue.dropped;
+      streams.erase(std::find(streams.begin(), streams.end(), found->second.get()));
+      router.remove(found->second->stream.get());
+      fanout->subscribe(-1);
+   }
+   epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+   ::close(fd);
+   clients.erase(fd);
+}
+
+/** Sends what the socket takes, the response before the stream frames, watches EPOLLOUT for the rest. */
+bool QueryServer::flush(Connection &client)
+{
+   while (client.out.size()) {
+      ssize_t n = send(client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+         }
+         break;
+      }
+      client.out.erase(0, n);
+   }
+   if (client.stream && client.out.empty() && client.stream->queue.write(client.fd) < 0) {
+      return false;
+   }
+
+   uint32_t events = client.out.size() || (client.stream && !client.stream->queue.empty()) ? EPOLLOUT : EPOLLIN;
+
+   if (events != client.events) {
+      epoll_event ev = {};
+
+      ev.events      = events;
+      ev.data.fd     = client.fd;
+      client.events  = events;
+      epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &ev);
+   }
+   return true;
+}
+
+/** Hands the new frames to the matching streams and sends to the streams not waiting for EPOLLOUT. */
+void QueryServer::distribute()
+{
+   Frame frame;
+
+   fanout->wake();
+   touched.clear();
+   while (fanout->pop(frame)) {
+      router.route(frame, [&](LiveStream &stream) {
+         if (stream.queue.empty()) {
+            touched.push_back(stream.fd);
+         }
+         stream.queue.push(frame);
+      });
+   }
+   for (int fd : touched) {
+      Connection &client = *clients[fd];
+
+      if (client.events == EPOLLIN && !flush(client)) {
+         close(fd);
+      }
+   }
+}
+
+/** Sends a comment to the idle streams, so proxies keep them open and dead peers are noticed. */
+void QueryServer::beat()
+{
+   Frame            frame = {};
+   std::vector<int> failed;
+
+   frame.data = heartbeat;
+   for (Connection *client : streams) {
+      if (client->stream->queue.empty()) {
+         client->stream->queue.push(frame);
+         if (!flush(*client)) {
+            failed.push_back(client->fd);
+         }
+      }
+   }
+   for (int fd : failed) {
+      close(fd);
+   }
+}
+
+/** Reads the requests, answers every complete one. */
+void QueryServer::onInput(Connection &client)
+{
+   int  fd        = client.fd;
+   bool keepAlive = true;
+
+   for (;;) {
+      char    buffer[4096];
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+
+      if (n > 0) {
+         client.in.append(buffer, n);
+      } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+         close(fd);
+         return;
+      } else {
+         break;
+      }
+   }
+
+   if (client.stream) {
+      // A stream only listens, the peer has nothing more to say.
+      client.in.clear();
+      return;
+   }
+
+   size_t end;
+
+   while (keepAlive && (end = client.in.find("\r\n\r\n")) != std::string::npos) {
+      std::string_view head(client.in.data(), end);
+      std::string_view line = head.substr(0, head.find("\r\n"));
+      size_t           first  = line.find(' ');
+      size_t           second = line.find(' ', first + 1);
+      std::string      status = "200 OK";
+      std::string      body;
+      auto             start  = std::chrono::steady_clock::now();
+
+      if (first == std::string_view::npos || second == std::string_view::npos) {
+         status    = "400 Bad Request";
+         body      = "{\"error\":\"bad request line\"}";
+         keepAlive = false;
+      } else if (line.substr(0, first) != "GET") {
+         status = "405 Method Not Allowed";
+         body   = "{\"error\":\"only GET\"}";
+      } else if (fanout && line.substr(first + 1, 7) == "/stream" &&
+                 (second - first - 1 == 7 || line[first + 8] == '?')) {
+         if (startStream(client, std::string(line.substr(first + 1, second - first - 1)))) {
+            client.in.clear();
+            requests++;
+            break;
+         }
+         status = "400 Bad Request";
+         body   = "{\"error\":\"unknown metric\"}";
+      } else {
+         handle(std::string(line.substr(first + 1, second - first - 1)), status, body);
+      }
+      if (line.substr(second + 1) == "HTTP/1.0" || head.find("Connection: close") != std::string_view::npos) {
+         keepAlive = false;
+      }
+      client.out += "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nAccess-Control-Allow-Origin: *\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                    (keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+      client.out += body;
+      client.in.erase(0, end + 4);
+      requests++;
+      totalMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+   }
+   if (client.in.size() > QUERY_MAX_REQUEST_BYTES) {
+      client.out += "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      keepAlive = false;
+   }
+   if (!flush(client) || (!keepAlive && client.out.empty())) {
+      close(fd);
+   } else if (!keepAlive) {
+      // Close after the rest of the response.
+      ::shutdown(fd, SHUT_RD);
+      client.in.clear();
+   }
+}
+
+/** Dispatches a request target. */
+void QueryServer::handle(const std::string &target, std::string &status, std::string &body)
+{
+   Params      params;
+   std::string path = parseTarget(target, params);
+
+   if (path == "/query") {
+      query(params, status, body);
+   } else if (path == "/boxes") {
+      body = "{\"boxes\":[";
+      for (const std::string &name : store.boxNames()) {
+         if (body.back() != '[') {
+            body += ',';
+         }
+         appendJsonString(body, name);
+      }
+      body += "]}";
+   } else if (path == "/liveness" && liveness) {
+      auto found = params.find("overdue");
+
+      listLiveness(found != params.end() && found->second == "1", body);
+   } else {
+      status = "404 Not Found";
+      body   = "{\"error\":\"unknown path\"}";
+   }
+}
+
+/** Turns the connection into an event stream of the selected boxes and metrics. */
+bool QueryServer::startStream(Connection &client, const std::string &target)
+{
+   Params                      params;
+   std::unique_ptr<LiveStream> stream(new LiveStream(client.fd));
+
+   parseTarget(target, params);
+   for (auto range = params.equal_range("box"); range.first != range.second; ++range.first) {
+      stream->filter.addBox(range.first->second);
+   }
+   for (auto range = params.equal_range("metric"); range.first != range.second; ++range.first) {
+      if (!stream->filter.addMetric(range.first->second)) {
+         return false;
+      }
+   }
+   client.out   += "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                   "Access-Control-Allow-Origin: *\r\n\r\nretry: 2000\n\n";
+   router.add(stream.get());
+   client.stream = std::move(stream);
+   streams.push_back(&client);
+   streamCount++;
+   fanout->subscribe(1);
+   return true;
+}
+
+/** Bucket aggregates of the selected boxes and metric. */
+void QueryServer::query(const Params &params, std::string &status, std::string &body)
+{
+   auto get = [&](const char *name, int64_t value) {
+      auto found = params.find(name);
+
+      return found == params.end() ? value : strtoll(found->second.c_str(), NULL, 10);
+   };
+   auto found  = params.find("metric");
+   int  metric = found == params.end() ? -1 : findMetricName(found->second);
+
+   int64_t toMs   = get("to", collectorNowMs());
+   int64_t fromMs = get("from", toMs - 86400000LL);
+   int64_t stepMs = get("step", std::max((int64_t) 1, (toMs - fromMs) / QUERY_DEFAULT_BUCKETS));
+
+   if (metric < 0 || fromMs < 0 || toMs < fromMs || stepMs <= 0 || (toMs - fromMs) / stepMs >= QUERY_MAX_BUCKETS) {
+      status = "400 Bad Request";
+      body   = "{\"error\":\"metric, from <= to or step invalid\"}";
+      return;
+   }
+
+   // Buckets aligned to the step, the last one holds toMs.
+   int64_t originMs = fromMs - fromMs % stepMs;
+   size_t  count    = (size_t) ((toMs - originMs) / stepMs + 1);
+
+   std::vector<std::string> boxes;
+   std::vector<std::string> names = store.boxNames();
+
+   for (auto range = params.equal_range("box"); range.first != range.second; ++range.first) {
+      const std::string &box = range.first->second;
+
+      if (box == "*" || (box.size() > 2 && box.compare(box.size() - 2, 2, "/*") == 0)) {
+         std::string prefix = box.substr(0, box.size() - 1);
+
+         for (const std::string &name : names) {
+            if (name.compare(0, prefix.size(), prefix) == 0) {
+               boxes.push_back(name);
+            }
+         }
+      } else {
+         boxes.push_back(box);
+      }
+   }
+
+   static const char     *columns[] = { "t", "min", "max", "avg", "last", "count" };
+   std::vector<Aggregate> buckets;
+   int64_t                rollup = 0;
+   std::string            series;
+
+   for (const std::string &box : boxes) {
+      Series *s = store.find(box, metric);
+
+      if (!s) {
+         continue;
+      }
+      buckets.assign(count, Aggregate());
+      rollup = std::max(rollup, s->query(originMs, stepMs, buckets));
+
+      series += series.empty() ? "{\"box\":" : ",{\"box\":";
+      appendJsonString(series, box);
+      series += ",\"metric\":\"";
+      series += metricTable[metric].name;
+      series += '"';
+      for (int column = 0; column < 6; column++) {
+         bool first = true;
+
+         series += ",\"";
+         series += columns[column];
+         series += "\":[";
+         for (size_t i = 0; i < count; i++) {
+            const Aggregate &a = buckets[i];
+
+            if (!a.count) {
+               continue;
+            }
+            if (!first) {
+               series += ',';
+            }
+            first = false;
+            switch (column) {
+               case 0: appendNumber(series, originMs + (int64_t) i * stepMs); break;
+               case 1: appendNumber(series, a.min);                           break;
+               case 2: appendNumber(series, a.max);                           break;
+               case 3: appendNumber(series, a.avg());                         break;
+               case 4: appendNumber(series, a.last);                          break;
+               case 5: appendNumber(series, a.count);                         break;
+            }
+         }
+         series += ']';
+      }
+      series += '}';
+   }
+   body  = "{\"from\":" + std::to_string(originMs) + ",\"step\":" + std::to_string(stepMs) +
+           ",\"rollup\":" + std::to_string(rollup) + ",\"series\":[";
+   body += series;
+   body += "]}";
+}
+
+/** Gap statistics of the boxes, the overdue count first. */
+void QueryServer::listLiveness(bool overdueOnly, std::string &body)
+{
+   std::string boxes;
+
+   liveness->forEach([&](const BoxLiveness &b) {
+      if (overdueOnly && !b.overdue) {
+         return;
+      }
+      boxes += boxes.empty() ? "{\"box\":" : ",{\"box\":";
+      appendJsonString(boxes, b.box->name);
+      boxes += ",\"every\":";
+      appendNumber(boxes, b.everySec);
+      boxes += ",\"last\":";
+      appendNumber(boxes, b.lastMs);
+      boxes += b.overdue ? ",\"overdue\":true,\"wakes\":" : ",\"overdue\":false,\"wakes\":";
+      appendNumber(boxes, b.wakes);
+      if (b.wakes > 1) {
+         boxes += ",\"gapMin\":";
+         appendNumber(boxes, b.gapMinMs / 1000.0);
+         boxes += ",\"gapAvg\":";
+         appendNumber(boxes, b.gapAvgMs() / 1000.0);
+         boxes += ",\"gapMax\":";
+         appendNumber(boxes, b.gapMaxMs / 1000.0);
+         boxes += ",\"gapLast\":";
+         appendNumber(boxes, b.gapLastMs / 1000.0);
+      }
+      boxes += ",\"overdues\":";
+      appendNumber(boxes, b.overdues);
+      boxes += ",\"down\":";
+      appendNumber(boxes, b.downMs / 1000.0);
+      boxes += ",\"errorRises\":";
+      appendNumber(boxes, b.errorRises);
+      boxes += '}';
+   });
+   body  = "{\"overdue\":" + std::to_string(liveness->overdueCount()) + ",\"boxes\":[";
+   body += boxes;
+   body += "]}";
+}
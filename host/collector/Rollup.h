@@ -0,0 +1,360 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Rollup.h
+  *
+  * Aggregates of the store: the min/max/sum kernel over decoded values and
+  * the rollup tiers of a series. A tier is a file of fixed buckets (one
+  * hour, one day) next to the series file, appended when a block is sealed.
+  * Queries with a step of whole buckets read the tier instead of the
+  * points, only the time after the last complete bucket comes from the
+  * blocks.
+  */
+
+#pragma once
+
+#include "Gorilla.h"
+
+#include <limits>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ROLLUP_TIERS 2 //!< Number of rollup tiers of a series.
+
+/** Resolution and file suffix of the rollup tiers, coarsest last. */
+static const struct { int64_t resolutionMs; const char *suffix; } rollupTable[ROLLUP_TIERS] = {
+   { 3600000LL,  ".1h.tsr" },
+   { 86400000LL, ".1d.tsr" }
+};
+
+typedef double ValueLanes __attribute__((vector_size(32))); //!< Four values, two SSE2 or one AVX register.
+
+/** Aggregates of a range. */
+struct Aggregate
+{
+   uint64_t count;  //!< Points.
+   double   min;    //!< Smallest value.
+   double   max;    //!< Largest value.
+   double   sum;    //!< Sum of the values.
+   double   last;   //!< Value of the newest point.
+   int64_t  lastMs; //!< Time of the newest point.
+
+   Aggregate() : count(0), min(INFINITY), max(-INFINITY), sum(0.0), last(NAN), lastMs(std::numeric_limits<int64_t>::min()) { }
+
+   void add(int64_t timeMs, double value);
+   void add(const BlockHeader &header);
+   void add(const Aggregate &other);
+   void addValues(const int64_t *times, const double *values, size_t n);
+   double avg() const { return count ? sum / count : NAN; }
+};
+
+/** One bucket of a rollup tier as stored in the file. */
+struct RollupBucket
+{
+   int64_t   startMs;   //!< Start of the bucket, a multiple of the resolution.
+   Aggregate aggregate; //!< Points of the bucket.
+};
+
+/**
+  * Read-only mapping of the first bytes of a file.
+  */
+class MappedFile
+{
+protected:
+   const uint8_t *data; //!< Mapping or NULL.
+   uint64_t       size; //!< Mapped bytes.
+
+public:
+   MappedFile() : data(NULL), size(0) { }
+   ~MappedFile() { unmap(); }
+
+   bool map(const std::string &fileName, uint64_t bytes, int advice);
+   void unmap();
+   const uint8_t *bytes() const { return data; }
+   uint64_t       length() const { return size; }
+};
+
+/**
+  * One rollup tier of a series. Completed buckets are appended to the file,
+  * the newest bucket stays open in memory until a point of a later bucket
+  * is sealed. The caller (Series) guards it with the series lock.
+  */
+class RollupTier
+{
+protected:
+   std::string  fileName;     //!< Path of the tier file.
+   int64_t      resolutionMs; //!< Length of a bucket.
+   uint64_t     fileSize;     //!< Bytes of the complete buckets.
+   MappedFile   file;         //!< Mapping for the scans.
+   RollupBucket current;      //!< Newest bucket, valid if count > 0.
+   std::string  pending;      //!< Completed buckets not yet written.
+   int64_t      completeMs;   //!< End of the last complete bucket.
+
+public:
+   RollupTier() : resolutionMs(0), fileSize(0), completeMs(std::numeric_limits<int64_t>::min()) { }
+
+   bool    load(const std::string &f, int64_t resolution);
+   void    add(int64_t timeMs, double value);
+   bool    flush();
+   int64_t coveredMs() const;
+   int64_t resolution() const { return resolutionMs; }
+
+   template <typename Fn> void scan(int64_t fromMs, int64_t toMs, Fn fn);
+};
+
+/* ******************************************** */
+
+/** Min, max and sum of n values in four lanes. */
+inline void aggregateValues(const double *values, size_t n, double &min, double &max, double &sum)
+{
+   size_t i = 0;
+
+   min = INFINITY;
+   max = -INFINITY;
+   sum = 0.0;
+   if (n >= 8) {
+      ValueLanes lo;
+      ValueLanes hi;
+      ValueLanes total = { 0.0, 0.0, 0.0, 0.0 };
+
+      memcpy(&lo, values, sizeof(lo));
+      hi = lo;
+      for (; i + 4 <= n; i += 4) {
+         ValueLanes v;
+
+         memcpy(&v, values + i, sizeof(v));
+         lo     = v < lo ? v : lo;
+         hi     = v > hi ? v : hi;
+         total += v;
+      }
+      for (int lane = 0; lane < 4; lane++) {
+         min  = std::min(min, lo[lane]);
+         max  = std::max(max, hi[lane]);
+         sum += total[lane];
+      }
+   }
+   for (; i < n; i++) {
+      min  = std::min(min, values[i]);
+      max  = std::max(max, values[i]);
+      sum += values[i];
+   }
+}
+
+inline void Aggregate::add(int64_t timeMs, double value)
+{
+   count++;
+   min  = std::min(min, value);
+   max  = std::max(max, value);
+   sum += value;
+   if (timeMs >= lastMs) {
+      last   = value;
+      lastMs = timeMs;
+   }
+}
+
+/** Adds a whole block by its header. */
+inline void Aggregate::add(const BlockHeader &header)
+{
+   count += header.count;
+   min    = std::min(min, header.min);
+   max    = std::max(max, header.max);
+   sum   += header.sum;
+   if (header.lastMs >= lastMs) {
+      last   = header.last;
+      lastMs = header.lastMs;
+   }
+}
+
+inline void Aggregate::add(const Aggregate &other)
+{
+   if (!other.count) {
+      return;
+   }
+   count += other.count;
+   min    = std::min(min, other.min);
+   max    = std::max(max, other.max);
+   sum   += other.sum;
+   if (other.lastMs >= lastMs) {
+      last   = other.last;
+      lastMs = other.lastMs;
+   }
+}
+
+/** Adds n decoded points, sorted by time. */
+inline void Aggregate::addValues(const int64_t *times, const double *values, size_t n)
+{
+   double lo;
+   double hi;
+   double total;
+
+   if (!n) {
+      return;
+   }
+   aggregateValues(values, n, lo, hi, total);
+   count += n;
+   min    = std::min(min, lo);
+   max    = std::max(max, hi);
+   sum   += total;
+   if (times[n - 1] >= lastMs) {
+      last   = values[n - 1];
+      lastMs = times[n - 1];
+   }
+}
+
+/** Maps the first bytes of the file, again if the length has changed. */
+inline bool MappedFile::map(const std::string &fileName, uint64_t bytes, int advice)
+{
+   if (data && size == bytes) {
+      return true;
+   }
+   unmap();
+   if (!bytes) {
+      return false;
+   }
+
+   int fd = ::open(fileName.c_str(), O_RDONLY);
+
+   if (fd < 0) {
+      return false;
+   }
+
+   void *p = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+
+   ::close(fd);
+   if (p == MAP_FAILED) {
+      return false;
+   }
+   madvise(p, bytes, advice);
+   data = (const uint8_t *) p;
+   size = bytes;
+   return true;
+}
+
+inline void MappedFile::unmap()
+{
+   if (data) {
+      munmap((void *) data, size);
+      data = NULL;
+      size = 0;
+   }
+}
+
+/** Opens the tier file and cuts a torn last bucket. */
+inline bool RollupTier::load(const std::string &f, int64_t resolution)
+{
+   struct stat st;
+
+   fileName     = f;
+   resolutionMs = resolution;
+   fileSize     = 0;
+   current      = RollupBucket();
+   completeMs   = std::numeric_limits<int64_t>::min();
+   pending.clear();
+   file.unmap();
+   if (stat(fileName.c_str(), &st) != 0) {
+      return true;
+   }
+   fileSize = st.st_size - st.st_size % sizeof(RollupBucket);
+   if (fileSize != (uint64_t) st.st_size && truncate(fileName.c_str(), fileSize) != 0) {
+      return false;
+   }
+   if (fileSize) {
+      RollupBucket last;
+      int          fd = ::open(fileName.c_str(), O_RDONLY);
+      bool         ok = fd >= 0 && pread(fd, &last, sizeof(last), fileSize - sizeof(last)) == sizeof(last);
+
+      if (fd >= 0) {
+         ::close(fd);
+      }
+      if (!ok) {
+         return false;
+      }
+      completeMs = last.startMs + resolutionMs;
+   }
+   return true;
+}
+
+/** Start of the open bucket: all sealed points before are in the complete buckets. */
+inline int64_t RollupTier::coveredMs() const
+{
+   return current.aggregate.count ? current.startMs : completeMs;
+}
+
+/** Adds a sealed point. Late points count to the open bucket. */
+inline void RollupTier::add(int64_t timeMs, double value)
+{
+   int64_t startMs = timeMs - ((timeMs % resolutionMs) + resolutionMs) % resolutionMs;
+
+   if (current.aggregate.count && startMs > current.startMs) {
+      pending.append((const char *) &current, sizeof(current));
+      completeMs = current.startMs + resolutionMs;
+      current    = RollupBucket();
+   }
+   if (!current.aggregate.count) {
+      current.startMs = std::max(startMs, completeMs);
+   }
+   current.aggregate.add(timeMs, value);
+}
+
+/** Appends the completed buckets to the file. */
+inline bool RollupTier::flush()
+{
+   if (pending.empty()) {
+      return true;
+   }
+
+   int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+   if (fd < 0) {
+      return false;
+   }
+
+   ssize_t n = write(fd, pending.data(), pending.size());
+
+   ::close(fd);
+   if (n != (ssize_t) pending.size()) {
+      if (n > 0 && truncate(fileName.c_str(), fileSize) != 0) {
+         fprintf(stderr, "%s: cannot cut a partial bucket\n", fileName.c_str());
+      }
+      return false;
+   }
+   fileSize += pending.size();
+   pending.clear();
+   return true;
+}
+
+/** Calls fn(bucket) for the complete buckets starting in [fromMs, toMs). */
+template <typename Fn>
+void RollupTier::scan(int64_t fromMs, int64_t toMs, Fn fn)
+{
+   if (!fileSize || !file.map(fileName, fileSize, MADV_RANDOM)) {
+      return;
+   }
+
+   const RollupBucket *begin = (const RollupBucket *) file.bytes();
+   const RollupBucket *end   = begin + fileSize / sizeof(RollupBucket);
+   const RollupBucket *it    = std::lower_bound(begin, end, fromMs,
+                                                [](const RollupBucket &bucket, int64_t ms) { return bucket.startMs < ms; });
+
+   for (; it != end && it->startMs < toMs; ++it) {
+      fn(*it);
+   }
+}
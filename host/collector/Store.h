@@ -0,0 +1,579 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Store.h
+  *
+  * Time series store of the collector. Every box and metric is one series
+  * file root/mqttName/mqttId/metric.tsd: an append-only column of sealed
+  * Gorilla blocks (Gorilla.h). The newest points are encoded in an
+  * in-memory head block which is sealed and appended after BLOCK_POINTS
+  * points, after -f seconds or at the shutdown.
+  * The series file is memory-mapped for the scans, a sparse index with one
+  * entry (block header and offset) per block finds the first block of a
+  * range. Whole blocks inside a range are aggregated from the index without
+  * touching the file, only the blocks at the range borders are decoded.
+  * So the heap use is the head block and 72 bytes per 1024 points per
+  * series, independent of the scanned range.
+  * Sealed blocks also go into the rollup tiers (Rollup.h), query() returns
+  * the aggregates per step from the coarsest tier that fits the step.
+  */
+
+#pragma once
+
+#include "Collector.h"
+#include "Rollup.h"
+
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <dirent.h>
+
+#define SERIES_EXTENSION ".tsd"   //!< File extension of the series.
+#define QUERY_MAX_BUCKETS 100000 //!< Most buckets of one query.
+
+/** Index entry of a sealed block, with the aggregates of the header. */
+struct BlockIndex
+{
+   BlockHeader header; //!< Copy of the block header.
+   uint64_t    offset; //!< Offset of the header in the file.
+};
+
+/**
+  * One box and metric: sealed blocks in the file and the head block.
+  * add() runs in the worker of the box, the scans in any thread.
+  */
+class Series
+{
+protected:
+   std::string             fileName;   //!< Path of the series file.
+   std::vector<BlockIndex> index;      //!< Sealed blocks, sorted by time.
+   uint64_t                fileSize;   //!< Bytes of the sealed blocks.
+   BlockEncoder            head;       //!< Newest points.
+   int64_t                 headOpenMs; //!< Wall clock of the first head point.
+   MappedFile              file;       //!< Mapping of the sealed blocks.
+   RollupTier              tiers[ROLLUP_TIERS]; //!< Rollups of the sealed points.
+   mutable std::mutex      lock;       //!< Guards all members.
+
+   bool mapFile() { return file.map(fileName, fileSize, MADV_RANDOM); }
+   void loadTiers();
+   void addToTiers(const BlockHeader &header, const uint8_t *data, const int64_t *coveredMs);
+   static void addToBuckets(const BlockHeader &header, const uint8_t *data, int64_t fromMs, int64_t toMs,
+                            int64_t originMs, int64_t stepMs, std::vector<Aggregate> &buckets);
+
+public:
+   explicit Series(const std::string &f);
+
+   bool load();
+   bool add(int64_t timeMs, double value, int64_t nowMs);
+   bool seal();
+   bool sealOlder(int64_t nowMs, int64_t maxAgeMs);
+
+   template <typename Fn> void scan(int64_t fromMs, int64_t toMs, Fn fn);
+   template <typename Fn> void scanBlocks(int64_t fromMs, int64_t toMs, Fn fn);
+   Aggregate aggregate(int64_t fromMs, int64_t toMs);
+   int64_t   query(int64_t fromMs, int64_t stepMs, std::vector<Aggregate> &buckets, bool rollups = true);
+   size_t    blockCount() const { std::lock_guard<std::mutex> guard(lock); return index.size(); }
+};
+
+/**
+  * All series, one directory per box. Registered as sink of the collector.
+  */
+class TimeSeriesStore : public RecordSink
+{
+protected:
+   /** Series of one box, created on the first value of each metric. */
+   struct BoxSeries
+   {
+      std::unique_ptr<Series> metrics[METRIC_COUNT];
+   };
+
+   std::string                                   root;     //!< Base directory.
+   int64_t                                       maxAgeMs; //!< Seal head blocks after this time, 0 = only full.
+   std::map<std::string, std::unique_ptr<BoxSeries> > boxes; //!< By "mqttName/mqttId".
+   mutable std::shared_mutex                     lock;     //!< Guards boxes (not the series).
+   std::vector<int64_t>                          sealMs;   //!< Last sealOlder() per worker.
+
+   Series *create(const std::string &box, int metric);
+   std::string seriesFile(const std::string &box, int metric) const;
+
+public:
+   std::atomic<uint64_t> outOfOrder; //!< Dropped values older than the last one of their series.
+
+   TimeSeriesStore(const std::string &r, int workers, int64_t maxAge);
+
+   bool open();
+   void close();
+
+   virtual void add(int worker, BoxState &box, const Record &record);
+   virtual void tick(int worker, int64_t nowMs);
+
+   Series                  *find(const std::string &box, int metric) const;
+   std::vector<std::string> boxNames() const;
+};
+
+/* ******************************************** */
+
+Series::Series(const std::string &f)
+   : fileName(f)
+   , fileSize(0)
+   , headOpenMs(0)
+{
+   loadTiers();
+}
+
+/** Opens the tier files next to the series file. */
+void Series::loadTiers()
+{
+   std::string base = fileName.substr(0, fileName.size() - strlen(SERIES_EXTENSION));
+
+   for (int i = 0; i < ROLLUP_TIERS; i++) {
+      if (!tiers[i].load(base + rollupTable[i].suffix, rollupTable[i].resolutionMs)) {
+         fprintf(stderr, "%s%s: cannot load\n", base.c_str(), rollupTable[i].suffix);
+      }
+   }
+}
+
+/** Builds the index from the block headers, cuts a torn last block. */
+bool Series::load()
+{
+   std::lock_guard<std::mutex> guard(lock);
+   struct stat                 st;
+
+   if (stat(fileName.c_str(), &st) != 0) {
+      return false;
+   }
+   fileSize = st.st_size;
+   index.clear();
+   if (!mapFile()) {
+      return fileSize == 0;
+   }
+
+   uint64_t pos = 0;
+
+   while (pos + sizeof(BlockHeader) <= fileSize) {
+      BlockHeader header;
+
+      memcpy(&header, file.bytes() + pos, sizeof(header));
+      if (header.magic != BLOCK_MAGIC || !header.count || pos + sizeof(header) + header.bytes > fileSize) {
+         break;
+      }
+      index.push_back({ header, pos });
+      pos += sizeof(header) + header.bytes;
+   }
+   if (pos != fileSize) {
+      fprintf(stderr, "%s: cut after %llu of %llu bytes\n", fileName.c_str(), (unsigned long long) pos, (unsigned long long) fileSize);
+      file.unmap();
+      if (truncate(fileName.c_str(), pos) != 0) {
+         return false;
+      }
+      fileSize = pos;
+      if (fileSize && !mapFile()) {
+         return false;
+      }
+   }
+
+   // The tiers miss the points after their last complete bucket.
+   int64_t coveredMs[ROLLUP_TIERS];
+   int64_t fromMs = std::numeric_limits<int64_t>::max();
+
+   loadTiers();
+   for (int i = 0; i < ROLLUP_TIERS; i++) {
+      coveredMs[i] = tiers[i].coveredMs();
+      fromMs       = std::min(fromMs, coveredMs[i]);
+   }
+   for (const BlockIndex &block : index) {
+      if (block.header.lastMs >= fromMs) {
+         addToTiers(block.header, file.bytes() + block.offset + sizeof(BlockHeader), coveredMs);
+      }
+   }
+   return true;
+}
+
+/** Adds the points of a sealed block to the tiers, with coveredMs only the later ones. */
+void Series::addToTiers(const BlockHeader &header, const uint8_t *data, const int64_t *coveredMs)
+{
+   BlockDecoder decoder(data, header.bytes, header.count);
+   int64_t      timeMs;
+   double       value;
+
+   while (decoder.next(timeMs, value)) {
+      for (int i = 0; i < ROLLUP_TIERS; i++) {
+         if (!coveredMs || timeMs >= coveredMs[i]) {
+            tiers[i].add(timeMs, value);
+         }
+      }
+   }
+   for (int i = 0; i < ROLLUP_TIERS; i++) {
+      if (!tiers[i].flush()) {
+         fprintf(stderr, "%s: cannot write the rollup\n", fileName.c_str());
+      }
+   }
+}
+
+/** Appends a point to the head block, seals it when full.
+  * False for a point before the last one, the blocks and the index stay sorted by time.
+  */
+bool Series::add(int64_t timeMs, double value, int64_t nowMs)
+{
+   bool full;
+   {
+      std::lock_guard<std::mutex> guard(lock);
+
+      if (!head.count()) {
+         if (!index.empty() && timeMs < index.back().header.lastMs) {
+            return false;
+         }
+         headOpenMs = nowMs;
+      }
+      if (!head.append(timeMs, value)) {
+         return false;
+      }
+      full = head.count() >= BLOCK_POINTS;
+   }
+   if (full) {
+      seal();
+   }
+   return true;
+}
+
+/** Appends the head block to the file. */
+bool Series::seal()
+{
+   std::lock_guard<std::mutex> guard(lock);
+   std::string                 block;
+
+   if (!head.count()) {
+      return true;
+   }
+   head.encode(block);
+
+   int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+   if (fd < 0) {
+      return false;
+   }
+
+   ssize_t n = write(fd, block.data(), block.size());
+
+   ::close(fd);
+   if (n != (ssize_t) block.size()) {
+      // Cut a partial write, the head stays for the next try.
+      if (n > 0 && truncate(fileName.c_str(), fileSize) != 0) {
+         fprintf(stderr, "%s: cannot cut a partial block\n", fileName.c_str());
+      }
+      return false;
+   }
+   index.push_back({ head.header, fileSize });
+   index.back().header.bytes = block.size() - sizeof(BlockHeader);
+   fileSize += block.size();
+   addToTiers(index.back().header, (const uint8_t *) block.data() + sizeof(BlockHeader), NULL);
+   head.clear();
+   return true;
+}
+
+/** Seals a head block which is older than maxAgeMs. */
+bool Series::sealOlder(int64_t nowMs, int64_t maxAgeMs)
+{
+   {
+      std::lock_guard<std::mutex> guard(lock);
+
+      if (!head.count() || nowMs - headOpenMs < maxAgeMs) {
+         return true;
+      }
+   }
+   return seal();
+}
+
+/** Calls fn(header, data) for all blocks overlapping the range, the head block last. */
+template <typename Fn>
+void Series::scanBlocks(int64_t fromMs, int64_t toMs, Fn fn)
+{
+   std::lock_guard<std::mutex> guard(lock);
+
+   if (index.size() && mapFile()) {
+      // First block which ends at or after fromMs.
+      auto it = std::lower_bound(index.begin(), index.end(), fromMs,
+                                 [](const BlockIndex &block, int64_t ms) { return block.header.lastMs < ms; });
+
+      for (; it != index.end() && it->header.firstMs <= toMs; ++it) {
+         fn(it->header, file.bytes() + it->offset + sizeof(BlockHeader));
+      }
+   }
+   if (head.count() && head.header.lastMs >= fromMs && head.header.firstMs <= toMs) {
+      std::string block;
+
+      head.encode(block);
+      fn(head.header, (const uint8_t *) block.data() + sizeof(BlockHeader));
+   }
+}
+
+/** Calls fn(timeMs, value) for every point in [fromMs, toMs]. */
+template <typename Fn>
+void Series::scan(int64_t fromMs, int64_t toMs, Fn fn)
+{
+   scanBlocks(fromMs, toMs, [&](const BlockHeader &header, const uint8_t *data) {
+      BlockDecoder decoder(data, header.bytes, header.count);
+      int64_t      timeMs;
+      double       value;
+
+      while (decoder.next(timeMs, value)) {
+         if (timeMs > toMs) {
+            break;
+         }
+         if (timeMs >= fromMs) {
+            fn(timeMs, value);
+         }
+      }
+   });
+}
+
+/** Aggregates of [fromMs, toMs], whole blocks only from their header. */
+Aggregate Series::aggregate(int64_t fromMs, int64_t toMs)
+{
+   Aggregate result;
+
+   scanBlocks(fromMs, toMs, [&](const BlockHeader &header, const uint8_t *data) {
+      if (header.firstMs >= fromMs && header.lastMs <= toMs) {
+         result.add(header);
+         return;
+      }
+
+      BlockDecoder decoder(data, header.bytes, header.count);
+      int64_t      timeMs;
+      double       value;
+
+      while (decoder.next(timeMs, value) && timeMs <= toMs) {
+         if (timeMs >= fromMs) {
+            result.add(timeMs, value);
+         }
+      }
+   });
+   return result;
+}
+
+/** Adds the points of a block in [fromMs, toMs) to the buckets of stepMs from originMs on. */
+void Series::addToBuckets(const BlockHeader &header, const uint8_t *data, int64_t fromMs, int64_t toMs,
+                          int64_t originMs, int64_t stepMs, std::vector<Aggregate> &buckets)
+{
+   if (header.firstMs >= fromMs && header.lastMs < toMs &&
+       (header.firstMs - originMs) / stepMs == (header.lastMs - originMs) / stepMs) {
+      buckets[(header.firstMs - originMs) / stepMs].add(header);
+      return;
+   }
+
+   int64_t      times[BLOCK_POINTS];
+   double       values[BLOCK_POINTS];
+   BlockDecoder decoder(data, header.bytes, header.count);
+   uint32_t     n     = decoder.decode(times, values, BLOCK_POINTS);
+   size_t       i     = std::lower_bound(times, times + n, fromMs) - times;
+   size_t       end   = std::lower_bound(times + i, times + n, toMs) - times;
+
+   // The times are sorted, every bucket is one run of values.
+   while (i < end) {
+      int64_t bucket = (times[i] - originMs) / stepMs;
+      size_t  next   = std::lower_bound(times + i, times + end, originMs + (bucket + 1) * stepMs) - times;
+
+      buckets[bucket].addValues(times + i, values + i, next - i);
+      i = next;
+   }
+}
+
+/**
+  * Aggregates of buckets.size() buckets of stepMs from fromMs on. Uses the
+  * coarsest rollup tier whose resolution divides fromMs and stepMs up to
+  * its last complete bucket, the rest is aggregated from the blocks.
+  * Returns the resolution of the used tier or 0.
+  */
+int64_t Series::query(int64_t fromMs, int64_t stepMs, std::vector<Aggregate> &buckets, bool rollups)
+{
+   int64_t toMs  = fromMs + stepMs * (int64_t) buckets.size();
+   int64_t rawMs = fromMs;
+   int64_t used  = 0;
+
+   for (int i = ROLLUP_TIERS - 1; rollups && i >= 0; i--) {
+      int64_t resolution = rollupTable[i].resolutionMs;
+
+      if (stepMs % resolution == 0 && fromMs % resolution == 0) {
+         std::lock_guard<std::mutex> guard(lock);
+
+         rawMs = std::min(std::max(fromMs, tiers[i].coveredMs()), toMs);
+         if (rawMs > fromMs) {
+            used = resolution;
+            tiers[i].scan(fromMs, rawMs, [&](const RollupBucket &bucket) {
+               buckets[(bucket.startMs - fromMs) / stepMs].add(bucket.aggregate);
+            });
+         }
+         break;
+      }
+   }
+   if (rawMs < toMs) {
+      scanBlocks(rawMs, toMs - 1, [&](const BlockHeader &header, const uint8_t *data) {
+         addToBuckets(header, data, rawMs, toMs, fromMs, stepMs, buckets);
+      });
+   }
+   return used;
+}
+
+/* ******************************************** */
+
+TimeSeriesStore::TimeSeriesStore(const std::string &r, int workers, int64_t maxAge)
+   : root(r)
+   , maxAgeMs(maxAge)
+   , sealMs(workers, 0)
+   , outOfOrder(0)
+{
+}
+
+/** Path of a series. The box name has no '/' but the one between mqttName and mqttId. */
+std::string TimeSeriesStore::seriesFile(const std::string &box, int metric) const
+{
+   return root + "/" + box + "/" + metricTable[metric].name + SERIES_EXTENSION;
+}
+
+/** Reads the index of all series below root/mqttName/mqttId/. */
+bool TimeSeriesStore::open()
+{
+   DIR *names = opendir(root.c_str());
+
+   if (!names && mkdir(root.c_str(), 0755) != 0) {
+      return false;
+   }
+   for (dirent *name; names && (name = readdir(names)); ) {
+      std::string namePath = root + "/" + name->d_name;
+      DIR        *ids      = name->d_name[0] != '.' ? opendir(namePath.c_str()) : NULL;
+
+      for (dirent *id; ids && (id = readdir(ids)); ) {
+         if (id->d_name[0] == '.') {
+            continue;
+         }
+
+         std::string box = std::string(name->d_name) + "/" + id->d_name;
+
+         for (int metric = 0; metric < METRIC_COUNT; metric++) {
+            struct stat st;
+
+            if (stat(seriesFile(box, metric).c_str(), &st) == 0) {
+               create(box, metric)->load();
+            }
+         }
+      }
+      if (ids) {
+         closedir(ids);
+      }
+   }
+   if (names) {
+      closedir(names);
+   }
+   return true;
+}
+
+/** Seals all head blocks. */
+void TimeSeriesStore::close()
+{
+   std::shared_lock<std::shared_mutex> guard(lock);
+
+   for (auto &box : boxes) {
+      for (auto &series : box.second->metrics) {
+         if (series) {
+            series->seal();
+         }
+      }
+   }
+}
+
+/** Series of a box and metric, creates the box directory. */
+Series *TimeSeriesStore::create(const std::string &box, int metric)
+{
+   std::unique_lock<std::shared_mutex> guard(lock);
+   std::unique_ptr<BoxSeries>         &entry = boxes[box];
+
+   if (!entry) {
+      std::string name = root + "/" + box.substr(0, box.find('/'));
+
+      entry.reset(new BoxSeries());
+      mkdir(name.c_str(), 0755);
+      mkdir((root + "/" + box).c_str(), 0755);
+   }
+   if (!entry->metrics[metric]) {
+      entry->metrics[metric].reset(new Series(seriesFile(box, metric)));
+   }
+   return entry->metrics[metric].get();
+}
+
+Series *TimeSeriesStore::find(const std::string &box, int metric) const
+{
+   std::shared_lock<std::shared_mutex> guard(lock);
+   auto                                found = boxes.find(box);
+
+   return found == boxes.end() || metric < 0 || metric >= METRIC_COUNT ? NULL : found->second->metrics[metric].get();
+}
+
+std::vector<std::string> TimeSeriesStore::boxNames() const
+{
+   std::shared_lock<std::shared_mutex> guard(lock);
+   std::vector<std::string>            names;
+
+   for (auto &box : boxes) {
+      names.push_back(box.first);
+   }
+   return names;
+}
+
+/** Appends a record. Boxes with "." or ".." as name part are not stored. */
+void TimeSeriesStore::add(int, BoxState &box, const Record &record)
+{
+   Series *series = find(box.name, record.metric);
+
+   if (!series) {
+      size_t slash = box.name.find('/');
+
+      if (box.name[0] == '.' || box.name[slash + 1] == '.') {
+         return;
+      }
+      series = create(box.name, record.metric);
+   }
+   if (!series->add(record.timeMs, record.value, collectorNowMs())) {
+      outOfOrder.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+/** Seals the old head blocks of the boxes of this worker once a second. */
+void TimeSeriesStore::tick(int worker, int64_t nowMs)
+{
+   if (!maxAgeMs || nowMs - sealMs[worker] < 1000) {
+      return;
+   }
+   sealMs[worker] = nowMs;
+
+   std::vector<Series *> series;
+   {
+      std::shared_lock<std::shared_mutex> guard(lock);
+
+      for (auto &box : boxes) {
+         if (hashBox(box.first) % sealMs.size() == (uint64_t) worker) {
+            for (auto &s : box.second->metrics) {
+               if (s) {
+                  series.push_back(s.get());
+               }
+            }
+         }
+      }
+   }
+   for (Series *s : series) {
+      s->sealOlder(nowMs, maxAgeMs);
+   }
+}
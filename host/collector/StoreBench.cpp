@@ -0,0 +1,220 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file StoreBench.cpp
+  *
+  * Writes -d days of one-minute temperature values for -n boxes into a
+  * temporary store and measures the range scans over all of them: the
+  * aggregate of the whole range, of a range with borders inside blocks,
+  * the decode of every point and the bucket queries of a dashboard with
+  * and without the rollup tiers. Prints the bytes per point and the
+  * largest resident set size.
+  *
+  *   storebench [-n boxes] [-d days] [-k (keep the directory)]
+  */
+
+#include "Store.h"
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double expectedSum = 0.0; //!< Sum of the values of box 0 to check the decoder.
+
+static double msSince(Clock::time_point start)
+{
+   return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/** Temperature with a daily cycle and some noise, received with jitter. */
+static void fillSeries(Series &series, int box, int64_t startMs, long points)
+{
+   uint64_t random = 0x9E3779B97F4A7C15ULL * (box + 1);
+
+   for (long i = 0; i < points; i++) {
+      random ^= random << 13;
+      random ^= random >> 7;
+      random ^= random << 17;
+
+      int64_t timeMs = startMs + i * 60000 + (int64_t) (random % 400);
+      double  value  = round((15.0 + 8.0 * sin(i / 1440.0 * 2.0 * M_PI) + (random >> 40) % 100 / 100.0) * 100.0) / 100.0;
+
+      series.add(timeMs, value, 0);
+      if (box == 0) {
+         expectedSum += value;
+      }
+   }
+   series.seal();
+}
+
+int main(int argc, char *argv[])
+{
+   int  boxes = 100;
+   int  days  = 365;
+   bool keep  = false;
+   int  opt;
+
+   while ((opt = getopt(argc, argv, "n:d:k")) != -1) {
+      switch (opt) {
+         case 'n': boxes = atoi(optarg); break;
+         case 'd': days  = atoi(optarg); break;
+         case 'k': keep  = true;         break;
+         default:
+            fprintf(stderr, "usage: %s [-n boxes] [-d days] [-k]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   char root[] = "/tmp/storebenchXXXXXX";
+
+   if (!mkdtemp(root)) {
+      perror("mkdtemp");
+      return 1;
+   }
+
+   TimeSeriesStore   store(root, 1, 0);
+   int64_t           startMs = 1609459200000LL;
+   long              points  = days * 1440L;
+   int64_t           endMs   = startMs + points * 60000;
+   Clock::time_point start   = Clock::now();
+
+   store.open();
+   for (int box = 0; box < boxes; box++) {
+      BoxState state;
+      Record   record;
+
+      state.name      = "SolarWeatherBox/" + std::to_string(box + 1);
+      record.metric   = METRIC_TEMPERATURE;
+      record.timeMs   = startMs;
+      record.value    = 0.0;
+      record.stored   = 0;
+      store.add(0, state, record);
+      fillSeries(*store.find(state.name, METRIC_TEMPERATURE), box, startMs + 60000, points - 1);
+   }
+
+   double      writeMs = msSince(start);
+   std::string command = std::string("du -sb ") + root;
+   FILE       *du      = popen(command.c_str(), "r");
+   long        bytes   = 0;
+
+   if (du) {
+      if (fscanf(du, "%ld", &bytes) != 1) {
+         bytes = 0;
+      }
+      pclose(du);
+   }
+   printf("%d boxes x %d days of one-minute values: %ld points, written in %.0f ms, %.2f bytes/point\n",
+          boxes, days, boxes * points, writeMs, (double) bytes / (boxes * points));
+
+   // Reopen, so the scans work on the mapped files and a rebuilt index.
+   TimeSeriesStore reopened(root, 1, 0);
+
+   start = Clock::now();
+   reopened.open();
+   printf("  open (index of %zu blocks per series): %.1f ms\n",
+          reopened.find("SolarWeatherBox/1", METRIC_TEMPERATURE)->blockCount(), msSince(start));
+
+   std::vector<std::string> names = reopened.boxNames();
+   Aggregate                total;
+   uint64_t                 decoded = 0;
+
+   start = Clock::now();
+   for (const std::string &name : names) {
+      Aggregate a = reopened.find(name, METRIC_TEMPERATURE)->aggregate(startMs, endMs);
+
+      total.count += a.count;
+   }
+   printf("  aggregate whole range, all boxes: %.2f ms (%llu points)\n", msSince(start), (unsigned long long) total.count);
+
+   start = Clock::now();
+   total = Aggregate();
+   for (const std::string &name : names) {
+      Aggregate a = reopened.find(name, METRIC_TEMPERATURE)->aggregate(startMs + 12345678, endMs - 12345678);
+
+      total.count += a.count;
+   }
+   printf("  aggregate range with borders in blocks, all boxes: %.2f ms (%llu points)\n", msSince(start), (unsigned long long) total.count);
+
+   static const struct { const char *name; int64_t fromMs; int64_t stepMs; } queries[] = {
+      { "whole range in days",  startMs,                 86400000LL },
+      { "whole range in hours", startMs,                 3600000LL  },
+      { "last day in 5 min",    endMs - 86400000LL,      300000LL   }
+   };
+
+   for (auto &q : queries) {
+      size_t    count = (size_t) ((endMs - q.fromMs + q.stepMs - 1) / q.stepMs);
+      double    ms[2];
+      Aggregate sums[2];
+      int64_t   tier  = 0;
+
+      for (int rollups = 1; rollups >= 0; rollups--) {
+         start = Clock::now();
+         for (const std::string &name : names) {
+            std::vector<Aggregate> buckets(count);
+
+            tier = std::max(tier, reopened.find(name, METRIC_TEMPERATURE)->query(q.fromMs, q.stepMs, buckets, rollups));
+            for (const Aggregate &bucket : buckets) {
+               sums[rollups].add(bucket);
+            }
+         }
+         ms[rollups] = msSince(start);
+      }
+      std::string used = tier ? "with the " + std::to_string(tier / 60000) + " min rollup" : "without rollup";
+
+      printf("  query %s (%zu buckets), all boxes: %.2f ms %s, %.2f ms from the blocks\n",
+             q.name, count, ms[1], used.c_str(), ms[0]);
+      if (sums[0].count != sums[1].count || fabs(sums[0].sum - sums[1].sum) > 1e-9 * fabs(sums[0].sum) ||
+          sums[0].min != sums[1].min || sums[0].max != sums[1].max || sums[0].last != sums[1].last) {
+         printf("  ROLLUP MISMATCH: %llu points, sum %f, expected %llu points, sum %f\n",
+                (unsigned long long) sums[1].count, sums[1].sum, (unsigned long long) sums[0].count, sums[0].sum);
+         return 1;
+      }
+   }
+
+   start = Clock::now();
+   total = Aggregate();
+   reopened.find("SolarWeatherBox/1", METRIC_TEMPERATURE)->scan(startMs, endMs, [&](int64_t, double value) {
+      decoded++;
+      total.sum += value;
+   });
+
+   double scanMs = msSince(start);
+
+   printf("  decode every point of one box: %.2f ms (%llu points, %.1f ns/point)\n",
+          scanMs, (unsigned long long) decoded, scanMs * 1e6 / std::max(decoded, (uint64_t) 1));
+
+   if (decoded != (uint64_t) points || fabs(total.sum - expectedSum) > 1e-6 * fabs(expectedSum)) {
+      printf("  DECODE MISMATCH: %llu points, sum %f, expected %ld points, sum %f\n",
+             (unsigned long long) decoded, total.sum, points, expectedSum);
+      return 1;
+   }
+
+   rusage usage;
+
+   getrusage(RUSAGE_SELF, &usage);
+   printf("  heap in use: %zu KB, max resident set (with the mapped files): %ld KB\n", mallinfo2().uordblks / 1024, usage.ru_maxrss);
+   if (!keep) {
+      command = std::string("rm -rf ") + root;
+      if (system(command.c_str()) != 0) {
+         fprintf(stderr, "Cannot remove %s\n", root);
+      }
+   } else {
+      printf("  kept %s\n", root);
+   }
+   return 0;
+}
@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TelemetryDecoder.h
+  *
+  * Decoder of the binary telemetry record of the boxes (Telemetry.h).
+  * It reads in place from the payload of the PUBLISH packet and allocates
+  * nothing: parse() checks the whole record and keeps the values of the
+  * wake, nextSample() then walks the stored readings, oldest first.
+  * Every input is safe, a damaged record is rejected as a whole.
+  */
+
+#pragma once
+
+#include "Telemetry.h"
+
+#include <string_view>
+
+/** Fixed point values of one point in time. */
+struct TelemetryPoint
+{
+   uint32_t timeSec;                       //!< Unix time, 0 = unknown.
+   uint32_t fieldMask;                     //!< Known fields with a value.
+   int32_t  values[TELEMETRY_FIELD_COUNT]; //!< Fixed point value per field.
+
+   bool   has(int field) const   { return fieldMask & (1u << field); }
+   double value(int field) const { return (double) values[field] / telemetryTable[field].scale; }
+};
+
+/**
+  * Parser of one record.
+  */
+class TelemetryDecoder
+{
+protected:
+   const uint8_t *first;       //!< First sample.
+   const uint8_t *next;        //!< Next sample of nextSample().
+   const uint8_t *end;         //!< End of the record.
+   uint32_t       sampleMask;  //!< Fields of the samples, also unknown ones.
+   int            remaining;   //!< Samples not read by nextSample().
+   TelemetryPoint sample;      //!< Last sample of nextSample().
+
+   bool readSample(const uint8_t *&p, TelemetryPoint &point, bool isFirst) const;
+
+public:
+   uint32_t       version;     //!< TELEMETRY_VERSION.
+   TelemetryPoint head;        //!< Values of the wake.
+   int            sampleCount; //!< Stored readings.
+
+   TelemetryDecoder() : first(NULL), next(NULL), end(NULL), sampleMask(0), remaining(0), version(0), sampleCount(0) { }
+
+   bool parse(std::string_view payload);
+   const TelemetryPoint *nextSample();
+};
+
+/* ******************************************** */
+
+/** Reads a varint of at most 32 bits, false at the end of the data or for a longer one. */
+inline bool telemetryGetVarint(const uint8_t *&p, const uint8_t *end, uint32_t &value)
+{
+   uint32_t result = 0;
+
+   for (int shift = 0; shift < 32; shift += 7) {
+      if (p >= end || (shift == 28 && *p > 0x0F)) {
+         return false;
+      }
+      result |= (uint32_t) (*p & 0x7F) << shift;
+      if (!(*p++ & 0x80)) {
+         value = result;
+         return true;
+      }
+   }
+   return false;
+}
+
+/** Reads one sample over the previous one in point. */
+inline bool TelemetryDecoder::readSample(const uint8_t *&p, TelemetryPoint &point, bool isFirst) const
+{
+   uint32_t delta;
+
+   if (!telemetryGetVarint(p, end, delta)) {
+      return false;
+   }
+   if (isFirst) {
+      if (delta > head.timeSec) {
+         return false;
+      }
+      point.timeSec = head.timeSec - delta;
+   } else {
+      if (delta > head.timeSec - point.timeSec) {
+         return false;
+      }
+      point.timeSec += delta;
+   }
+   for (int field = 0; field < 32; field++) {
+      uint32_t value;
+
+      if (!(sampleMask & (1u << field))) {
+         continue;
+      }
+      if (!telemetryGetVarint(p, end, value)) {
+         return false;
+      }
+      if (field < TELEMETRY_FIELD_COUNT) {
+         point.values[field] = (int32_t) ((uint32_t) point.values[field] + (uint32_t) telemetryUnzigzag(value));
+      }
+   }
+   return true;
+}
+
+/** Checks the record and reads the values of the wake. */
+inline bool TelemetryDecoder::parse(std::string_view payload)
+{
+   const uint8_t *p = (const uint8_t *) payload.data();
+   uint32_t       fieldMask;
+   uint32_t       count;
+
+   end       = p + payload.size();
+   remaining = 0;
+   if (!telemetryGetVarint(p, end, version) || version != TELEMETRY_VERSION ||
+       !telemetryGetVarint(p, end, fieldMask) || !telemetryGetVarint(p, end, head.timeSec)) {
+      return false;
+   }
+   head.fieldMask = fieldMask & ((1u << TELEMETRY_FIELD_COUNT) - 1);
+   for (int field = 0; field < 32; field++) {
+      uint32_t value;
+
+      if (!(fieldMask & (1u << field))) {
+         if (field < TELEMETRY_FIELD_COUNT) {
+            head.values[field] = 0;
+         }
+         continue;
+      }
+      if (!telemetryGetVarint(p, end, value)) {
+         return false;
+      }
+      if (field < TELEMETRY_FIELD_COUNT) {
+         head.values[field] = telemetryUnzigzag(value);
+      }
+   }
+   if (!telemetryGetVarint(p, end, count)) {
+      return false;
+   }
+   sampleMask = 0;
+   if (count && (!head.timeSec || !telemetryGetVarint(p, end, sampleMask))) {
+      return false;
+   }
+
+   // Every sample has at least one byte, so the count is bounded by the payload.
+   TelemetryPoint point = head;
+
+   first = p;
+   for (uint32_t i = 0; i < count; i++) {
+      if (!readSample(p, point, i == 0)) {
+         return false;
+      }
+   }
+   if (p != end) {
+      return false;
+   }
+   sampleCount      = count;
+   remaining        = count;
+   next             = first;
+   sample           = head;
+   sample.fieldMask = sampleMask & ((1u << TELEMETRY_FIELD_COUNT) - 1);
+   return true;
+}
+
+/** The next stored reading or NULL after the last one. */
+inline const TelemetryPoint *TelemetryDecoder::nextSample()
+{
+   if (remaining <= 0) {
+      return NULL;
+   }
+   readSample(next, sample, remaining-- == sampleCount);
+   return &sample;
+}
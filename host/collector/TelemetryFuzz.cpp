@@ -0,0 +1,284 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TelemetryFuzz.cpp
+  *
+  * Fuzzer of the telemetry decoder, built with the address and undefined
+  * behaviour sanitizers. Every round encodes a random record on a random
+  * buffer size, checks that the decoder returns exactly the encoded values
+  * and then feeds -m mutations of it (bit flips, cuts, inserted and removed
+  * bytes, splices with the previous record, random bytes) to the decoder,
+  * which has to reject or accept them without touching memory outside of
+  * the payload. Files as arguments are decoded once instead (crash inputs).
+  * With -DTELEMETRY_FUZZ_LIBFUZZER the file only provides the entry point
+  * LLVMFuzzerTestOneInput for clang -fsanitize=fuzzer.
+  *
+  *   telemetryfuzz [-n rounds] [-m mutations] [-s seed] [file...]
+  */
+
+#include "TelemetryDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#ifndef TELEMETRY_FUZZ_LIBFUZZER
+#include <unistd.h>
+#endif
+
+/** Stops with the reason, the sanitizers print their own reports. */
+static void fuzzFail(const char *what, const uint8_t *data, size_t size)
+{
+   fprintf(stderr, "FAILED: %s, input", what);
+   for (size_t i = 0; i < size; i++) {
+      fprintf(stderr, " %02x", data[i]);
+   }
+   fprintf(stderr, "\n");
+   abort();
+}
+
+/** Decodes any input and checks what a valid record promises. */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+   // Copy to an exact heap block, so ASan sees every read past the end.
+   std::vector<uint8_t>  copy(data, data + size);
+   const uint8_t        *payload = copy.empty() ? NULL : copy.data();
+   TelemetryDecoder      decoder;
+   const TelemetryPoint *sample;
+   uint32_t              lastSec = 0;
+   int                   count   = 0;
+
+   if (!decoder.parse(std::string_view((const char *) payload, size))) {
+      return 0;
+   }
+   if (decoder.version != TELEMETRY_VERSION || decoder.sampleCount < 0 || (size_t) decoder.sampleCount > size) {
+      fuzzFail("header", data, size);
+   }
+   while ((sample = decoder.nextSample()) != NULL) {
+      if (sample->timeSec > decoder.head.timeSec || sample->timeSec < lastSec) {
+         fuzzFail("sample time order", data, size);
+      }
+      if (sample->fieldMask & ~((1u << TELEMETRY_FIELD_COUNT) - 1)) {
+         fuzzFail("sample fields", data, size);
+      }
+      lastSec = sample->timeSec;
+      count++;
+   }
+   if (count != decoder.sampleCount) {
+      fuzzFail("sample count", data, size);
+   }
+   return 0;
+}
+
+#ifndef TELEMETRY_FUZZ_LIBFUZZER
+
+static uint64_t fuzzState = 1; //!< xorshift state.
+
+static uint64_t fuzzRandom()
+{
+   fuzzState ^= fuzzState << 13;
+   fuzzState ^= fuzzState >> 7;
+   fuzzState ^= fuzzState << 17;
+   return fuzzState;
+}
+
+/** Mostly realistic values, sometimes the extremes of the fixed point range. */
+static double fuzzValue(int field)
+{
+   switch (fuzzRandom() % 8) {
+      case 0:  return 1e12;
+      case 1:  return -1e12;
+      case 2:  return (double) (int32_t) fuzzRandom();
+      case 3:  return 0.0;
+      default: return ((int64_t) (fuzzRandom() % 200000) - 100000) / (double) telemetryTable[field].scale;
+   }
+}
+
+/** Encodes a random record into out, false if the decoder does not return the same values. */
+static bool fuzzRoundTrip(std::vector<uint8_t> &out)
+{
+   uint32_t         timeSec = fuzzRandom() % 4 ? (uint32_t) fuzzRandom() : 0;
+   TelemetryEncoder encoder(timeSec);
+   int32_t          expected[TELEMETRY_FIELD_COUNT];
+   uint32_t         fieldMask = fuzzRandom() % 3 ? (1u << TELEMETRY_FIELD_COUNT) - 1 : (uint32_t) fuzzRandom() & ((1u << TELEMETRY_FIELD_COUNT) - 1);
+   TelemetrySample  samples[TELEMETRY_BACKLOG * 2];
+   int              sampleCount = fuzzRandom() % (TELEMETRY_BACKLOG * 2 + 1);
+   bool             ordered     = fuzzRandom() % 8 != 0;
+   uint8_t          buffer[TELEMETRY_MAX_SIZE * 2];
+   size_t           size        = fuzzRandom() % 2 ? sizeof(buffer) : fuzzRandom() % sizeof(buffer);
+   size_t           length;
+   int              sent        = -1;
+
+   for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+      if (fieldMask & (1u << field)) {
+         double value = fuzzValue(field);
+
+         encoder.set(field, value);
+         expected[field] = telemetryFixed(field, value);
+      }
+   }
+   for (int i = 0; i < sampleCount; i++) {
+      uint32_t sec = ordered ? timeSec - (uint32_t) ((sampleCount - i) * (fuzzRandom() % 4000)) : (uint32_t) fuzzRandom();
+
+      if (ordered && i && sec < samples[i - 1].timeSec) {
+         sec = samples[i - 1].timeSec;
+      }
+      samples[i] = telemetrySample(sec, fuzzValue(TELEMETRY_TEMPERATURE), fuzzValue(TELEMETRY_HUMIDITY),
+                                   fuzzValue(TELEMETRY_PRESSURE), fuzzValue(TELEMETRY_VOLTAGE));
+   }
+   encoder.setSamples(samples, sampleCount);
+   length = encoder.encode(buffer, size, &sent);
+   out.assign(buffer, buffer + length);
+   if (!length) {
+      // Only a buffer below the shortest record (no samples) may be too small.
+      return size < TELEMETRY_VARINT_SIZE * (3 + TELEMETRY_FIELD_COUNT + 1);
+   }
+   if (length > size || sent < 0 || sent > sampleCount) {
+      return false;
+   }
+
+   TelemetryDecoder      decoder;
+   const TelemetryPoint *sample;
+
+   if (!decoder.parse(std::string_view((const char *) buffer, length)) ||
+       decoder.head.timeSec != timeSec || decoder.head.fieldMask != fieldMask || decoder.sampleCount != sent) {
+      return false;
+   }
+   for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+      if (decoder.head.has(field) && decoder.head.values[field] != expected[field]) {
+         return false;
+      }
+   }
+   for (int i = sampleCount - sent; i < sampleCount; i++) {
+      if ((sample = decoder.nextSample()) == NULL || sample->timeSec != samples[i].timeSec ||
+          sample->fieldMask != TELEMETRY_SAMPLE_MASK) {
+         return false;
+      }
+      for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+         if (sample->has(field) && sample->values[field] != telemetrySampleValue(samples[i], field)) {
+            return false;
+         }
+      }
+   }
+   return decoder.nextSample() == NULL;
+}
+
+/** A random change of a valid record. */
+static std::vector<uint8_t> fuzzMutate(const std::vector<uint8_t> &record, const std::vector<uint8_t> &other)
+{
+   std::vector<uint8_t> data = record;
+   size_t               pos  = data.empty() ? 0 : fuzzRandom() % data.size();
+
+   switch (fuzzRandom() % 6) {
+      case 0:
+         if (!data.empty()) data[pos] ^= 1 << (fuzzRandom() % 8);
+         break;
+      case 1:
+         data.resize(pos);
+         break;
+      case 2:
+         data.insert(data.begin() + pos, (uint8_t) fuzzRandom());
+         break;
+      case 3:
+         if (!data.empty()) data.erase(data.begin() + pos);
+         break;
+      case 4:
+         data.resize(pos);
+         data.insert(data.end(), other.begin() + (other.empty() ? 0 : fuzzRandom() % other.size()), other.end());
+         break;
+      default:
+         for (size_t i = 0, n = fuzzRandom() % 4 + 1; i < n && !data.empty(); i++) {
+            data[fuzzRandom() % data.size()] = (uint8_t) fuzzRandom();
+         }
+         break;
+   }
+   return data;
+}
+
+/** Decodes a file once. */
+static int fuzzFile(const char *name)
+{
+   FILE                *file = fopen(name, "rb");
+   std::vector<uint8_t> data;
+   int                  c;
+
+   if (!file) {
+      perror(name);
+      return 1;
+   }
+   while ((c = fgetc(file)) != EOF) {
+      data.push_back(c);
+   }
+   fclose(file);
+   LLVMFuzzerTestOneInput(data.data(), data.size());
+   printf("%s: %zu bytes ok\n", name, data.size());
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   long                 rounds    = 200000;
+   int                  mutations = 20;
+   uint64_t             seed      = 1;
+   std::vector<uint8_t> record;
+   std::vector<uint8_t> previous;
+   long                 accepted  = 0;
+   long                 inputs    = 0;
+   int                  opt;
+
+   while ((opt = getopt(argc, argv, "n:m:s:")) != -1) {
+      switch (opt) {
+         case 'n': rounds    = atol(optarg);                 break;
+         case 'm': mutations = atoi(optarg);                 break;
+         case 's': seed      = strtoull(optarg, NULL, 10);   break;
+         default:
+            fprintf(stderr, "usage: %s [-n rounds] [-m mutations] [-s seed] [file...]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (optind < argc) {
+      int result = 0;
+
+      for (int i = optind; i < argc; i++) {
+         result |= fuzzFile(argv[i]);
+      }
+      return result;
+   }
+   fuzzState = seed ? seed : 1;
+   for (long round = 0; round < rounds; round++) {
+      if (!fuzzRoundTrip(record)) {
+         fuzzFail("round trip", record.data(), record.size());
+      }
+      for (int i = 0; i < mutations; i++) {
+         std::vector<uint8_t> data = fuzzMutate(record, previous);
+         TelemetryDecoder     decoder;
+
+         accepted += decoder.parse(std::string_view((const char *) data.data(), data.size()));
+         LLVMFuzzerTestOneInput(data.data(), data.size());
+         inputs++;
+      }
+      if (!record.empty()) {
+         previous = record;
+      }
+   }
+   printf("%ld round trips ok, %ld mutated records decoded (%.1f%% accepted), seed %llu\n",
+          rounds, inputs, inputs ? accepted * 100.0 / inputs : 0.0, (unsigned long long) seed);
+   return 0;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimerWheel.h
+  *
+  * Hierarchical timer wheel with one second resolution: four levels of
+  * 256 slots (256 s, 18 h, 194 days, 136 years). A timer is an index into
+  * the node array and lives in the doubly linked list of its slot, so
+  * schedule() and cancel() are O(1). advance() expires the level 0 slot of
+  * every second and moves the timers of a higher level slot one level down
+  * when the lower level wraps, as in the Linux kernel timers.
+  */
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#define WHEEL_BITS   8                    //!< Slots per level as power of two.
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)    //!< Slots per level.
+#define WHEEL_LEVELS 4                    //!< Levels.
+#define WHEEL_NONE   UINT32_MAX           //!< End of a list, not scheduled.
+
+/**
+  * Timers 0..n-1 with deadlines in seconds.
+  */
+class TimerWheel
+{
+protected:
+   /** List links of one timer. */
+   struct Node
+   {
+      uint32_t next;        //!< Next timer of the slot.
+      uint32_t prev;        //!< Previous timer of the slot.
+      uint32_t slot;        //!< Slot (level * WHEEL_SLOTS + index) or WHEEL_NONE.
+      int64_t  deadlineSec; //!< Expiry.
+   };
+
+   std::vector<Node>     nodes;                             //!< By timer.
+   uint32_t              heads[WHEEL_LEVELS * WHEEL_SLOTS]; //!< First timer per slot.
+   int64_t               nowSec;                            //!< Next second to expire.
+   std::vector<uint32_t> moved;                             //!< Scratch of cascade() and advance().
+
+   void link(uint32_t timer);
+   void cascade(int level);
+
+public:
+   explicit TimerWheel(int64_t startSec);
+
+   void    schedule(uint32_t timer, int64_t deadlineSec);
+   void    cancel(uint32_t timer);
+   bool    scheduled(uint32_t timer) const { return timer < nodes.size() && nodes[timer].slot != WHEEL_NONE; }
+   int64_t now() const { return nowSec; }
+
+   template <typename Fn> void advance(int64_t toSec, Fn fn);
+};
+
+/* ******************************************** */
+
+inline TimerWheel::TimerWheel(int64_t startSec)
+   : nowSec(startSec)
+{
+   for (uint32_t &head : heads) {
+      head = WHEEL_NONE;
+   }
+}
+
+/** Puts the timer into the slot of its deadline relative to now. */
+inline void TimerWheel::link(uint32_t timer)
+{
+   Node    &node  = nodes[timer];
+   int64_t  delta = node.deadlineSec - nowSec;
+   int      level = 0;
+
+   if (delta < 0) {
+      node.deadlineSec = nowSec;
+      delta            = 0;
+   }
+   while (level < WHEEL_LEVELS - 1 && delta >= (1LL << (WHEEL_BITS * (level + 1)))) {
+      level++;
+   }
+   if (delta >= (1LL << (WHEEL_BITS * WHEEL_LEVELS))) {
+      node.deadlineSec = nowSec + (1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+   }
+
+   uint32_t slot = level * WHEEL_SLOTS + ((node.deadlineSec >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+
+   node.slot = slot;
+   node.prev = WHEEL_NONE;
+   node.next = heads[slot];
+   if (node.next != WHEEL_NONE) {
+      nodes[node.next].prev = timer;
+   }
+   heads[slot] = timer;
+}
+
+/** (Re)schedules a timer, grows the node array for new timers. */
+inline void TimerWheel::schedule(uint32_t timer, int64_t deadlineSec)
+{
+   if (timer >= nodes.size()) {
+      nodes.resize(timer + 1, Node { WHEEL_NONE, WHEEL_NONE, WHEEL_NONE, 0 });
+   }
+   cancel(timer);
+   nodes[timer].deadlineSec = deadlineSec;
+   link(timer);
+}
+
+inline void TimerWheel::cancel(uint32_t timer)
+{
+   if (!scheduled(timer)) {
+      return;
+   }
+
+   Node &node = nodes[timer];
+
+   if (node.prev != WHEEL_NONE) {
+      nodes[node.prev].next = node.next;
+   } else {
+      heads[node.slot] = node.next;
+   }
+   if (node.next != WHEEL_NONE) {
+      nodes[node.next].prev = node.prev;
+   }
+   node.slot = WHEEL_NONE;
+}
+
+/** Moves the timers of the current slot of a level to the lower levels. */
+inline void TimerWheel::cascade(int level)
+{
+   uint32_t slot = level * WHEEL_SLOTS + ((nowSec >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+
+   moved.clear();
+   for (uint32_t timer = heads[slot]; timer != WHEEL_NONE; timer = nodes[timer].next) {
+      moved.push_back(timer);
+   }
+   heads[slot] = WHEEL_NONE;
+   for (uint32_t timer : moved) {
+      link(timer);
+   }
+}
+
+/** Expires the timers up to and including toSec, fn(timer) for each. fn may reschedule the timer. */
+template <typename Fn>
+void TimerWheel::advance(int64_t toSec, Fn fn)
+{
+   while (nowSec <= toSec) {
+      int index = nowSec & (WHEEL_SLOTS - 1);
+
+      for (int level = 1; level < WHEEL_LEVELS && ((nowSec >> (WHEEL_BITS * (level - 1))) & (WHEEL_SLOTS - 1)) == 0; level++) {
+         cascade(level);
+      }
+      moved.clear();
+      for (uint32_t timer = heads[index]; timer != WHEEL_NONE; timer = nodes[timer].next) {
+         nodes[timer].slot = WHEEL_NONE;
+         moved.push_back(timer);
+      }
+      heads[index] = WHEEL_NONE;
+      // A timer rescheduled by fn for now goes into the next second.
+      nowSec++;
+      for (size_t i = 0; i < moved.size(); i++) {
+         fn(moved[i]);
+      }
+   }
+}
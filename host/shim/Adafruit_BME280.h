@@ -0,0 +1,48 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Adafruit_BME280.h
+  *
+  * Host replacement of the BME280 driver. The values come from the HostRuntime sensor hook.
+  */
+
+#pragma once
+
+#include <Arduino.h>
+
+/**
+  * Scripted BME280 sensor.
+  */
+class Adafruit_BME280
+{
+protected:
+   float temperature; //!< Last read temperature in degree.
+   float humidity;    //!< Last read humidity in percent.
+   float pressure;    //!< Last read pressure in Pa.
+
+public:
+   Adafruit_BME280() : temperature(0), humidity(0), pressure(0) { }
+
+   bool begin(uint8_t addr = 0x77)
+   {
+      (void) addr;
+      return HostRuntime::get().bme280(temperature, humidity, pressure);
+   }
+   float readTemperature() { return temperature; }
+   float readHumidity()    { return humidity; }
+   float readPressure()    { return pressure; }
+};
@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Arduino.h
+  *
+  * Minimal Arduino/ESP8266 core replacement for the host build.
+  * Only the functions and classes the firmware uses are available.
+  */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+using std::isnan;
+using std::isinf;
+#include <ctime>
+#include <algorithm>
+#include <functional>
+
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+using std::min;
+using std::max;
+
+template <typename T, typename L, typename H> inline T constrain(T v, L lo, H hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+#define PROGMEM
+#define PGM_P                    const char *
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PSTR(s)                  (s)
+#define pgm_read_byte(addr)      (*(const uint8_t  *)(addr))
+#define pgm_read_word(addr)      (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)     (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)       (*(const void * const *)(addr))
+#define memcpy_P                 memcpy
+#define strlen_P                 strlen
+#define strcmp_P                 strcmp
+#define strncmp_P                strncmp
+#define strncpy_P                strncpy
+#define sprintf_P                sprintf
+#define snprintf_P               snprintf
+
+#define RANDOM_REG32             ((uint32_t) rand()) // Hardware random number register
+
+#define INPUT  0x00
+#define OUTPUT 0x01
+#define LOW    0x00
+#define HIGH   0x01
+
+#define DEC 10
+#define HEX 16
+
+#define A0 17
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+/**
+  * Hooks of the host runtime. The default implementation works with the
+  * real clock, the simulator replaces them with a virtual clock and
+  * scripted sensors.
+  */
+struct HostRuntime
+{
+   unsigned long (*millis)();                    //!< Milliseconds since the last (virtual) boot.
+   unsigned long (*micros)();                    //!< Microseconds since the last (virtual) boot.
+   void          (*delay)(unsigned long ms);     //!< Wait or advance the virtual clock.
+   int           (*analogRead)(uint8_t pin);     //!< ADC reading.
+   bool          (*bme280)(float &temperature, float &humidity, float &pressure); //!< BME280 reading.
+   void          (*deepSleep)(uint64_t us);      //!< Emulated deep sleep; does not return.
+   void          (*restart)();                   //!< Emulated restart; does not return.
+
+   static HostRuntime &get();
+};
+
+inline unsigned long millis()                  { return HostRuntime::get().millis(); }
+inline unsigned long micros()                  { return HostRuntime::get().micros(); }
+inline void          delay(unsigned long ms)   { HostRuntime::get().delay(ms); }
+inline void          delayMicroseconds(unsigned int) { }
+inline void          yield()                   { }
+inline void          pinMode(uint8_t, uint8_t) { }
+inline void          digitalWrite(uint8_t, uint8_t) { }
+inline int           digitalRead(uint8_t)      { return LOW; }
+inline int           analogRead(uint8_t pin)   { return HostRuntime::get().analogRead(pin); }
+
+#include "Print.h"
+#include "Esp.h"
+
+inline char *ltoa(long value, char *result, int base) { if (base == 10) { sprintf(result, "%ld", value); } else { sprintf(result, "%lx", value); } return result; }
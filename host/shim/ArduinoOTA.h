@@ -0,0 +1,51 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ArduinoOTA.h
+  *
+  * Host replacement of the OTA update (does nothing).
+  */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+typedef enum {
+   OTA_AUTH_ERROR,
+   OTA_BEGIN_ERROR,
+   OTA_CONNECT_ERROR,
+   OTA_RECEIVE_ERROR,
+   OTA_END_ERROR
+} ota_error_t;
+
+/**
+  * OTA replacement.
+  */
+class ArduinoOTAClass
+{
+public:
+   void setHostname(const char *) { }
+   void setPort(uint16_t) { }
+   void onStart(std::function<void(void)>) { }
+   void onEnd(std::function<void(void)>) { }
+   void onProgress(std::function<void(unsigned int, unsigned int)>) { }
+   void onError(std::function<void(ota_error_t)>) { }
+   void begin() { }
+   void handle() { }
+};
+
+extern ArduinoOTAClass ArduinoOTA;
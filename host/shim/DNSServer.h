@@ -0,0 +1,39 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file DNSServer.h
+  *
+  * Host replacement of the captive portal DNS server (does nothing).
+  */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+enum class DNSReplyCode { NoError = 0, FormError = 1, ServerFailure = 2, NonExistentDomain = 3 };
+
+/**
+  * DNS server replacement.
+  */
+class DNSServer
+{
+public:
+   void setErrorReplyCode(const DNSReplyCode &) { }
+   bool start(const uint16_t &, const String &, const IPAddress &) { return true; }
+   void processNextRequest() { }
+   void stop() { }
+};
@@ -0,0 +1,199 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ESP8266WebServer.h
+  *
+  * Host replacement of the synchronous ESP8266WebServer.
+  * Handles one client per handleClient() call like the original and
+  * closes the connection after every request.
+  */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <FS.h>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+#define CONTENT_LENGTH_NOT_SET ((size_t) -2)
+
+/**
+  * Synchronous web server with the API subset the firmware uses.
+  */
+class ESP8266WebServer
+{
+public:
+   typedef std::function<void(void)> THandlerFunction;
+
+protected:
+   struct Route {
+      String           uri;
+      HTTPMethod       method;
+      THandlerFunction fn;
+   };
+   struct Pair {
+      String name;
+      String value;
+   };
+
+   WiFiServer         _server;           //!< Listening socket.
+   WiFiClient         _currentClient;    //!< Client of the current request.
+   HTTPMethod         _currentMethod;    //!< Method of the current request.
+   String             _currentUri;       //!< Uri of the current request.
+   std::vector<Route> _routes;           //!< Registered handlers.
+   THandlerFunction   _notFoundHandler;  //!< Handler for unknown uris.
+   std::vector<Pair>  _args;             //!< Query and form arguments.
+   std::vector<Pair>  _headers;          //!< Collected request headers.
+   std::vector<String> _collectHeaders;  //!< Header names to collect.
+   String             _responseHeaders;  //!< Headers for the next response.
+   size_t             _contentLength;    //!< Content length of the next response.
+   bool               _chunked;          //!< Current response is chunked.
+
+public:
+   ESP8266WebServer(int port = 80) : _server(port), _currentMethod(HTTP_ANY), _contentLength(CONTENT_LENGTH_NOT_SET), _chunked(false) { }
+   virtual ~ESP8266WebServer() { }
+
+   void begin()                                                    { _server.begin(); }
+   void close()                                                    { _server.close(); }
+   void stop()                                                     { close(); }
+   void on(const String &uri, THandlerFunction fn)                 { on(uri, HTTP_ANY, fn); }
+   void on(const String &uri, HTTPMethod method, THandlerFunction fn) { _routes.push_back({ uri, method, fn }); }
+   void onNotFound(THandlerFunction fn)                            { _notFoundHandler = fn; }
+
+   String     uri()               { return _currentUri; }
+   HTTPMethod method()            { return _currentMethod; }
+   WiFiClient &client()           { return _currentClient; }
+
+   String arg(const String &name)
+   {
+      for (auto &a : _args) {
+         if (a.name == name) {
+            return a.value;
+         }
+      }
+      return String();
+   }
+   String arg(int i)              { return i < (int) _args.size() ? _args[i].value : String(); }
+   String argName(int i)          { return i < (int) _args.size() ? _args[i].name  : String(); }
+   int    args()                  { return (int) _args.size(); }
+   bool   hasArg(const String &name)
+   {
+      for (auto &a : _args) {
+         if (a.name == name) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   void collectHeaders(const char *headerKeys[], const size_t count)
+   {
+      _collectHeaders.clear();
+      for (size_t i = 0; i < count; i++) {
+         _collectHeaders.push_back(headerKeys[i]);
+      }
+   }
+   String header(const String &name)
+   {
+      for (auto &h : _headers) {
+         if (h.name.equalsIgnoreCase(name)) {
+            return h.value;
+         }
+      }
+      return String();
+   }
+   bool hasHeader(const String &name)
+   {
+      for (auto &h : _headers) {
+         if (h.name.equalsIgnoreCase(name)) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   void sendHeader(const String &name, const String &value, bool first = false)
+   {
+      String line = name + F(": ") + value + F("\r\n");
+
+      if (first) {
+         _responseHeaders = line + _responseHeaders;
+      } else {
+         _responseHeaders += line;
+      }
+   }
+   void setContentLength(const size_t contentLength) { _contentLength = contentLength; }
+
+   void send(int code, const char *contentType, const String &content)     { sendResponse(code, contentType, content.c_str(), content.length()); }
+   void send(int code, const String &contentType, const String &content)   { sendResponse(code, contentType.c_str(), content.c_str(), content.length()); }
+   void send(int code, const __FlashStringHelper *contentType, const String &content) { sendResponse(code, (const char *) contentType, content.c_str(), content.length()); }
+   void send(int code, const char *contentType, const char *content)       { sendResponse(code, contentType, content, strlen(content)); }
+   void send(int code, const __FlashStringHelper *contentType, const char *content) { sendResponse(code, (const char *) contentType, content, strlen(content)); }
+   void send(int code)                                                     { sendResponse(code, "text/html", "", 0); }
+   void send_P(int code, const char * contentType, const char * content, size_t length)  { sendResponse(code, contentType, content, length); }
+
+   void sendContent(const String &content)                { sendContent(content.c_str(), content.length()); }
+   void sendContent_P(const char * content)                      { sendContent(content, strlen(content)); }
+   void sendContent_P(const char * content, size_t size)         { sendContent(content, size); }
+   void sendContent(const char *content, size_t size)
+   {
+      if (_chunked) {
+         char len[24];
+
+         if (size == 0) {
+            return;
+         }
+         snprintf(len, sizeof(len), "%zx\r\n", size);
+         _currentClient.write(len);
+         _currentClient.write(content, size);
+         _currentClient.write("\r\n");
+      } else {
+         _currentClient.write(content, size);
+      }
+   }
+
+   template <typename T> size_t streamFile(T &file, const String &contentType)
+   {
+      String type = contentType;
+
+      if (String(file.name()).endsWith(F(".gz")) && type != F("application/x-gzip") && type != F("application/octet-stream")) {
+         sendHeader(F("Content-Encoding"), F("gzip"));
+      }
+      setContentLength(file.size());
+      sendResponse(200, type.c_str(), NULL, 0);
+
+      uint8_t buf[1024];
+      size_t  sent = 0;
+
+      for (size_t n; (n = file.read(buf, sizeof(buf))) > 0; ) {
+         sent += _currentClient.write(buf, n);
+      }
+      return sent;
+   }
+
+   void handleClient();
+
+protected:
+   void sendResponse(int code, const char *contentType, const char *content, size_t length);
+   void finishResponse();
+   bool parseRequest(WiFiClient &client);
+   void parseArguments(const String &data);
+   static String urlDecode(const String &text);
+   static const char *responseCodeToString(int code);
+};
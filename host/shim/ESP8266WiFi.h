@@ -0,0 +1,232 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ESP8266WiFi.h
+  *
+  * Host replacement of the ESP8266 WiFi classes.
+  * WiFi association, client connections and servers are delegated to the
+  * HostNetwork which uses the host sockets by default and can be replaced
+  * by the simulator.
+  */
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+typedef enum WiFiMode { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+typedef enum {
+   WL_NO_SHIELD       = 255,
+   WL_IDLE_STATUS     = 0,
+   WL_NO_SSID_AVAIL   = 1,
+   WL_SCAN_COMPLETED  = 2,
+   WL_CONNECTED       = 3,
+   WL_CONNECT_FAILED  = 4,
+   WL_CONNECTION_LOST = 5,
+   WL_DISCONNECTED    = 6
+} wl_status_t;
+
+/**
+  * IPv4 address.
+  */
+class IPAddress
+{
+protected:
+   uint8_t bytes[4]; //!< Address in network order.
+
+public:
+   IPAddress() : bytes() { }
+   IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d; }
+
+   uint8_t  operator [] (int idx) const { return bytes[idx]; }
+   uint8_t &operator [] (int idx)       { return bytes[idx]; }
+   bool     operator == (const IPAddress &o) const { return memcmp(bytes, o.bytes, 4) == 0; }
+   bool     isSet() const { return bytes[0] || bytes[1] || bytes[2] || bytes[3]; }
+
+   String toString() const
+   {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+      return buf;
+   }
+};
+
+/**
+  * One TCP connection. Shared between the WiFiClient copies like the
+  * ClientContext of the ESP8266 core.
+  */
+class HostConnection
+{
+public:
+   virtual ~HostConnection() { }
+
+   virtual int    available() = 0;
+   virtual int    read(uint8_t *buf, size_t size) = 0;
+   virtual int    peek() = 0;
+   virtual size_t write(const uint8_t *buf, size_t size) = 0;
+   virtual size_t availableForWrite() = 0;
+   virtual bool   connected() = 0;
+   virtual void   close() = 0;
+   virtual IPAddress remoteIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+/**
+  * Listening socket of a WiFiServer.
+  */
+class HostListener
+{
+public:
+   virtual ~HostListener() { }
+
+   virtual std::shared_ptr<HostConnection> accept() = 0;
+   virtual void close() = 0;
+};
+
+/**
+  * Network environment of the host build: WiFi association and TCP.
+  */
+class HostNetwork
+{
+public:
+   virtual ~HostNetwork() { }
+
+   virtual void        wifiBegin(const char *ssid, const char *password) { (void) ssid; (void) password; }
+   virtual wl_status_t wifiStatus()                                      { return WL_CONNECTED; }
+   virtual void        wifiMode(WiFiMode_t mode)                         { (void) mode; }
+   virtual int32_t     wifiRSSI()                                        { return -60; }
+
+   virtual std::shared_ptr<HostConnection> connect(const char *host, uint16_t port);
+   virtual std::shared_ptr<HostListener>   listen(uint16_t port);
+
+   static HostNetwork *&current();
+   static HostNetwork &get() { return *current(); }
+};
+
+/**
+  * Arduino Client interface.
+  */
+class Client : public Stream
+{
+public:
+   virtual int    connect(IPAddress ip, uint16_t port) = 0;
+   virtual int    connect(const char *host, uint16_t port) = 0;
+   virtual size_t write(uint8_t c) = 0;
+   virtual size_t write(const uint8_t *buf, size_t size) = 0;
+   virtual int    available() = 0;
+   virtual int    read() = 0;
+   virtual int    read(uint8_t *buf, size_t size) = 0;
+   virtual int    peek() = 0;
+   virtual void   flush() = 0;
+   virtual void   stop() = 0;
+   virtual uint8_t connected() = 0;
+   virtual explicit operator bool() = 0;
+   using Print::write;
+};
+
+/**
+  * TCP client.
+  */
+class WiFiClient : public Client
+{
+protected:
+   std::shared_ptr<HostConnection> conn; //!< Shared connection.
+
+public:
+   WiFiClient() { }
+   WiFiClient(std::shared_ptr<HostConnection> c) : conn(c) { }
+
+   virtual int connect(IPAddress ip, uint16_t port) { return connect(ip.toString().c_str(), port); }
+   virtual int connect(const char *host, uint16_t port)
+   {
+      conn = HostNetwork::get().connect(host, port);
+      return conn && conn->connected() ? 1 : 0;
+   }
+   virtual size_t  write(uint8_t c)                       { return write(&c, 1); }
+   virtual size_t  write(const uint8_t *buf, size_t size) { return conn ? conn->write(buf, size) : 0; }
+   using Client::write;
+   size_t          write_P(const char *buf, size_t size)  { return write((const uint8_t *) buf, size); }
+   virtual int     available()                            { return conn ? conn->available() : 0; }
+   virtual int     read()                                 { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+   virtual int     read(uint8_t *buf, size_t size)        { return conn ? conn->read(buf, size) : -1; }
+   virtual int     peek()                                 { return conn ? conn->peek() : -1; }
+   virtual void    flush()                                { }
+   virtual void    stop()                                 { if (conn) conn->close(); conn.reset(); }
+   virtual uint8_t connected()                            { return conn && (conn->connected() || conn->available()); }
+   virtual explicit operator bool()                       { return conn != NULL; }
+   size_t          availableForWrite()                    { return conn ? conn->availableForWrite() : 0; }
+   IPAddress       remoteIP()                             { return conn ? conn->remoteIP() : IPAddress(); }
+   void            setNoDelay(bool)                       { }
+   void            setSync(bool)                          { }
+   void            setTimeout(unsigned long)              { }
+};
+
+/**
+  * TCP server.
+  */
+class WiFiServer
+{
+protected:
+   uint16_t                      port;     //!< Listening port.
+   std::shared_ptr<HostListener> listener; //!< Listening socket.
+
+public:
+   WiFiServer(uint16_t p) : port(p) { }
+
+   void       begin()            { listener = HostNetwork::get().listen(port); }
+   void       begin(uint16_t p)  { port = p; begin(); }
+   void       close()            { if (listener) listener->close(); listener.reset(); }
+   void       stop()             { close(); }
+   void       setNoDelay(bool)   { }
+   WiFiClient available()        { return listener ? WiFiClient(listener->accept()) : WiFiClient(); }
+   WiFiClient accept()           { return available(); }
+};
+
+/**
+  * WiFi replacement.
+  */
+class ESP8266WiFiClass
+{
+protected:
+   WiFiMode_t mode_;      //!< Current mode.
+   IPAddress  softAPIP_;  //!< Configured soft AP address.
+
+public:
+   ESP8266WiFiClass() : mode_(WIFI_OFF) { }
+
+   bool       mode(WiFiMode_t m)                        { mode_ = m; HostNetwork::get().wifiMode(m); return true; }
+   WiFiMode_t getMode()                                 { return mode_; }
+   bool       softAP(const char *, const char * = NULL) { return true; }
+   bool       softAPConfig(IPAddress local, IPAddress, IPAddress) { softAPIP_ = local; return true; }
+   IPAddress  softAPIP()                                { return softAPIP_; }
+   String     softAPmacAddress()                        { return F("5E:CF:7F:00:00:01"); }
+   wl_status_t begin(const char *ssid, const char *password = NULL) { HostNetwork::get().wifiBegin(ssid, password); return status(); }
+   wl_status_t status()                                 { return (mode_ & WIFI_STA) ? HostNetwork::get().wifiStatus() : WL_DISCONNECTED; }
+   bool       isConnected()                             { return status() == WL_CONNECTED; }
+   IPAddress  localIP()                                 { return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress(); }
+   int32_t    RSSI()                                    { return status() == WL_CONNECTED ? HostNetwork::get().wifiRSSI() : 31; }
+   bool       disconnect(bool = false)                  { HostNetwork::get().wifiBegin(NULL, NULL); return true; }
+   bool       forceSleepWake()                          { return true; }
+   bool       forceSleepBegin()                         { mode(WIFI_OFF); return true; }
+   void       persistent(bool)                          { }
+   bool       hostByName(const char *, IPAddress &ip)   { ip = IPAddress(127, 0, 0, 1); return true; }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+/** SNTP start. The host clock is always synchronized. */
+inline void configTime(int, int, const char *, const char * = NULL, const char * = NULL) { }
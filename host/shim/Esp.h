@@ -0,0 +1,83 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Esp.h
+  *
+  * Host replacement of the ESP class with the RTC user memory and the heap information.
+  */
+
+#pragma once
+
+#define RTC_USER_MEMORY_SIZE 512 //!< Size of the ESP8266 RTC user memory.
+
+enum RFMode { RF_DEFAULT = 0, RF_CAL = 1, RF_NO_CAL = 2, RF_DISABLED = 4 };
+
+#define WAKE_RF_DEFAULT  RF_DEFAULT
+#define WAKE_RFCAL       RF_CAL
+#define WAKE_NO_RFCAL    RF_NO_CAL
+#define WAKE_RF_DISABLED RF_DISABLED
+
+/**
+  * ESP replacement. The RTC user memory survives the emulated deep sleeps.
+  */
+class EspClass
+{
+public:
+   uint8_t  rtcMemory[RTC_USER_MEMORY_SIZE]; //!< Emulated RTC user memory.
+   uint32_t freeHeap;                        //!< Reported free heap.
+   uint32_t maxFreeBlockSize;                //!< Reported biggest free block.
+
+public:
+   EspClass() : rtcMemory(), freeHeap(40000), maxFreeBlockSize(32000) { }
+
+   bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+   {
+      if (offset * 4 + size > sizeof(rtcMemory)) {
+         return false;
+      }
+      memcpy(data, rtcMemory + offset * 4, size);
+      return true;
+   }
+   bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+   {
+      if (offset * 4 + size > sizeof(rtcMemory)) {
+         return false;
+      }
+      memcpy(rtcMemory + offset * 4, data, size);
+      return true;
+   }
+
+   void     deepSleep(uint64_t timeUs, RFMode = RF_DEFAULT) { HostRuntime::get().deepSleep(timeUs); }
+   void     restart()                                       { HostRuntime::get().restart(); }
+   void     reset()                                         { restart(); }
+   void     wdtFeed()                                       { }
+
+   uint32_t getCycleCount()                                 { return (uint32_t) (micros() * 80); }
+   uint32_t getCpuFreqMHz()                                 { return 80; }
+   uint32_t getFreeHeap()                                   { return freeHeap; }
+   uint32_t getMaxFreeBlockSize()                           { return maxFreeBlockSize; }
+   uint8_t  getHeapFragmentation()                          { return freeHeap ? 100 - (uint8_t) (100ULL * maxFreeBlockSize / freeHeap) : 0; }
+   uint32_t getChipId()                                     { return 0x00C0FFEE; }
+   uint32_t getFlashChipId()                                { return 0x001640E0; }
+   uint32_t getFlashChipRealSize()                          { return 4 * 1024 * 1024; }
+   uint32_t getFlashChipSize()                              { return 4 * 1024 * 1024; }
+   uint32_t getSketchSize()                                 { return 400 * 1024; }
+   uint32_t getFreeSketchSpace()                            { return 600 * 1024; }
+   String   getResetReason()                                { return F("Deep-Sleep Wake"); }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,131 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FS.h
+  *
+  * Host replacement of the SPIFFS file system. The files are stored in a
+  * directory of the host file system (default ./spiffs).
+  */
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+  * SPIFFS file replacement based on stdio.
+  */
+class File : public Stream
+{
+protected:
+   FILE  *fp;   //!< Host file handle.
+   String path; //!< SPIFFS path of the file.
+
+public:
+   File() : fp(NULL) { }
+   File(FILE *f, const String &p) : fp(f), path(p) { }
+   File(const File &other) = delete;
+   File(File &&other) : fp(other.fp), path(other.path) { other.fp = NULL; }
+   File &operator = (File &&other) { close(); fp = other.fp; path = other.path; other.fp = NULL; return *this; }
+   ~File() { close(); }
+
+   explicit operator bool() const { return fp != NULL; }
+
+   virtual size_t write(uint8_t c)                          { return fp ? fwrite(&c, 1, 1, fp) : 0; }
+   virtual size_t write(const uint8_t *buffer, size_t size) { return fp ? fwrite(buffer, 1, size, fp) : 0; }
+   using Print::write;
+
+   virtual int available()
+   {
+      if (!fp) {
+         return 0;
+      }
+      long pos = ftell(fp);
+      return (int) (size() - pos);
+   }
+   virtual int read()                            { return fp ? fgetc(fp) : -1; }
+   virtual int peek()                            { int c = read(); if (c >= 0) ungetc(c, fp); return c; }
+   size_t      read(uint8_t *buf, size_t size)   { return fp ? fread(buf, 1, size, fp) : 0; }
+   virtual size_t readBytes(char *buf, size_t n) { return read((uint8_t *) buf, n); }
+   virtual void flush()                          { if (fp) fflush(fp); }
+   bool        seek(uint32_t pos)                { return fp && fseek(fp, pos, SEEK_SET) == 0; }
+   size_t      position()                        { return fp ? ftell(fp) : 0; }
+
+   size_t size()
+   {
+      if (!fp) {
+         return 0;
+      }
+      fflush(fp);
+      struct stat st;
+      return fstat(fileno(fp), &st) == 0 ? st.st_size : 0;
+   }
+   const char *name() const { return path.c_str(); }
+   void close()             { if (fp) { fclose(fp); fp = NULL; } }
+};
+
+/**
+  * SPIFFS file system replacement.
+  */
+class FS
+{
+protected:
+   std::string root; //!< Host directory of the file system.
+   bool        mounted;
+
+   std::string hostPath(const char *path) const { return root + (path[0] == '/' ? "" : "/") + path; }
+
+public:
+   FS() : root("spiffs"), mounted(false) { }
+
+   void setRoot(const std::string &r) { root = r; }
+   const std::string &getRoot() const { return root; }
+
+   bool begin()      { mkdir(root.c_str(), 0755); mounted = true; return true; }
+   void end()        { mounted = false; }
+   bool isMounted()  { return mounted; }
+
+   File open(const char *path, const char *mode)
+   {
+      std::string m = mode;
+
+      if (m == "w+") {
+         m = "w+b";
+      } else if (m == "r") {
+         m = "rb";
+      }
+      FILE *fp = fopen(hostPath(path).c_str(), m.c_str());
+      return File(fp, path);
+   }
+   File open(const String &path, const char *mode)           { return open(path.c_str(), mode); }
+   bool exists(const char *path)                             { struct stat st; return stat(hostPath(path).c_str(), &st) == 0; }
+   bool exists(const String &path)                           { return exists(path.c_str()); }
+   bool remove(const char *path)                             { return ::remove(hostPath(path).c_str()) == 0; }
+   bool remove(const String &path)                           { return remove(path.c_str()); }
+   bool rename(const char *from, const char *to)
+   {
+      if (exists(to)) { // SPIFFS does not overwrite
+         return false;
+      }
+      return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+   }
+   bool rename(const String &from, const String &to)         { return rename(from.c_str(), to.c_str()); }
+};
+
+extern FS SPIFFS;
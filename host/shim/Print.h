@@ -0,0 +1,152 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Print.h
+  *
+  * Host replacement of the Arduino Print, Stream and Serial classes.
+  */
+
+#pragma once
+
+#include <cstdarg>
+
+/**
+  * Base class of everything we can print to.
+  */
+class Print
+{
+public:
+   virtual ~Print() { }
+
+   virtual size_t write(uint8_t c) = 0;
+   virtual size_t write(const uint8_t *buffer, size_t size)
+   {
+      size_t n = 0;
+
+      while (size--) {
+         n += write(*buffer++);
+      }
+      return n;
+   }
+   size_t write(const char *str)                      { return str ? write((const uint8_t *) str, strlen(str)) : 0; }
+   size_t write(const char *buffer, size_t size)      { return write((const uint8_t *) buffer, size); }
+
+   size_t print(const String &s)                      { return write(s.c_str(), s.length()); }
+   size_t print(const char *str)                      { return write(str); }
+   size_t print(const __FlashStringHelper *str)       { return write((const char *) str); }
+   size_t print(char c)                               { return write((uint8_t) c); }
+   size_t print(int v)                                { return print(String(v)); }
+   size_t print(unsigned int v)                       { return print(String(v)); }
+   size_t print(long v)                               { return print(String(v)); }
+   size_t print(unsigned long v)                      { return print(String(v)); }
+   size_t print(double v, int digits = 2)             { return print(String(v, digits)); }
+
+   size_t println()                                   { return write("\r\n"); }
+   template <typename T> size_t println(const T &v)   { size_t n = print(v); return n + println(); }
+
+   size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+   {
+      char    buf[256];
+      va_list args;
+
+      va_start(args, format);
+      int n = vsnprintf(buf, sizeof(buf), format, args);
+      va_end(args);
+      return write(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+   }
+   size_t printf_P(const char *format, ...) __attribute__((format(printf, 2, 3)))
+   {
+      char    buf[256];
+      va_list args;
+
+      va_start(args, format);
+      int n = vsnprintf(buf, sizeof(buf), format, args);
+      va_end(args);
+      return write(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+   }
+   virtual void flush() { }
+};
+
+/**
+  * Base class of all readable streams.
+  */
+class Stream : public Print
+{
+public:
+   virtual int available() = 0;
+   virtual int read() = 0;
+   virtual int peek() = 0;
+
+   virtual size_t readBytes(char *buffer, size_t length)
+   {
+      size_t n = 0;
+
+      while (n < length && available()) {
+         buffer[n++] = (char) read();
+      }
+      return n;
+   }
+   String readStringUntil(char terminator)
+   {
+      String ret;
+
+      while (available()) {
+         int c = read();
+
+         if (c < 0 || c == terminator) {
+            break;
+         }
+         ret += (char) c;
+      }
+      return ret;
+   }
+   String readString()
+   {
+      String ret;
+
+      while (available()) {
+         ret += (char) read();
+      }
+      return ret;
+   }
+   void setTimeout(unsigned long) { }
+};
+
+/**
+  * Serial port replacement. Writes to stdout unless it is switched off.
+  */
+class HardwareSerial : public Stream
+{
+public:
+   bool enabled; //!< Print to stdout?
+
+public:
+   HardwareSerial() : enabled(true) { }
+
+   void begin(unsigned long) { setvbuf(stdout, NULL, _IOLBF, 0); }
+   void end() { }
+
+   virtual size_t write(uint8_t c)                          { if (enabled) fputc(c, stdout); return 1; }
+   virtual size_t write(const uint8_t *buffer, size_t size) { if (enabled) fwrite(buffer, 1, size, stdout); return size; }
+   using Print::write;
+
+   virtual int available() { return 0; }
+   virtual int read()      { return -1; }
+   virtual int peek()      { return -1; }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,278 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file PubSubClient.h
+  *
+  * Host replacement of the PubSubClient MQTT library.
+  * Speaks MQTT 3.1.1 (QoS 0) over the given Client like the original.
+  */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE       15
+#define MQTT_SOCKET_TIMEOUT  15
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+/**
+  * Minimal MQTT client.
+  */
+class PubSubClient
+{
+public:
+   typedef std::function<void(char *, uint8_t *, unsigned int)> Callback;
+
+protected:
+   Client     *_client;   //!< Transport.
+   String      _host;     //!< Broker host.
+   uint16_t    _port;     //!< Broker port.
+   Callback    _callback; //!< Callback for subscribed topics.
+   int         _state;    //!< Connection state.
+   uint16_t    _nextId;   //!< Next packet id.
+   uint8_t     _buffer[MQTT_MAX_PACKET_SIZE]; //!< Receive buffer.
+
+public:
+   PubSubClient() : _client(NULL), _port(1883), _state(MQTT_DISCONNECTED), _nextId(1) { }
+   PubSubClient(Client &client) : _client(&client), _port(1883), _state(MQTT_DISCONNECTED), _nextId(1) { }
+
+   PubSubClient &setServer(const char *host, uint16_t port) { _host = host; _port = port; return *this; }
+   PubSubClient &setCallback(Callback cb)                    { _callback = cb; return *this; }
+   PubSubClient &setClient(Client &client)                   { _client = &client; return *this; }
+
+   bool connect(const char *id)                                { return connect(id, NULL, NULL); }
+   bool connect(const char *id, const char *user, const char *pass);
+   void disconnect();
+   bool publish(const char *topic, const char *payload)                { return publish(topic, (const uint8_t *) payload, strlen(payload), false); }
+   bool publish(const char *topic, const char *payload, bool retained) { return publish(topic, (const uint8_t *) payload, strlen(payload), retained); }
+   bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained);
+   bool subscribe(const char *topic);
+   bool loop();
+   bool connected();
+   int  state() { return _state; }
+
+protected:
+   bool     writePacket(uint8_t header, const uint8_t *body, size_t length);
+   bool     readPacket(uint8_t &header, size_t &length, unsigned long timeoutMs);
+   bool     readByte(uint8_t &c, unsigned long timeoutMs);
+   static size_t writeString(uint8_t *buf, const char *s);
+};
+
+/* ******************************************** */
+
+inline size_t PubSubClient::writeString(uint8_t *buf, const char *s)
+{
+   size_t len = strlen(s);
+
+   buf[0] = len >> 8;
+   buf[1] = len & 0xFF;
+   memcpy(buf + 2, s, len);
+   return len + 2;
+}
+
+inline bool PubSubClient::writePacket(uint8_t header, const uint8_t *body, size_t length)
+{
+   uint8_t fixed[5];
+   size_t  n = 0;
+
+   fixed[n++] = header;
+   do {
+      uint8_t digit = length % 128;
+      length /= 128;
+      fixed[n++] = digit | (length > 0 ? 0x80 : 0);
+   } while (length > 0);
+
+   size_t total = 0;
+   for (size_t i = 1, mul = 1; i < n; i++, mul *= 128) {
+      total += (fixed[i] & 0x7F) * mul;
+   }
+   return _client->write(fixed, n) == n && (total == 0 || _client->write(body, total) == total);
+}
+
+inline bool PubSubClient::readByte(uint8_t &c, unsigned long timeoutMs)
+{
+   unsigned long start = millis();
+
+   while (!_client->available()) {
+      if (!_client->connected() || millis() - start >= timeoutMs) {
+         return false;
+      }
+      delay(1);
+   }
+   c = (uint8_t) _client->read();
+   return true;
+}
+
+inline bool PubSubClient::readPacket(uint8_t &header, size_t &length, unsigned long timeoutMs)
+{
+   uint8_t c;
+   size_t  mul = 1;
+
+   if (!readByte(header, timeoutMs)) {
+      return false;
+   }
+   length = 0;
+   do {
+      if (!readByte(c, timeoutMs)) {
+         return false;
+      }
+      length += (c & 0x7F) * mul;
+      mul    *= 128;
+   } while (c & 0x80);
+
+   for (size_t i = 0; i < length; i++) {
+      if (!readByte(c, timeoutMs)) {
+         return false;
+      }
+      if (i < sizeof(_buffer)) {
+         _buffer[i] = c;
+      }
+   }
+   return length <= sizeof(_buffer);
+}
+
+inline bool PubSubClient::connect(const char *id, const char *user, const char *pass)
+{
+   if (!_client) {
+      return false;
+   }
+   if (connected()) {
+      return true;
+   }
+   if (!_client->connect(_host.c_str(), _port)) {
+      _state = MQTT_CONNECT_FAILED;
+      return false;
+   }
+
+   uint8_t body[MQTT_MAX_PACKET_SIZE];
+   size_t  n     = 0;
+   uint8_t flags = 0x02; // clean session
+
+   n += writeString(body + n, "MQTT");
+   body[n++] = 4; // 3.1.1
+   if (user && *user) flags |= 0x80;
+   if (pass && *pass) flags |= 0x40;
+   body[n++] = flags;
+   body[n++] = 0;
+   body[n++] = MQTT_KEEPALIVE;
+   n += writeString(body + n, id);
+   if (user && *user) n += writeString(body + n, user);
+   if (pass && *pass) n += writeString(body + n, pass);
+
+   uint8_t header;
+   size_t  length;
+
+   if (!writePacket(0x10, body, n) || !readPacket(header, length, MQTT_SOCKET_TIMEOUT * 1000UL)) {
+      _client->stop();
+      _state = MQTT_CONNECTION_TIMEOUT;
+      return false;
+   }
+   if ((header & 0xF0) != 0x20 || length != 2 || _buffer[1] != 0) {
+      _client->stop();
+      _state = (header & 0xF0) == 0x20 && length == 2 ? _buffer[1] : MQTT_CONNECT_FAILED;
+      return false;
+   }
+   _state = MQTT_CONNECTED;
+   return true;
+}
+
+inline void PubSubClient::disconnect()
+{
+   if (_client && _client->connected()) {
+      writePacket(0xE0, NULL, 0);
+      _client->stop();
+   }
+   _state = MQTT_DISCONNECTED;
+}
+
+inline bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained)
+{
+   uint8_t body[MQTT_MAX_PACKET_SIZE];
+   size_t  n = strlen(topic) + 2;
+
+   if (!connected() || n + length > sizeof(body)) {
+      return false;
+   }
+   writeString(body, topic);
+   memcpy(body + n, payload, length);
+   return writePacket(0x30 | (retained ? 1 : 0), body, n + length);
+}
+
+inline bool PubSubClient::subscribe(const char *topic)
+{
+   uint8_t body[MQTT_MAX_PACKET_SIZE];
+   size_t  n = 0;
+
+   if (!connected() || strlen(topic) + 5 > sizeof(body)) {
+      return false;
+   }
+   _nextId++;
+   body[n++] = _nextId >> 8;
+   body[n++] = _nextId & 0xFF;
+   n += writeString(body + n, topic);
+   body[n++] = 0;
+   return writePacket(0x82, body, n);
+}
+
+inline bool PubSubClient::loop()
+{
+   if (!connected()) {
+      return false;
+   }
+   while (_client->available()) {
+      uint8_t header;
+      size_t  length;
+
+      if (!readPacket(header, length, 100)) {
+         break;
+      }
+      if ((header & 0xF0) == 0x30 && _callback && length >= 2) {
+         size_t topicLen = (_buffer[0] << 8) | _buffer[1];
+
+         if (topicLen + 2 <= length && length < sizeof(_buffer)) {
+            char topic[MQTT_MAX_PACKET_SIZE];
+
+            memcpy(topic, _buffer + 2, topicLen);
+            topic[topicLen] = '\0';
+            _callback(topic, _buffer + 2 + topicLen, length - 2 - topicLen);
+         }
+      }
+   }
+   return true;
+}
+
+inline bool PubSubClient::connected()
+{
+   if (!_client) {
+      return false;
+   }
+   if (_state == MQTT_CONNECTED && !_client->connected()) {
+      _state = MQTT_CONNECTION_LOST;
+   }
+   return _state == MQTT_CONNECTED;
+}
@@ -0,0 +1,41 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file SoftwareSerial.h
+  *
+  * Host replacement of the software serial port (not connected).
+  */
+
+#pragma once
+
+#include <Arduino.h>
+
+/**
+  * Unconnected software serial port.
+  */
+class SoftwareSerial : public Stream
+{
+public:
+   SoftwareSerial(uint8_t, uint8_t, bool = false) { }
+
+   void begin(long) { }
+   virtual size_t write(uint8_t) { return 1; }
+   using Print::write;
+   virtual int available() { return 0; }
+   virtual int read()      { return -1; }
+   virtual int peek()      { return -1; }
+};
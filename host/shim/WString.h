@@ -0,0 +1,386 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WString.h
+  *
+  * Host replacement of the Arduino String class.
+  * Uses malloc/realloc and the same small string optimization (11 chars)
+  * as the ESP8266 core so the allocation counts of the benchmarks are
+  * comparable with the device.
+  */
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+
+class __FlashStringHelper;
+
+#define F(string_literal)  (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+
+/**
+  * Arduino compatible String class with the subset the firmware uses.
+  */
+class String
+{
+protected:
+   enum { SSO_SIZE = 11 };
+
+   char        *buffer;            //!< Points to sso or to the heap buffer.
+   unsigned int capacity;          //!< Usable size without the terminating zero.
+   unsigned int len;               //!< Current length.
+   char         sso[SSO_SIZE + 1]; //!< Inline buffer for short strings.
+
+public:
+   String(const char *cstr = "")                  : buffer(sso), capacity(SSO_SIZE), len(0), sso() { if (cstr) copy(cstr, strlen(cstr)); }
+   String(const char *cstr, unsigned int length)  : buffer(sso), capacity(SSO_SIZE), len(0), sso() { if (cstr) copy(cstr, length); }
+   String(const String &str)                      : buffer(sso), capacity(SSO_SIZE), len(0), sso() { copy(str.buffer, str.len); }
+   String(String &&str)                           : buffer(sso), capacity(SSO_SIZE), len(0), sso() { move(str); }
+   String(const __FlashStringHelper *str)         : buffer(sso), capacity(SSO_SIZE), len(0), sso() { const char *p = (const char *) str; if (p) copy(p, strlen(p)); }
+   explicit String(char c)                        : buffer(sso), capacity(SSO_SIZE), len(0), sso() { copy(&c, 1); }
+   explicit String(unsigned char v, unsigned char base = 10)      : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromULL(v, base); }
+   explicit String(int v, unsigned char base = 10)                : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromLL(v, base); }
+   explicit String(unsigned int v, unsigned char base = 10)       : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromULL(v, base); }
+   explicit String(long v, unsigned char base = 10)               : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromLL(v, base); }
+   explicit String(unsigned long v, unsigned char base = 10)      : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromULL(v, base); }
+   explicit String(long long v, unsigned char base = 10)          : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromLL(v, base); }
+   explicit String(unsigned long long v, unsigned char base = 10) : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromULL(v, base); }
+   explicit String(float v, unsigned char decimals = 2)           : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromDouble(v, decimals); }
+   explicit String(double v, unsigned char decimals = 2)          : buffer(sso), capacity(SSO_SIZE), len(0), sso() { fromDouble(v, decimals); }
+   ~String() { if (buffer != sso) free(buffer); }
+
+   String &operator = (const String &rhs)              { if (this != &rhs) copy(rhs.buffer, rhs.len); return *this; }
+   String &operator = (String &&rhs)                   { if (this != &rhs) move(rhs); return *this; }
+   String &operator = (const char *cstr)               { copy(cstr, cstr ? strlen(cstr) : 0); return *this; }
+   String &operator = (const __FlashStringHelper *str) { return *this = (const char *) str; }
+
+   bool reserve(unsigned int size);
+   unsigned int length() const { return len; }
+   const char *c_str() const   { return buffer; }
+   char *begin()               { return buffer; }
+   char *end()                 { return buffer + len; }
+
+   bool concat(const char *cstr, unsigned int length);
+   bool concat(const String &str)              { return concat(str.buffer, str.len); }
+   bool concat(const char *cstr)               { return cstr ? concat(cstr, strlen(cstr)) : false; }
+   bool concat(const __FlashStringHelper *str) { return concat((const char *) str); }
+   bool concat(char c)                         { return concat(&c, 1); }
+   bool concat(unsigned char v)                { return concat(String(v)); }
+   bool concat(int v)                          { return concat(String(v)); }
+   bool concat(unsigned int v)                 { return concat(String(v)); }
+   bool concat(long v)                         { return concat(String(v)); }
+   bool concat(unsigned long v)                { return concat(String(v)); }
+   bool concat(long long v)                    { return concat(String(v)); }
+   bool concat(unsigned long long v)           { return concat(String(v)); }
+   bool concat(float v)                        { return concat(String(v)); }
+   bool concat(double v)                       { return concat(String(v)); }
+
+   template <typename T> String &operator += (const T &rhs) { concat(rhs); return *this; }
+   String &operator += (const char *cstr)                   { concat(cstr); return *this; }
+
+   explicit operator bool() const { return true; }
+
+   int  compareTo(const String &s) const;
+   bool equals(const String &s) const { return len == s.len && compareTo(s) == 0; }
+   bool equals(const char *cstr) const { return strcmp(c_str(), cstr ? cstr : "") == 0; }
+   bool operator == (const String &rhs) const              { return equals(rhs); }
+   bool operator == (const char *cstr) const               { return equals(cstr); }
+   bool operator == (const __FlashStringHelper *rhs) const { return equals((const char *) rhs); }
+   bool operator != (const String &rhs) const              { return !equals(rhs); }
+   bool operator != (const char *cstr) const               { return !equals(cstr); }
+   bool operator != (const __FlashStringHelper *rhs) const { return !equals((const char *) rhs); }
+   bool operator <  (const String &rhs) const              { return compareTo(rhs) < 0; }
+   bool equalsIgnoreCase(const String &s) const;
+   bool startsWith(const String &prefix) const             { return prefix.len <= len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0; }
+   bool endsWith(const String &suffix) const               { return suffix.len <= len && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0; }
+
+   char  charAt(unsigned int index) const          { return index < len ? buffer[index] : 0; }
+   void  setCharAt(unsigned int index, char c)     { if (index < len) buffer[index] = c; }
+   char  operator [] (unsigned int index) const    { return charAt(index); }
+   char &operator [] (unsigned int index)          { static char dummy; if (index >= len) { dummy = 0; return dummy; } return buffer[index]; }
+
+   int indexOf(char ch, unsigned int fromIndex = 0) const;
+   int indexOf(const String &str, unsigned int fromIndex = 0) const;
+   int lastIndexOf(char ch) const;
+   int lastIndexOf(const String &str) const;
+
+   String substring(unsigned int beginIndex) const { return substring(beginIndex, len); }
+   String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+   void replace(char find, char replace);
+   void replace(const String &find, const String &replace);
+   void remove(unsigned int index)                 { remove(index, (unsigned int) -1); }
+   void remove(unsigned int index, unsigned int count);
+   void toLowerCase()                              { for (unsigned int i = 0; i < len; i++) buffer[i] = tolower(buffer[i]); }
+   void toUpperCase()                              { for (unsigned int i = 0; i < len; i++) buffer[i] = toupper(buffer[i]); }
+   void trim();
+
+   long   toInt() const    { return atol(c_str()); }
+   float  toFloat() const  { return atof(c_str()); }
+   double toDouble() const { return atof(c_str()); }
+
+protected:
+   void move(String &rhs);
+   void copy(const char *cstr, unsigned int length);
+   void fromLL(long long v, unsigned char base);
+   void fromULL(unsigned long long v, unsigned char base);
+   void fromDouble(double v, unsigned char decimals);
+};
+
+/* ******************************************** */
+
+inline String operator + (const String &lhs, const String &rhs)              { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, const char *rhs)                { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, const __FlashStringHelper *rhs) { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, char rhs)                       { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, unsigned char rhs)              { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, int rhs)                        { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, unsigned int rhs)               { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, long rhs)                       { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, unsigned long rhs)              { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, long long rhs)                  { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, unsigned long long rhs)         { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, float rhs)                      { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (const String &lhs, double rhs)                     { String s(lhs); s.concat(rhs); return s; }
+inline String operator + (String &&lhs, const String &rhs)                   { lhs.concat(rhs); return static_cast<String &&>(lhs); }
+inline String operator + (String &&lhs, const char *rhs)                     { lhs.concat(rhs); return static_cast<String &&>(lhs); }
+inline String operator + (String &&lhs, const __FlashStringHelper *rhs)      { lhs.concat(rhs); return static_cast<String &&>(lhs); }
+inline String operator + (const char *lhs, const String &rhs)                { String s(lhs); s.concat(rhs); return s; }
+inline bool   operator == (const char *lhs, const String &rhs)               { return rhs == lhs; }
+inline bool   operator != (const char *lhs, const String &rhs)               { return rhs != lhs; }
+
+inline bool String::reserve(unsigned int size)
+{
+   if (capacity >= size) {
+      return true;
+   }
+   char *newBuffer = (char *) realloc(buffer == sso ? NULL : buffer, size + 1);
+
+   if (!newBuffer) {
+      return false;
+   }
+   if (buffer == sso) {
+      memcpy(newBuffer, sso, len + 1);
+   }
+   buffer   = newBuffer;
+   capacity = size;
+   return true;
+}
+
+inline void String::move(String &rhs)
+{
+   if (buffer != sso) {
+      free(buffer);
+   }
+   if (rhs.buffer == rhs.sso) {
+      memcpy(sso, rhs.sso, rhs.len + 1);
+      buffer   = sso;
+      capacity = SSO_SIZE;
+   } else {
+      buffer   = rhs.buffer;
+      capacity = rhs.capacity;
+   }
+   len = rhs.len;
+   rhs.buffer   = rhs.sso;
+   rhs.capacity = SSO_SIZE;
+   rhs.len      = 0;
+   rhs.sso[0]   = '\0';
+}
+
+inline void String::copy(const char *cstr, unsigned int length)
+{
+   if (!reserve(length)) {
+      return;
+   }
+   if (length) {
+      memmove(buffer, cstr, length);
+   }
+   buffer[length] = '\0';
+   len = length;
+}
+
+inline bool String::concat(const char *cstr, unsigned int length)
+{
+   if (!cstr) {
+      return false;
+   }
+   if (length == 0) {
+      return true;
+   }
+   if (cstr >= buffer && cstr < buffer + len) { // self concat
+      String tmp(cstr, length);
+      return concat(tmp.buffer, tmp.len);
+   }
+   if (!reserve(len + length)) {
+      return false;
+   }
+   memcpy(buffer + len, cstr, length);
+   len += length;
+   buffer[len] = '\0';
+   return true;
+}
+
+inline void String::fromLL(long long v, unsigned char base)
+{
+   if (v < 0 && base == 10) {
+      char tmp[24];
+      snprintf(tmp, sizeof(tmp), "%lld", v);
+      copy(tmp, strlen(tmp));
+   } else {
+      fromULL((unsigned long long) v, base);
+   }
+}
+
+inline void String::fromULL(unsigned long long v, unsigned char base)
+{
+   char  tmp[72];
+   char *p = tmp + sizeof(tmp) - 1;
+
+   *p = '\0';
+   do {
+      int digit = v % base;
+      *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+      v /= base;
+   } while (v);
+   copy(p, strlen(p));
+}
+
+inline void String::fromDouble(double v, unsigned char decimals)
+{
+   char tmp[64];
+   snprintf(tmp, sizeof(tmp), "%.*f", decimals, v);
+   copy(tmp, strlen(tmp));
+}
+
+inline int String::compareTo(const String &s) const
+{
+   return strcmp(c_str(), s.c_str());
+}
+
+inline bool String::equalsIgnoreCase(const String &s) const
+{
+   return len == s.len && strcasecmp(c_str(), s.c_str()) == 0;
+}
+
+inline int String::indexOf(char ch, unsigned int fromIndex) const
+{
+   if (fromIndex >= len) {
+      return -1;
+   }
+   const char *p = (const char *) memchr(buffer + fromIndex, ch, len - fromIndex);
+   return p ? p - buffer : -1;
+}
+
+inline int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+   if (fromIndex >= len) {
+      return -1;
+   }
+   const char *p = strstr(buffer + fromIndex, str.c_str());
+   return p ? p - buffer : -1;
+}
+
+inline int String::lastIndexOf(char ch) const
+{
+   const char *p = strrchr(buffer, ch);
+   return p ? p - buffer : -1;
+}
+
+inline int String::lastIndexOf(const String &str) const
+{
+   int ret = -1;
+
+   for (int i = indexOf(str); i != -1; i = indexOf(str, i + 1)) {
+      ret = i;
+   }
+   return ret;
+}
+
+inline String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+   if (beginIndex > endIndex) {
+      unsigned int tmp = beginIndex;
+      beginIndex = endIndex;
+      endIndex   = tmp;
+   }
+   if (beginIndex >= len) {
+      return String();
+   }
+   if (endIndex > len) {
+      endIndex = len;
+   }
+   return String(buffer + beginIndex, endIndex - beginIndex);
+}
+
+inline void String::replace(char find, char replace)
+{
+   for (unsigned int i = 0; i < len; i++) {
+      if (buffer[i] == find) {
+         buffer[i] = replace;
+      }
+   }
+}
+
+inline void String::replace(const String &find, const String &replace)
+{
+   if (len == 0 || find.len == 0) {
+      return;
+   }
+   String result;
+   int    last = 0;
+
+   for (int i = indexOf(find); i != -1; i = indexOf(find, i + find.len)) {
+      result.concat(buffer + last, i - last);
+      result.concat(replace);
+      last = i + find.len;
+   }
+   if (last == 0 && indexOf(find) == -1) {
+      return;
+   }
+   result.concat(buffer + last, len - last);
+   *this = static_cast<String &&>(result);
+}
+
+inline void String::remove(unsigned int index, unsigned int count)
+{
+   if (index >= len) {
+      return;
+   }
+   if (count > len - index) {
+      count = len - index;
+   }
+   memmove(buffer + index, buffer + index + count, len - index - count + 1);
+   len -= count;
+}
+
+inline void String::trim()
+{
+   if (len == 0) {
+      return;
+   }
+   unsigned int b = 0;
+   unsigned int e = len;
+
+   while (b < e && isspace((unsigned char) buffer[b])) b++;
+   while (e > b && isspace((unsigned char) buffer[e - 1])) e--;
+   memmove(buffer, buffer + b, e - b);
+   len = e - b;
+   buffer[len] = '\0';
+}
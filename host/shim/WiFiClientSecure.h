@@ -0,0 +1,360 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFiClientSecure.h
+  *
+  * Host replacement of the BearSSL client of the ESP8266 core.
+  * OpenSSL runs over memory buffers on top of the HostConnection, limited
+  * to what BearSSL does: TLS 1.2 at most, resumption only with the session
+  * ID (no tickets, no extended master secret). The session parameters are
+  * exchanged in the layout of br_ssl_session_parameters, so an OpenSSL
+  * session is rebuilt from them before the handshake and read back after.
+  */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <string>
+#include <time.h>
+
+#define HOST_TLS_TIMEOUT_MS 15000 //!< Longest handshake.
+
+/** Session parameters like in BearSSL. */
+typedef struct {
+   unsigned char session_id[32];
+   unsigned char session_id_len;
+   uint16_t      version;
+   uint16_t      cipher_suite;
+   unsigned char master_secret[48];
+} br_ssl_session_parameters;
+
+namespace BearSSL {
+
+/**
+  * Session of the last handshake.
+  */
+class Session
+{
+protected:
+   br_ssl_session_parameters params; //!< Offered before and updated after the handshake.
+
+public:
+   Session() { memset(&params, 0, sizeof(params)); }
+
+   br_ssl_session_parameters *getSession() { return &params; }
+};
+
+/**
+  * TLS client.
+  */
+class WiFiClientSecure : public WiFiClient
+{
+protected:
+   SSL_CTX     *ctx;                 //!< Context, created with the first connect.
+   SSL         *ssl;                 //!< Connection state or NULL.
+   BIO         *input;               //!< Received TLS records.
+   BIO         *output;              //!< TLS records to send.
+   Session     *session;             //!< Session to offer and update, NULL = none.
+   bool         insecure;            //!< No certificate check.
+   bool         hasFingerprint;      //!< Check the SHA-1 of the certificate.
+   uint8_t      fingerprint[20];     //!< Expected SHA-1.
+   int          lastError;           //!< Error of the last failure, 0 = none.
+   std::string  plain;               //!< Decrypted bytes not read yet.
+
+   bool flushOutput();
+   bool receive();
+   void decrypt();
+   bool sessionToSsl();
+   void sslToSession();
+   bool checkFingerprint();
+   void release();
+
+public:
+   WiFiClientSecure();
+   WiFiClientSecure(const WiFiClientSecure &) = delete;
+   virtual ~WiFiClientSecure();
+
+   void setInsecure()                           { insecure = true; hasFingerprint = false; }
+   bool setFingerprint(const uint8_t print[20]) { memcpy(fingerprint, print, sizeof(fingerprint)); hasFingerprint = true; insecure = false; return true; }
+   void setSession(Session *s)                  { session = s; }
+   void setBufferSizes(int, int)                { }
+   int  getLastSSLError(char *dest = NULL, size_t length = 0);
+
+   virtual int connect(IPAddress ip, uint16_t port) { return connect(ip.toString().c_str(), port); }
+   virtual int connect(const char *host, uint16_t port);
+
+   virtual size_t  write(uint8_t c)                       { return write(&c, 1); }
+   virtual size_t  write(const uint8_t *buf, size_t size);
+   using WiFiClient::write;
+   virtual int     available();
+   virtual int     read()                                 { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+   virtual int     read(uint8_t *buf, size_t size);
+   virtual int     peek()                                 { return available() ? (uint8_t) plain[0] : -1; }
+   virtual void    stop();
+   virtual uint8_t connected()                            { return ssl && (WiFiClient::connected() || !plain.empty()); }
+   virtual explicit operator bool()                       { return ssl != NULL; }
+};
+
+/* ******************************************** */
+
+inline WiFiClientSecure::WiFiClientSecure()
+   : ctx(NULL)
+   , ssl(NULL)
+   , input(NULL)
+   , output(NULL)
+   , session(NULL)
+   , insecure(false)
+   , hasFingerprint(false)
+   , fingerprint()
+   , lastError(0)
+{
+}
+
+inline WiFiClientSecure::~WiFiClientSecure()
+{
+   release();
+   if (ctx) {
+      SSL_CTX_free(ctx);
+   }
+}
+
+/** Frees the connection state, the BIOs belong to it. */
+inline void WiFiClientSecure::release()
+{
+   if (ssl) {
+      SSL_free(ssl);
+   }
+   ssl    = NULL;
+   input  = NULL;
+   output = NULL;
+   plain.clear();
+}
+
+/** Sends the pending TLS records. */
+inline bool WiFiClientSecure::flushOutput()
+{
+   char buf[4096];
+   int  n;
+
+   while ((n = BIO_read(output, buf, sizeof(buf))) > 0) {
+      if (WiFiClient::write((const uint8_t *) buf, n) != (size_t) n) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/** Moves the received bytes into the TLS engine, false if there were none. */
+inline bool WiFiClientSecure::receive()
+{
+   uint8_t buf[4096];
+   bool    any = false;
+   int     n;
+
+   while (WiFiClient::available() > 0 && (n = WiFiClient::read(buf, sizeof(buf))) > 0) {
+      BIO_write(input, buf, n);
+      any = true;
+   }
+   return any;
+}
+
+/** Decrypts the complete records into plain. */
+inline void WiFiClientSecure::decrypt()
+{
+   char buf[4096];
+   int  n;
+
+   receive();
+   while ((n = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+      plain.append(buf, n);
+   }
+   flushOutput();
+}
+
+/** Offers the stored session, the way BearSSL resumes one. */
+inline bool WiFiClientSecure::sessionToSsl()
+{
+   br_ssl_session_parameters *params = session ? session->getSession() : NULL;
+   const unsigned char        suite[2] = { (unsigned char) (params ? params->cipher_suite >> 8 : 0),
+                                           (unsigned char) (params ? params->cipher_suite : 0) };
+   const SSL_CIPHER          *cipher;
+   SSL_SESSION               *offered;
+   bool                       ok;
+
+   if (!params || !params->session_id_len || params->session_id_len > sizeof(params->session_id) ||
+       (cipher = SSL_CIPHER_find(ssl, suite)) == NULL) {
+      return false;
+   }
+   offered = SSL_SESSION_new();
+   ok      = offered &&
+             SSL_SESSION_set1_id(offered, params->session_id, params->session_id_len) &&
+             SSL_SESSION_set1_master_key(offered, params->master_secret, sizeof(params->master_secret)) &&
+             SSL_SESSION_set_protocol_version(offered, params->version) &&
+             SSL_SESSION_set_cipher(offered, cipher) &&
+             SSL_SESSION_set_time(offered, time(NULL)) &&
+             SSL_SESSION_set_timeout(offered, 7 * 24 * 3600) &&
+             SSL_set_session(ssl, offered);
+   SSL_SESSION_free(offered);
+   return ok;
+}
+
+/** Stores the negotiated session like BearSSL after the handshake. */
+inline void WiFiClientSecure::sslToSession()
+{
+   br_ssl_session_parameters *params  = session ? session->getSession() : NULL;
+   SSL_SESSION               *current = SSL_get_session(ssl);
+   const unsigned char       *id;
+   unsigned int               length;
+
+   if (!params || !current) {
+      return;
+   }
+   memset(params, 0, sizeof(*params));
+   id = SSL_SESSION_get_id(current, &length);
+   if (length <= sizeof(params->session_id)) {
+      memcpy(params->session_id, id, length);
+      params->session_id_len = length;
+   }
+   SSL_SESSION_get_master_key(current, params->master_secret, sizeof(params->master_secret));
+   params->version      = SSL_SESSION_get_protocol_version(current);
+   params->cipher_suite = SSL_CIPHER_get_protocol_id(SSL_SESSION_get0_cipher(current));
+}
+
+/** SHA-1 of the server certificate against the fingerprint, only in a full handshake. */
+inline bool WiFiClientSecure::checkFingerprint()
+{
+   X509         *cert;
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int  length = 0;
+   bool          ok;
+
+   if (insecure || SSL_session_reused(ssl)) {
+      return true;
+   }
+   if (!hasFingerprint || (cert = SSL_get1_peer_certificate(ssl)) == NULL) {
+      return false;
+   }
+   ok = X509_digest(cert, EVP_sha1(), digest, &length) && length == sizeof(fingerprint) &&
+        memcmp(digest, fingerprint, sizeof(fingerprint)) == 0;
+   X509_free(cert);
+   return ok;
+}
+
+/** TCP connect and handshake, offers the session of setSession(). */
+inline int WiFiClientSecure::connect(const char *host, uint16_t port)
+{
+   unsigned long start = millis();
+   int           ret;
+
+   stop();
+   lastError = 0;
+   if (!ctx) {
+      ctx = SSL_CTX_new(TLS_client_method());
+      SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET | SSL_OP_NO_EXTENDED_MASTER_SECRET);
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+   }
+   if (!WiFiClient::connect(host, port)) {
+      lastError = -1;
+      return 0;
+   }
+   ssl    = SSL_new(ctx);
+   input  = BIO_new(BIO_s_mem());
+   output = BIO_new(BIO_s_mem());
+   SSL_set_bio(ssl, input, output);
+   SSL_set_connect_state(ssl);
+   SSL_set_tlsext_host_name(ssl, host);
+   sessionToSsl();
+
+   while ((ret = SSL_do_handshake(ssl)) != 1) {
+      if (SSL_get_error(ssl, ret) != SSL_ERROR_WANT_READ || !flushOutput()) {
+         break;
+      }
+      if (!receive()) {
+         if (!WiFiClient::connected() || millis() - start >= HOST_TLS_TIMEOUT_MS) {
+            break;
+         }
+         delay(1);
+      }
+   }
+   if (ret != 1 || !flushOutput() || !checkFingerprint()) {
+      lastError = ret == 1 ? -2 : (int) ERR_GET_REASON(ERR_peek_last_error());
+      ERR_clear_error();
+      stop();
+      return 0;
+   }
+   sslToSession();
+   return 1;
+}
+
+inline size_t WiFiClientSecure::write(const uint8_t *buf, size_t size)
+{
+   if (!ssl || !size || SSL_write(ssl, buf, size) <= 0 || !flushOutput()) {
+      return 0;
+   }
+   return size;
+}
+
+inline int WiFiClientSecure::available()
+{
+   if (ssl && plain.empty()) {
+      decrypt();
+   }
+   return plain.size();
+}
+
+inline int WiFiClientSecure::read(uint8_t *buf, size_t size)
+{
+   size_t n = min(size, (size_t) available());
+
+   if (!n) {
+      return -1;
+   }
+   memcpy(buf, plain.data(), n);
+   plain.erase(0, n);
+   return n;
+}
+
+/** Sends the close_notify and closes the connection. */
+inline void WiFiClientSecure::stop()
+{
+   if (ssl && WiFiClient::connected()) {
+      SSL_shutdown(ssl);
+      flushOutput();
+   }
+   release();
+   WiFiClient::stop();
+}
+
+inline int WiFiClientSecure::getLastSSLError(char *dest, size_t length)
+{
+   const char *reason = lastError > 0 ? ERR_reason_error_string(ERR_PACK(ERR_LIB_SSL, 0, lastError)) : NULL;
+
+   if (dest && length) {
+      snprintf(dest, length, "%s", reason ? reason : lastError == -2 ? "fingerprint mismatch" : lastError ? "connect failed" : "");
+   }
+   return lastError;
+}
+
+}
+
+using namespace BearSSL;
@@ -0,0 +1,208 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Sim.h
+  *
+  * Virtual clock, scripted sensors and the per boot results of the simulator.
+  */
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+#define SIM_BOOT_US      150000 //!< Time from the reset to setup() (boot loader and SDK start).
+#define SIM_CLOCK_READ_US     1 //!< Every clock read costs this much, so busy waits end.
+#define SIM_CPU_MA         20.0 //!< Awake with the radio off (modem sleep) in mA.
+
+/**
+  * Parameters of one simulation run.
+  */
+struct SimConfig
+{
+   double      days            = 90.0;       //!< Simulated time.
+   double      reportDays      = 30.0;       //!< Length of one report period.
+   long        startEpoch      = 1609459200; //!< Unix time of the power on (2021-01-01 00:00 UTC).
+   uint64_t    seed            = 1;          //!< Seed of the random WiFi latencies and failures.
+   long        wifiLatencyMs   = 2500;       //!< Time of a successful WiFi association.
+   long        wifiJitterMs    = 1500;       //!< Random extra association time 0..jitter.
+   double      wifiFailureRate = 0.05;       //!< Probability that an association never succeeds.
+   int         wifiRssi        = -67;        //!< Signal strength of the access point.
+   bool        brokerEnabled   = true;       //!< Does the MQTT broker accept connections?
+   bool        realBroker      = false;      //!< MQTT to the broker of the options instead of the stand-in.
+   long        brokerLatencyMs = 50;         //!< Time of the TCP connect to the broker.
+   double      rtcFactor       = 1.09;       //!< The RTC runs this much fast: real sleep = requested / factor.
+   double      cpuMa           = SIM_CPU_MA;                   //!< Awake with the radio off.
+   double      radioMa         = POWER_CONSUMPTION_ACTIVE;     //!< Awake with the radio on.
+   double      sleepMa         = POWER_CONSUMPTION_DEEP_SLEEP; //!< In deep sleep.
+   bool        verbose         = false;      //!< Show the serial output of the firmware.
+   std::string script;                       //!< Sensor script file, empty = built-in day.
+   std::vector<std::string> options;         //!< 'key=value' lines for the options file.
+};
+
+/**
+  * Virtual time of the simulation. The firmware only sees the time since
+  * its last boot, the sensors and the SNTP time the absolute time.
+  */
+struct SimClock
+{
+   static inline uint64_t bootUs = 0; //!< Absolute time of the current boot.
+   static inline uint64_t nowUs  = 0; //!< Time since the current boot.
+   static inline uint64_t endUs  = 0; //!< Absolute end of the simulation.
+
+   static uint64_t absoluteUs() { return bootUs + nowUs; }
+   static bool     isOver()     { return absoluteUs() >= endUs; }
+};
+
+/**
+  * One sensor sample of the script.
+  */
+struct SimSample
+{
+   double sec;         //!< Time since the power on, the script repeats after the last sample.
+   double temperature; //!< Degree celsius.
+   double humidity;    //!< Percent.
+   double pressure;    //!< hPa.
+   double voltage;     //!< Supply voltage at the ADC divider.
+};
+
+/**
+  * Scripted BME280 and ADC values. Linear between the samples.
+  * The script file has one sample per line:
+  *   seconds temperature humidity pressure voltage
+  */
+class SimScript
+{
+protected:
+   std::vector<SimSample> samples; //!< Sorted by time, the first at 0.
+
+public:
+   SimScript();
+
+   bool      load(const char *fileName);
+   SimSample at(double sec) const;
+};
+
+/* ******************************************** */
+
+/** Built-in day: cool damp night, warm day and the battery charged by the solar panel. */
+SimScript::SimScript()
+{
+   samples = {
+      {     0.0, 12.0, 80.0, 1013.0, 3.62 },
+      { 21600.0, 10.0, 85.0, 1013.5, 3.55 },
+      { 36000.0, 19.0, 60.0, 1012.0, 3.95 },
+      { 50400.0, 24.0, 45.0, 1011.0, 4.15 },
+      { 72000.0, 16.0, 65.0, 1012.0, 3.80 },
+      { 86400.0, 12.0, 80.0, 1013.0, 3.62 },
+   };
+}
+
+/** Reads the samples of a script file. '#' starts a comment line. */
+bool SimScript::load(const char *fileName)
+{
+   FILE                  *file = fopen(fileName, "r");
+   std::vector<SimSample> loaded;
+   char                   line[256];
+
+   if (!file) {
+      return false;
+   }
+   while (fgets(line, sizeof(line), file)) {
+      SimSample s;
+
+      if (line[0] == '#') {
+         continue;
+      }
+      if (sscanf(line, "%lf %lf %lf %lf %lf", &s.sec, &s.temperature, &s.humidity, &s.pressure, &s.voltage) == 5) {
+         if (loaded.size() && s.sec <= loaded.back().sec) {
+            fclose(file);
+            return false;
+         }
+         loaded.push_back(s);
+      }
+   }
+   fclose(file);
+   if (loaded.empty() || loaded[0].sec != 0.0) {
+      return false;
+   }
+   samples = loaded;
+   return true;
+}
+
+/** Interpolated sample at sec seconds since the power on. */
+SimSample SimScript::at(double sec) const
+{
+   double period = samples.back().sec;
+
+   if (samples.size() == 1 || period <= 0.0) {
+      return samples[0];
+   }
+   sec = fmod(sec, period);
+
+   size_t i = 1;
+
+   while (samples[i].sec < sec) {
+      i++;
+   }
+
+   const SimSample &a = samples[i - 1];
+   const SimSample &b = samples[i];
+   double           f = (sec - a.sec) / (b.sec - a.sec);
+   SimSample        s;
+
+   s.sec         = sec;
+   s.temperature = a.temperature + f * (b.temperature - a.temperature);
+   s.humidity    = a.humidity    + f * (b.humidity    - a.humidity);
+   s.pressure    = a.pressure    + f * (b.pressure    - a.pressure);
+   s.voltage     = a.voltage     + f * (b.voltage     - a.voltage);
+   return s;
+}
+
+/**
+  * Counters of one boot.
+  */
+struct SimStats
+{
+   uint64_t awakeUs;       //!< From the reset to the deep sleep.
+   uint64_t radioUs;       //!< WiFi mode not off.
+   uint32_t wifiAttempts;  //!< WiFi.begin calls.
+   uint32_t wifiFailures;  //!< Associations which never succeed.
+   uint32_t mqttConnects;  //!< Accepted broker connections.
+   uint32_t mqttPublishes; //!< Published messages.
+   uint64_t mqttBytes;     //!< Bytes of the PUBLISH packets.
+};
+
+/** How one boot ended. */
+enum SimBootEnd
+{
+   SIM_BOOT_DEEP_SLEEP, //!< ESP.deepSleep
+   SIM_BOOT_RESTART,    //!< ESP.restart
+   SIM_BOOT_END,        //!< End of the simulated time
+};
+
+/**
+  * Result of one boot, sent from the boot process to the simulator.
+  */
+struct SimBootResult
+{
+   int      end;                               //!< SimBootEnd
+   uint64_t sleepUs;                           //!< Real deep sleep time.
+   SimStats stats;                             //!< Counters of the boot.
+   uint8_t  rtcMemory[RTC_USER_MEMORY_SIZE];   //!< RTC user memory at the end.
+};
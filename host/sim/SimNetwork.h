@@ -0,0 +1,304 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file SimNetwork.h
+  *
+  * Simulated WiFi with association latency and failures and an in memory
+  * MQTT broker stand-in or a real broker for the TLS tests.
+  */
+
+#pragma once
+
+#include "Sim.h"
+#include <ESP8266WiFi.h>
+#include <deque>
+#include <unistd.h>
+
+/**
+  * Connection to the broker stand-in. Answers CONNECT, SUBSCRIBE and
+  * PINGREQ like a broker and counts the PUBLISH packets (QoS 0) and their bytes.
+  */
+class SimBrokerConnection : public HostConnection
+{
+protected:
+   SimStats            &stats;   //!< Counters of the current boot.
+   bool                 verbose; //!< Print the published values.
+   std::vector<uint8_t> input;   //!< Received bytes of incomplete packets.
+   std::deque<uint8_t>  output;  //!< Answers not read by the client.
+   bool                 open;    //!< Until DISCONNECT or close.
+
+   void handlePacket(uint8_t header, const uint8_t *body, size_t length);
+
+public:
+   SimBrokerConnection(SimStats &s, bool v) : stats(s), verbose(v), open(true) { }
+
+   virtual int    available()         { return output.size(); }
+   virtual int    read(uint8_t *buf, size_t size);
+   virtual int    peek()              { return output.empty() ? -1 : output.front(); }
+   virtual size_t write(const uint8_t *buf, size_t size);
+   virtual size_t availableForWrite() { return open ? 1460 : 0; }
+   virtual bool   connected()         { return open; }
+   virtual void   close()             { open = false; }
+};
+
+/**
+  * Socket to a real broker. Waits 1 ms of real time when nothing was
+  * received, so the virtual clock of the reading loops roughly keeps pace
+  * with the broker. Counts the sent bytes, TLS records included.
+  */
+class SimRealConnection : public HostConnection
+{
+protected:
+   std::shared_ptr<HostConnection> conn;  //!< Host socket.
+   SimStats                       &stats; //!< Counters of the current boot.
+
+public:
+   SimRealConnection(std::shared_ptr<HostConnection> c, SimStats &s) : conn(c), stats(s) { stats.mqttConnects++; }
+
+   virtual int available()
+   {
+      int n = conn->available();
+
+      if (!n && conn->connected()) {
+         usleep(1000);
+         n = conn->available();
+      }
+      return n;
+   }
+   virtual int    read(uint8_t *buf, size_t size)        { return conn->read(buf, size); }
+   virtual int    peek()                                 { return conn->peek(); }
+   virtual size_t write(const uint8_t *buf, size_t size) { size = conn->write(buf, size); stats.mqttBytes += size; return size; }
+   virtual size_t availableForWrite()                    { return conn->availableForWrite(); }
+   virtual bool   connected()                            { return conn->connected(); }
+   virtual void   close()                                { conn->close(); }
+};
+
+/**
+  * WiFi and TCP of the simulation. The association succeeds after the
+  * configured latency plus a random jitter or never with the failure rate.
+  * The radio is on while the WiFi mode is not off.
+  */
+class SimNetwork : public HostNetwork
+{
+protected:
+   const SimConfig &config;      //!< Simulation parameters.
+   SimStats        &stats;       //!< Counters of the current boot.
+   uint64_t         random;      //!< xorshift state.
+   WiFiMode_t       mode;        //!< Current WiFi mode.
+   uint64_t         radioSince;  //!< Boot time of the radio switch on.
+   bool             begun;       //!< Association started.
+   bool             failing;     //!< Association will not succeed.
+   uint64_t         connectAt;   //!< Boot time of the successful association.
+
+   double nextRandom();
+
+public:
+   SimNetwork(const SimConfig &c, SimStats &s, uint64_t seed);
+
+   void finish();
+
+   virtual void        wifiBegin(const char *ssid, const char *password);
+   virtual wl_status_t wifiStatus();
+   virtual void        wifiMode(WiFiMode_t m);
+   virtual int32_t     wifiRSSI() { return config.wifiRssi; }
+
+   virtual std::shared_ptr<HostConnection> connect(const char *host, uint16_t port);
+   virtual std::shared_ptr<HostListener>   listen(uint16_t) { return std::shared_ptr<HostListener>(); }
+};
+
+/* ******************************************** */
+
+/** Hands out the answers of the broker. */
+int SimBrokerConnection::read(uint8_t *buf, size_t size)
+{
+   size_t n = 0;
+
+   while (n < size && !output.empty()) {
+      buf[n++] = output.front();
+      output.pop_front();
+   }
+   return n > 0 ? (int) n : -1;
+}
+
+/** Collects the bytes and handles every complete packet. */
+size_t SimBrokerConnection::write(const uint8_t *buf, size_t size)
+{
+   if (!open) {
+      return 0;
+   }
+   input.insert(input.end(), buf, buf + size);
+   for (;;) {
+      size_t length = 0;
+      size_t mul    = 1;
+      size_t pos    = 1;
+
+      if (input.size() < 2) {
+         break;
+      }
+      while (pos < input.size() && pos < 5) {
+         length += (input[pos] & 0x7F) * mul;
+         mul    *= 128;
+         if (!(input[pos++] & 0x80)) {
+            break;
+         }
+      }
+      if (input[pos - 1] & 0x80 || input.size() < pos + length) {
+         break;
+      }
+      handlePacket(input[0], input.data() + pos, length);
+      input.erase(input.begin(), input.begin() + pos + length);
+   }
+   return size;
+}
+
+/** Answers one packet of the client. */
+void SimBrokerConnection::handlePacket(uint8_t header, const uint8_t *body, size_t length)
+{
+   switch (header >> 4) {
+      case 1:  // CONNECT
+         stats.mqttConnects++;
+         output.insert(output.end(), { 0x20, 0x02, 0x00, 0x00 });
+         break;
+      case 3:  // PUBLISH
+         stats.mqttPublishes++;
+         stats.mqttBytes += 1 + (length < 128 ? 1 : length < 16384 ? 2 : 3) + length;
+         if (verbose && length >= 2) {
+            size_t topicLength = (body[0] << 8) | body[1];
+
+            if (topicLength + 2 <= length) {
+               const uint8_t *payload = body + 2 + topicLength;
+               size_t         size    = length - 2 - topicLength;
+               bool           text    = true;
+
+               for (size_t i = 0; i < size; i++) {
+                  text = text && payload[i] >= 0x20 && payload[i] < 0x7F;
+               }
+               printf("[sim] publish %.*s = ", (int) topicLength, body + 2);
+               if (text) {
+                  printf("%.*s\n", (int) size, payload);
+               } else {
+                  // Binary telemetry as hex.
+                  for (size_t i = 0; i < size; i++) {
+                     printf("%02x", payload[i]);
+                  }
+                  printf(" (%zu byte)\n", size);
+               }
+            }
+         }
+         break;
+      case 8:  // SUBSCRIBE
+         if (length >= 2) {
+            output.insert(output.end(), { 0x90, 0x03, body[0], body[1], 0x00 });
+         }
+         break;
+      case 12: // PINGREQ
+         output.insert(output.end(), { 0xD0, 0x00 });
+         break;
+      case 14: // DISCONNECT
+         open = false;
+         break;
+   }
+}
+
+/* ******************************************** */
+
+SimNetwork::SimNetwork(const SimConfig &c, SimStats &s, uint64_t seed)
+   : config(c)
+   , stats(s)
+   , random(0)
+   , mode(WIFI_OFF)
+   , radioSince(0)
+   , begun(false)
+   , failing(false)
+   , connectAt(0)
+{
+   // splitmix64, so neighbouring seeds give unrelated sequences.
+   seed  += 0x9E3779B97F4A7C15ULL;
+   seed   = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   seed   = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+   random = (seed ^ (seed >> 31)) | 1;
+}
+
+/** Uniform random number in [0, 1). */
+double SimNetwork::nextRandom()
+{
+   random ^= random << 13;
+   random ^= random >> 7;
+   random ^= random << 17;
+   return (random >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** Adds the radio time up to now, at the end of the boot. */
+void SimNetwork::finish()
+{
+   wifiMode(WIFI_OFF);
+}
+
+/** Starts an association, a NULL ssid disconnects. */
+void SimNetwork::wifiBegin(const char *ssid, const char *password)
+{
+   (void) password;
+   begun = ssid != NULL;
+   if (begun) {
+      stats.wifiAttempts++;
+      failing   = nextRandom() < config.wifiFailureRate;
+      connectAt = SimClock::nowUs + 1000ULL * (config.wifiLatencyMs + (long) (nextRandom() * config.wifiJitterMs));
+      if (failing) {
+         stats.wifiFailures++;
+      }
+   }
+}
+
+/** Connected after the association time of a successful attempt. */
+wl_status_t SimNetwork::wifiStatus()
+{
+   if (!(mode & WIFI_STA) || !begun) {
+      return WL_DISCONNECTED;
+   }
+   if (SimClock::nowUs < connectAt) {
+      return WL_DISCONNECTED;
+   }
+   return failing ? WL_NO_SSID_AVAIL : WL_CONNECTED;
+}
+
+/** Switches the radio and counts its on time. */
+void SimNetwork::wifiMode(WiFiMode_t m)
+{
+   if (mode != WIFI_OFF) {
+      stats.radioUs += SimClock::nowUs - radioSince;
+   }
+   radioSince = SimClock::nowUs;
+   if (m == WIFI_OFF) {
+      begun = false;
+   }
+   mode = m;
+}
+
+/** Every connection goes to the broker stand-in (or the real one) after the connect latency. */
+std::shared_ptr<HostConnection> SimNetwork::connect(const char *host, uint16_t port)
+{
+   if (wifiStatus() != WL_CONNECTED || !config.brokerEnabled) {
+      return std::shared_ptr<HostConnection>();
+   }
+   delay(config.brokerLatencyMs);
+   if (config.realBroker) {
+      std::shared_ptr<HostConnection> conn = HostNetwork::connect(host, port);
+
+      return conn ? std::make_shared<SimRealConnection>(conn, stats) : conn;
+   }
+   return std::make_shared<SimBrokerConnection>(stats, config.verbose);
+}
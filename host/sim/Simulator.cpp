@@ -0,0 +1,345 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Simulator.cpp
+  *
+  * Deterministic simulation of the unchanged firmware over months.
+  * Every boot runs setup() and loop() in a forked process against the
+  * virtual clock, so the RAM starts fresh like after a real reset while the
+  * RTC memory and the SPIFFS folder are handed to the next boot.
+  * The deep sleep only advances the virtual clock.
+  *
+  *   simulator [-d days] [-r reportDays] [-l wifiLatencyMs] [-j wifiJitterMs]
+  *             [-f wifiFailureRate] [-b brokerLatencyMs] [-B | -M] [-c rtcFactor]
+  *             [-s script] [-S seed] [-o key=value]... [-v]
+  *
+  * -M sends MQTT to the real broker of the options mqttServer and mqttPort
+  * (for example host/mqttbroker -t with isMqttTls), "pub KB" are then all
+  * sent bytes of the connections.
+  */
+
+#include <Arduino.h>
+#include "solarweather.ino"
+#include "Sim.h"
+#include "SimNetwork.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static SimConfig   simConfig;  //!< Parameters of the run.
+static SimScript   simScript;  //!< Sensor values.
+static SimStats    simStats;   //!< Counters of the running boot.
+static SimNetwork *simNetwork; //!< Network of the running boot.
+static int         simPipe;    //!< Result pipe of the running boot.
+
+/** The SNTP time of the firmware is the virtual time. */
+extern "C" time_t time(time_t *t)
+{
+   time_t now = simConfig.startEpoch + SimClock::absoluteUs() / 1000000;
+
+   if (t) {
+      *t = now;
+   }
+   return now;
+}
+
+/** Sends the result of the boot to the simulator and ends the boot process. */
+static void simFinishBoot(SimBootEnd end, uint64_t sleepUs)
+{
+   SimBootResult result;
+
+   simNetwork->finish();
+   simStats.awakeUs = SimClock::nowUs;
+   result.end       = end;
+   result.sleepUs   = sleepUs;
+   result.stats     = simStats;
+   memcpy(result.rtcMemory, ESP.rtcMemory, sizeof(result.rtcMemory));
+   fflush(stdout);
+   if (write(simPipe, &result, sizeof(result)) != sizeof(result)) {
+      _exit(2);
+   }
+   _exit(0);
+}
+
+static unsigned long simMillis()
+{
+   SimClock::nowUs += SIM_CLOCK_READ_US;
+   return SimClock::nowUs / 1000;
+}
+
+static unsigned long simMicros()
+{
+   SimClock::nowUs += SIM_CLOCK_READ_US;
+   return SimClock::nowUs;
+}
+
+static void simDelay(unsigned long ms)
+{
+   SimClock::nowUs += ms * 1000ULL;
+   if (SimClock::isOver()) {
+      simFinishBoot(SIM_BOOT_END, 0);
+   }
+}
+
+static int simAnalogRead(uint8_t)
+{
+   SimSample s = simScript.at(SimClock::absoluteUs() / 1e6);
+
+   return constrain((int) round(s.voltage / ANALOG_FACTOR), 0, 1023);
+}
+
+static bool simBme280(float &temperature, float &humidity, float &pressure)
+{
+   SimSample s = simScript.at(SimClock::absoluteUs() / 1e6);
+
+   temperature = s.temperature;
+   humidity    = s.humidity;
+   pressure    = s.pressure * 100.0; // Pa
+   return true;
+}
+
+/** The RTC runs fast, so the real sleep is shorter than requested. */
+static void simDeepSleep(uint64_t us)
+{
+   simFinishBoot(SIM_BOOT_DEEP_SLEEP, (uint64_t) (us / simConfig.rtcFactor));
+}
+
+static void simRestart()
+{
+   simFinishBoot(SIM_BOOT_RESTART, 0);
+}
+
+/** Runs one boot in this (forked) process. Does not return. */
+static void simBoot(int boot)
+{
+   HostRuntime &runtime = HostRuntime::get();
+   SimNetwork   network(simConfig, simStats, (simConfig.seed << 32) + boot);
+
+   runtime.millis     = simMillis;
+   runtime.micros     = simMicros;
+   runtime.delay      = simDelay;
+   runtime.analogRead = simAnalogRead;
+   runtime.bme280     = simBme280;
+   runtime.deepSleep  = simDeepSleep;
+   runtime.restart    = simRestart;
+
+   simNetwork             = &network;
+   HostNetwork::current() = &network;
+   Serial.enabled         = simConfig.verbose;
+   SimClock::nowUs        = SIM_BOOT_US;
+   srand(simConfig.seed + boot);
+
+   setup();
+   for (;;) {
+      loop();
+   }
+}
+
+/** Writes the options of the run as the (legacy, CRC less) options file. */
+static bool simWriteOptions(const std::string &root)
+{
+   std::string fileName = root + OPTION_FILE_NAME;
+   FILE       *file     = fopen(fileName.c_str(), "w");
+
+   if (!file) {
+      return false;
+   }
+   fprintf(file, "isDeepSleepEnabled=1\nconnectWifiAP=1\nisMqttEnabled=1\n");
+   for (const std::string &option : simConfig.options) {
+      fprintf(file, "%s\n", option.c_str());
+   }
+   fclose(file);
+   return true;
+}
+
+/**
+  * Sums of several boots.
+  */
+struct SimTotals
+{
+   uint32_t boots;         //!< Started boots.
+   uint32_t restarts;      //!< Boots ended by ESP.restart.
+   double   awakeSec;      //!< Awake time.
+   double   radioSec;      //!< Radio on time.
+   double   sleepSec;      //!< Deep sleep time.
+   uint32_t wifiAttempts;  //!< WiFi.begin calls.
+   uint32_t wifiFailures;  //!< Failed associations.
+   uint32_t mqttConnects;  //!< Broker connections.
+   uint32_t mqttPublishes; //!< Published messages.
+   uint64_t mqttBytes;     //!< Bytes of the published messages.
+
+   void add(const SimBootResult &result, double sleepSec);
+   double mAh() const;
+   void print(const char *name) const;
+};
+
+void SimTotals::add(const SimBootResult &result, double sleep)
+{
+   boots++;
+   restarts      += result.end == SIM_BOOT_RESTART;
+   awakeSec      += result.stats.awakeUs / 1e6;
+   radioSec      += result.stats.radioUs / 1e6;
+   sleepSec      += sleep;
+   wifiAttempts  += result.stats.wifiAttempts;
+   wifiFailures  += result.stats.wifiFailures;
+   mqttConnects  += result.stats.mqttConnects;
+   mqttPublishes += result.stats.mqttPublishes;
+   mqttBytes     += result.stats.mqttBytes;
+}
+
+/** Consumption with the power model of the run. */
+double SimTotals::mAh() const
+{
+   return (simConfig.cpuMa   * (awakeSec - radioSec) +
+           simConfig.radioMa * radioSec +
+           simConfig.sleepMa * sleepSec) / 3600.0;
+}
+
+void SimTotals::print(const char *name) const
+{
+   double hours = (awakeSec + sleepSec) / 3600.0;
+
+   printf("%-8s %6u %9.2f %9.2f %9.1f %9.1f %7.3f %7u %7.1f %5u/%-5u\n", name, boots, awakeSec / 3600.0, radioSec / 3600.0,
+          sleepSec / 3600.0, mAh(), hours > 0 ? mAh() / hours : 0.0, mqttPublishes, mqttBytes / 1024.0, wifiFailures, wifiAttempts);
+}
+
+int main(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:r:l:j:f:b:BMc:s:S:o:v")) != -1) {
+      switch (opt) {
+         case 'd': simConfig.days            = atof(optarg);  break;
+         case 'r': simConfig.reportDays      = atof(optarg);  break;
+         case 'l': simConfig.wifiLatencyMs   = atol(optarg);  break;
+         case 'j': simConfig.wifiJitterMs    = atol(optarg);  break;
+         case 'f': simConfig.wifiFailureRate = atof(optarg);  break;
+         case 'b': simConfig.brokerLatencyMs = atol(optarg);  break;
+         case 'B': simConfig.brokerEnabled   = false;         break;
+         case 'M': simConfig.realBroker      = true;          break;
+         case 'c': simConfig.rtcFactor       = atof(optarg);  break;
+         case 's': simConfig.script          = optarg;        break;
+         case 'S': simConfig.seed            = atoll(optarg); break;
+         case 'o': simConfig.options.push_back(optarg);       break;
+         case 'v': simConfig.verbose         = true;          break;
+         default:
+            fprintf(stderr, "usage: %s [-d days] [-r reportDays] [-l wifiLatencyMs] [-j wifiJitterMs] [-f wifiFailureRate]\n"
+                            "          [-b brokerLatencyMs] [-B | -M] [-c rtcFactor] [-s script] [-S seed] [-o key=value]... [-v]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (simConfig.script.size() && !simScript.load(simConfig.script.c_str())) {
+      fprintf(stderr, "Invalid script %s\n", simConfig.script.c_str());
+      return 1;
+   }
+   if (simConfig.rtcFactor <= 0.0 || simConfig.reportDays <= 0.0) {
+      fprintf(stderr, "Invalid rtc factor or report period\n");
+      return 1;
+   }
+
+   char root[] = "/tmp/simulatorXXXXXX";
+
+   if (!mkdtemp(root) || !simWriteOptions(root)) {
+      perror("simulator");
+      return 1;
+   }
+   SPIFFS.setRoot(root);
+
+   uint64_t  periodUs = (uint64_t) (simConfig.reportDays * 86400e6);
+   uint64_t  nowUs    = 0;
+   uint64_t  nextUs   = periodUs;
+   int       period   = 1;
+   int       boot     = 0;
+   SimTotals total    = {};
+   SimTotals part     = {};
+   char      name[16];
+
+   SimClock::endUs = (uint64_t) (simConfig.days * 86400e6);
+   printf("%.1f days, WiFi %ld+%ld ms %.0f%% failures, broker %s, rtc factor %.2f, seed %llu\n",
+          simConfig.days, simConfig.wifiLatencyMs, simConfig.wifiJitterMs, simConfig.wifiFailureRate * 100.0,
+          !simConfig.brokerEnabled ? "off" : simConfig.realBroker ? "real" : "on", simConfig.rtcFactor, (unsigned long long) simConfig.seed);
+   printf("%-8s %6s %9s %9s %9s %9s %7s %7s %7s %11s\n", "period", "boots", "awake h", "radio h", "sleep h", "mAh", "mA avg", "publish", "pub KB", "wifi fail");
+
+   while (nowUs < SimClock::endUs) {
+      SimBootResult result;
+      int           fds[2];
+
+      SimClock::bootUs = nowUs;
+      if (pipe(fds) != 0) {
+         perror("pipe");
+         return 1;
+      }
+      fflush(stdout);
+
+      pid_t pid = fork();
+
+      if (pid < 0) {
+         perror("fork");
+         return 1;
+      }
+      if (pid == 0) {
+         close(fds[0]);
+         simPipe = fds[1];
+         simBoot(boot);
+      }
+      close(fds[1]);
+
+      ssize_t n = read(fds[0], &result, sizeof(result));
+      int     status;
+
+      close(fds[0]);
+      waitpid(pid, &status, 0);
+      if (n != sizeof(result)) {
+         fprintf(stderr, "Boot %d at %.1f days ended without result (status %d)\n", boot, nowUs / 86400e6, status);
+         return 1;
+      }
+
+      uint64_t awakeEndUs = nowUs + result.stats.awakeUs;
+      uint64_t sleepUs    = min(result.sleepUs, awakeEndUs < SimClock::endUs ? SimClock::endUs - awakeEndUs : 0);
+
+      memcpy(ESP.rtcMemory, result.rtcMemory, sizeof(ESP.rtcMemory));
+      part.add(result, sleepUs / 1e6);
+      total.add(result, sleepUs / 1e6);
+      nowUs = awakeEndUs + sleepUs;
+      boot++;
+      while (nowUs >= nextUs || (nowUs >= SimClock::endUs && part.boots)) {
+         snprintf(name, sizeof(name), "%d", period++);
+         part.print(name);
+         part    = {};
+         nextUs += periodUs;
+      }
+   }
+   total.print("total");
+
+   MyData::RtcData rtcData;
+
+   memcpy(&rtcData, ESP.rtcMemory, sizeof(rtcData));
+   if (rtcData.isValid()) {
+      printf("firmware: %.1f mAh estimated, %ld MQTT sent, %ld connect and %ld send errors, overruns",
+             (POWER_CONSUMPTION_ACTIVE * rtcData.activeTimeSumSec + POWER_CONSUMPTION_DEEP_SLEEP * rtcData.deepSleepTimeSumSec) / 3600.0,
+             rtcData.mqttSendCount, rtcData.mqttConnErrorCount, rtcData.mqttSendErrorCount);
+      for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+         printf(" %s %ld", awakePhaseName(i).c_str(), rtcData.overrunCount[i]);
+      }
+      printf("\n");
+   }
+   SPIFFS.remove(OPTION_FILE_NAME);
+   SPIFFS.remove(OPTION_TEMP_FILE_NAME);
+   SPIFFS.remove(OPTION_BACKUP_FILE_NAME);
+   rmdir(root);
+   return 0;
+}
@@ -0,0 +1,467 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Host.cpp
+  *
+  * Implementation of the host replacements: the default runtime with the
+  * real clock, the socket based network and the synchronous web server.
+  */
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h>
+#include <ArduinoOTA.h>
+
+#include <chrono>
+#include <thread>
+#include <csetjmp>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+HardwareSerial   Serial;
+EspClass         ESP;
+FS               SPIFFS;
+ESP8266WiFiClass WiFi;
+ArduinoOTAClass  ArduinoOTA;
+
+/* ******************************************** */
+
+static std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+
+static unsigned long hostMillis()
+{
+   return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+static unsigned long hostMicros()
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+static void hostDelay(unsigned long ms)
+{
+   std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static int hostAnalogRead(uint8_t)
+{
+   return 120; // 3.72 V with ANALOG_FACTOR 0.031
+}
+
+static bool hostBme280(float &temperature, float &humidity, float &pressure)
+{
+   temperature = 21.5f;
+   humidity    = 48.0f;
+   pressure    = 96000.0f;
+   return true;
+}
+
+static void hostDeepSleep(uint64_t us)
+{
+   printf("\n[host] deep sleep for %llu s requested, exit\n", (unsigned long long) (us / 1000000));
+   exit(0);
+}
+
+static void hostRestart()
+{
+   printf("\n[host] restart requested, exit\n");
+   exit(0);
+}
+
+HostRuntime &HostRuntime::get()
+{
+   static HostRuntime runtime = { hostMillis, hostMicros, hostDelay, hostAnalogRead, hostBme280, hostDeepSleep, hostRestart };
+   return runtime;
+}
+
+/* ******************************************** */
+
+/**
+  * Non blocking host socket.
+  */
+class SocketConnection : public HostConnection
+{
+protected:
+   int fd; //!< Socket descriptor or -1.
+
+public:
+   SocketConnection(int f) : fd(f)
+   {
+      int one = 1;
+
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   }
+   virtual ~SocketConnection() { close(); }
+
+   virtual int available()
+   {
+      int n = 0;
+
+      if (fd < 0 || ioctl(fd, FIONREAD, &n) != 0) {
+         return 0;
+      }
+      return n;
+   }
+   virtual int read(uint8_t *buf, size_t size)
+   {
+      if (fd < 0) {
+         return -1;
+      }
+      ssize_t n = ::recv(fd, buf, size, 0);
+      return n > 0 ? (int) n : -1;
+   }
+   virtual int peek()
+   {
+      uint8_t c;
+
+      return fd >= 0 && ::recv(fd, &c, 1, MSG_PEEK) == 1 ? c : -1;
+   }
+   virtual size_t write(const uint8_t *buf, size_t size)
+   {
+      size_t sent = 0;
+
+      while (fd >= 0 && sent < size) { // blocking like the ESP8266 write
+         ssize_t n = ::send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+
+         if (n > 0) {
+            sent += n;
+         } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd p = { fd, POLLOUT, 0 };
+            poll(&p, 1, 100);
+         } else {
+            break;
+         }
+      }
+      return sent;
+   }
+   virtual size_t availableForWrite()
+   {
+      struct pollfd p = { fd, POLLOUT, 0 };
+
+      return fd >= 0 && poll(&p, 1, 0) == 1 && (p.revents & POLLOUT) ? 1460 : 0;
+   }
+   virtual bool connected()
+   {
+      if (fd < 0) {
+         return false;
+      }
+      uint8_t c;
+      ssize_t n = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+      return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+   }
+   virtual void close()
+   {
+      if (fd >= 0) {
+         ::close(fd);
+         fd = -1;
+      }
+   }
+};
+
+/**
+  * Non blocking listening host socket.
+  */
+class SocketListener : public HostListener
+{
+protected:
+   int fd; //!< Socket descriptor or -1.
+
+public:
+   SocketListener(int f) : fd(f) { fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK); }
+   virtual ~SocketListener() { close(); }
+
+   virtual std::shared_ptr<HostConnection> accept()
+   {
+      int c = fd >= 0 ? ::accept(fd, NULL, NULL) : -1;
+
+      if (c < 0) {
+         return std::shared_ptr<HostConnection>();
+      }
+      return std::make_shared<SocketConnection>(c);
+   }
+   virtual void close()
+   {
+      if (fd >= 0) {
+         ::close(fd);
+         fd = -1;
+      }
+   }
+};
+
+std::shared_ptr<HostConnection> HostNetwork::connect(const char *host, uint16_t port)
+{
+   struct addrinfo  hints = {};
+   struct addrinfo *res   = NULL;
+   char             service[8];
+
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   snprintf(service, sizeof(service), "%u", port);
+   if (getaddrinfo(host, service, &hints, &res) != 0 || !res) {
+      return std::shared_ptr<HostConnection>();
+   }
+   int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+   if (fd < 0 || ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+      if (fd >= 0) {
+         ::close(fd);
+      }
+      freeaddrinfo(res);
+      return std::shared_ptr<HostConnection>();
+   }
+   freeaddrinfo(res);
+   return std::make_shared<SocketConnection>(fd);
+}
+
+std::shared_ptr<HostListener> HostNetwork::listen(uint16_t port)
+{
+   const char *portEnv = getenv("HOST_HTTP_PORT"); // port 80 needs root on the host
+   int         fd      = socket(AF_INET, SOCK_STREAM, 0);
+   int         one     = 1;
+   sockaddr_in addr    = {};
+
+   if (port == 80 && portEnv) {
+      port = atoi(portEnv);
+   }
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+      if (fd >= 0) {
+         ::close(fd);
+      }
+      return std::shared_ptr<HostListener>();
+   }
+   return std::make_shared<SocketListener>(fd);
+}
+
+HostNetwork *&HostNetwork::current()
+{
+   static HostNetwork  defaultNetwork;
+   static HostNetwork *network = &defaultNetwork;
+   return network;
+}
+
+/* ******************************************** */
+
+void ESP8266WebServer::handleClient()
+{
+   WiFiClient client = _server.available();
+
+   if (!client) {
+      return;
+   }
+   if (!parseRequest(client)) {
+      client.stop();
+      return;
+   }
+   _currentClient   = client;
+   _responseHeaders = String();
+   _contentLength   = CONTENT_LENGTH_NOT_SET;
+   _chunked         = false;
+
+   bool handled = false;
+
+   for (auto &r : _routes) {
+      if (r.uri == _currentUri && (r.method == HTTP_ANY || r.method == _currentMethod)) {
+         r.fn();
+         handled = true;
+         break;
+      }
+   }
+   if (!handled) {
+      if (_notFoundHandler) {
+         _notFoundHandler();
+      } else {
+         send(404, "text/plain", "Not found");
+      }
+   }
+   finishResponse();
+   _currentClient = WiFiClient();
+}
+
+bool ESP8266WebServer::parseRequest(WiFiClient &client)
+{
+   String        request;
+   unsigned long start = millis();
+
+   while (request.indexOf(F("\r\n\r\n")) == -1) {
+      int c = client.read();
+
+      if (c < 0) {
+         if (!client.connected() || millis() - start > 2000 || request.length() > 4096) {
+            return false;
+         }
+         delay(1);
+         continue;
+      }
+      request += (char) c;
+   }
+
+   int    lineEnd = request.indexOf(F("\r\n"));
+   String line    = request.substring(0, lineEnd);
+   int    sp1     = line.indexOf(' ');
+   int    sp2     = line.indexOf(' ', sp1 + 1);
+
+   if (sp1 == -1 || sp2 == -1) {
+      return false;
+   }
+   String method = line.substring(0, sp1);
+   String url    = line.substring(sp1 + 1, sp2);
+
+   _currentMethod = method == F("POST") ? HTTP_POST : method == F("HEAD") ? HTTP_HEAD : HTTP_GET;
+   _args.clear();
+   _headers.clear();
+
+   int q = url.indexOf('?');
+   if (q != -1) {
+      parseArguments(url.substring(q + 1));
+      url = url.substring(0, q);
+   }
+   _currentUri = urlDecode(url);
+
+   size_t contentLength = 0;
+   for (int pos = lineEnd + 2; pos < (int) request.length(); ) {
+      int    end   = request.indexOf(F("\r\n"), pos);
+      String h     = request.substring(pos, end);
+      int    colon = h.indexOf(':');
+
+      if (end == -1 || h.length() == 0) {
+         break;
+      }
+      if (colon != -1) {
+         String name  = h.substring(0, colon);
+         String value = h.substring(colon + 1);
+
+         value.trim();
+         if (name.equalsIgnoreCase(F("Content-Length"))) {
+            contentLength = value.toInt();
+         }
+         for (auto &k : _collectHeaders) {
+            if (k.equalsIgnoreCase(name)) {
+               _headers.push_back({ name, value });
+            }
+         }
+      }
+      pos = end + 2;
+   }
+   if (contentLength > 0 && contentLength < 16384) {
+      String body;
+
+      start = millis();
+      while (body.length() < contentLength && millis() - start < 2000) {
+         int c = client.read();
+
+         if (c < 0) {
+            delay(1);
+            continue;
+         }
+         body += (char) c;
+      }
+      parseArguments(body);
+   }
+   return true;
+}
+
+void ESP8266WebServer::parseArguments(const String &data)
+{
+   for (int pos = 0; pos < (int) data.length(); ) {
+      int    amp = data.indexOf('&', pos);
+      String kv  = data.substring(pos, amp == -1 ? data.length() : amp);
+      int    eq  = kv.indexOf('=');
+
+      if (kv.length() > 0) {
+         _args.push_back({ urlDecode(eq == -1 ? kv : kv.substring(0, eq)), eq == -1 ? String() : urlDecode(kv.substring(eq + 1)) });
+      }
+      if (amp == -1) {
+         break;
+      }
+      pos = amp + 1;
+   }
+}
+
+String ESP8266WebServer::urlDecode(const String &text)
+{
+   String ret;
+
+   for (unsigned int i = 0; i < text.length(); i++) {
+      char c = text[i];
+
+      if (c == '+') {
+         ret += ' ';
+      } else if (c == '%' && i + 2 < text.length()) {
+         char hex[3] = { text[i + 1], text[i + 2], 0 };
+         ret += (char) strtol(hex, NULL, 16);
+         i   += 2;
+      } else {
+         ret += c;
+      }
+   }
+   return ret;
+}
+
+const char *ESP8266WebServer::responseCodeToString(int code)
+{
+   switch (code) {
+      case 200: return "OK";
+      case 204: return "No Content";
+      case 302: return "Found";
+      case 304: return "Not Modified";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 500: return "Internal Server Error";
+      case 503: return "Service Unavailable";
+      default:  return "";
+   }
+}
+
+void ESP8266WebServer::sendResponse(int code, const char *contentType, const char *content, size_t length)
+{
+   String head = String(F("HTTP/1.1 ")) + String(code) + F(" ") + responseCodeToString(code) + F("\r\n");
+
+   head += String(F("Content-Type: ")) + contentType + F("\r\n");
+   if (_contentLength == CONTENT_LENGTH_UNKNOWN) {
+      _chunked = true;
+      head += F("Transfer-Encoding: chunked\r\n");
+   } else {
+      head += String(F("Content-Length: ")) + String((unsigned long) (_contentLength == CONTENT_LENGTH_NOT_SET ? length : _contentLength)) + F("\r\n");
+   }
+   head += _responseHeaders;
+   head += F("Connection: close\r\n\r\n");
+   _responseHeaders = String();
+   _currentClient.write(head.c_str(), head.length());
+   if (content && length > 0) {
+      sendContent(content, length);
+   }
+}
+
+void ESP8266WebServer::finishResponse()
+{
+   if (_chunked) {
+      _currentClient.write("0\r\n\r\n");
+      _chunked = false;
+   }
+}
@@ -0,0 +1,750 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FleetLoad.cpp
+  *
+  * Load generator of many virtual SolarWeatherBoxes against an MQTT broker.
+  * Every box wakes every -e seconds like MyMqtt::handleClient: connect with
+  * up to -R attempts one second apart, publish the retained values of the
+  * firmware topics as mqttName/mqttId/..., stay connected -k ms and drop the
+  * connection without DISCONNECT when the WiFi goes off.
+  * The wakes start at a random phase per box or, with -a, all at the same
+  * time (a fleet synchronized by a firmware roll-out). The outage -O
+  * start:length[:fraction] keeps a part of the fleet down, those boxes all
+  * boot together at its end.
+  * An observer subscribes mqttName/# and measures the latency from the
+  * publish to the delivery. What it does not receive after -D ms is dropped.
+  *
+  *   fleetload [-h host] [-p port] [-n boxes] [-e everySec] [-t durationSec] [-a] [-j jitterMs]
+  *             [-k holdMs] [-R retries] [-O start:length[:fraction]] [-T threads] [-D drainMs]
+  *             [-N mqttName] [-u user] [-w password] [-S seed]
+  */
+
+#include "MqttWire.h"
+#include "MqttTopics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+typedef std::chrono::steady_clock Clock;
+
+#define FLEET_CONNECT_TIMEOUT_MS 10000 //!< Give up one connect attempt.
+#define FLEET_RETRY_DELAY_MS      1000 //!< MyDelay(1000) between the attempts.
+
+/** Published sub topics in the order of MyMqtt::handleClient (without the heap statistics). */
+static const char *fleetTopics[] = {
+   topic_temperature, topic_humidity, topic_pressure, topic_time, topic_voltage, topic_mAh,
+   topic_alive, topic_rssi, topic_conn_error_count, topic_send_error_count,
+   topic_overrun "WiFi", topic_overrun "Time", topic_overrun "Mqtt", topic_overrun "Web",
+   topic_trace, topic_heap_free, topic_heap_max_block, topic_heap_frag, topic_heap_low_water,
+};
+
+#define FLEET_TOPIC_COUNT (int) (sizeof(fleetTopics) / sizeof(fleetTopics[0]))
+
+/** Command line options. */
+struct Options
+{
+   std::string host           = "127.0.0.1";       //!< Broker host.
+   std::string port           = "1883";            //!< Broker port.
+   int         boxes          = 1000;              //!< Virtual boxes.
+   int         everySec       = 60;                //!< mqttSendEverySec of the boxes.
+   int         durationSec    = 120;               //!< No new wakes after this time.
+   bool        aligned        = false;             //!< All boxes wake at the same time.
+   int         jitterMs       = 2000;              //!< Random wake delay (RTC drift, association time).
+   int         holdMs         = 5000;              //!< Connected after the publish.
+   int         retries        = 25;                //!< Connect attempts per wake.
+   double      outageStart    = -1.0;              //!< Begin of the outage in seconds, < 0 = none.
+   double      outageLength   = 0.0;               //!< Length of the outage.
+   double      outageFraction = 1.0;               //!< Part of the fleet in the outage.
+   int         threads        = 4;                 //!< Worker threads.
+   int         drainMs        = 3000;              //!< Wait for late deliveries.
+   std::string name           = "SolarWeatherBox"; //!< mqttName of the fleet.
+   std::string user;                               //!< mqttUser.
+   std::string password;                           //!< mqttPassword.
+   uint64_t    seed           = 1;                 //!< Seed of the phases, jitter and values.
+};
+
+/** Counters of all threads. */
+struct Results
+{
+   std::atomic<long>   wakes{0};           //!< Started wakes.
+   std::atomic<long>   missed{0};          //!< Wakes lost in the outage.
+   std::atomic<long>   attempts{0};        //!< TCP connects.
+   std::atomic<long>   failures{0};        //!< Failed attempts (refused, timeout, CONNACK error).
+   std::atomic<long>   givenUp{0};         //!< Wakes without connection after all attempts.
+   std::atomic<long>   sendErrors{0};      //!< Publishes the socket did not take.
+   std::atomic<long>   published{0};       //!< Sent PUBLISH packets.
+   std::atomic<long>   received{0};        //!< Delivered to the observer.
+   std::atomic<long>   overwritten{0};     //!< Published again before the last one was delivered.
+   std::atomic<long>   open{0};            //!< Open connections.
+   std::atomic<long>   maxOpen{0};         //!< Most open connections at once.
+   std::mutex          lock;               //!< Guards the vectors.
+   std::vector<double> connectMs;          //!< Connect to CONNACK.
+   std::vector<double> publishMs;          //!< Publish to delivery.
+   std::vector<int>    wakesPerSec;        //!< Started wakes per second of the run.
+};
+
+static Options                              options;
+static Results                              results;
+static std::unique_ptr<std::atomic<int64_t>[]> sentNs; //!< Publish time per box and topic, 0 = delivered.
+static Clock::time_point                    startTime;
+static std::atomic<bool>                    observerReady(false);
+static std::atomic<bool>                    observerStop(false);
+
+static int64_t nowNs()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - startTime).count();
+}
+
+/** Random numbers of one box or thread. */
+struct Random
+{
+   uint64_t state; //!< xorshift state.
+
+   explicit Random(uint64_t seed)
+   {
+      // splitmix64, so neighbouring seeds give unrelated sequences.
+      seed += 0x9E3779B97F4A7C15ULL;
+      seed  = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      seed  = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+      state = (seed ^ (seed >> 31)) | 1;
+   }
+
+   /** Uniform in [0, 1). */
+   double next()
+   {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return (state >> 11) * (1.0 / 9007199254740992.0);
+   }
+};
+
+/** Connection state of a box. */
+enum BoxState
+{
+   BOX_SLEEPING,   //!< Waiting for the next wake.
+   BOX_CONNECTING, //!< TCP connect in progress.
+   BOX_CONNACK,    //!< CONNECT sent.
+   BOX_HOLDING,    //!< Published, connected until the hold time is over.
+   BOX_RETRY,      //!< Waiting before the next attempt.
+};
+
+/** One virtual box. */
+struct Box
+{
+   int         index;        //!< Box number, mqttId = index + 1.
+   std::string prefix;       //!< mqttName/mqttId
+   int         fd;           //!< Socket or -1.
+   int         state;        //!< BoxState
+   uint32_t    generation;   //!< Invalidates older timers.
+   MqttReader  reader;       //!< Received packets.
+   std::string output;       //!< Unsent bytes.
+   int64_t     phaseNs;      //!< Wake n is at phaseNs + n * every.
+   long        wake;         //!< Number of the next wake since phaseNs.
+   int         attempt;      //!< Connect attempts of this wake.
+   int64_t     attemptNs;    //!< Start of the current attempt.
+   bool        inOutage;     //!< Affected by the outage.
+   Random      random;       //!< Jitter and values.
+   long        connErrors;   //!< Published as ConnErrorCount.
+   long        sendErrors;   //!< Published as SendErrorCount.
+   double      mAh;          //!< Published as mAh.
+
+   Box(int i) : index(i), fd(-1), state(BOX_SLEEPING), generation(0), phaseNs(0), wake(0), attempt(0),
+                attemptNs(0), inOutage(false), random(options.seed * 1000003 + i), connErrors(0), sendErrors(0), mAh(0.0) { }
+};
+
+/** Timer of a box, ordered by time. */
+struct Timer
+{
+   int64_t  atNs;       //!< Due time.
+   Box     *box;        //!< Owner.
+   uint32_t generation; //!< Box generation at the start.
+
+   bool operator>(const Timer &other) const { return atNs > other.atNs; }
+};
+
+/**
+  * Runs a slice of the fleet in one epoll loop.
+  */
+class Worker
+{
+protected:
+   std::vector<std::unique_ptr<Box> >                          boxes;     //!< Boxes of this worker.
+   std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > timers;    //!< Pending timers.
+   int                                                         epollFd;   //!< Event loop.
+   addrinfo                                                   *address;   //!< Broker address.
+   std::vector<double>                                         connectMs; //!< Connect latencies.
+   int                                                         active;    //!< Boxes with a wake left.
+
+   void addTimer(Box &box, int64_t atNs) { timers.push({ atNs, &box, box.generation }); }
+   void scheduleWake(Box &box);
+   void startAttempt(Box &box);
+   void failAttempt(Box &box);
+   void closeBox(Box &box);
+   void publish(Box &box);
+   bool flush(Box &box);
+   void onTimer(Box &box);
+   void onEvent(Box &box, uint32_t events);
+
+public:
+   Worker(addrinfo *addr) : epollFd(epoll_create1(0)), address(addr), active(0) { }
+   ~Worker() { close(epollFd); }
+
+   void add(int index);
+   void run();
+};
+
+/** Creates a box with its phase and outage membership. */
+void Worker::add(int index)
+{
+   std::unique_ptr<Box> box(new Box(index));
+   char                 id[16];
+
+   snprintf(id, sizeof(id), "%02d", index + 1);
+   box->prefix   = options.name + "/" + id;
+   box->phaseNs  = options.aligned ? 0 : (int64_t) (box->random.next() * options.everySec * 1e9);
+   box->inOutage = options.outageStart >= 0.0 && box->random.next() < options.outageFraction;
+   active++;
+   scheduleWake(*box);
+   boxes.push_back(std::move(box));
+}
+
+/** Plans the next wake. A box in the outage skips the wakes there and boots at its end. */
+void Worker::scheduleWake(Box &box)
+{
+   int64_t everyNs = (int64_t) options.everySec * 1000000000LL;
+   int64_t atNs    = box.phaseNs + box.wake * everyNs;
+
+   if (box.inOutage) {
+      int64_t beginNs = (int64_t) (options.outageStart * 1e9);
+      int64_t endNs   = (int64_t) ((options.outageStart + options.outageLength) * 1e9);
+
+      if (atNs >= beginNs && atNs < endNs) {
+         results.missed += (endNs - atNs + everyNs - 1) / everyNs;
+         box.phaseNs = endNs;
+         box.wake    = 0;
+         atNs        = endNs;
+      }
+   }
+   box.wake++;
+   atNs += (int64_t) (box.random.next() * options.jitterMs * 1e6);
+   box.state = BOX_SLEEPING;
+   box.generation++;
+   if (atNs < (int64_t) options.durationSec * 1000000000LL) {
+      addTimer(box, atNs);
+   } else {
+      active--;
+   }
+}
+
+/** Opens a non blocking connection to the broker. */
+void Worker::startAttempt(Box &box)
+{
+   epoll_event ev  = {};
+   int         one = 1;
+
+   box.attempt++;
+   box.attemptNs = nowNs();
+   box.generation++;
+   box.reader    = MqttReader();
+   box.output.clear();
+   results.attempts++;
+   box.fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+   if (box.fd < 0) {
+      failAttempt(box);
+      return;
+   }
+   setsockopt(box.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   if (connect(box.fd, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS) {
+      failAttempt(box);
+      return;
+   }
+
+   long open = ++results.open;
+   long max  = results.maxOpen;
+
+   while (open > max && !results.maxOpen.compare_exchange_weak(max, open)) {
+   }
+   box.state   = BOX_CONNECTING;
+   ev.events   = EPOLLOUT;
+   ev.data.ptr = &box;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, box.fd, &ev);
+   addTimer(box, box.attemptNs + FLEET_CONNECT_TIMEOUT_MS * 1000000LL);
+}
+
+void Worker::closeBox(Box &box)
+{
+   if (box.fd >= 0) {
+      if (box.state != BOX_SLEEPING && box.state != BOX_RETRY) {
+         results.open--;
+      }
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, box.fd, NULL);
+      close(box.fd);
+      box.fd = -1;
+   }
+}
+
+/** Retries after a second like the firmware or gives up this wake. */
+void Worker::failAttempt(Box &box)
+{
+   closeBox(box);
+   results.failures++;
+   if (box.attempt < options.retries) {
+      box.state = BOX_RETRY;
+      box.generation++;
+      addTimer(box, nowNs() + FLEET_RETRY_DELAY_MS * 1000000LL);
+   } else {
+      box.connErrors++;
+      results.givenUp++;
+      scheduleWake(box);
+   }
+}
+
+/** Sends the output, watches for writing while some is left. */
+bool Worker::flush(Box &box)
+{
+   epoll_event ev = {};
+
+   while (box.output.size()) {
+      ssize_t n = send(box.fd, box.output.data(), box.output.size(), MSG_NOSIGNAL);
+
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+         }
+         break;
+      }
+      box.output.erase(0, n);
+   }
+   ev.events   = EPOLLIN | (box.output.size() ? (uint32_t) EPOLLOUT : 0u);
+   ev.data.ptr = &box;
+   epoll_ctl(epollFd, EPOLL_CTL_MOD, box.fd, &ev);
+   return true;
+}
+
+/** Publishes the values of one wake as retained QoS 0 messages. */
+void Worker::publish(Box &box)
+{
+   char   values[FLEET_TOPIC_COUNT][128];
+   double hour    = fmod((double) time(NULL) / 3600.0, 24.0);
+   double day     = sin((hour - 9.0) / 24.0 * 2.0 * M_PI);
+   long   aliveSec = 8 + (long) (box.random.next() * 10.0);
+   int    v       = 0;
+
+   box.mAh += 70.0 * aliveSec / 3600.0 + 0.5 * options.everySec / 3600.0;
+   snprintf(values[v++], sizeof(values[0]), "%.2f", 15.0 + 8.0 * day + box.random.next());
+   snprintf(values[v++], sizeof(values[0]), "%.2f", 65.0 - 15.0 * day + 2.0 * box.random.next());
+   snprintf(values[v++], sizeof(values[0]), "%.2f", 1013.0 + 3.0 * box.random.next());
+   snprintf(values[v++], sizeof(values[0]), "%ld", (long) time(NULL));
+   snprintf(values[v++], sizeof(values[0]), "%.2f", 3.8 + 0.3 * day);
+   snprintf(values[v++], sizeof(values[0]), "%.2f", box.mAh);
+   snprintf(values[v++], sizeof(values[0]), "00:00:%02ld", aliveSec);
+   snprintf(values[v++], sizeof(values[0]), "%d", -60 - (int) (box.random.next() * 25.0));
+   snprintf(values[v++], sizeof(values[0]), "%ld", box.connErrors);
+   snprintf(values[v++], sizeof(values[0]), "%ld", box.sendErrors);
+   for (int i = 0; i < 4; i++) {
+      snprintf(values[v++], sizeof(values[0]), "0");
+   }
+   snprintf(values[v++], sizeof(values[0]), "Setup=1004 Spiffs=31 Options=12 Rtc=0 WiFi=%ld Time=120 MqttConnect=%ld",
+            2500 + (long) (box.random.next() * 1500.0), (nowNs() - box.attemptNs) / 1000000);
+   snprintf(values[v++], sizeof(values[0]), "%d", 24000 + (int) (box.random.next() * 2000.0));
+   snprintf(values[v++], sizeof(values[0]), "%d", 18000 + (int) (box.random.next() * 2000.0));
+   snprintf(values[v++], sizeof(values[0]), "%d", 5 + (int) (box.random.next() * 10.0));
+   snprintf(values[v++], sizeof(values[0]), "%d", 21000);
+
+   int64_t now = nowNs();
+
+   for (int i = 0; i < FLEET_TOPIC_COUNT; i++) {
+      if (sentNs[box.index * FLEET_TOPIC_COUNT + i].exchange(now)) {
+         results.overwritten++;
+      }
+      mqttAddPublish(box.output, box.prefix + fleetTopics[i], values[i], true);
+   }
+   results.published += FLEET_TOPIC_COUNT;
+}
+
+/** Socket events of a box. */
+void Worker::onEvent(Box &box, uint32_t events)
+{
+   // Closed by an earlier event of the same epoll_wait.
+   if (box.fd < 0) {
+      return;
+   }
+   if (box.state == BOX_CONNECTING) {
+      int       error  = 0;
+      socklen_t length = sizeof(error);
+
+      getsockopt(box.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if (error || events & (EPOLLERR | EPOLLHUP)) {
+         failAttempt(box);
+         return;
+      }
+      box.state = BOX_CONNACK;
+      mqttAddConnect(box.output, box.prefix, options.user, options.password);
+      if (!flush(box)) {
+         failAttempt(box);
+      }
+      return;
+   }
+   if (events & EPOLLOUT && !flush(box)) {
+      box.sendErrors++;
+      results.sendErrors++;
+      if (box.state == BOX_CONNACK) {
+         failAttempt(box);
+      } else {
+         closeBox(box);
+         scheduleWake(box);
+      }
+      return;
+   }
+   if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+      return;
+   }
+
+   char    buf[4096];
+   ssize_t n = recv(box.fd, buf, sizeof(buf), 0);
+
+   if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+   }
+   if (n <= 0) {
+      // Closed by the broker: fails the attempt before the CONNACK, ends the wake after it.
+      if (box.state == BOX_CONNACK) {
+         failAttempt(box);
+      } else {
+         closeBox(box);
+         scheduleWake(box);
+      }
+      return;
+   }
+   box.reader.append(buf, n);
+
+   MqttPacket packet;
+
+   while (box.state == BOX_CONNACK && box.reader.next(packet)) {
+      if (packet.type() != MQTT_CONNACK || packet.length != 2 || packet.body[1] != 0) {
+         failAttempt(box);
+         return;
+      }
+      connectMs.push_back((nowNs() - box.attemptNs) / 1e6);
+      publish(box);
+      box.state = BOX_HOLDING;
+      box.generation++;
+      addTimer(box, nowNs() + options.holdMs * 1000000LL);
+      if (!flush(box)) {
+         box.sendErrors++;
+         results.sendErrors++;
+         closeBox(box);
+         scheduleWake(box);
+         return;
+      }
+   }
+}
+
+/** Due timer of a box. */
+void Worker::onTimer(Box &box)
+{
+   switch (box.state) {
+      case BOX_SLEEPING: {
+         int64_t now = nowNs();
+         size_t  sec = now / 1000000000LL;
+
+         results.wakes++;
+         {
+            std::lock_guard<std::mutex> guard(results.lock);
+
+            if (sec < results.wakesPerSec.size()) {
+               results.wakesPerSec[sec]++;
+            }
+         }
+         box.attempt = 0;
+         startAttempt(box);
+         break;
+      }
+      case BOX_RETRY:
+         startAttempt(box);
+         break;
+      case BOX_CONNECTING:
+      case BOX_CONNACK:
+         failAttempt(box);
+         break;
+      case BOX_HOLDING:
+         // The WiFi goes off, no DISCONNECT.
+         closeBox(box);
+         scheduleWake(box);
+         break;
+   }
+}
+
+/** Runs until no box has a wake left. */
+void Worker::run()
+{
+   while (active) {
+      epoll_event events[256];
+      int64_t     waitNs = timers.top().atNs - nowNs();
+      int         n      = epoll_wait(epollFd, events, 256, waitNs > 0 ? (int) (waitNs / 1000000 + 1) : 0);
+
+      for (int i = 0; i < n; i++) {
+         onEvent(*(Box *) events[i].data.ptr, events[i].events);
+      }
+      for (int64_t now = nowNs(); timers.size() && timers.top().atNs <= now; ) {
+         Timer timer = timers.top();
+
+         timers.pop();
+         if (timer.generation == timer.box->generation) {
+            onTimer(*timer.box);
+         }
+      }
+   }
+   std::lock_guard<std::mutex> guard(results.lock);
+   results.connectMs.insert(results.connectMs.end(), connectMs.begin(), connectMs.end());
+}
+
+/** Box index and topic index of a delivered topic or false. */
+static bool parseTopic(std::string_view topic, int &box, int &index)
+{
+   if (topic.size() <= options.name.size() + 1 || topic.compare(0, options.name.size(), options.name) || topic[options.name.size()] != '/') {
+      return false;
+   }
+
+   size_t pos = options.name.size() + 1;
+   int    id  = 0;
+
+   while (pos < topic.size() && topic[pos] >= '0' && topic[pos] <= '9') {
+      id = id * 10 + topic[pos++] - '0';
+   }
+   box = id - 1;
+   if (box < 0 || box >= options.boxes) {
+      return false;
+   }
+
+   std::string_view sub = topic.substr(pos);
+
+   for (index = 0; index < FLEET_TOPIC_COUNT; index++) {
+      if (sub == fleetTopics[index]) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/** Subscribes the fleet and records the delivery latencies. */
+static void observer(addrinfo *address)
+{
+   int                 fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+   timeval             tv = { 0, 200000 };
+   std::string         out;
+   MqttReader          reader;
+   std::vector<double> publishMs;
+
+   if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+      fprintf(stderr, "Observer cannot connect to %s:%s\n", options.host.c_str(), options.port.c_str());
+      exit(1);
+   }
+   setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   mqttAddConnect(out, "fleetload-observer", options.user, options.password, 60);
+   mqttAddSubscribe(out, 1, options.name + "/#");
+   send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+
+   time_t lastPing = time(NULL);
+
+   while (!observerStop) {
+      char       buf[65536];
+      ssize_t    n = recv(fd, buf, sizeof(buf), 0);
+      MqttPacket packet;
+      int64_t    now = nowNs();
+
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+         fprintf(stderr, "Observer disconnected by the broker\n");
+         break;
+      }
+      if (time(NULL) - lastPing >= 30) {
+         out.clear();
+         mqttAddEmpty(out, MQTT_PINGREQ);
+         send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+         lastPing = time(NULL);
+      }
+      if (n < 0) {
+         continue;
+      }
+      reader.append(buf, n);
+      while (reader.next(packet)) {
+         MqttPublish publish;
+         int         box;
+         int         index;
+
+         if (packet.type() == MQTT_SUBACK) {
+            observerReady = true;
+         }
+         // Retained messages of earlier runs come with the retain flag.
+         if (!mqttParsePublish(packet, publish) || publish.retained || !parseTopic(publish.topic, box, index)) {
+            continue;
+         }
+
+         int64_t sent = sentNs[box * FLEET_TOPIC_COUNT + index].exchange(0);
+
+         if (sent) {
+            publishMs.push_back((now - sent) / 1e6);
+            results.received++;
+         }
+      }
+   }
+   close(fd);
+   std::lock_guard<std::mutex> guard(results.lock);
+   results.publishMs.swap(publishMs);
+}
+
+/** Percentile of the sorted latencies. */
+static double percentile(const std::vector<double> &sorted, double p)
+{
+   if (sorted.empty()) {
+      return 0.0;
+   }
+   return sorted[std::min(sorted.size() - 1, (size_t) (p / 100.0 * sorted.size()))];
+}
+
+static void printLatency(const char *name, std::vector<double> &latency)
+{
+   std::sort(latency.begin(), latency.end());
+   printf("  %s ms: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", name,
+          percentile(latency, 50), percentile(latency, 90), percentile(latency, 99),
+          percentile(latency, 99.9), latency.empty() ? 0.0 : latency.back());
+}
+
+int main(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "h:p:n:e:t:aj:k:R:O:T:D:N:u:w:S:")) != -1) {
+      switch (opt) {
+         case 'h': options.host        = optarg;        break;
+         case 'p': options.port        = optarg;        break;
+         case 'n': options.boxes       = atoi(optarg);  break;
+         case 'e': options.everySec    = atoi(optarg);  break;
+         case 't': options.durationSec = atoi(optarg);  break;
+         case 'a': options.aligned     = true;          break;
+         case 'j': options.jitterMs    = atoi(optarg);  break;
+         case 'k': options.holdMs      = atoi(optarg);  break;
+         case 'R': options.retries     = atoi(optarg);  break;
+         case 'O': sscanf(optarg, "%lf:%lf:%lf", &options.outageStart, &options.outageLength, &options.outageFraction); break;
+         case 'T': options.threads     = atoi(optarg);  break;
+         case 'D': options.drainMs     = atoi(optarg);  break;
+         case 'N': options.name        = optarg;        break;
+         case 'u': options.user        = optarg;        break;
+         case 'w': options.password    = optarg;        break;
+         case 'S': options.seed        = atoll(optarg); break;
+         default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-n boxes] [-e everySec] [-t durationSec] [-a] [-j jitterMs]\n"
+                            "          [-k holdMs] [-R retries] [-O start:length[:fraction]] [-T threads] [-D drainMs]\n"
+                            "          [-N mqttName] [-u user] [-w password] [-S seed]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (options.boxes <= 0 || options.everySec <= 0 || options.threads <= 0 || options.retries <= 0) {
+      fprintf(stderr, "Invalid box count, interval, threads or retries\n");
+      return 1;
+   }
+
+   addrinfo  hints   = {};
+   addrinfo *address = NULL;
+
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address) != 0) {
+      fprintf(stderr, "Unknown host %s\n", options.host.c_str());
+      return 1;
+   }
+   sentNs.reset(new std::atomic<int64_t>[options.boxes * FLEET_TOPIC_COUNT]);
+   for (int i = 0; i < options.boxes * FLEET_TOPIC_COUNT; i++) {
+      sentNs[i] = 0;
+   }
+   results.wakesPerSec.resize(options.durationSec + 1);
+   startTime = Clock::now();
+
+   std::thread observerThread(observer, address);
+
+   for (int i = 0; i < 50 && !observerReady; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+   }
+   if (!observerReady) {
+      fprintf(stderr, "No SUBACK from the broker\n");
+      return 1;
+   }
+
+   std::vector<std::unique_ptr<Worker> > workers;
+   std::vector<std::thread>              threads;
+
+   for (int t = 0; t < options.threads; t++) {
+      workers.push_back(std::unique_ptr<Worker>(new Worker(address)));
+   }
+   for (int i = 0; i < options.boxes; i++) {
+      workers[i % options.threads]->add(i);
+   }
+   for (auto &worker : workers) {
+      threads.push_back(std::thread(&Worker::run, worker.get()));
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+
+   double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+   std::this_thread::sleep_for(std::chrono::milliseconds(options.drainMs));
+   observerStop = true;
+   observerThread.join();
+   freeaddrinfo(address);
+
+   long published = results.published;
+   long dropped   = published - results.received;
+   int  peak      = *std::max_element(results.wakesPerSec.begin(), results.wakesPerSec.end());
+
+   printf("%d boxes every %d s (%s, jitter %d ms), %d topics per wake, %.1f s\n", options.boxes, options.everySec,
+          options.aligned ? "aligned" : "random phase", options.jitterMs, FLEET_TOPIC_COUNT, seconds);
+   if (options.outageStart >= 0.0) {
+      printf("  outage: %.0f%% of the boxes from %.0f s for %.0f s, %ld wakes missed\n",
+             options.outageFraction * 100.0, options.outageStart, options.outageLength, (long) results.missed);
+   }
+   printf("  wakes: %ld, peak %d/s, max %ld open connections\n", (long) results.wakes, peak, (long) results.maxOpen);
+   printf("  connects: %ld attempts, %ld failed, %ld wakes given up\n",
+          (long) results.attempts, (long) results.failures, (long) results.givenUp);
+   printLatency("connect", results.connectMs);
+   printLatency("publish", results.publishMs);
+   printf("  published %ld, received %ld, dropped %ld (%.3f%%), %ld send errors\n", published, (long) results.received,
+          dropped, published ? 100.0 * dropped / published : 0.0, (long) results.sendErrors);
+   printf("  throughput: %.1f messages/s\n", published / seconds);
+   return 0;
+}
@@ -0,0 +1,569 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MqttBroker.cpp
+  *
+  * Small MQTT 3.1.1 broker stand-in for the host tools when no real broker
+  * is at hand. One epoll thread, QoS 0 and 1 from the clients (forwarded
+  * with QoS 0), retained messages and the '+'/'#' wildcards.
+  * A subscriber whose unsent data exceeds the queue limit is disconnected.
+  * Prints the counters every -i seconds and at the end.
+  * -t adds a TLS port with the certificate and key of -c and -k (PEM) or
+  * a generated self-signed one, whose SHA-1 fingerprint is printed for the
+  * box option. The TLS sessions are kept -l seconds for the resumption with
+  * the session ID (BearSSL of the boxes does not use tickets), the
+  * counters show how many handshakes were resumed.
+  *
+  *   mqttbroker [-p port] [-t tlsPort [-c cert -k key] [-l sessionSec]] [-q queueKB] [-i statsSec] [-v]
+  */
+
+#include "MqttWire.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+/** Command line options. */
+struct Options
+{
+   int         port       = 1883;  //!< Listen port.
+   int         tlsPort    = 0;     //!< TLS listen port, 0 = none.
+   std::string certFile;           //!< PEM certificate, empty = self-signed.
+   std::string keyFile;            //!< PEM key of certFile.
+   long        sessionSec = 86400; //!< Lifetime of the cached TLS sessions.
+   long        queueKB    = 4096;  //!< Unsent bytes per client before it is dropped.
+   int         statsSec   = 10;    //!< Counter output interval, 0 = only at the end.
+   bool        verbose    = false; //!< Print connects and subscriptions.
+};
+
+/** One client connection. */
+struct Client
+{
+   int                      fd;         //!< Socket.
+   SSL                     *ssl;        //!< TLS state, NULL = plain.
+   std::string              clientId;   //!< Of the CONNECT packet.
+   bool                     connected;  //!< CONNECT received.
+   MqttReader               reader;     //!< Received packets.
+   std::string              output;     //!< Unsent bytes.
+   std::vector<std::string> filters;    //!< Subscriptions.
+};
+
+/** Broker counters. */
+struct Counters
+{
+   long connects;     //!< Accepted CONNECT packets.
+   long publishesIn;  //!< Received PUBLISH packets.
+   long publishesOut; //!< Forwarded PUBLISH packets.
+   long dropped;      //!< Clients disconnected because of a full queue.
+   long maxClients;   //!< Most open connections at once.
+   long tlsFull;      //!< TLS handshakes with key exchange.
+   long tlsResumed;   //!< TLS handshakes of a cached session.
+};
+
+static Options                                 options;
+static Counters                                counters;
+static std::map<int, std::unique_ptr<Client> > clients;
+static std::set<int>                           subscribers; //!< Clients with subscriptions.
+static std::map<std::string, std::string>      retained;    //!< Topic -> payload.
+static std::map<std::string, int>              sessions;    //!< Client id -> socket.
+static int                                     epollFd;
+static SSL_CTX                                *tlsCtx;
+static volatile sig_atomic_t                   stop = 0;
+
+static void onSignal(int)
+{
+   stop = 1;
+}
+
+/** Watches the socket for reading and, with unsent data, for writing. */
+static void watch(Client &client, int op)
+{
+   epoll_event ev = {};
+
+   ev.events  = EPOLLIN | (client.output.size() ? (uint32_t) EPOLLOUT : 0u);
+   ev.data.fd = client.fd;
+   epoll_ctl(epollFd, op, client.fd, &ev);
+}
+
+static void closeClient(int fd)
+{
+   if (options.verbose) {
+      printf("close %s\n", clients[fd]->clientId.c_str());
+   }
+   auto session = sessions.find(clients[fd]->clientId);
+
+   if (session != sessions.end() && session->second == fd) {
+      sessions.erase(session);
+   }
+   epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+   if (clients[fd]->ssl) {
+      // OpenSSL drops the session from the cache without close_notify.
+      if (SSL_is_init_finished(clients[fd]->ssl)) {
+         SSL_shutdown(clients[fd]->ssl);
+      }
+      ERR_clear_error();
+      SSL_free(clients[fd]->ssl);
+   }
+   close(fd);
+   clients.erase(fd);
+   subscribers.erase(fd);
+}
+
+/** Sends as much of the output as the socket takes. Returns false on a closed socket. */
+static bool flush(Client &client)
+{
+   bool wasPending = client.output.size();
+
+   while (client.output.size()) {
+      ssize_t n;
+
+      if (client.ssl) {
+         n = SSL_write(client.ssl, client.output.data(), client.output.size());
+         if (n <= 0) {
+            int error = SSL_get_error(client.ssl, n);
+
+            if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+               break;
+            }
+            return false;
+         }
+      } else {
+         n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+         if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+               break;
+            }
+            return false;
+         }
+      }
+      client.output.erase(0, n);
+   }
+   if (wasPending != (client.output.size() > 0)) {
+      watch(client, EPOLL_CTL_MOD);
+   }
+   return true;
+}
+
+/** Forwards a message to all matching subscribers. */
+static void forward(std::string_view topic, std::string_view payload, std::vector<int> &full)
+{
+   for (int fd : subscribers) {
+      Client &client = *clients[fd];
+
+      for (const std::string &filter : client.filters) {
+         if (mqttTopicMatches(filter, topic)) {
+            mqttAddPublish(client.output, topic, payload);
+            counters.publishesOut++;
+            if (client.output.size() > (size_t) options.queueKB * 1024) {
+               full.push_back(client.fd);
+            }
+            break;
+         }
+      }
+   }
+}
+
+/** Handles one packet of a client. Returns false to close the connection. */
+static bool handlePacket(Client &client, const MqttPacket &packet, std::vector<int> &full)
+{
+   if (!client.connected && packet.type() != MQTT_CONNECT) {
+      return false;
+   }
+   switch (packet.type()) {
+      case MQTT_CONNECT: {
+         size_t           pos = 0;
+         std::string_view protocol;
+         std::string_view clientId;
+
+         if (client.connected || !mqttGetString(packet, pos, protocol) || pos + 4 > packet.length) {
+            return false;
+         }
+         pos += 4;
+         if (!mqttGetString(packet, pos, clientId)) {
+            return false;
+         }
+         client.clientId.assign(clientId.data(), clientId.size());
+         client.connected = true;
+         counters.connects++;
+         // A second connection with the same id replaces the first one.
+         if (clientId.size()) {
+            int &session = sessions[client.clientId];
+
+            if (session && session != client.fd) {
+               full.push_back(session);
+            }
+            session = client.fd;
+         }
+         mqttAddShort(client.output, MQTT_CONNACK, 0);
+         if (options.verbose) {
+            printf("connect %s\n", client.clientId.c_str());
+         }
+         break;
+      }
+      case MQTT_PUBLISH: {
+         MqttPublish publish;
+
+         if (!mqttParsePublish(packet, publish)) {
+            return false;
+         }
+         counters.publishesIn++;
+         if (publish.qos == 1) {
+            mqttAddShort(client.output, MQTT_PUBACK, publish.packetId);
+         }
+         if (publish.retained) {
+            std::string topic(publish.topic);
+
+            if (publish.payload.empty()) {
+               retained.erase(topic);
+            } else {
+               retained[topic].assign(publish.payload.data(), publish.payload.size());
+            }
+         }
+         forward(publish.topic, publish.payload, full);
+         break;
+      }
+      case MQTT_SUBSCRIBE: {
+         size_t      pos = 2;
+         std::string codes;
+
+         if (packet.length < 2) {
+            return false;
+         }
+         while (pos < packet.length) {
+            std::string_view filter;
+
+            if (!mqttGetString(packet, pos, filter) || pos >= packet.length) {
+               return false;
+            }
+            pos++;
+            client.filters.push_back(std::string(filter));
+            subscribers.insert(client.fd);
+            codes += (char) 0;
+            if (options.verbose) {
+               printf("subscribe %s %.*s\n", client.clientId.c_str(), (int) filter.size(), filter.data());
+            }
+         }
+         client.output += (char) (MQTT_SUBACK << 4);
+         mqttAddLength(client.output, 2 + codes.size());
+         client.output.append((const char *) packet.body, 2);
+         client.output += codes;
+         for (auto &entry : retained) {
+            for (size_t i = client.filters.size() - codes.size(); i < client.filters.size(); i++) {
+               if (mqttTopicMatches(client.filters[i], entry.first)) {
+                  mqttAddPublish(client.output, entry.first, entry.second, true);
+                  break;
+               }
+            }
+         }
+         break;
+      }
+      case MQTT_PINGREQ:
+         mqttAddEmpty(client.output, MQTT_PINGRESP);
+         break;
+      case MQTT_DISCONNECT:
+         return false;
+   }
+   return true;
+}
+
+/** Reads from the socket or decrypts, finishes the TLS handshake first. -1 with EAGAIN = nothing yet. */
+static ssize_t receive(Client &client, char *buf, size_t size)
+{
+   size_t n = 0;
+
+   if (!client.ssl) {
+      return recv(client.fd, buf, size, 0);
+   }
+   if (!SSL_is_init_finished(client.ssl)) {
+      int ret = SSL_do_handshake(client.ssl);
+
+      if (ret != 1) {
+         int error = SSL_get_error(client.ssl, ret);
+
+         errno = error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE ? EAGAIN : EPROTO;
+         ERR_clear_error();
+         return -1;
+      }
+      if (SSL_session_reused(client.ssl)) {
+         counters.tlsResumed++;
+      } else {
+         counters.tlsFull++;
+      }
+   }
+   // All buffered records, epoll only sees the socket.
+   while (n < size) {
+      int ret = SSL_read(client.ssl, buf + n, size - n);
+
+      if (ret <= 0) {
+         int error = SSL_get_error(client.ssl, ret);
+
+         ERR_clear_error();
+         if (n) {
+            break;
+         }
+         if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+            errno = EAGAIN;
+            return -1;
+         }
+         return error == SSL_ERROR_ZERO_RETURN ? 0 : (errno = EPROTO, -1);
+      }
+      n += ret;
+   }
+   return n;
+}
+
+/** Reads and handles the received packets of a client. */
+static void handleInput(int fd)
+{
+   Client          &client = *clients[fd];
+   char             buf[16384];
+   ssize_t          n      = receive(client, buf, sizeof(buf));
+   std::vector<int> full;
+   MqttPacket       packet;
+   bool             ok     = n > 0;
+
+   if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+   }
+   if (ok) {
+      client.reader.append(buf, n);
+      while (ok && client.reader.next(packet)) {
+         ok = handlePacket(client, packet, full);
+      }
+      ok = ok && !client.reader.error();
+   }
+   // Flush all clients which got data, the sender last.
+   for (int s : subscribers) {
+      if (s != fd && clients[s]->output.size() && !flush(*clients[s])) {
+         full.push_back(s);
+      }
+   }
+   if (!ok || !flush(client)) {
+      full.push_back(fd);
+   }
+   for (int f : full) {
+      if (clients.count(f)) {
+         if (f != fd && clients[f]->output.size() > (size_t) options.queueKB * 1024) {
+            counters.dropped++;
+         }
+         closeClient(f);
+      }
+   }
+}
+
+static void printCounters()
+{
+   printf("%ld clients (max %ld), %ld connects, %ld publishes in, %ld out, %ld slow clients dropped",
+          (long) clients.size(), counters.maxClients, counters.connects, counters.publishesIn,
+          counters.publishesOut, counters.dropped);
+   if (tlsCtx) {
+      printf(", %ld TLS handshakes (%ld resumed)", counters.tlsFull + counters.tlsResumed, counters.tlsResumed);
+   }
+   printf("\n");
+   fflush(stdout);
+}
+
+/** Self-signed EC P-256 certificate for a test without certificate files. */
+static bool generateCertificate(SSL_CTX *ctx)
+{
+   EVP_PKEY  *key  = EVP_EC_gen("P-256");
+   X509      *cert = X509_new();
+   X509_NAME *name;
+   bool       ok;
+
+   ok = key && cert && X509_set_version(cert, 2) && ASN1_INTEGER_set(X509_get_serialNumber(cert), time(NULL)) &&
+        X509_gmtime_adj(X509_getm_notBefore(cert), -3600) && X509_gmtime_adj(X509_getm_notAfter(cert), 10L * 365 * 86400) &&
+        X509_set_pubkey(cert, key) && (name = X509_get_subject_name(cert)) != NULL &&
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "mqttbroker", -1, -1, 0) &&
+        X509_set_issuer_name(cert, name) && X509_sign(cert, key, EVP_sha256()) &&
+        SSL_CTX_use_certificate(ctx, cert) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1;
+   X509_free(cert);
+   EVP_PKEY_free(key);
+   return ok;
+}
+
+/** TLS context with the server session cache for the resumption. */
+static SSL_CTX *createTlsContext()
+{
+   SSL_CTX      *ctx = SSL_CTX_new(TLS_server_method());
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int  length = 0;
+   bool          ok;
+
+   if (!ctx) {
+      return NULL;
+   }
+   ok = options.certFile.empty() ? generateCertificate(ctx) :
+        SSL_CTX_use_certificate_file(ctx, options.certFile.c_str(), SSL_FILETYPE_PEM) == 1 &&
+        SSL_CTX_use_PrivateKey_file(ctx, options.keyFile.c_str(), SSL_FILETYPE_PEM) == 1;
+   if (!ok || !SSL_CTX_check_private_key(ctx)) {
+      ERR_print_errors_fp(stderr);
+      SSL_CTX_free(ctx);
+      return NULL;
+   }
+   // A box going to sleep just drops the connection, that must not end its session.
+   SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET | SSL_OP_IGNORE_UNEXPECTED_EOF);
+   SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+   SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "mqttbroker", 10);
+   SSL_CTX_set_timeout(ctx, options.sessionSec);
+   if (X509_digest(SSL_CTX_get0_certificate(ctx), EVP_sha1(), digest, &length)) {
+      printf("TLS certificate SHA-1 ");
+      for (unsigned int i = 0; i < length; i++) {
+         printf("%02X%s", digest[i], i + 1 < length ? ":" : "\n");
+      }
+   }
+   return ctx;
+}
+
+/** Non-blocking listening socket, -1 on failure. */
+static int listenOn(int port)
+{
+   int         fd   = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   int         one  = 1;
+   sockaddr_in addr = {};
+
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   if (bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 4096) != 0) {
+      perror("mqttbroker");
+      close(fd);
+      return -1;
+   }
+
+   epoll_event ev = {};
+
+   ev.events  = EPOLLIN;
+   ev.data.fd = fd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+   return fd;
+}
+
+/** Accepts the waiting connections, with TLS on the TLS port. */
+static void acceptClients(int listenFd, bool tls)
+{
+   int one = 1;
+
+   for (int c; (c = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK)) >= 0; ) {
+      std::unique_ptr<Client> client(new Client());
+
+      setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      client->fd        = c;
+      client->ssl       = NULL;
+      client->connected = false;
+      if (tls) {
+         client->ssl = SSL_new(tlsCtx);
+         SSL_set_fd(client->ssl, c);
+         SSL_set_accept_state(client->ssl);
+      }
+      watch(*client, EPOLL_CTL_ADD);
+      clients[c] = std::move(client);
+      counters.maxClients = std::max(counters.maxClients, (long) clients.size());
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "p:t:c:k:l:q:i:v")) != -1) {
+      switch (opt) {
+         case 'p': options.port       = atoi(optarg); break;
+         case 't': options.tlsPort    = atoi(optarg); break;
+         case 'c': options.certFile   = optarg;       break;
+         case 'k': options.keyFile    = optarg;       break;
+         case 'l': options.sessionSec = atol(optarg); break;
+         case 'q': options.queueKB    = atol(optarg); break;
+         case 'i': options.statsSec   = atoi(optarg); break;
+         case 'v': options.verbose    = true;         break;
+         default:
+            fprintf(stderr, "usage: %s [-p port] [-t tlsPort [-c cert -k key] [-l sessionSec]] [-q queueKB] [-i statsSec] [-v]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   int tlsFd = -1;
+
+   epollFd = epoll_create1(0);
+
+   int listenFd = listenOn(options.port);
+
+   if (listenFd < 0) {
+      return 1;
+   }
+   if (options.tlsPort) {
+      if ((tlsCtx = createTlsContext()) == NULL || (tlsFd = listenOn(options.tlsPort)) < 0) {
+         return 1;
+      }
+   }
+   signal(SIGINT,  onSignal);
+   signal(SIGTERM, onSignal);
+   signal(SIGPIPE, SIG_IGN);
+
+   printf("MQTT broker on port %d", options.port);
+   if (tlsCtx) {
+      printf(", TLS on port %d", options.tlsPort);
+   }
+   printf("\n");
+   fflush(stdout);
+
+   time_t lastStats = time(NULL);
+
+   while (!stop) {
+      epoll_event events[256];
+      int         n = epoll_wait(epollFd, events, 256, 1000);
+
+      for (int i = 0; i < n; i++) {
+         int fd = events[i].data.fd;
+
+         if (fd == listenFd || fd == tlsFd) {
+            acceptClients(fd, fd == tlsFd);
+         } else if (clients.count(fd)) {
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+               handleInput(fd);
+            } else if (events[i].events & EPOLLOUT && !flush(*clients[fd])) {
+               closeClient(fd);
+            }
+         }
+      }
+      if (options.statsSec && time(NULL) - lastStats >= options.statsSec) {
+         lastStats = time(NULL);
+         printCounters();
+      }
+   }
+   printCounters();
+   return 0;
+}
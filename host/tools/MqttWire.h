@@ -0,0 +1,290 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MqttWire.h
+  *
+  * MQTT 3.1.1 packets of the host tools: builders for the packets the
+  * firmware and the tools send and a stream reader which splits the
+  * received bytes into packets without copying them again.
+  */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+
+#define MQTT_CONNECT     1  //!< Packet types (upper nibble of the fixed header).
+#define MQTT_CONNACK     2
+#define MQTT_PUBLISH     3
+#define MQTT_PUBACK      4
+#define MQTT_SUBSCRIBE   8
+#define MQTT_SUBACK      9
+#define MQTT_PINGREQ    12
+#define MQTT_PINGRESP   13
+#define MQTT_DISCONNECT 14
+
+#define MQTT_MAX_PACKET (256 * 1024) //!< Larger packets are treated as protocol error.
+
+/**
+  * One received packet, the body points into the reader buffer.
+  */
+struct MqttPacket
+{
+   uint8_t        header; //!< Fixed header byte.
+   const uint8_t *body;   //!< Variable header and payload.
+   size_t         length; //!< Remaining length.
+
+   int type() const { return header >> 4; }
+};
+
+/**
+  * Parsed PUBLISH packet, topic and payload point into the packet.
+  */
+struct MqttPublish
+{
+   std::string_view topic;    //!< Topic name.
+   std::string_view payload;  //!< Application message.
+   uint16_t         packetId; //!< Only for QoS 1 and 2.
+   int              qos;      //!< Requested quality of service.
+   bool             retained; //!< Retain flag.
+};
+
+/** Appends the variable length encoding of the remaining length. */
+inline void mqttAddLength(std::string &out, size_t length)
+{
+   do {
+      uint8_t c = length % 128;
+
+      length /= 128;
+      out += (char) (length ? c | 0x80 : c);
+   } while (length);
+}
+
+/** Appends a two byte length prefixed string. */
+inline void mqttAddString(std::string &out, std::string_view text)
+{
+   out += (char) (text.size() >> 8);
+   out += (char) (text.size() & 0xFF);
+   out.append(text.data(), text.size());
+}
+
+/** Appends a CONNECT packet with clean session. User and password are optional. */
+inline void mqttAddConnect(std::string &out, std::string_view clientId, std::string_view user = std::string_view(),
+                           std::string_view password = std::string_view(), uint16_t keepAliveSec = 15)
+{
+   std::string body;
+   uint8_t     flags = 0x02;
+
+   if (user.size()) {
+      flags |= 0x80;
+      if (password.size()) {
+         flags |= 0x40;
+      }
+   }
+   mqttAddString(body, "MQTT");
+   body += (char) 4;
+   body += (char) flags;
+   body += (char) (keepAliveSec >> 8);
+   body += (char) (keepAliveSec & 0xFF);
+   mqttAddString(body, clientId);
+   if (flags & 0x80) {
+      mqttAddString(body, user);
+   }
+   if (flags & 0x40) {
+      mqttAddString(body, password);
+   }
+   out += (char) (MQTT_CONNECT << 4);
+   mqttAddLength(out, body.size());
+   out += body;
+}
+
+/** Appends a PUBLISH packet. The packet id is only sent with QoS 1. */
+inline void mqttAddPublish(std::string &out, std::string_view topic, std::string_view payload,
+                           bool retained = false, int qos = 0, uint16_t packetId = 0)
+{
+   out += (char) ((MQTT_PUBLISH << 4) | (qos ? 0x02 : 0) | (retained ? 0x01 : 0));
+   mqttAddLength(out, 2 + topic.size() + (qos ? 2 : 0) + payload.size());
+   mqttAddString(out, topic);
+   if (qos) {
+      out += (char) (packetId >> 8);
+      out += (char) (packetId & 0xFF);
+   }
+   out.append(payload.data(), payload.size());
+}
+
+/** Appends a SUBSCRIBE packet for one topic filter. */
+inline void mqttAddSubscribe(std::string &out, uint16_t packetId, std::string_view filter, int qos = 0)
+{
+   out += (char) ((MQTT_SUBSCRIBE << 4) | 0x02);
+   mqttAddLength(out, 2 + 2 + filter.size() + 1);
+   out += (char) (packetId >> 8);
+   out += (char) (packetId & 0xFF);
+   mqttAddString(out, filter);
+   out += (char) qos;
+}
+
+/** Appends a packet of a type without body (PINGREQ, PINGRESP, DISCONNECT). */
+inline void mqttAddEmpty(std::string &out, int type)
+{
+   out += (char) (type << 4);
+   out += (char) 0;
+}
+
+/** Appends an answer with two bytes (CONNACK return code or PUBACK packet id). */
+inline void mqttAddShort(std::string &out, int type, uint16_t value)
+{
+   out += (char) (type << 4);
+   out += (char) 2;
+   out += (char) (value >> 8);
+   out += (char) (value & 0xFF);
+}
+
+/** Reads the two byte length prefixed string at pos. */
+inline bool mqttGetString(const MqttPacket &packet, size_t &pos, std::string_view &text)
+{
+   if (pos + 2 > packet.length) {
+      return false;
+   }
+
+   size_t length = (packet.body[pos] << 8) | packet.body[pos + 1];
+
+   if (pos + 2 + length > packet.length) {
+      return false;
+   }
+   text = std::string_view((const char *) packet.body + pos + 2, length);
+   pos += 2 + length;
+   return true;
+}
+
+/** Splits a PUBLISH packet without copying. */
+inline bool mqttParsePublish(const MqttPacket &packet, MqttPublish &publish)
+{
+   size_t pos = 0;
+
+   publish.qos      = (packet.header >> 1) & 0x03;
+   publish.retained = packet.header & 0x01;
+   publish.packetId = 0;
+   if (packet.type() != MQTT_PUBLISH || publish.qos == 3 || !mqttGetString(packet, pos, publish.topic)) {
+      return false;
+   }
+   if (publish.qos) {
+      if (pos + 2 > packet.length) {
+         return false;
+      }
+      publish.packetId = (packet.body[pos] << 8) | packet.body[pos + 1];
+      pos += 2;
+   }
+   publish.payload = std::string_view((const char *) packet.body + pos, packet.length - pos);
+   return true;
+}
+
+/**
+  * Splits a byte stream into packets. The packets stay valid until the
+  * next append() call.
+  */
+class MqttReader
+{
+protected:
+   std::string buffer; //!< Received bytes.
+   size_t      pos;    //!< Begin of the first unhandled packet.
+   bool        failed; //!< Malformed length, the connection has to be closed.
+
+public:
+   MqttReader() : pos(0), failed(false) { }
+
+   void append(const char *data, size_t size);
+   bool next(MqttPacket &packet);
+   bool error() const { return failed; }
+};
+
+/** Adds received bytes, drops the handled packets first. */
+inline void MqttReader::append(const char *data, size_t size)
+{
+   if (pos) {
+      buffer.erase(0, pos);
+      pos = 0;
+   }
+   buffer.append(data, size);
+}
+
+/** Returns the next complete packet or false. */
+inline bool MqttReader::next(MqttPacket &packet)
+{
+   const uint8_t *p      = (const uint8_t *) buffer.data() + pos;
+   size_t         size   = buffer.size() - pos;
+   size_t         length = 0;
+   size_t         i      = 1;
+
+   if (failed || size < 2) {
+      return false;
+   }
+   for (int shift = 0; ; shift += 7, i++) {
+      if (i >= size) {
+         return false;
+      }
+      if (i > 4) {
+         failed = true;
+         return false;
+      }
+      length |= (size_t) (p[i] & 0x7F) << shift;
+      if (!(p[i] & 0x80)) {
+         break;
+      }
+   }
+   i++;
+   if (length > MQTT_MAX_PACKET) {
+      failed = true;
+      return false;
+   }
+   if (size < i + length) {
+      return false;
+   }
+   packet.header = p[0];
+   packet.body   = p + i;
+   packet.length = length;
+   pos += i + length;
+   return true;
+}
+
+/** Does the topic match the filter with the '+' and '#' wildcards? */
+inline bool mqttTopicMatches(std::string_view filter, std::string_view topic)
+{
+   size_t f = 0;
+   size_t t = 0;
+
+   while (f < filter.size()) {
+      if (filter[f] == '#') {
+         return true;
+      }
+      if (filter[f] == '+') {
+         while (t < topic.size() && topic[t] != '/') {
+            t++;
+         }
+         f++;
+      } else {
+         if (t >= topic.size() || topic[t] != filter[f]) {
+            // "a/#" also matches "a".
+            return t == topic.size() && filter.substr(f) == "/#";
+         }
+         f++;
+         t++;
+      }
+   }
+   return t == topic.size();
+}
@@ -0,0 +1,223 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WebLoad.cpp
+  *
+  * Load client for the host build of the web server.
+  * Runs several clients in parallel which request one uri again and again
+  * while optional slow clients send their request byte by byte.
+  * Prints the status codes and the latency percentiles.
+  *
+  *   webload [-h host] [-p port] [-c clients] [-n requests] [-s slow] [-d delayMs] [uri]
+  */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+typedef std::chrono::steady_clock Clock;
+
+/** Command line options. */
+struct Options
+{
+   std::string host     = "127.0.0.1"; //!< Server host.
+   std::string port     = "80";        //!< Server port.
+   std::string uri      = "/MainInfo"; //!< Requested uri.
+   int         clients  = 4;           //!< Parallel fast clients.
+   int         requests = 50;          //!< Requests per fast client.
+   int         slow     = 0;           //!< Clients sending byte by byte.
+   int         delayMs  = 100;         //!< Pause between the bytes of the slow clients.
+};
+
+/** Results of all clients. */
+struct Results
+{
+   std::mutex          lock;      //!< Guards the members.
+   std::vector<double> latencyMs; //!< Latency of every successful request.
+   std::map<int, int>  codes;     //!< Count per status code (0 = connection error).
+};
+
+static Options options;
+static Results results;
+
+/** Opens a tcp connection with a receive timeout. */
+static int connectServer()
+{
+   addrinfo  hints = {};
+   addrinfo *addr  = NULL;
+
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &addr) != 0) {
+      return -1;
+   }
+
+   int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+   if (fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+   }
+   freeaddrinfo(addr);
+   if (fd >= 0) {
+      timeval tv = { 30, 0 };
+
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   }
+   return fd;
+}
+
+/** Sends one request, reads until the server closes and returns the status code. */
+static int request(int byteDelayMs)
+{
+   int fd = connectServer();
+
+   if (fd < 0) {
+      return 0;
+   }
+
+   std::string req = "GET " + options.uri + " HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n";
+
+   if (byteDelayMs) {
+      for (char c : req) {
+         if (send(fd, &c, 1, MSG_NOSIGNAL) != 1) {
+            close(fd);
+            return 0;
+         }
+         std::this_thread::sleep_for(std::chrono::milliseconds(byteDelayMs));
+      }
+   } else if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) != (ssize_t) req.size()) {
+      close(fd);
+      return 0;
+   }
+
+   std::string response;
+   char        buf[4096];
+
+   for (ssize_t n; (n = recv(fd, buf, sizeof(buf), 0)) > 0; ) {
+      response.append(buf, n);
+   }
+   close(fd);
+
+   int code = 0;
+
+   sscanf(response.c_str(), "HTTP/%*s %d", &code);
+   return code;
+}
+
+/** Fast client: requests in a loop and records the latencies. */
+static void fastClient()
+{
+   for (int i = 0; i < options.requests; i++) {
+      Clock::time_point start = Clock::now();
+      int               code  = request(0);
+      double            ms    = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+      std::lock_guard<std::mutex> guard(results.lock);
+      results.codes[code]++;
+      if (code == 200) {
+         results.latencyMs.push_back(ms);
+      }
+   }
+}
+
+/** Slow client: trickles its requests until the fast clients are done. */
+static void slowClient(std::atomic<bool> *done)
+{
+   while (!*done) {
+      int code = request(options.delayMs);
+
+      std::lock_guard<std::mutex> guard(results.lock);
+      results.codes[code]++;
+   }
+}
+
+/** Percentile of the sorted latencies. */
+static double percentile(const std::vector<double> &sorted, double p)
+{
+   if (sorted.empty()) {
+      return 0.0;
+   }
+   return sorted[std::min(sorted.size() - 1, (size_t) (p / 100.0 * sorted.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+   int opt;
+
+   while ((opt = getopt(argc, argv, "h:p:c:n:s:d:")) != -1) {
+      switch (opt) {
+         case 'h': options.host     = optarg;       break;
+         case 'p': options.port     = optarg;       break;
+         case 'c': options.clients  = atoi(optarg); break;
+         case 'n': options.requests = atoi(optarg); break;
+         case 's': options.slow     = atoi(optarg); break;
+         case 'd': options.delayMs  = atoi(optarg); break;
+         default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c clients] [-n requests] [-s slow] [-d delayMs] [uri]\n", argv[0]);
+            return 1;
+      }
+   }
+   if (optind < argc) {
+      options.uri = argv[optind];
+   }
+
+   std::atomic<bool>        done(false);
+   std::vector<std::thread> slow;
+   std::vector<std::thread> fast;
+   Clock::time_point        start = Clock::now();
+
+   for (int i = 0; i < options.slow; i++) {
+      slow.push_back(std::thread(slowClient, &done));
+   }
+   for (int i = 0; i < options.clients; i++) {
+      fast.push_back(std::thread(fastClient));
+   }
+   for (auto &t : fast) {
+      t.join();
+   }
+   done = true;
+   for (auto &t : slow) {
+      t.join();
+   }
+
+   double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+   std::sort(results.latencyMs.begin(), results.latencyMs.end());
+   printf("%s: %d clients x %d requests, %d slow clients, %.1f s\n",
+          options.uri.c_str(), options.clients, options.requests, options.slow, seconds);
+   for (auto &c : results.codes) {
+      printf("  status %3d: %d\n", c.first, c.second);
+   }
+   printf("  latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+          percentile(results.latencyMs, 50), percentile(results.latencyMs, 90),
+          percentile(results.latencyMs, 99), results.latencyMs.empty() ? 0.0 : results.latencyMs.back());
+   printf("  throughput: %.1f requests/s\n", results.latencyMs.size() / seconds);
+   return 0;
+}
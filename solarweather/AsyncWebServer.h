@@ -0,0 +1,793 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file AsyncWebServer.h
+  *
+  * Non blocking web server with several connections at once.
+  * Drop in replacement for the ESP8266WebServer API subset used by the
+  * firmware (see USE_ASYNC_WEB_SERVER in Config.h).
+  */
+
+
+#include <ESP8266WiFi.h>
+#include <ESP8266WebServer.h> // HTTPMethod and CONTENT_LENGTH_UNKNOWN
+#include <FS.h>
+
+#define ASYNC_WEB_CLIENT_COUNT  3    //!< Parallel connections.
+#define ASYNC_WEB_REQUEST_SIZE  1024 //!< Request line, headers and form body of one connection.
+#define ASYNC_WEB_OUTPUT_SIZE   1024 //!< Queued response bytes of one connection.
+#define ASYNC_WEB_OVERFLOW_SIZE 4096 //!< Heap bytes of one connection when the handler outruns the tcp window.
+#define ASYNC_WEB_ROUTE_COUNT   32   //!< Maximum number of registered uris.
+#define ASYNC_WEB_ARG_COUNT     32   //!< Maximum number of query and form arguments.
+#define ASYNC_WEB_HEADER_COUNT  4    //!< Maximum number of collected request headers.
+#define ASYNC_WEB_TIMEOUT_MS    5000 //!< Idle time after which a connection is dropped.
+
+/** State of one connection slot. */
+enum AsyncWebState
+{
+   ASYNC_WEB_FREE,  //!< Slot is unused.
+   ASYNC_WEB_READ,  //!< Collecting the request.
+   ASYNC_WEB_WRITE  //!< Sending the queued response and the streamed file.
+};
+
+/** One client connection with its bounded buffers. */
+struct AsyncWebConnection
+{
+   WiFiClient    client;                          //!< Tcp connection.
+   AsyncWebState state;                           //!< Current state.
+   unsigned long lastMs;                          //!< Time of the last progress.
+   char          request[ASYNC_WEB_REQUEST_SIZE]; //!< Received request (zero terminated).
+   size_t        requestLength;                   //!< Used bytes in request.
+   char          output[ASYNC_WEB_OUTPUT_SIZE];   //!< Queued response bytes.
+   size_t        outputStart;                     //!< First unsent byte in output.
+   size_t        outputLength;                    //!< Used bytes in output.
+   char         *overflow;                        //!< Response bytes behind output, NULL = none.
+   size_t        overflowStart;                   //!< First byte in overflow not moved to output.
+   size_t        overflowLength;                  //!< Used bytes in overflow.
+   bool          aborted;                         //!< Response did not fit, close after the handler.
+   File          file;                            //!< Rest of a streamed file.
+};
+
+/**
+  * Web server polling all connections from handleClient() without waiting.
+  * Every connection reads its request into a fixed buffer, runs the handler
+  * as soon as the request is complete and sends the response as far as the
+  * tcp window allows. Files are streamed piece by piece on the next passes.
+  * Every response closes the connection.
+  */
+class MyAsyncWebServer
+{
+public:
+   typedef std::function<void(void)> THandlerFunction;
+
+protected:
+   /** One registered uri. */
+   struct Route
+   {
+      String           uri; //!< Exact uri.
+      THandlerFunction fn;  //!< Request handler.
+   };
+   /** Name and value of an argument or header. */
+   struct Pair
+   {
+      String name;  //!< Name
+      String value; //!< Value
+   };
+
+   WiFiServer          _server;                                  //!< Listening socket.
+   WiFiClient          _currentClient;                           //!< Client outside of the request handling.
+   AsyncWebConnection  _connections[ASYNC_WEB_CLIENT_COUNT];     //!< Connection slots.
+   AsyncWebConnection *_current;                                 //!< Connection of the running handler.
+   Route               _routes[ASYNC_WEB_ROUTE_COUNT];           //!< Registered handlers.
+   int                 _routeCount;                              //!< Used routes.
+   THandlerFunction    _notFoundHandler;                         //!< Handler for unknown uris.
+   HTTPMethod          _currentMethod;                           //!< Method of the current request.
+   String              _currentUri;                              //!< Uri of the current request.
+   Pair                _args[ASYNC_WEB_ARG_COUNT];               //!< Query and form arguments.
+   int                 _argCount;                                //!< Used arguments.
+   Pair                _headers[ASYNC_WEB_HEADER_COUNT];         //!< Collected request headers.
+   int                 _headerCount;                             //!< Header names to collect.
+   String              _responseHeaders;                         //!< Headers of the next response.
+   size_t              _contentLength;                           //!< Content length of the next response.
+   bool                _chunked;                                 //!< Current response is chunked.
+   bool                _headerSent;                              //!< Response header is queued.
+
+public:
+   MyAsyncWebServer(int port = 80);
+
+   void   begin();
+   void   handleClient();
+   void   on(const String &uri, THandlerFunction fn);
+   void   onNotFound(THandlerFunction fn);
+
+   String      uri();
+   HTTPMethod  method();
+   WiFiClient &client();
+   String      arg(const String &name);
+   bool        hasArg(const String &name);
+   int         args();
+   void        collectHeaders(const char *headerKeys[], const size_t count);
+   String      header(const String &name);
+   bool        hasHeader(const String &name);
+
+   void   sendHeader(const String &name, const String &value, bool first = false);
+   void   setContentLength(const size_t contentLength);
+   void   send(int code, const char *contentType = NULL, const String &content = String());
+   void   send(int code, const String &contentType, const String &content);
+   void   send_P(int code, PGM_P contentType, PGM_P content, size_t length);
+   void   sendContent(const String &content);
+   void   sendContent_P(PGM_P content, size_t size);
+
+   /** Queues the header and streams the file content on the next passes. */
+   template <typename T> size_t streamFile(T &file, const String &contentType)
+   {
+      if (String(file.name()).endsWith(F(".gz")) &&
+          contentType != F("application/x-gzip") &&
+          contentType != F("application/octet-stream")) {
+         sendHeader(F("Content-Encoding"), F("gzip"));
+      }
+      setContentLength(file.size());
+      send(200, contentType, String());
+      if (_current) {
+         // Own handle, the caller closes its file when the handler returns.
+         _current->file = SPIFFS.open(file.name(), "r");
+      }
+      return file.size();
+   }
+
+protected:
+   void   accept();
+   void   readRequest(AsyncWebConnection &conn);
+   void   handleRequest(AsyncWebConnection &conn);
+   void   writeResponse(AsyncWebConnection &conn);
+   void   close(AsyncWebConnection &conn);
+   bool   parseRequest(AsyncWebConnection &conn, size_t headerLength);
+   void   parseArguments(const char *data);
+   void   sendError(AsyncWebConnection &conn, int code);
+   void   queue(const char *data, size_t size);
+   bool   park(AsyncWebConnection &conn, const char *data, size_t size);
+   bool   drain(AsyncWebConnection &conn);
+   void   refill(AsyncWebConnection &conn);
+
+   static String urlDecode(const char *text, size_t length);
+   static const __FlashStringHelper *codeToString(int code);
+};
+
+/* ******************************************** */
+
+MyAsyncWebServer::MyAsyncWebServer(int port)
+   : _server(port)
+   , _current(NULL)
+   , _routeCount(0)
+   , _currentMethod(HTTP_ANY)
+   , _argCount(0)
+   , _headerCount(0)
+   , _contentLength(CONTENT_LENGTH_NOT_SET)
+   , _chunked(false)
+   , _headerSent(false)
+{
+   for (int i = 0; i < ASYNC_WEB_CLIENT_COUNT; i++) {
+      _connections[i].state    = ASYNC_WEB_FREE;
+      _connections[i].overflow = NULL;
+   }
+}
+
+/** Starts listening. */
+void MyAsyncWebServer::begin()
+{
+   _server.begin();
+}
+
+/** Registers the handler of one uri. */
+void MyAsyncWebServer::on(const String &uri, THandlerFunction fn)
+{
+   if (_routeCount < ASYNC_WEB_ROUTE_COUNT) {
+      _routes[_routeCount].uri = uri;
+      _routes[_routeCount].fn  = fn;
+      _routeCount++;
+   } else {
+      MyDbg(F("AsyncWebServer: too many routes"));
+   }
+}
+
+/** Registers the handler of all unknown uris. */
+void MyAsyncWebServer::onNotFound(THandlerFunction fn)
+{
+   _notFoundHandler = fn;
+}
+
+/** Uri of the current request. */
+String MyAsyncWebServer::uri()
+{
+   return _currentUri;
+}
+
+/** Method of the current request. */
+HTTPMethod MyAsyncWebServer::method()
+{
+   return _currentMethod;
+}
+
+/** Client of the current request. The handler may keep a copy of it. */
+WiFiClient &MyAsyncWebServer::client()
+{
+   return _current ? _current->client : _currentClient;
+}
+
+/** Value of a query or form argument. */
+String MyAsyncWebServer::arg(const String &name)
+{
+   for (int i = 0; i < _argCount; i++) {
+      if (_args[i].name == name) {
+         return _args[i].value;
+      }
+   }
+   return String();
+}
+
+/** Is there a query or form argument with this name? */
+bool MyAsyncWebServer::hasArg(const String &name)
+{
+   for (int i = 0; i < _argCount; i++) {
+      if (_args[i].name == name) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/** Number of arguments of the current request. */
+int MyAsyncWebServer::args()
+{
+   return _argCount;
+}
+
+/** Sets the request headers which are stored for the handlers. */
+void MyAsyncWebServer::collectHeaders(const char *headerKeys[], const size_t count)
+{
+   _headerCount = 0;
+   for (size_t i = 0; i < count && _headerCount < ASYNC_WEB_HEADER_COUNT; i++) {
+      _headers[_headerCount++].name = headerKeys[i];
+   }
+}
+
+/** Value of a collected request header. */
+String MyAsyncWebServer::header(const String &name)
+{
+   for (int i = 0; i < _headerCount; i++) {
+      if (_headers[i].name.equalsIgnoreCase(name)) {
+         return _headers[i].value;
+      }
+   }
+   return String();
+}
+
+/** Did the current request contain this collected header? */
+bool MyAsyncWebServer::hasHeader(const String &name)
+{
+   return header(name).length() > 0;
+}
+
+/** Adds a header to the next response. */
+void MyAsyncWebServer::sendHeader(const String &name, const String &value, bool first)
+{
+   String line = name + F(": ") + value + F("\r\n");
+
+   if (first) {
+      _responseHeaders = line + _responseHeaders;
+   } else {
+      _responseHeaders += line;
+   }
+}
+
+/** Content length of the next response or CONTENT_LENGTH_UNKNOWN for chunked content. */
+void MyAsyncWebServer::setContentLength(const size_t contentLength)
+{
+   _contentLength = contentLength;
+}
+
+/** Queues the response header and the content. */
+void MyAsyncWebServer::send(int code, const char *contentType, const String &content)
+{
+   String head;
+
+   head.reserve(128 + _responseHeaders.length());
+   head  = F("HTTP/1.1 ");
+   head += code;
+   head += ' ';
+   head += codeToString(code);
+   head += F("\r\nContent-Type: ");
+   head += contentType ? contentType : "text/html";
+   head += F("\r\n");
+   if (_contentLength == CONTENT_LENGTH_UNKNOWN) {
+      head    += F("Transfer-Encoding: chunked\r\n");
+      _chunked = true;
+   } else {
+      head += F("Content-Length: ");
+      head += (unsigned long) (_contentLength == CONTENT_LENGTH_NOT_SET ? content.length() : _contentLength);
+      head += F("\r\n");
+   }
+   head += _responseHeaders;
+   head += F("Connection: close\r\n\r\n");
+   _responseHeaders = String();
+   _headerSent      = true;
+
+   queue(head.c_str(), head.length());
+   if (content.length()) {
+      sendContent(content);
+   }
+}
+
+/** Queues the response header and the content. */
+void MyAsyncWebServer::send(int code, const String &contentType, const String &content)
+{
+   send(code, contentType.c_str(), content);
+}
+
+/** Queues the response header and the flash content. */
+void MyAsyncWebServer::send_P(int code, PGM_P contentType, PGM_P content, size_t length)
+{
+   char type[64];
+
+   strncpy_P(type, contentType, sizeof(type) - 1);
+   type[sizeof(type) - 1] = 0;
+   if (_contentLength == CONTENT_LENGTH_NOT_SET) {
+      _contentLength = length;
+   }
+   send(code, type, String());
+   sendContent_P(content, length);
+}
+
+/** Queues more content of the current response. */
+void MyAsyncWebServer::sendContent(const String &content)
+{
+   sendContent_P(content.c_str(), content.length());
+}
+
+/** Queues more content of the current response, the final empty chunk is added after the handler. */
+void MyAsyncWebServer::sendContent_P(PGM_P content, size_t size)
+{
+   if (!size) {
+      return;
+   }
+   if (_chunked) {
+      char len[12];
+
+      snprintf(len, sizeof(len), "%x\r\n", (unsigned int) size);
+      queue(len, strlen(len));
+      queue(content, size);
+      queue("\r\n", 2);
+   } else {
+      queue(content, size);
+   }
+}
+
+/** Polls the listener and all connections, never waits for the network. */
+void MyAsyncWebServer::handleClient()
+{
+   // Called again from a running handler (MyDbg, MyDelay): the other
+   // connections wait, another request would replace the current one.
+   if (_current) {
+      return;
+   }
+   accept();
+   for (int i = 0; i < ASYNC_WEB_CLIENT_COUNT; i++) {
+      AsyncWebConnection &conn = _connections[i];
+
+      if (conn.state == ASYNC_WEB_READ) {
+         readRequest(conn);
+      } else if (conn.state == ASYNC_WEB_WRITE) {
+         writeResponse(conn);
+      }
+      if (conn.state != ASYNC_WEB_FREE && millis() - conn.lastMs > ASYNC_WEB_TIMEOUT_MS) {
+         MyDbg(F("AsyncWebServer: timeout"));
+         close(conn);
+      }
+   }
+}
+
+/** Takes new connections as long as there are free slots, the others wait in the backlog. */
+void MyAsyncWebServer::accept()
+{
+   for (int i = 0; i < ASYNC_WEB_CLIENT_COUNT; i++) {
+      AsyncWebConnection &conn = _connections[i];
+
+      if (conn.state != ASYNC_WEB_FREE) {
+         continue;
+      }
+      conn.client = _server.available();
+      if (!conn.client) {
+         return;
+      }
+      conn.client.setNoDelay(true);
+      conn.state         = ASYNC_WEB_READ;
+      conn.lastMs        = millis();
+      conn.requestLength = 0;
+      conn.outputStart   = 0;
+      conn.outputLength  = 0;
+      conn.aborted       = false;
+   }
+}
+
+/** Reads what is available and runs the handler once the request is complete. */
+void MyAsyncWebServer::readRequest(AsyncWebConnection &conn)
+{
+   int available = conn.client.available();
+
+   if (available <= 0) {
+      if (!conn.client.connected()) {
+         close(conn);
+      }
+      return;
+   }
+
+   size_t space = sizeof(conn.request) - 1 - conn.requestLength;
+   int    read  = conn.client.read((uint8_t *) conn.request + conn.requestLength, min((size_t) available, space));
+
+   if (read <= 0) {
+      return;
+   }
+   conn.requestLength += read;
+   conn.request[conn.requestLength] = 0;
+   conn.lastMs = millis();
+
+   char *end = strstr(conn.request, "\r\n\r\n");
+
+   if (!end) {
+      if (conn.requestLength == sizeof(conn.request) - 1) {
+         sendError(conn, 431);
+      }
+      return;
+   }
+
+   size_t headerLength = end + 4 - conn.request;
+   size_t bodyLength   = 0;
+
+   for (const char *h = strstr(conn.request, "\r\n"); h && h < end; h = strstr(h + 2, "\r\n")) {
+      if (!strncasecmp(h + 2, "Content-Length:", 15)) {
+         bodyLength = strtoul(h + 17, NULL, 10);
+      }
+   }
+
+   if (headerLength + bodyLength > sizeof(conn.request) - 1) {
+      sendError(conn, 413);
+   } else if (conn.requestLength >= headerLength + bodyLength) {
+      if (parseRequest(conn, headerLength)) {
+         handleRequest(conn);
+      } else {
+         sendError(conn, 400);
+      }
+   }
+}
+
+/** Splits the request line, arguments and collected headers. */
+bool MyAsyncWebServer::parseRequest(AsyncWebConnection &conn, size_t headerLength)
+{
+   char *line   = conn.request;
+   char *target = strchr(line, ' ');
+   char *eol    = strstr(line, "\r\n");
+
+   if (!target || target > eol) {
+      return false;
+   }
+   _currentMethod = !strncmp(line, "GET ", 4) ? HTTP_GET : !strncmp(line, "POST ", 5) ? HTTP_POST : HTTP_ANY;
+   target++;
+
+   char *targetEnd = strchr(target, ' ');
+   char *query     = strchr(target, '?');
+
+   if (!targetEnd || targetEnd > eol) {
+      return false;
+   }
+   *targetEnd = 0;
+   if (query) {
+      *query++ = 0;
+   }
+   _currentUri = urlDecode(target, strlen(target));
+   _argCount   = 0;
+   if (query) {
+      parseArguments(query);
+   }
+
+   for (int i = 0; i < _headerCount; i++) {
+      _headers[i].value = String();
+   }
+   conn.request[headerLength - 2] = 0;
+   for (char *h = eol + 2; *h; ) {
+      char *next  = strstr(h, "\r\n");
+      char *colon = strchr(h, ':');
+
+      if (!next) {
+         break;
+      }
+      *next = 0;
+      if (colon) {
+         *colon++ = 0;
+         while (*colon == ' ') {
+            colon++;
+         }
+         for (int i = 0; i < _headerCount; i++) {
+            if (_headers[i].name.equalsIgnoreCase(h)) {
+               _headers[i].value = colon;
+            }
+         }
+      }
+      h = next + 2;
+   }
+
+   if (strstr(conn.request + headerLength, "=")) {
+      parseArguments(conn.request + headerLength);
+   }
+   return true;
+}
+
+/** Adds the arguments of a query string or urlencoded form body. */
+void MyAsyncWebServer::parseArguments(const char *data)
+{
+   while (*data && _argCount < ASYNC_WEB_ARG_COUNT) {
+      const char *end = strchr(data, '&');
+      const char *eq  = strchr(data, '=');
+      size_t      len = end ? end - data : strlen(data);
+
+      if (eq && eq < data + len) {
+         _args[_argCount].name  = urlDecode(data, eq - data);
+         _args[_argCount].value = urlDecode(eq + 1, data + len - eq - 1);
+      } else {
+         _args[_argCount].name  = urlDecode(data, len);
+         _args[_argCount].value = String();
+      }
+      _argCount++;
+      data += len;
+      if (*data) {
+         data++;
+      }
+   }
+}
+
+/** Runs the matching handler and switches to writing the response. */
+void MyAsyncWebServer::handleRequest(AsyncWebConnection &conn)
+{
+   _current         = &conn;
+   _responseHeaders = String();
+   _contentLength   = CONTENT_LENGTH_NOT_SET;
+   _chunked         = false;
+   _headerSent      = false;
+
+   bool handled = false;
+
+   for (int i = 0; i < _routeCount && !handled; i++) {
+      if (_routes[i].uri == _currentUri) {
+         _routes[i].fn();
+         handled = true;
+      }
+   }
+   if (!handled) {
+      if (_notFoundHandler) {
+         _notFoundHandler();
+      } else {
+         send(404, "text/plain", F("Not found"));
+      }
+   }
+   if (_chunked) {
+      queue("0\r\n\r\n", 5);
+   }
+   _current = NULL;
+
+   if (conn.aborted) {
+      // A truncated answer must not look complete.
+      close(conn);
+   } else if (_headerSent) {
+      conn.state  = ASYNC_WEB_WRITE;
+      conn.lastMs = millis();
+      writeResponse(conn);
+   } else {
+      // The handler took over the client (server sent events).
+      conn.client = WiFiClient();
+      conn.state  = ASYNC_WEB_FREE;
+   }
+}
+
+/** Sends the queued bytes and the file as far as the tcp window allows, closes when all is sent. */
+void MyAsyncWebServer::writeResponse(AsyncWebConnection &conn)
+{
+   if (!conn.client.connected()) {
+      close(conn);
+      return;
+   }
+   while (drain(conn)) {
+      if (conn.overflow) {
+         refill(conn);
+         continue;
+      }
+      if (!conn.file) {
+         close(conn);
+         return;
+      }
+
+      size_t size = min(conn.client.availableForWrite(), sizeof(conn.output));
+
+      if (!size) {
+         return;
+      }
+      conn.outputLength = conn.file.read((uint8_t *) conn.output, size);
+      if (!conn.outputLength) {
+         conn.file.close();
+      }
+   }
+}
+
+/** Sends as much of the queue as the tcp window takes. Returns true if the queue is empty. */
+bool MyAsyncWebServer::drain(AsyncWebConnection &conn)
+{
+   size_t pending = conn.outputLength - conn.outputStart;
+
+   if (pending) {
+      size_t size = min(pending, conn.client.availableForWrite());
+
+      if (size) {
+         size = conn.client.write((const uint8_t *) conn.output + conn.outputStart, size);
+         conn.outputStart += size;
+         conn.lastMs       = millis();
+      }
+      if (conn.outputStart < conn.outputLength) {
+         return false;
+      }
+   }
+   conn.outputStart  = 0;
+   conn.outputLength = 0;
+   return true;
+}
+
+/** Moves the parked bytes into the empty output queue. */
+void MyAsyncWebServer::refill(AsyncWebConnection &conn)
+{
+   size_t part = min(conn.overflowLength - conn.overflowStart, sizeof(conn.output));
+
+   memcpy(conn.output, conn.overflow + conn.overflowStart, part);
+   conn.outputStart     = 0;
+   conn.outputLength    = part;
+   conn.overflowStart  += part;
+   if (conn.overflowStart == conn.overflowLength) {
+      free(conn.overflow);
+      conn.overflow = NULL;
+   }
+}
+
+/** Keeps bytes behind the full output queue on the heap, up to ASYNC_WEB_OVERFLOW_SIZE.
+  * False if they do not fit, the connection is aborted then.
+  */
+bool MyAsyncWebServer::park(AsyncWebConnection &conn, const char *data, size_t size)
+{
+   if (!conn.overflow) {
+      conn.overflow       = (char *) malloc(ASYNC_WEB_OVERFLOW_SIZE);
+      conn.overflowStart  = 0;
+      conn.overflowLength = 0;
+   }
+   if (!conn.overflow || conn.overflowLength + size > ASYNC_WEB_OVERFLOW_SIZE) {
+      MyDbg(F("AsyncWebServer: response too large for the tcp window, aborted"));
+      free(conn.overflow);
+      conn.overflow = NULL;
+      conn.aborted  = true;
+      return false;
+   }
+   memcpy_P(conn.overflow + conn.overflowLength, data, size);
+   conn.overflowLength += size;
+   return true;
+}
+
+/** Appends bytes to the output of the current connection.
+  * When the queue is full and the tcp window is closed the rest is parked on
+  * the heap and sent on the next passes, the loop never waits for the client.
+  */
+void MyAsyncWebServer::queue(const char *data, size_t size)
+{
+   if (!_current || _current->aborted) {
+      return;
+   }
+
+   AsyncWebConnection &conn = *_current;
+
+   while (size) {
+      if (conn.overflow) {
+         park(conn, data, size);
+         return;
+      }
+      if (conn.outputLength == sizeof(conn.output)) {
+         if (conn.outputStart) {
+            memmove(conn.output, conn.output + conn.outputStart, conn.outputLength - conn.outputStart);
+            conn.outputLength -= conn.outputStart;
+            conn.outputStart   = 0;
+         } else if (!drain(conn)) {
+            park(conn, data, size);
+            return;
+         }
+         continue;
+      }
+
+      size_t part = min(size, sizeof(conn.output) - conn.outputLength);
+
+      memcpy_P(conn.output + conn.outputLength, data, part);
+      conn.outputLength += part;
+      data              += part;
+      size              -= part;
+   }
+}
+
+/** Answers with an error code and closes after sending. */
+void MyAsyncWebServer::sendError(AsyncWebConnection &conn, int code)
+{
+   _current       = &conn;
+   _contentLength = CONTENT_LENGTH_NOT_SET;
+   _chunked       = false;
+   send(code, "text/plain", codeToString(code));
+   _current    = NULL;
+   conn.state  = ASYNC_WEB_WRITE;
+   conn.lastMs = millis();
+}
+
+/** Closes the connection and frees the slot. */
+void MyAsyncWebServer::close(AsyncWebConnection &conn)
+{
+   if (conn.file) {
+      conn.file.close();
+   }
+   free(conn.overflow);
+   conn.overflow = NULL;
+   // Unread input would reset the connection before the client got the answer.
+   while (conn.client.available() > 0 && conn.client.read((uint8_t *) conn.request, sizeof(conn.request)) > 0) {
+   }
+   conn.client.stop();
+   conn.client = WiFiClient();
+   conn.state  = ASYNC_WEB_FREE;
+}
+
+/** Decodes %xx and '+' of an url part. */
+String MyAsyncWebServer::urlDecode(const char *text, size_t length)
+{
+   String ret;
+
+   ret.reserve(length);
+   for (size_t i = 0; i < length; i++) {
+      char c = text[i];
+
+      if (c == '+') {
+         c = ' ';
+      } else if (c == '%' && i + 2 < length && isxdigit(text[i + 1]) && isxdigit(text[i + 2])) {
+         char hex[3] = { text[i + 1], text[i + 2], 0 };
+
+         c  = (char) strtol(hex, NULL, 16);
+         i += 2;
+      }
+      ret += c;
+   }
+   return ret;
+}
+
+/** Reason phrase of the used status codes. */
+const __FlashStringHelper *MyAsyncWebServer::codeToString(int code)
+{
+   switch (code) {
+      case 200: return F("OK");
+      case 304: return F("Not Modified");
+      case 400: return F("Bad Request");
+      case 404: return F("Not Found");
+      case 413: return F("Payload Too Large");
+      case 431: return F("Request Header Fields Too Large");
+      case 503: return F("Service Unavailable");
+      default:  return F("Error");
+   }
+}
@@ -53,14 +53,14 @@ public:
 
 /** Constructor */
 MyBME280::MyBME280(MyOptions &options, MyData &data, int pin)
-   : pinGrnd(pin)
-   , myOptions(options)
+   : myOptions(options)
    , myData(data)
+   , pinGrnd(pin)
    , portAddr(0x77)
 {
 }
 
-/** Switch off the module at startup to safe power. */
+/** Switch off the module at startup to safe power. Returns false without a sensor. */
 bool MyBME280::begin()
 {
    pinMode(D1,      INPUT); // I2C SCL Open state to safe power
@@ -74,33 +74,49 @@ bool MyBME280::begin()
    } else if (bme280.begin(0x76)) { // China 0x76
       portAddr = 0x76;
       MyDbg("BME280 sensor with port 0x76!");
+   } else {
+      return false;
    }
+   return true;
 }
 
 /** 
   * Switch on the modul, read the values and switch off the modul to save power. 
   * Do this only every bme280CheckIntervalSec
+  * Returns true if new values were read.
   */
 bool MyBME280::readValues()
 {
+   bool ret = false;
+
    if (secondsElapsedAndUpdate(myData.getAllTimeSumSec(), myData.rtcData.lastBme280ReadSec, myOptions.bme280CheckIntervalSec)) {
+      MyTrace trace(TRACE_BME280);
+
       digitalWrite(pinGrnd, LOW);
       delay(100); // Short delay after power on
       if (!bme280.begin(portAddr)) {
          myData.temperature = 0;
          myData.humidity    = 0;
          myData.pressure    = 0;
+         myData.sampleTime  = 0;
          MyDbg("No valid BME280 sensor, check wiring!");
       } else {
          myData.temperature = bme280.readTemperature() + TEMP_CORR_DEGREE;
          myData.humidity    = bme280.readHumidity();
          myData.pressure    = (bme280.readPressure() / 100.0F) + BARO_CORR_HPA;
+         myData.sampleTime  = myData.getEpochTime();
+         ret                = true;
          MyDbg("Temperature: " + String(myData.temperature) + "°C");
          MyDbg("Humidity: "    + String(myData.humidity)    + "%");
          MyDbg("Pressure: "    + String(myData.pressure)    + "hPa");
+         if (myOptions.isMqttEnabled && myOptions.isMqttTelemetry && myData.sampleTime > 0) {
+            myData.addSample(telemetrySample(myData.sampleTime, myData.temperature, myData.humidity, myData.pressure, myData.voltage));
+         }
       }
+      myData.changed();
       digitalWrite(pinGrnd, HIGH); 
       pinMode(D1, INPUT); // I2C SCL Open state to safe power
       pinMode(D2, INPUT); // I2C SDA Open state to safe power
    }
+   return ret;
 }
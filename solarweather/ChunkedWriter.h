@@ -0,0 +1,278 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ChunkedWriter.h
+  *
+  * Buffered writer for chunked http responses.
+  */
+
+#define CHUNKED_WRITER_SIZE 512 //!< Size of the send buffer.
+
+
+/**
+  * Writes a http response in chunks from a small fixed buffer instead of
+  * building the complete body in one String. The header is sent by the 
+  * constructor, the last chunk by the destructor.
+  * The escaping functions write the converted characters directly into the buffer.
+  */
+class ChunkedWriter
+{
+protected:
+   WebServerBase    *server;                      //!< The server of the current request (NULL for the derived writers).
+   char              buffer[CHUNKED_WRITER_SIZE]; //!< Collected content of the next chunk.
+   size_t            length;                      //!< Used bytes of the buffer.
+   char              last;                        //!< Last written character.
+
+protected:
+   ChunkedWriter();
+
+   virtual void send();
+
+public:
+   ChunkedWriter(WebServerBase &server, int code, const __FlashStringHelper *contentType);
+   virtual ~ChunkedWriter();
+
+   char lastChar() { return last; }
+
+   void flush();
+   void write(char c);
+   void write(const char *data, size_t size);
+
+   ChunkedWriter &operator+=(char c)                         { write(c); return *this; }
+   ChunkedWriter &operator+=(const char *text)               { write(text, strlen(text)); return *this; }
+   ChunkedWriter &operator+=(const String &text)             { write(text.c_str(), text.length()); return *this; }
+   ChunkedWriter &operator+=(const __FlashStringHelper *text);
+   ChunkedWriter &operator+=(int value)                      { return *this += (long) value; }
+   ChunkedWriter &operator+=(long value);
+
+   void addXml (const String &text);
+   void addXml (const char *text);
+   void addXml (const __FlashStringHelper *text);
+   void addJson(const String &text);
+   void addUrl (const String &text);
+
+protected:
+   void addXml (PGM_P text, size_t size);
+};
+
+/* ******************************************** */
+
+/** Constructor for the derived writers without http response. */
+ChunkedWriter::ChunkedWriter()
+   : server(NULL)
+   , length(0)
+   , last('\0')
+{
+}
+
+/** Sends the http header with unknown content length (chunked). */
+ChunkedWriter::ChunkedWriter(WebServerBase &s, int code, const __FlashStringHelper *contentType)
+   : server(&s)
+   , length(0)
+   , last('\0')
+{
+   server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+   server->send(code, contentType, String());
+}
+
+/** Sends the rest of the buffer and the last empty chunk. 
+  * The derived writers have to flush in their own destructor.
+  */
+ChunkedWriter::~ChunkedWriter()
+{
+   if (server) {
+      flush();
+      server->sendContent(String());
+   }
+}
+
+/** Sends the buffer as one chunk. */
+void ChunkedWriter::send()
+{
+   server->sendContent_P(buffer, length);
+}
+
+/** Sends the filled part of the buffer. */
+void ChunkedWriter::flush()
+{
+   if (length > 0) {
+      send();
+      length = 0;
+   }
+}
+
+/** Appends one character. */
+void ChunkedWriter::write(char c)
+{
+   if (length >= sizeof(buffer)) {
+      flush();
+   }
+   buffer[length++] = c;
+   last = c;
+}
+
+/** Appends a memory block. */
+void ChunkedWriter::write(const char *data, size_t size)
+{
+   while (size > 0) {
+      size_t part = min(size, sizeof(buffer) - length);
+
+      memcpy(buffer + length, data, part);
+      length += part;
+      data   += part;
+      size   -= part;
+      last    = data[-1];
+      if (length >= sizeof(buffer)) {
+         flush();
+      }
+   }
+}
+
+/** Appends a flash string without a temporary String. */
+ChunkedWriter &ChunkedWriter::operator+=(const __FlashStringHelper *text)
+{
+   PGM_P  p    = (PGM_P) text;
+   size_t size = strlen_P(p);
+
+   while (size > 0) {
+      size_t part = min(size, sizeof(buffer) - length);
+
+      memcpy_P(buffer + length, p, part);
+      length += part;
+      p      += part;
+      size   -= part;
+      last    = buffer[length - 1];
+      if (length >= sizeof(buffer)) {
+         flush();
+      }
+   }
+   return *this;
+}
+
+/** Appends a number as decimal text. */
+ChunkedWriter &ChunkedWriter::operator+=(long value)
+{
+   char buff[LONG_SIZE];
+
+   write(buff, formatLong(buff, value));
+   return *this;
+}
+
+/** Appends the text with the HTML special characters as entities. */
+void ChunkedWriter::addXml(const String &text)
+{
+   addXml(text.c_str(), text.length());
+}
+
+/** Appends the buffer text with the HTML special characters as entities. */
+void ChunkedWriter::addXml(const char *text)
+{
+   addXml((PGM_P) text, strlen(text));
+}
+
+/** Appends the flash text with the HTML special characters as entities. */
+void ChunkedWriter::addXml(const __FlashStringHelper *text)
+{
+   addXml((PGM_P) text, strlen_P((PGM_P) text));
+}
+
+/** pgm_read_byte reads RAM and flash so this works for both.
+  * The entities are the ones of TextToXml (xmlEscape in Utils.h).
+  */
+void ChunkedWriter::addXml(PGM_P text, size_t size)
+{
+   for (size_t i = 0; i < size; i++) {
+      char  c   = pgm_read_byte(text + i);
+      PGM_P seq = xmlEscape(c);
+
+      if (seq) {
+         *this += FPSTR(seq);
+      } else {
+         write(c);
+      }
+   }
+}
+
+/** Appends the text with JSON escapes for quotes, backslashes and control characters. */
+void ChunkedWriter::addJson(const String &text)
+{
+   for (size_t i = 0; i < text.length(); i++) {
+      char c = text[i];
+
+      if (c == '"' || c == '\\') {
+         write('\\');
+         write(c);
+      } else if ((unsigned char) c < 0x20) {
+         char buff[8];
+
+         sprintf(buff, "\\u%04x", c);
+         *this += (const char *) buff;
+      } else {
+         write(c);
+      }
+   }
+}
+
+/** Appends the text url encoded like TextToUrl. */
+void ChunkedWriter::addUrl(const String &text)
+{
+   for (size_t i = 0; i < text.length(); i++) {
+      char  c   = text[i];
+      PGM_P seq = urlEscape(c);
+
+      if (seq) {
+         *this += FPSTR(seq);
+      } else {
+         write(isValidUrlChar(c) ? c : '?');
+      }
+   }
+}
+
+
+/**
+  * Writer for one server-sent event to one client.
+  * The content has to be a single line (like the escaped JSON).
+  */
+class EventWriter : public ChunkedWriter
+{
+protected:
+   WiFiClient &client; //!< The receiving event client.
+
+   virtual void send() { client.write((const uint8_t *) buffer, length); }
+
+public:
+   EventWriter(WiFiClient &client, const __FlashStringHelper *event);
+   virtual ~EventWriter();
+};
+
+/* ******************************************** */
+
+/** Starts the event with its name. */
+EventWriter::EventWriter(WiFiClient &c, const __FlashStringHelper *event)
+   : client(c)
+{
+   *this += F("event: ");
+   *this += event;
+   *this += F("\ndata: ");
+}
+
+/** Ends the event and sends the rest. */
+EventWriter::~EventWriter()
+{
+   *this += F("\n\n");
+   flush();
+}
@@ -33,5 +33,11 @@
 #define MQTT_USER     "user"                   //!< MQTT connection user
 #define MQTT_PASSWORD "password"               //!< MQTT connection password
 
+#define NTP_SERVER    "pool.ntp.org"           //!< SNTP server for the wall-clock time
+
 #define POWER_CONSUMPTION_ACTIVE       70.0    //!< Power consumption if Active in mA
 #define POWER_CONSUMPTION_DEEP_SLEEP    0.5    //!< Power consumption if in deep sleep mode in mA
+
+// #define HEAP_ALLOC_COUNTING                 //!< Count the allocations per code path (needs the linker flags from README.md)
+// #define USE_EMBEDDED_WEB_ASSETS             //!< Serve the web pages from the flash (needs tools/compress_data.py --embed)
+// #define USE_ASYNC_WEB_SERVER                //!< Non blocking web server with several connections at once
@@ -43,6 +43,18 @@ public:
       long mqttConnErrorCount;     //!< How many time the mqtt connection to the server fails.
       long mqttSendCount;          //!< How many time the mqtt data successfully sent.
       long mqttSendErrorCount;     //!< How many time the mqtt sending failed.
+
+      long epochOffsetSec;         //!< Unix time at getAllTimeSumSec() == 0. 0 = never synchronized.
+      long lastTimeSyncSec;        //!< Timestamp of the last SNTP synchronization.
+
+      long overrunCount[AWAKE_PHASE_COUNT]; //!< How many times a phase exhausted the awake budget since the power on.
+
+      TraceBoot traceBoots[TRACE_BOOT_COUNT]; //!< Timelines of the last boots, the newest first.
+
+      TelemetrySample samples[TELEMETRY_BACKLOG]; //!< Unpublished BME280 readings for the binary telemetry, oldest first.
+      long            sampleCount;                //!< Used entries of samples.
+
+      TlsSessionCache tlsSession;                 //!< TLS session of the MQTT server to resume.
                  
       long crcValue;               //!< CRC of the RtcData
 
@@ -65,6 +77,7 @@ public:
    double temperature;         //!< Current BME280 temperature
    double humidity;            //!< Current BME280 humidity
    double pressure;            //!< Current BME280 pressure
+   long   sampleTime;          //!< Unix time of the current BME280 values. 0 = unknown
 
    String softAPIP;            //!< registered ip of the access point
    String softAPmacAddress;    //!< module mac address
@@ -77,17 +90,29 @@ public:
    StringList consoleCmds;     //!< open commands to send to the sim808 module
    StringList logInfos;        //!< received sim808 answers or other logs
 
+   unsigned long version;      //!< Bumped whenever a displayed value changes (ETag of the info pages).
+
 public:
    MyData();
 
    long   getActiveTimeSec();
+   long   getAwakeTimeSec();
    long   getAllTimeSumSec();
    long   getActiveTimeSumSec();
    long   getDeepSleepTimeSumSec();
 
+   bool   isTimeValid();
+   long   getEpochTime();
+   void   setEpochTime(long epoch);
+
+   void   changed();
+   void   addSample(const TelemetrySample &sample);
+
    double getPowerConsumption();
 };
 
+static_assert(sizeof(MyData::RtcData) <= 512, "RtcData does not fit into the RTC user memory");
+
 /* ******************************************** */
 
 MyData::RtcData::RtcData()
@@ -99,7 +124,14 @@ MyData::RtcData::RtcData()
    , mqttConnErrorCount(0)
    , mqttSendCount(0)
    , mqttSendErrorCount(0)
+   , epochOffsetSec(0)
+   , lastTimeSyncSec(0)
+   , sampleCount(0)
 {
+   memset(overrunCount, 0, sizeof(overrunCount));
+   memset(traceBoots,   0, sizeof(traceBoots));
+   memset(samples,      0, sizeof(samples));
+   memset(&tlsSession,  0, sizeof(tlsSession));
    crcValue = getCRC();
 }
 
@@ -127,7 +159,14 @@ long MyData::RtcData::getCRC()
    crc = crc32(crc, (unsigned char *) &lastMqttPublishSec,   sizeof(long));
    crc = crc32(crc, (unsigned char *) &mqttConnErrorCount,   sizeof(long));
    crc = crc32(crc, (unsigned char *) &mqttSendCount,        sizeof(long));
-   crc = crc32(crc, (unsigned char *) &mqttConnErrorCount,   sizeof(long));
+   crc = crc32(crc, (unsigned char *) &mqttSendErrorCount,   sizeof(long));
+   crc = crc32(crc, (unsigned char *) &epochOffsetSec,       sizeof(long));
+   crc = crc32(crc, (unsigned char *) &lastTimeSyncSec,      sizeof(long));
+   crc = crc32(crc, (unsigned char *) overrunCount,          sizeof(overrunCount));
+   crc = crc32(crc, (unsigned char *) traceBoots,            sizeof(traceBoots));
+   crc = crc32(crc, (unsigned char *) samples,               sizeof(samples));
+   crc = crc32(crc, (unsigned char *) &sampleCount,          sizeof(long));
+   crc = crc32(crc, (unsigned char *) &tlsSession,           sizeof(tlsSession));
    
    return crc;
 }
@@ -141,6 +180,8 @@ MyData::MyData()
    , temperature(0.0)
    , humidity(0.0)
    , pressure(0.0)
+   , sampleTime(0)
+   , version(RANDOM_REG32) // Random start, a cached ETag of the last boot must not match.
 {
 }
 
@@ -150,6 +191,12 @@ long MyData::getActiveTimeSec()
    return millis() / 1000;
 }
 
+/** Returns the seconds since the wake up or the last settings change. */
+long MyData::getAwakeTimeSec()
+{
+   return getActiveTimeSec() - awakeTimeOffsetSec;
+}
+
 /** Return all the active and deep sleep time plus the current active time. */
 long MyData::getAllTimeSumSec()
 {
@@ -168,6 +215,50 @@ long MyData::getDeepSleepTimeSumSec()
    return rtcData.deepSleepTimeSumSec;
 }
 
+/** Do we know the wall-clock time? Lost on power loss until the next SNTP sync. */
+bool MyData::isTimeValid()
+{
+   return rtcData.epochOffsetSec != 0;
+}
+
+/** Returns the current unix time or 0 if the time was never synchronized.
+  * The offset is kept in the RTC memory and the deep sleep times are part
+  * of getAllTimeSumSec() so the time stays valid over the deep sleeps. 
+  */
+long MyData::getEpochTime()
+{
+   if (!isTimeValid()) {
+      return 0;
+   }
+   return rtcData.epochOffsetSec + getAllTimeSumSec();
+}
+
+/** Sets the current unix time from a SNTP sync. */
+void MyData::setEpochTime(long epoch)
+{
+   rtcData.epochOffsetSec  = epoch - getAllTimeSumSec();
+   rtcData.lastTimeSyncSec = getAllTimeSumSec();
+   changed();
+}
+
+/** Marks a change of a value shown on the Main or Infos page. 
+  * The running times are not part of the version, they tick every second.
+  */
+void MyData::changed()
+{
+   version++;
+}
+
+/** Stores a reading for the next binary telemetry record, a full backlog drops the oldest. */
+void MyData::addSample(const TelemetrySample &sample)
+{
+   if (rtcData.sampleCount >= TELEMETRY_BACKLOG) {
+      memmove(rtcData.samples, rtcData.samples + 1, sizeof(TelemetrySample) * (TELEMETRY_BACKLOG - 1));
+      rtcData.sampleCount = TELEMETRY_BACKLOG - 1;
+   }
+   rtcData.samples[rtcData.sampleCount++] = sample;
+}
+
 /** Calculates the power consumption from power on.
   * In mA/h
   */
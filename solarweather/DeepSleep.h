@@ -23,6 +23,7 @@
 #define NO_DEEP_SLEEP_STARTUP_TIME 120     //!< No deep sleep for the first two minutes.
 #define MAX_DEEP_SLEEP_TIME_SEC    60 * 60 //!< Maximum deep sleep time (60 minutes)
 #define DEEP_SLEEP_CORRECT         1.09    //!< Correction try for the deep sleep inaccuracy
+#define AWAKE_BUDGET_EXTRA_SEC     60      //!< Hard awake limit above the configured active time.
 
 
 /**
@@ -41,6 +42,8 @@ public:
    bool begin();
    
    bool haveToSleep();
+   bool isBudgetExhausted();
+   void checkBudget(AwakePhase phase);
    void updateTimeToSleep();
    void sleep();
 };
@@ -63,6 +66,7 @@ bool MyDeepSleep::begin()
 {
    MyDbg(F("MyDeepSleep::begin"));
    
+   MyTrace         trace(TRACE_RTC);
    MyData::RtcData rtcData;
 
    ESP.rtcUserMemoryRead(0, (uint32_t *) &rtcData, sizeof(MyData::RtcData));
@@ -80,7 +84,7 @@ void MyDeepSleep::updateTimeToSleep()
 {
    myData.secondsToDeepSleep = -1;
    if (myOptions.isDeepSleepEnabled) {
-      long activeTimeSec = myData.getActiveTimeSec() - myData.awakeTimeOffsetSec;
+      long activeTimeSec = myData.getAwakeTimeSec();
       
       myData.secondsToDeepSleep = max(myOptions.activeTimeSec - activeTimeSec, NO_DEEP_SLEEP_STARTUP_TIME - myData.getActiveTimeSumSec());
    }
@@ -92,7 +96,7 @@ bool MyDeepSleep::haveToSleep()
    if (myData.rtcData.deepSleepTimeRestSec > 0) {
       return true;
    } else {
-      long activeTimeSec = myData.getActiveTimeSec() - myData.awakeTimeOffsetSec;
+      long activeTimeSec = myData.getAwakeTimeSec();
        
       return (myOptions.isDeepSleepEnabled &&
               myData.getActiveTimeSumSec() > NO_DEEP_SLEEP_STARTUP_TIME &&
@@ -100,6 +104,32 @@ bool MyDeepSleep::haveToSleep()
    }
 }
 
+/** Has the current wake used more time than the hard budget allows? 
+  * Like the normal deep sleep never in the startup phase after power on.
+  * The consumption is only estimated from the awake time, so there is no separate energy limit.
+  */
+bool MyDeepSleep::isBudgetExhausted()
+{
+   if (!myOptions.isDeepSleepEnabled || myData.getActiveTimeSumSec() <= NO_DEEP_SLEEP_STARTUP_TIME) {
+      return false;
+   }
+   return myData.getAwakeTimeSec() >= myOptions.activeTimeSec + AWAKE_BUDGET_EXTRA_SEC;
+}
+
+/** Forces the deep sleep if the awake budget is exhausted.
+  * The overrun is counted per phase in the RTC memory, the counters are never
+  * reset and only start again from 0 after a power loss.
+  */
+void MyDeepSleep::checkBudget(AwakePhase phase)
+{
+   if (isBudgetExhausted()) {
+      myData.rtcData.overrunCount[phase]++;
+      myData.changed();
+      MyDbg((String) F("Awake budget exhausted in phase ") + awakePhaseName(phase), true);
+      sleep();
+   }
+}
+
 /**
   * Entering the DeepSleep mode. Be sure we have connected the RST pin to the D0 pin for wakeup.
   * If the deep sleep mode time is above the maximum then we do it stepwise.
@@ -107,8 +137,9 @@ bool MyDeepSleep::haveToSleep()
 void MyDeepSleep::sleep()
 {
    long deepSleepTimeSec = myOptions.deepSleepTimeSec;
+   bool intermediateWake = myData.rtcData.deepSleepTimeRestSec > 0;
 
-   if (myData.rtcData.deepSleepTimeRestSec > 0) {
+   if (intermediateWake) {
       deepSleepTimeSec = myData.rtcData.deepSleepTimeRestSec;
       if (deepSleepTimeSec < MAX_DEEP_SLEEP_TIME_SEC) {
          myData.rtcData.deepSleepTimeRestSec = 0;
@@ -122,6 +153,12 @@ void MyDeepSleep::sleep()
       deepSleepTimeSec = MAX_DEEP_SLEEP_TIME_SEC;
    }
 
+   // The timer wakes of a stepwise sleep would push the real boots out.
+   if (!intermediateWake) {
+      memmove(&myData.rtcData.traceBoots[1], &myData.rtcData.traceBoots[0], sizeof(TraceBoot) * (TRACE_BOOT_COUNT - 1));
+      MyTrace::toBoot(myData.rtcData.traceBoots[0], myData.getAllTimeSumSec() - myData.getActiveTimeSec());
+   }
+
    myData.rtcData.activeTimeSumSec    += myData.getActiveTimeSec();
    myData.rtcData.deepSleepTimeSumSec += deepSleepTimeSec;
    myData.rtcData.setCRC();
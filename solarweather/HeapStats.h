@@ -0,0 +1,185 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HeapStats.h
+  *
+  * Heap fragmentation, low-water mark and allocation counters per code path.
+  */
+
+/** Code paths with their own allocation counters. */
+enum HeapSite
+{
+   HEAP_SITE_MAIN_INFO,
+   HEAP_SITE_SETTINGS_INFO,
+   HEAP_SITE_SAVE_SETTINGS,
+   HEAP_SITE_INFO_INFO,
+   HEAP_SITE_CONSOLE_INFO,
+   HEAP_SITE_RESTART_INFO,
+   HEAP_SITE_TRACE,
+   HEAP_SITE_PERF_INFO,
+   HEAP_SITE_FILE,
+   HEAP_SITE_MQTT_PUBLISH,
+   HEAP_SITE_LOG_APPEND,
+   HEAP_SITE_COUNT
+};
+
+/** Readable name of the code path. */
+String heapSiteName(int site)
+{
+   switch (site) {
+      case HEAP_SITE_MAIN_INFO:     return F("MainInfo");
+      case HEAP_SITE_SETTINGS_INFO: return F("SettingsInfo");
+      case HEAP_SITE_SAVE_SETTINGS: return F("SaveSettings");
+      case HEAP_SITE_INFO_INFO:     return F("InfoInfo");
+      case HEAP_SITE_CONSOLE_INFO:  return F("ConsoleInfo");
+      case HEAP_SITE_RESTART_INFO:  return F("RestartInfo");
+      case HEAP_SITE_TRACE:         return F("Trace");
+      case HEAP_SITE_PERF_INFO:     return F("PerfInfo");
+      case HEAP_SITE_FILE:          return F("File");
+      case HEAP_SITE_MQTT_PUBLISH:  return F("MqttPublish");
+      case HEAP_SITE_LOG_APPEND:    return F("LogAppend");
+   }
+   return F("Unknown");
+}
+
+/**
+  * Heap statistics. The low-water mark is sampled in loop() and at every
+  * MyHeapScope. The allocation counters only work with HEAP_ALLOC_COUNTING
+  * and the malloc wrapper linker flags (see README.md).
+  */
+class MyHeap
+{
+public:
+   /** Allocation statistic of one code path. */
+   struct Site
+   {
+      uint32_t calls;     //!< Number of passes.
+      uint32_t allocs;    //!< Sum of all allocations.
+      uint32_t maxAllocs; //!< Most allocations of one pass.
+      uint32_t bytes;     //!< Sum of all requested bytes.
+   };
+
+public:
+   static uint32_t allocCount;             //!< Number of all allocations since the start.
+   static uint32_t allocBytes;             //!< Requested bytes of all allocations since the start.
+   static uint32_t lowWater;               //!< Smallest sampled free heap.
+   static Site     sites[HEAP_SITE_COUNT]; //!< Allocation statistic per code path.
+
+public:
+   static bool isCounting();
+   static void sample();
+};
+
+/**
+  * Counts the allocations and requested bytes from the constructor to the 
+  * destructor for one code path. Nested scopes are counted inclusive.
+  */
+class MyHeapScope
+{
+protected:
+   HeapSite site;        //!< The code path.
+   uint32_t beginCount;  //!< MyHeap::allocCount at the start.
+   uint32_t beginBytes;  //!< MyHeap::allocBytes at the start.
+
+public:
+   MyHeapScope(HeapSite site);
+   ~MyHeapScope();
+};
+
+/* ******************************************** */
+
+uint32_t       MyHeap::allocCount = 0;
+uint32_t       MyHeap::allocBytes = 0;
+uint32_t       MyHeap::lowWater   = 0xFFFFFFFF;
+MyHeap::Site   MyHeap::sites[HEAP_SITE_COUNT];
+
+/** Are the allocation counters active? */
+bool MyHeap::isCounting()
+{
+#ifdef HEAP_ALLOC_COUNTING
+   return true;
+#else
+   return false;
+#endif
+}
+
+/** Updates the low-water mark of the free heap. */
+void MyHeap::sample()
+{
+   uint32_t freeHeap = ESP.getFreeHeap();
+
+   if (freeHeap < lowWater) {
+      lowWater = freeHeap;
+   }
+}
+
+/** Starts counting. */
+MyHeapScope::MyHeapScope(HeapSite s)
+   : site(s)
+   , beginCount(MyHeap::allocCount)
+   , beginBytes(MyHeap::allocBytes)
+{
+   MyHeap::sample();
+}
+
+/** Adds the counted allocations to the code path statistic. */
+MyHeapScope::~MyHeapScope()
+{
+   MyHeap::Site &stat   = MyHeap::sites[site];
+   uint32_t      allocs = MyHeap::allocCount - beginCount;
+
+   MyHeap::sample();
+   stat.calls++;
+   stat.allocs += allocs;
+   stat.bytes  += MyHeap::allocBytes - beginBytes;
+   if (allocs > stat.maxAllocs) {
+      stat.maxAllocs = allocs;
+   }
+}
+
+#ifdef HEAP_ALLOC_COUNTING
+/**
+  * Counting hooks on the allocator. The linker redirects the calls with
+  * -Wl,--wrap=malloc -Wl,--wrap=realloc -Wl,--wrap=calloc
+  */
+extern "C" {
+   void *__real_malloc (size_t size);
+   void *__real_realloc(void *ptr, size_t size);
+   void *__real_calloc (size_t count, size_t size);
+
+   void *__wrap_malloc(size_t size)
+   {
+      MyHeap::allocCount++;
+      MyHeap::allocBytes += size;
+      return __real_malloc(size);
+   }
+
+   void *__wrap_realloc(void *ptr, size_t size)
+   {
+      MyHeap::allocCount++;
+      MyHeap::allocBytes += size;
+      return __real_realloc(ptr, size);
+   }
+
+   void *__wrap_calloc(size_t count, size_t size)
+   {
+      MyHeap::allocCount++;
+      MyHeap::allocBytes += count * size;
+      return __real_calloc(count, size);
+   }
+}
+#endif
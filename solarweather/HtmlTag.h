@@ -34,25 +34,27 @@
 class HtmlTag
 {
 protected:
-   String &html;    //!< The html content.
-   String  tagName; //!< The current element name.
+   ChunkedWriter             &html;    //!< The html content.
+   const __FlashStringHelper *tagName; //!< The current element name.
 
 public:
-   HtmlTag(String &h, const String &tn, String attributes = "");
+   HtmlTag(ChunkedWriter &h, const __FlashStringHelper *tn, const __FlashStringHelper *attributes = NULL);
    ~HtmlTag();
 };
 
 /* ******************************************** */
 
 /** Creates the begin element */
-HtmlTag::HtmlTag(String &h, const String &tn, String attributes /*= ""*/)
+HtmlTag::HtmlTag(ChunkedWriter &h, const __FlashStringHelper *tn, const __FlashStringHelper *attributes /*= NULL*/)
    : html(h)
    , tagName(tn)
 {
    html += F("<");
    html += tagName;
    html += F(" ");
-   html += attributes;
+   if (attributes) {
+      html += attributes;
+   }
    html += F(">");
 }
 
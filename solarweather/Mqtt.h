@@ -22,21 +22,9 @@
 
 
 #include <PubSubClient.h>
+#include "MqttTopics.h"
 
-#define topic_deep_sleep       "/DeepSleep"          //!< Deep sleep on/off
-#define topic_send_every       "/SendEverySec"       //!< mqtt sending interval
-
-#define topic_temperature      "/BME280/Temperature" //!< Temperature
-#define topic_humidity         "/BME280/Humidity"    //!< Humidity
-#define topic_pressure         "/BME280/Pressure"    //!< Pressure
-
-#define topic_voltage          "/Voltage"            //!< Power supply voltage
-#define topic_mAh              "/mAh"                //!< Power consumption
-#define topic_alive            "/Alive"              //!< Alive time in sec
-#define topic_rssi             "/RSSI"               //!< Wifi conection quality
-
-#define topic_conn_error_count "/ConnErrorCount"     //!< Connection error Count
-#define topic_send_error_count "/SendErrorCount"     //!< mqtt sending error count
+static_assert(AWAKE_PHASE_COUNT == TELEMETRY_OVERRUN_WEB - TELEMETRY_OVERRUN_WIFI + 1, "One telemetry field per awake phase");
 
 /**
   * MQTT client for sending the collected data to a MQTT server
@@ -52,11 +40,18 @@ public:
 protected:
    MyOptions &myOptions;            //!< Reference to the options. 
    MyData    &myData;               //!< Reference to the data.
+   MyMqttTls  tls;                  //!< TLS transport with isMqttTls.
    bool       publishInProgress;    //!< Are we publishing right now.
 
 protected:
    bool mySubscribe(String subTopic);
    bool myPublish(String subTopic, String value);
+   bool myPublish(String subTopic, const char *value);
+   bool myPublish(String subTopic, long value);
+   bool myPublish(String subTopic, const uint8_t *value, size_t length);
+
+   void publishValues();
+   bool publishTelemetry();
 
 public:
    MyMqtt(Client &client, MyOptions &options, MyData &data);
@@ -75,6 +70,7 @@ MyMqtt::MyMqtt(Client &client, MyOptions &options, MyData &data)
    : PubSubClient(client)
    , myOptions(options)
    , myData(data)
+   , tls(options, data.rtcData.tlsSession)
    , publishInProgress(false)
 {
    g_myOptions = &options;
@@ -100,20 +96,148 @@ bool MyMqtt::mySubscribe(String subTopic)
  *  It put the mqttName from optione before the topic.
 */
 bool MyMqtt::myPublish(String subTopic, String value)
+{
+   return myPublish(subTopic, value.c_str());
+}
+
+/** Publishes a text from a buffer. */
+bool MyMqtt::myPublish(String subTopic, const char *value)
 {
    bool ret = false;
 
-   if (value.length() > 0) {
-      String topic;
+   if (*value) {
+      MyHeapScope heapScope(HEAP_SITE_MQTT_PUBLISH);
+      String      topic;
 
       topic = myOptions.mqttName + F("/") + myOptions.mqttId + subTopic;
       MyDbg((String) F("MyMqtt::publish: [") + topic + F("]=[") + value + F("]"), true);
-      ret = PubSubClient::publish(topic.c_str(), value.c_str(), true);
+      ret = PubSubClient::publish(topic.c_str(), value, true);
       if (!ret) myData.rtcData.mqttSendErrorCount++;
    }
    return ret;
 }
 
+/** Publishes a number without building a String for the value. */
+bool MyMqtt::myPublish(String subTopic, long value)
+{
+   char buff[LONG_SIZE];
+
+   formatLong(buff, value);
+   return myPublish(subTopic, buff);
+}
+
+/** Publishes a binary payload. */
+bool MyMqtt::myPublish(String subTopic, const uint8_t *value, size_t length)
+{
+   bool ret = false;
+
+   if (length) {
+      MyHeapScope heapScope(HEAP_SITE_MQTT_PUBLISH);
+      String      topic;
+
+      topic = myOptions.mqttName + F("/") + myOptions.mqttId + subTopic;
+      MyDbg((String) F("MyMqtt::publish: [") + topic + F("]=[") + length + F(" byte]"), true);
+      ret = PubSubClient::publish(topic.c_str(), value, length, true);
+      if (!ret) myData.rtcData.mqttSendErrorCount++;
+   }
+   return ret;
+}
+
+/** Publishes every value as text on its own topic. */
+void MyMqtt::publishValues()
+{
+   char buff[INTERVAL_SIZE];
+
+   myPublish(topic_temperature,      String(myData.temperature));
+   myPublish(topic_humidity,         String(myData.humidity));
+   myPublish(topic_pressure,         String(myData.pressure));
+   if (myData.sampleTime > 0) {
+      myPublish(topic_time,          (long) myData.sampleTime);
+   }
+   myPublish(topic_voltage,          String(myData.voltage, 2));
+   myPublish(topic_mAh,              String(myData.getPowerConsumption()));
+   formatInterval(buff, sizeof(buff), myData.getActiveTimeSec());
+   myPublish(topic_alive,            buff);
+   myPublish(topic_rssi,             (long) WiFi.RSSI());
+   myPublish(topic_conn_error_count, (long) myData.rtcData.mqttConnErrorCount);
+   myPublish(topic_send_error_count, (long) myData.rtcData.mqttSendErrorCount);
+   for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+      myPublish(topic_overrun + awakePhaseName(i), (long) myData.rtcData.overrunCount[i]);
+   }
+   myPublish(topic_heap_free,        (long) ESP.getFreeHeap());
+   myPublish(topic_heap_max_block,   (long) ESP.getMaxFreeBlockSize());
+   myPublish(topic_heap_frag,        (long) ESP.getHeapFragmentation());
+   myPublish(topic_heap_low_water,   (long) MyHeap::lowWater);
+   if (myOptions.isMqttTls && myData.rtcData.tlsSession.isConnected()) {
+      myPublish(topic_tls_handshake, (long) myData.rtcData.tlsSession.handshakeMs);
+      myPublish(topic_tls_resumed,   (long) myData.rtcData.tlsSession.resumed);
+   }
+}
+
+/** 
+  * Publishes the same values and the stored readings since the last publish
+  * as one binary record (Telemetry.h). The published readings are removed
+  * from the RTC memory, on an error they are sent with the next record.
+  */
+bool MyMqtt::publishTelemetry()
+{
+   TelemetryEncoder encoder(myData.sampleTime > 0 ? myData.sampleTime : 0);
+   uint8_t          buff[TELEMETRY_MAX_SIZE];
+   size_t           topicLength = myOptions.mqttName.length() + 1 + myOptions.mqttId.length() + strlen(topic_telemetry);
+   size_t           maxLength   = MQTT_MAX_PACKET_SIZE - 7 - topicLength; // Fixed header, topic length.
+   int              backlog     = 0;
+   int              sent        = 0;
+   size_t           length;
+
+   encoder.set(TELEMETRY_TEMPERATURE,    myData.temperature);
+   encoder.set(TELEMETRY_HUMIDITY,       myData.humidity);
+   encoder.set(TELEMETRY_PRESSURE,       myData.pressure);
+   encoder.set(TELEMETRY_VOLTAGE,        myData.voltage);
+   encoder.set(TELEMETRY_MAH,            myData.getPowerConsumption());
+   encoder.set(TELEMETRY_ALIVE,          myData.getActiveTimeSec());
+   encoder.set(TELEMETRY_RSSI,           WiFi.RSSI());
+   encoder.set(TELEMETRY_CONN_ERRORS,    myData.rtcData.mqttConnErrorCount);
+   encoder.set(TELEMETRY_SEND_ERRORS,    myData.rtcData.mqttSendErrorCount);
+   for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+      encoder.set(TELEMETRY_OVERRUN_WIFI + i, myData.rtcData.overrunCount[i]);
+   }
+   encoder.set(TELEMETRY_HEAP_FREE,      ESP.getFreeHeap());
+   encoder.set(TELEMETRY_HEAP_MAX_BLOCK, ESP.getMaxFreeBlockSize());
+   encoder.set(TELEMETRY_HEAP_FRAG,      ESP.getHeapFragmentation());
+   encoder.set(TELEMETRY_HEAP_LOW_WATER, MyHeap::lowWater);
+   if (myOptions.isMqttTls && myData.rtcData.tlsSession.isConnected()) {
+      encoder.set(TELEMETRY_TLS_HANDSHAKE, myData.rtcData.tlsSession.handshakeMs);
+      encoder.set(TELEMETRY_TLS_RESUMED,   myData.rtcData.tlsSession.resumed);
+   }
+
+   // The newest sample is the reading of the values above.
+   while (myData.sampleTime > 0 && backlog < myData.rtcData.sampleCount &&
+          myData.rtcData.samples[backlog].timeSec < (uint32_t) myData.sampleTime) {
+      backlog++;
+   }
+   encoder.setSamples(myData.rtcData.samples, backlog);
+   length = encoder.encode(buff, maxLength < sizeof(buff) ? maxLength : sizeof(buff), &sent);
+   if (!length) {
+      myData.rtcData.mqttSendErrorCount++;
+      return false;
+   }
+   if (!myPublish(topic_telemetry, buff, length)) {
+      return false;
+   }
+   MyDbg((String) F("MyMqtt::publish: ") + sent + F(" of ") + backlog + F(" stored readings"), true);
+   if (myData.sampleTime > 0) {
+      int keep = 0;
+
+      for (int i = 0; i < myData.rtcData.sampleCount; i++) {
+         if (myData.rtcData.samples[i].timeSec > (uint32_t) myData.sampleTime) {
+            myData.rtcData.samples[keep++] = myData.rtcData.samples[i];
+         }
+      }
+      myData.rtcData.sampleCount = keep;
+   }
+   return true;
+}
+
 /** Check if we have to wait for sending mqtt data. */
 bool MyMqtt::waitingForMqtt()
 {
@@ -132,6 +256,11 @@ bool MyMqtt::begin()
    MyDbg(F("MQTT:begin"), true);
    MyDbg((String) "MQTT:setServer(" + myOptions.mqttServer + ", " + myOptions.mqttPort + ")", true);
    PubSubClient::setServer(myOptions.mqttServer.c_str(), myOptions.mqttPort);
+   if (myOptions.isMqttTls) {
+      MyDbg(F("MQTT:TLS"), true);
+      tls.begin();
+      PubSubClient::setClient(tls);
+   }
    PubSubClient::setCallback(mqttCallback);
    return true;
 }
@@ -144,7 +273,10 @@ void MyMqtt::handleClient()
    if (send && !publishInProgress) {
       publishInProgress = true;
       if (!PubSubClient::connected()) {
+         MyTrace trace(TRACE_MQTT_CONNECT);
+
          for (int i = 0; !PubSubClient::connected() && i < 25; i++) {  
+            myCheckAwakeBudget(AWAKE_PHASE_MQTT);
             MyDbg((String) "Attempting MQTT connection..." + " [" + myOptions.mqttName + "][" + myOptions.mqttUser + "][" + myOptions.mqttPassword + "]", true);
             if (PubSubClient::connect(myOptions.mqttName.c_str(), myOptions.mqttUser.c_str(), myOptions.mqttPassword.c_str())) {  
                // mySubscribe(topic_deep_sleep);
@@ -160,17 +292,24 @@ void MyMqtt::handleClient()
       if (!PubSubClient::connected()) {
          myData.rtcData.mqttConnErrorCount++;
       } else {
+         MyTrace trace(TRACE_MQTT_PUBLISH);
+
          MyDbg(F("Attempting MQTT publishing"), true);
-         myPublish(topic_temperature,      String(myData.temperature));
-         myPublish(topic_humidity,         String(myData.humidity));
-         myPublish(topic_pressure,         String(myData.pressure));
-         myPublish(topic_voltage,          String(myData.voltage, 2));
-         myPublish(topic_mAh,              String(myData.getPowerConsumption()));
-         myPublish(topic_alive,            formatInterval(myData.getActiveTimeSec()));
-         myPublish(topic_rssi,             String(WiFi.RSSI()));
-         myPublish(topic_conn_error_count, String(myData.rtcData.mqttConnErrorCount));
-         myPublish(topic_send_error_count, String(myData.rtcData.mqttSendErrorCount));
+         if (myOptions.isMqttTelemetry) {
+            publishTelemetry();
+         } else {
+            publishValues();
+         }
+         myPublish(topic_trace, MyTrace::summary());
+         if (MyHeap::isCounting()) {
+            for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+               if (MyHeap::sites[i].calls) {
+                  myPublish(topic_heap_allocs + heapSiteName(i), (long) (MyHeap::sites[i].allocs / MyHeap::sites[i].calls));
+               }
+            }
+         }
          myData.rtcData.mqttSendCount++;
+         myData.changed();
          MyDbg(F("mqtt published"), true);
          MyDelay(5000);
       }
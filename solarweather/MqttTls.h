@@ -0,0 +1,173 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MqttTls.h
+  *
+  * TLS transport of the MQTT connection (BearSSL of the ESP8266 core).
+  * A full handshake costs seconds of CPU time for the key exchange and the
+  * certificate, so the session parameters of the last handshake are kept
+  * in the RTC memory. After the deep sleep the box offers the session ID
+  * again and a broker which still knows it resumes the session with an
+  * abbreviated handshake (symmetric crypto only). The broker has to keep
+  * its sessions longer than the sleep interval.
+  */
+
+#include <WiFiClientSecure.h>
+
+#define TLS_FINGERPRINT_SIZE 20 //!< SHA-1 of the broker certificate.
+
+/**
+  * Session of the last handshake in the RTC memory, the fields of
+  * br_ssl_session_parameters plus the broker they belong to.
+  */
+struct TlsSessionCache
+{
+   uint8_t  masterSecret[48]; //!< Secret of the session.
+   uint8_t  sessionId[32];    //!< Session ID of the broker.
+   uint32_t serverHash;       //!< Broker, port and fingerprint of the session. 0 = none or the last connect failed.
+   uint16_t version;          //!< TLS version.
+   uint16_t cipherSuite;      //!< Negotiated cipher suite.
+   uint16_t handshakeMs;      //!< Duration of the last connect including the TCP connect.
+   uint16_t fullCount;        //!< Full handshakes since the power on.
+   uint16_t resumedCount;     //!< Resumed handshakes since the power on.
+   uint8_t  sessionIdLength;  //!< Used bytes of sessionId.
+   uint8_t  resumed;          //!< Was the last handshake resumed?
+
+   bool isConnected() const { return serverHash != 0; } //!< Did the last connect succeed?
+};
+
+/**
+  * TLS client for PubSubClient which resumes the session of the RTC memory.
+  */
+class MyMqttTls : public BearSSL::WiFiClientSecure
+{
+protected:
+   MyOptions       &myOptions; //!< Broker and fingerprint.
+   TlsSessionCache &cache;     //!< Session in the RTC memory.
+   BearSSL::Session session;   //!< Session of the BearSSL engine.
+
+   uint32_t serverHash(const char *host, uint16_t port);
+
+public:
+   MyMqttTls(MyOptions &options, TlsSessionCache &c);
+
+   bool begin();
+
+   virtual int connect(const char *host, uint16_t port);
+   virtual int connect(IPAddress ip, uint16_t port);
+};
+
+/* ******************************************** */
+
+/** Constructor */
+MyMqttTls::MyMqttTls(MyOptions &options, TlsSessionCache &c)
+   : myOptions(options)
+   , cache(c)
+{
+}
+
+/** Sets the certificate check, without fingerprint only the traffic is encrypted. */
+bool MyMqttTls::begin()
+{
+   uint8_t fingerprint[TLS_FINGERPRINT_SIZE];
+   int     length = 0;
+
+   for (const char *p = myOptions.mqttTlsFingerprint.c_str(); *p && length < TLS_FINGERPRINT_SIZE; p++) {
+      if (isxdigit(p[0]) && isxdigit(p[1])) {
+         char hex[3] = { p[0], p[1], 0 };
+
+         fingerprint[length++] = strtoul(hex, NULL, 16);
+         p++;
+      }
+   }
+   if (length == TLS_FINGERPRINT_SIZE) {
+      setFingerprint(fingerprint);
+      return true;
+   }
+   MyDbg(F("MQTT:TLS without fingerprint, the broker is not verified"), true);
+   setInsecure();
+   return false;
+}
+
+/** FNV-1a of the broker, a session is only offered to the same one. */
+uint32_t MyMqttTls::serverHash(const char *host, uint16_t port)
+{
+   uint32_t    hash = 2166136261u;
+   const char *text[] = { host, myOptions.mqttTlsFingerprint.c_str() };
+
+   for (const char *p : text) {
+      for (; *p; p++) {
+         hash = (hash ^ (uint8_t) *p) * 16777619u;
+      }
+      hash = (hash ^ 0xFF) * 16777619u;
+   }
+   hash = (hash ^ (port & 0xFF)) * 16777619u;
+   hash = (hash ^ (port >> 8)) * 16777619u;
+   return hash ? hash : 1;
+}
+
+/** Connects with the cached session and keeps the new one. */
+int MyMqttTls::connect(const char *host, uint16_t port)
+{
+   br_ssl_session_parameters *params  = session.getSession();
+   uint32_t                   hash    = serverHash(host, port);
+   bool                       offered = cache.serverHash == hash && cache.sessionIdLength > 0 &&
+                                        cache.sessionIdLength <= sizeof(params->session_id);
+   unsigned long              start   = millis();
+   int                        ret;
+
+   memset(params, 0, sizeof(*params));
+   if (offered) {
+      memcpy(params->session_id,    cache.sessionId,    cache.sessionIdLength);
+      memcpy(params->master_secret, cache.masterSecret, sizeof(params->master_secret));
+      params->session_id_len = cache.sessionIdLength;
+      params->version        = cache.version;
+      params->cipher_suite   = cache.cipherSuite;
+   }
+   setSession(&session);
+   ret = WiFiClientSecure::connect(host, port);
+   cache.handshakeMs = min(millis() - start, 65535UL);
+   if (!ret) {
+      cache.serverHash      = 0;
+      cache.sessionIdLength = 0;
+      cache.resumed         = 0;
+      MyDbg((String) F("MQTT:TLS connect failed (") + getLastSSLError() + F(")"), true);
+      return ret;
+   }
+   // The broker accepted the offered session if it kept its ID.
+   cache.resumed = offered && params->session_id_len == cache.sessionIdLength &&
+                   memcmp(params->session_id, cache.sessionId, cache.sessionIdLength) == 0;
+   if (cache.resumed) {
+      cache.resumedCount++;
+   } else {
+      cache.fullCount++;
+   }
+   memcpy(cache.sessionId,    params->session_id,    sizeof(cache.sessionId));
+   memcpy(cache.masterSecret, params->master_secret, sizeof(cache.masterSecret));
+   cache.sessionIdLength = params->session_id_len;
+   cache.version         = params->version;
+   cache.cipherSuite     = params->cipher_suite;
+   cache.serverHash      = hash;
+   MyDbg((String) F("MQTT:TLS ") + (cache.resumed ? F("resumed") : F("full")) + F(" handshake in ") +
+         cache.handshakeMs + F(" ms"), true);
+   return ret;
+}
+
+int MyMqttTls::connect(IPAddress ip, uint16_t port)
+{
+   return connect(ip.toString().c_str(), port);
+}
@@ -0,0 +1,48 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MqttTopics.h
+  *
+  * Sub topics of the MQTT values after mqttName/mqttId.
+  * Shared with the host tools which speak the same topic scheme.
+  */
+
+#define topic_deep_sleep       "/DeepSleep"          //!< Deep sleep on/off
+#define topic_send_every       "/SendEverySec"       //!< mqtt sending interval
+
+#define topic_temperature      "/BME280/Temperature" //!< Temperature
+#define topic_humidity         "/BME280/Humidity"    //!< Humidity
+#define topic_pressure         "/BME280/Pressure"    //!< Pressure
+#define topic_time             "/BME280/Time"        //!< Unix time of the BME280 values
+
+#define topic_voltage          "/Voltage"            //!< Power supply voltage
+#define topic_mAh              "/mAh"                //!< Power consumption
+#define topic_alive            "/Alive"              //!< Alive time in sec
+#define topic_rssi             "/RSSI"               //!< Wifi conection quality
+
+#define topic_conn_error_count "/ConnErrorCount"     //!< Connection error Count
+#define topic_send_error_count "/SendErrorCount"     //!< mqtt sending error count
+#define topic_trace            "/Trace"              //!< Boot timeline summary
+#define topic_overrun          "/Overrun/"           //!< Awake budget overruns since the power on, followed by the phase name
+#define topic_heap_free        "/Heap/Free"          //!< Free heap
+#define topic_heap_max_block   "/Heap/MaxFreeBlock"  //!< Largest free heap block
+#define topic_heap_frag        "/Heap/Fragmentation" //!< Heap fragmentation in percent
+#define topic_heap_low_water   "/Heap/LowWater"      //!< Smallest sampled free heap
+#define topic_heap_allocs      "/Heap/Allocs/"       //!< Mean allocations per pass of one code path
+#define topic_tls_handshake    "/TLS/HandshakeMs"    //!< Duration of the last TLS connect
+#define topic_tls_resumed      "/TLS/Resumed"        //!< Was the last TLS session resumed (1) or new (0)
+#define topic_telemetry        "/Telemetry"          //!< Binary record of a wake instead of the values above (Telemetry.h)
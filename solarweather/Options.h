@@ -20,12 +20,58 @@
   * Configuration data with load and save to the SPIFFS.
   */
 
-#define OPTION_FILE_NAME "/options.txt" //!< Option file name.
+#define OPTION_FILE_NAME        "/options.txt" //!< Option file name.
+#define OPTION_TEMP_FILE_NAME   "/options.tmp" //!< New option file while saving.
+#define OPTION_BACKUP_FILE_NAME "/options.bak" //!< Previous good option file.
+#define OPTION_CRC_KEY          "crc"          //!< Key of the CRC line at the end of the option file.
+
+#define OPTION_KEY_SIZE   24 //!< Maximum key length + 1.
+#define OPTION_LABEL_SIZE 40 //!< Maximum label length + 1.
+#define OPTION_TEXT_SIZE  65 //!< Maximum default text length + 1 (WiFi passwords have up to 64 characters).
+#define OPTION_HASH_SIZE  64 //!< Slots of the perfect hash for the key lookup.
+
+#define OPTION_LEGEND     0x01 //!< Bool option which starts a fieldset as its legend.
+
+/** Value type of one option. */
+enum OptionType
+{
+   OPTION_BOOL,     //!< Checkbox, stored as 0/1.
+   OPTION_LONG,     //!< Number.
+   OPTION_INTERVAL, //!< Seconds, shown as '[days] hours:minutes:seconds'.
+   OPTION_TEXT,     //!< Text.
+   OPTION_PASSWORD  //!< Text which is a secret.
+};
+
+class MyOptions;
+
+/**
+  * Description of one option: key, type, default, label, bounds and the
+  * member which holds the value. The descriptor table is in the flash.
+  */
+struct OptionInfo
+{
+   char                 key[OPTION_KEY_SIZE];           //!< Key in the option file and the settings form.
+   char                 label[OPTION_LABEL_SIZE];       //!< Label in the settings form.
+   OptionType           type;                           //!< Value type.
+   uint8_t              flags;                          //!< OPTION_LEGEND
+   long                 defaultValue;                   //!< Default of the bool and number options.
+   char                 defaultText[OPTION_TEXT_SIZE];  //!< Default of the text options.
+   long                 minValue;                       //!< Lower bound of the number options.
+   long                 maxValue;                       //!< Upper bound of the number options.
+   bool   MyOptions::*  boolValue;                      //!< Member of a bool option.
+   long   MyOptions::*  longValue;                      //!< Member of a number or interval option.
+   String MyOptions::*  textValue;                      //!< Member of a text option.
+};
 
 /** 
   * Class with the complete configuration data of the programm.
   * It can load and save the data in a ini file format to the SPIFFS
-  * as key value pairs 'key=value' line by line.
+  * as key value pairs 'key=value' line by line. The last line is the CRC
+  * of the file. A save writes a new file first and keeps the last good
+  * one as backup, so a power loss while saving never loses the settings.
+  * Only changed options cause a write.
+  * All the options are described in the optionTable below, loading,
+  * saving and the settings form work on the table.
   */
 class MyOptions
 {
@@ -42,142 +88,427 @@ public:
    long   mqttPort;                  //!< MQTT server port.
    String mqttUser;                  //!< MQTT user.
    String mqttPassword;              //!< MQTT password.
+   bool   isMqttTls;                 //!< Connect to the MQTT server with TLS (MqttTls.h).
+   String mqttTlsFingerprint;        //!< SHA-1 fingerprint of the MQTT server certificate, empty = not verified.
    long   mqttSendEverySec;          //!< Send data interval to MQTT server.
+   bool   isMqttTelemetry;           //!< Publish one binary record (Telemetry.h) instead of the text values.
    bool   isDeepSleepEnabled;        //!< Should the system go into deepsleep if needed.
    long   activeTimeSec;             //!< Maximum alive time after deepsleep.
    long   deepSleepTimeSec;          //!< Time to stay in deep sleep (without check interrupts)
 
+protected:
+   uint32_t dirty;                   //!< One bit per option changed since the last load or save.
+
 public:
    MyOptions();
 
    bool load();
    bool save();
+   bool isDirty();
+
+   static int  count();
+   static void getInfo(int idx, OptionInfo &info);
+   static int  find(const char *key);
+
+   String getValue(const OptionInfo &info);
+   void   setValue(const OptionInfo &info, const String &value);
+   void   setValue(const OptionInfo &info, const char *value);
+   void   setValue(const OptionInfo &info, long value);
+
+protected:
+   bool   loadFile(const char *fileName, bool needsCrc);
+   bool   check(char *content, size_t &size, const char *fileName, bool needsCrc);
+   void   apply(const char *content, size_t size);
+   int    indexOf(const OptionInfo &info);
+
+   static void printCrc(File &file, long &crc, const char *text);
+};
+
+/* ******************************************** */
+
+/** All options in the order of the option file and the settings form. */
+static constexpr OptionInfo optionTable[] PROGMEM = {
+   // key                       label                                 type             flags          default  default text   min     max                     member
+   { "isDebugActive",          "Debug Active",                       OPTION_BOOL,     0,             0,       "",            0,      1,                      &MyOptions::isDebugActive,      NULL,                               NULL                    },
+   { "bme280CheckIntervalSec", "Temperature check every (Interval)", OPTION_INTERVAL, 0,             60,      "",            10,     7 * 24 * 3600,          NULL,                           &MyOptions::bme280CheckIntervalSec, NULL                    },
+   { "connectWifiAP",          "WiFi connect",                       OPTION_BOOL,     OPTION_LEGEND, 1,       "",            0,      1,                      &MyOptions::connectWifiAP,      NULL,                               NULL                    },
+   { "wifiAP",                 "WiFi SSID",                          OPTION_TEXT,     0,             0,       WIFI_SID,      0,      0,                      NULL,                           NULL,                               &MyOptions::wifiAP       },
+   { "wifiPassword",           "WiFi Password",                      OPTION_PASSWORD, 0,             0,       WIFI_PW,       0,      0,                      NULL,                           NULL,                               &MyOptions::wifiPassword },
+   { "isMqttEnabled",          "MQTT Active",                        OPTION_BOOL,     OPTION_LEGEND, 0,       "",            0,      1,                      &MyOptions::isMqttEnabled,      NULL,                               NULL                    },
+   { "mqttName",               "MQTT Name",                          OPTION_TEXT,     0,             0,       MQTT_NAME,     0,      0,                      NULL,                           NULL,                               &MyOptions::mqttName     },
+   { "mqttId",                 "MQTT Id",                            OPTION_TEXT,     0,             0,       MQTT_ID,       0,      0,                      NULL,                           NULL,                               &MyOptions::mqttId       },
+   { "mqttServer",             "MQTT Server",                        OPTION_TEXT,     0,             0,       MQTT_SERVER,   0,      0,                      NULL,                           NULL,                               &MyOptions::mqttServer   },
+   { "mqttPort",               "MQTT Port",                          OPTION_LONG,     0,             MQTT_PORT, "",          1,      65535,                  NULL,                           &MyOptions::mqttPort,               NULL                    },
+   { "mqttUser",               "MQTT User",                          OPTION_TEXT,     0,             0,       MQTT_USER,     0,      0,                      NULL,                           NULL,                               &MyOptions::mqttUser     },
+   { "mqttPassword",           "MQTT Password",                      OPTION_PASSWORD, 0,             0,       MQTT_PASSWORD, 0,      0,                      NULL,                           NULL,                               &MyOptions::mqttPassword },
+   { "isMqttTls",              "MQTT TLS",                           OPTION_BOOL,     0,             0,       "",            0,      1,                      &MyOptions::isMqttTls,          NULL,                               NULL                    },
+   { "mqttTlsFingerprint",     "MQTT TLS Fingerprint (SHA-1)",       OPTION_TEXT,     0,             0,       "",            0,      0,                      NULL,                           NULL,                               &MyOptions::mqttTlsFingerprint },
+   { "mqttSendEverySec",       "MQTT Send every (Interval)",         OPTION_INTERVAL, 0,             1800,    "",            10,     7 * 24 * 3600,          NULL,                           &MyOptions::mqttSendEverySec,       NULL                    },
+   { "isMqttTelemetry",        "MQTT Binary telemetry",              OPTION_BOOL,     0,             0,       "",            0,      1,                      &MyOptions::isMqttTelemetry,    NULL,                               NULL                    },
+   { "isDeepSleepEnabled",     "Power saving mode active",           OPTION_BOOL,     OPTION_LEGEND, 0,       "",            0,      1,                      &MyOptions::isDeepSleepEnabled, NULL,                               NULL                    },
+   { "activeTimeSec",          "Active time (Interval)",             OPTION_INTERVAL, 0,             60,      "",            10,     24 * 3600,              NULL,                           &MyOptions::activeTimeSec,          NULL                    },
+   { "deepSleepTimeSec",       "DeepSleep time (Interval)",          OPTION_INTERVAL, 0,             3600,    "",            10,     7 * 24 * 3600,          NULL,                           &MyOptions::deepSleepTimeSec,       NULL                    },
+};
+
+#define OPTION_COUNT ((int) (sizeof(optionTable) / sizeof(optionTable[0]))) //!< Number of options.
+
+/** FNV-1a hash of an option key, the seed makes the hash perfect for the table keys. */
+constexpr uint32_t optionHash(const char *key, uint32_t seed)
+{
+   uint32_t hash = 2166136261u ^ seed;
+
+   while (*key) {
+      hash = (hash ^ (uint8_t) *key++) * 16777619u;
+   }
+   return hash % OPTION_HASH_SIZE;
+}
+
+/** Does the seed map all keys of the table to different slots? */
+constexpr bool optionIsPerfect(uint32_t seed)
+{
+   bool used[OPTION_HASH_SIZE] = {};
+
+   for (int i = 0; i < OPTION_COUNT; i++) {
+      uint32_t slot = optionHash(optionTable[i].key, seed);
+
+      if (used[slot]) {
+         return false;
+      }
+      used[slot] = true;
+   }
+   return true;
+}
+
+/** First seed without collisions. */
+constexpr uint32_t optionFindSeed()
+{
+   uint32_t seed = 0;
+
+   while (!optionIsPerfect(seed)) {
+      seed++;
+   }
+   return seed;
+}
+
+static constexpr uint32_t optionSeed = optionFindSeed(); //!< Seed of the perfect hash.
+
+/** Table index per hash slot, -1 for unused slots. */
+struct OptionSlots
+{
+   int8_t index[OPTION_HASH_SIZE]; //!< Index in the optionTable.
 };
 
+/** Fills the slots of the perfect hash. */
+constexpr OptionSlots optionMakeSlots()
+{
+   OptionSlots slots = {};
+
+   for (int i = 0; i < OPTION_HASH_SIZE; i++) {
+      slots.index[i] = -1;
+   }
+   for (int i = 0; i < OPTION_COUNT; i++) {
+      slots.index[optionHash(optionTable[i].key, optionSeed)] = i;
+   }
+   return slots;
+}
+
+static constexpr OptionSlots optionSlots PROGMEM = optionMakeSlots(); //!< Key lookup table.
+
+static_assert(OPTION_COUNT < 128, "Too many options for the int8_t slot index");
+static_assert(OPTION_COUNT <= 32,  "Too many options for the dirty bits");
+
 /* ******************************************** */
 
+/** Sets all the defaults of the option table. */
 MyOptions::MyOptions()
-   : isDebugActive(false)
-   , wifiAP(WIFI_SID)
-   , connectWifiAP(true)
-   , wifiPassword(WIFI_PW)
-   , bme280CheckIntervalSec(60) //  1 minute
-   , isMqttEnabled(false)
-   , mqttName(MQTT_NAME)
-   , mqttId(MQTT_ID)
-   , mqttServer(MQTT_SERVER)
-   , mqttPort(MQTT_PORT)
-   , mqttUser(MQTT_USER)
-   , mqttPassword(MQTT_PASSWORD)
-   , mqttSendEverySec(1800)     //  30 minute
-   , isDeepSleepEnabled(false)
-   , activeTimeSec(60)          //  1 minute
-   , deepSleepTimeSec(3600)     // 59 minute
-{
-}
-
-/** Load the key-value pairs from the option file into the option values. */
+   : dirty(0)
+{
+   for (int i = 0; i < count(); i++) {
+      OptionInfo info;
+
+      getInfo(i, info);
+      if (info.textValue) {
+         this->*info.textValue = info.defaultText;
+      } else {
+         setValue(info, info.defaultValue);
+      }
+   }
+}
+
+/** Number of options. */
+int MyOptions::count()
+{
+   return OPTION_COUNT;
+}
+
+/** Copies the description of one option from the flash. */
+void MyOptions::getInfo(int idx, OptionInfo &info)
+{
+   memcpy_P(&info, &optionTable[idx], sizeof(OptionInfo));
+}
+
+/** Index of the option with the given key or -1. */
+int MyOptions::find(const char *key)
+{
+   int idx = (int8_t) pgm_read_byte(&optionSlots.index[optionHash(key, optionSeed)]);
+
+   if (idx < 0 || strcmp_P(key, optionTable[idx].key) != 0) {
+      return -1;
+   }
+   return idx;
+}
+
+/** Table index of the option. */
+int MyOptions::indexOf(const OptionInfo &info)
+{
+   return find(info.key);
+}
+
+/** Has an option changed since the last load or save? */
+bool MyOptions::isDirty()
+{
+   return dirty != 0;
+}
+
+/** Option value as it is stored in the option file. */
+String MyOptions::getValue(const OptionInfo &info)
+{
+   if (info.boolValue) {
+      return String(this->*info.boolValue);
+   } else if (info.longValue) {
+      return String(this->*info.longValue);
+   }
+   return this->*info.textValue;
+}
+
+/** Sets the option from the option file format. */
+void MyOptions::setValue(const OptionInfo &info, const String &value)
+{
+   setValue(info, value.c_str());
+}
+
+/** Sets the option from the option file format without a temporary String. */
+void MyOptions::setValue(const OptionInfo &info, const char *value)
+{
+   if (info.textValue) {
+      if (this->*info.textValue != value) {
+         this->*info.textValue = value;
+         dirty |= 1UL << indexOf(info);
+      }
+   } else {
+      setValue(info, atol(value));
+   }
+}
+
+/** Sets a bool or number option within its bounds. */
+void MyOptions::setValue(const OptionInfo &info, long value)
+{
+   value = constrain(value, info.minValue, info.maxValue);
+   if (info.boolValue && this->*info.boolValue != (value != 0)) {
+      this->*info.boolValue = value != 0;
+      dirty |= 1UL << indexOf(info);
+   } else if (info.longValue && this->*info.longValue != value) {
+      this->*info.longValue = value;
+      dirty |= 1UL << indexOf(info);
+   }
+}
+
+/** Load the key-value pairs from the option file into the option values.
+  * Falls back to the new file of an interrupted save and then to the backup.
+  */
 bool MyOptions::load()
 {
-   bool ret  = false;
-   File file = SPIFFS.open(OPTION_FILE_NAME, "r");
+   const char *fileNames[] = { OPTION_FILE_NAME, OPTION_TEMP_FILE_NAME, OPTION_BACKUP_FILE_NAME };
+   bool        hasBackup   = SPIFFS.exists(OPTION_BACKUP_FILE_NAME);
+
+   for (int i = 0; i < 3; i++) {
+      // Once this version has saved there is a backup and the option file needs a CRC.
+      // The new file is always written with CRC, the backup may still be an old file.
+      if (loadFile(fileNames[i], i == 0 ? hasBackup : i == 1)) {
+         dirty = 0;
+         MyDbg(F("Settings loaded"));
+         if (i > 0) {
+            MyDbg((String) F("Settings restored from ") + fileNames[i], true);
+            SPIFFS.remove(OPTION_FILE_NAME); // Broken, must not become the backup
+            dirty = 0xFFFFFFFF;
+            save();
+         }
+         return true;
+      }
+   }
+   dirty = 0xFFFFFFFF; // Nothing stored yet
+   return false;
+}
+
+/** Loads one option file if its CRC is correct. Files of older versions have no CRC line.
+  * The file is read into one buffer which is checked and parsed in place.
+  */
+bool MyOptions::loadFile(const char *fileName, bool needsCrc)
+{
+   File file = SPIFFS.open(fileName, "r");
 
    if (!file) {
-      MyDbg(F("Failed to read options file"));
+      MyDbg((String) F("Failed to read options file ") + fileName);
+      return false;
+   }
+
+   size_t size    = file.size();
+   char  *content = (char *) malloc(size + 1);
+   bool   ret     = false;
+
+   if (content) {
+      size          = file.read((uint8_t *) content, size);
+      content[size] = '\0';
+      ret           = check(content, size, fileName, needsCrc);
+      if (ret) {
+         apply(content, size);
+      }
+      free(content);
    } else {
-      ret = true;
-      while (file.available() && ret) {
-         String line = file.readStringUntil('\n');
-         int    idx  = line.indexOf('=');
-
-         if (idx == -1) {
-            MyDbg((String) F("Wrong option entry: ") + line);
-            ret = false;
-         } else {
-            String key    = line.substring(0, idx);
-            String value  = line.substring(idx + 1);
-            long   lValue = atol(value.c_str());
-            double fValue = atof(value.c_str());
-
-            value.replace("\r", "");
-            value.replace("\n", "");
-            if (isDebugActive) {
-               MyDbg((String) F("Load option '") + key + F("=") + value + F("'"));
-            }
-
-            if (key == F("isDebugActive")) {
-               isDebugActive = lValue;
-            } else if (key == F("wifiAP")) {
-               wifiAP = value;
-            } else if (key == F("connectWifiAP")) {
-               connectWifiAP = lValue;
-            } else if (key == F("wifiPassword")) {
-               wifiPassword = value;
-            } else if (key == F("bme280CheckIntervalSec")) {
-               bme280CheckIntervalSec = lValue;
-            } else if (key == F("isMqttEnabled")) {
-               isMqttEnabled = lValue;
-            } else if (key == F("mqttName")) {
-               mqttName = value;
-            } else if (key == F("mqttId")) {
-               mqttId = value;
-            } else if (key == F("mqttServer")) {
-               mqttServer = value;
-            } else if (key == F("mqttPort")) {
-               mqttPort = lValue;
-            } else if (key == F("mqttUser")) {
-               mqttUser = value;
-            } else if (key == F("mqttPassword")) {
-               mqttPassword = value;
-            } else if (key == F("mqttSendEverySec")) {
-               mqttSendEverySec = lValue;
-            } else if (key == F("isDeepSleepEnabled")) {
-               isDeepSleepEnabled = lValue;
-            } else if (key == F("activeTimeSec")) {
-               activeTimeSec = lValue;
-            } else if (key == F("deepSleepTimeSec")) {
-               deepSleepTimeSec = lValue;
-            } else {
-               MyDbg((String) F("Wrong option entry: ") + line);
-               ret = false;
-            }
+      MyDbg((String) F("No memory to read options file ") + fileName);
+   }
+   file.close();
+   return ret;
+}
+
+/** Checks the 'key=value' lines up to the CRC line and calculates the CRC on the way.
+  * The valid lines are packed in place as 'key\0value\0' for apply(),
+  * size becomes the length of the packed lines.
+  */
+bool MyOptions::check(char *content, size_t &size, const char *fileName, bool needsCrc)
+{
+   char       *line    = content;
+   char       *end     = content + size;
+   char       *packed  = content;
+   const char *wrong   = NULL;
+   bool        hasCrc  = false;
+   uint32_t    fileCrc = 0;
+   long        crc     = 0;
+
+   while (line < end) {
+      char *newline = (char *) memchr(line, '\n', end - line);
+      char *next    = newline ? newline + 1 : end;
+
+      if (strncmp_P(line, PSTR(OPTION_CRC_KEY "="), strlen(OPTION_CRC_KEY "=")) == 0) {
+         fileCrc = strtoul(line + strlen(OPTION_CRC_KEY "="), NULL, 16);
+         hasCrc  = true;
+         break;
+      }
+      crc = crc32(crc, (unsigned char *) line, next - line);
+      if (newline) {
+         *newline = '\0';
+      }
+
+      size_t      len   = 0;
+      const char *text  = Trim(line, "\r", len);
+      const char *equal = (const char *) memchr(text, '=', len);
+
+      line = next;
+      if (len == 0 || wrong) {
+         continue;
+      }
+      memmove(packed, text, len);
+      packed[len] = '\0';
+      if (equal) {
+         packed[equal - text] = '\0';
+      }
+      if (!equal || find(packed) < 0) {
+         if (equal) {
+            packed[equal - text] = '=';
          }
+         wrong = packed;
+         continue;
       }
-      file.close();
+      packed += len + 1;
    }
-   if (ret) {
-      MyDbg(F("Settings loaded"));
+
+   if (hasCrc && fileCrc != (uint32_t) crc) {
+      MyDbg((String) F("Wrong CRC in ") + fileName, true);
+      return false;
+   } else if (!hasCrc && needsCrc) {
+      MyDbg((String) F("Missing CRC in ") + fileName, true);
+      return false;
+   } else if (wrong) {
+      MyDbg((String) F("Wrong option entry: ") + wrong);
+      return false;
+   }
+   size = packed - content;
+   return true;
+}
+
+/** Applies the packed 'key\0value\0' lines of check(). */
+void MyOptions::apply(const char *content, size_t size)
+{
+   const char *end = content + size;
+
+   while (content < end) {
+      const char *value = content + strlen(content) + 1;
+      OptionInfo  info;
+
+      if (isDebugActive) {
+         MyDbg((String) F("Load option '") + content + '=' + value + F("'"));
+      }
+      getInfo(find(content), info);
+      setValue(info, value);
+      content = value + strlen(value) + 1;
    }
-   return ret;
 }
 
-/** Save all the options as key-value pair to the option file. */
+/** Writes text to the option file and adds it to the CRC. */
+void MyOptions::printCrc(File &file, long &crc, const char *text)
+{
+   size_t len = strlen(text);
+
+   file.write((const uint8_t *) text, len);
+   crc = crc32(crc, (unsigned char *) text, len);
+}
+
+/** Save all the options as key-value pair to the option file.
+  * Nothing is written if no option has changed. The new file gets a CRC
+  * line, the old file stays as backup until the next save.
+  */
 bool MyOptions::save()
 {
-  File file = SPIFFS.open(OPTION_FILE_NAME, "w+");
-
-  if (!file) {
-     MyDbg("Failed to write options file");
-  } else {
-     file.println((String) F("isDebugActive=")          + String(isDebugActive));
-     file.println((String) F("connectWifiAP=")          + String(connectWifiAP));
-     file.println((String) F("wifiAP=")                 + wifiAP);
-     file.println((String) F("wifiPassword=")           + wifiPassword);
-     file.println((String) F("bme280CheckIntervalSec=") + String(bme280CheckIntervalSec));
-     file.println((String) F("isMqttEnabled=")          + String(isMqttEnabled));
-     file.println((String) F("mqttName=")               + mqttName);
-     file.println((String) F("mqttId=")                 + mqttId);
-     file.println((String) F("mqttServer=")             + mqttServer);
-     file.println((String) F("mqttPort=")               + String(mqttPort));
-     file.println((String) F("mqttUser=")               + mqttUser);
-     file.println((String) F("mqttPassword=")           + mqttPassword);
-     file.println((String) F("mqttSendEverySec=")       + String(mqttSendEverySec));
-     file.println((String) F("isDeepSleepEnabled=")     + String(isDeepSleepEnabled));
-     file.println((String) F("activeTimeSec=")          + String(activeTimeSec));
-     file.println((String) F("deepSleepTimeSec=")       + String(deepSleepTimeSec));
-     file.close();
-     MyDbg(F("Settings saved"));
-     return true;
-  }
-  return false;
+   if (!dirty) {
+      MyDbg(F("Settings unchanged"));
+      return true;
+   }
+
+   File file = SPIFFS.open(OPTION_TEMP_FILE_NAME, "w");
+
+   if (!file) {
+      MyDbg(F("Failed to write options file"));
+      return false;
+   }
+
+   long crc = 0;
+
+   for (int i = 0; i < count(); i++) {
+      OptionInfo info;
+
+      getInfo(i, info);
+      printCrc(file, crc, info.key);
+      printCrc(file, crc, "=");
+      printCrc(file, crc, getValue(info).c_str());
+      printCrc(file, crc, "\n");
+   }
+   file.print(F(OPTION_CRC_KEY "="));
+   file.print(String((uint32_t) crc, HEX));
+   file.print('\n');
+   file.close();
+
+   if (SPIFFS.exists(OPTION_FILE_NAME)) {
+      SPIFFS.remove(OPTION_BACKUP_FILE_NAME);
+      if (!SPIFFS.rename(OPTION_FILE_NAME, OPTION_BACKUP_FILE_NAME)) {
+         MyDbg(F("Failed to keep the options backup"));
+         return false;
+      }
+   }
+   if (!SPIFFS.rename(OPTION_TEMP_FILE_NAME, OPTION_FILE_NAME)) {
+      MyDbg(F("Failed to write options file"));
+      return false;
+   }
+   dirty = 0;
+   MyDbg(F("Settings saved"));
+   return true;
 }
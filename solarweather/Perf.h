@@ -0,0 +1,135 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Perf.h
+  *
+  * Cycle counter statistics of the subsystem calls in loop().
+  */
+
+#define PERF_BUCKET_COUNT  21    //!< Log2 histogram buckets in us (<2us .. >=1s)
+#define PERF_SATURATE_MS   20000 //!< Longer calls than the cycle counter wrap are saturated.
+
+/** The measured subsystems of loop(). */
+enum PerfSlot
+{
+   PERF_VOLTAGE,
+   PERF_BME280,
+   PERF_DEEP_SLEEP,
+   PERF_WEB,
+   PERF_OTA,
+   PERF_MQTT,
+   PERF_LOOP,
+   PERF_SLOT_COUNT
+};
+
+/** Readable name of the subsystem. */
+String perfSlotName(int slot)
+{
+   switch (slot) {
+      case PERF_VOLTAGE:    return F("readVoltage");
+      case PERF_BME280:     return F("readValues");
+      case PERF_DEEP_SLEEP: return F("updateTimeToSleep");
+      case PERF_WEB:        return F("handleClient");
+      case PERF_OTA:        return F("ArduinoOTA.handle");
+      case PERF_MQTT:       return F("myMqtt.handleClient");
+      case PERF_LOOP:       return F("loop");
+   }
+   return F("Unknown");
+}
+
+/**
+  * Measures the cycles of one subsystem call from the constructor to the destructor
+  * and collects them in a fixed statistic per subsystem. 
+  * Only the cycle counter, some additions and one clz per call so it can stay 
+  * active in production.
+  */
+class MyPerf
+{
+public:
+   /** Statistic of one subsystem. */
+   struct Stats
+   {
+      uint32_t count;                        //!< Number of measured calls.
+      uint32_t minCycles;                    //!< Fastest call.
+      uint32_t maxCycles;                    //!< Slowest call.
+      uint64_t sumCycles;                    //!< Sum of all calls for the mean value.
+      uint32_t histogram[PERF_BUCKET_COUNT]; //!< Number of calls per log2(us) bucket.
+   };
+
+protected:
+   PerfSlot slot;        //!< The measured subsystem.
+   uint32_t beginCycles; //!< Cycle counter at the start.
+   uint32_t beginMs;     //!< millis() at the start to detect a cycle counter wrap.
+
+   static Stats stats[PERF_SLOT_COUNT]; //!< Statistics of all subsystems.
+
+public:
+   MyPerf(PerfSlot slot);
+   ~MyPerf();
+
+   static Stats &get(int slot) { return stats[slot]; }
+   static int    bucket(uint32_t us);
+   static void   reset();
+};
+
+/* ******************************************** */
+
+MyPerf::Stats MyPerf::stats[PERF_SLOT_COUNT];
+
+
+/** Starts the measurement. */
+MyPerf::MyPerf(PerfSlot s)
+   : slot(s)
+   , beginMs(millis())
+{
+   beginCycles = ESP.getCycleCount();
+}
+
+/** Adds the measured cycles to the statistic. */
+MyPerf::~MyPerf()
+{
+   uint32_t cycles = ESP.getCycleCount() - beginCycles;
+   Stats   &stat   = stats[slot];
+
+   if (millis() - beginMs >= PERF_SATURATE_MS) {
+      cycles = 0xFFFFFFFF;
+   }
+   if (stat.count == 0 || cycles < stat.minCycles) {
+      stat.minCycles = cycles;
+   }
+   if (cycles > stat.maxCycles) {
+      stat.maxCycles = cycles;
+   }
+   stat.count++;
+   stat.sumCycles += cycles;
+   stat.histogram[bucket(cycles / ESP.getCpuFreqMHz())]++;
+}
+
+/** Returns the histogram bucket of the duration: 0 is < 2us, n is [2^n, 2^(n+1)) us. */
+int MyPerf::bucket(uint32_t us)
+{
+   if (us < 2) {
+      return 0;
+   }
+   return min(31 - __builtin_clz(us), PERF_BUCKET_COUNT - 1);
+}
+
+/** Clears all statistics. */
+void MyPerf::reset()
+{
+   memset(stats, 0, sizeof(stats));
+}
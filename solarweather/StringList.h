@@ -94,7 +94,7 @@ String StringList::getAt(int idx)
    int currIdx = 0;
    int lastPos = 0;
    
-   for(int i = 0; i < infos.length(); i++) {
+   for(int i = 0; i < (int) infos.length(); i++) {
       if (infos[i] == '\1') {
          if (currIdx == idx) {
             return infos.substring(lastPos, i);
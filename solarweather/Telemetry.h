@@ -0,0 +1,299 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Telemetry.h
+  *
+  * Compact binary record of one wake, published as mqttName/mqttId/Telemetry
+  * instead of the text topics. Shared with the host tools which decode it.
+  *
+  * All numbers are varints (7 bits per byte, lowest group first, the high
+  * bit marks a following byte), the values zigzag coded fixed point numbers
+  * (value * scale of the field, rounded):
+  *
+  *   version fieldMask timeSec value... sampleCount [sampleMask sample...]
+  *   sample: seconds value...
+  *
+  * version is TELEMETRY_VERSION. fieldMask has one bit per TelemetryField,
+  * the values follow in the order of the bits. timeSec is the unix time of
+  * the BME280 values, 0 = unknown. The samples are the stored readings of
+  * the wakes without publish (backlog), oldest first, with the fields of
+  * sampleMask. The seconds of the first sample count back from timeSec,
+  * the following ones forward from the previous sample. The sample values
+  * are the differences to the previous sample, the first one to the value
+  * of the record (0 if not in fieldMask), modulo 2^32.
+  * Fields are only appended, a decoder of the same version skips unknown
+  * fields, every other layout change needs a new version.
+  */
+
+#pragma once
+
+#include "MqttTopics.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_VERSION      1  //!< Layout of the record.
+#define TELEMETRY_BACKLOG      6  //!< Stored samples of the device (RTC memory).
+#define TELEMETRY_VARINT_SIZE  5  //!< Longest varint of 32 bits.
+
+/** Fields of the record, the bit number in fieldMask. */
+enum TelemetryField
+{
+   TELEMETRY_TEMPERATURE,    //!< Degree celsius.
+   TELEMETRY_HUMIDITY,       //!< Percent.
+   TELEMETRY_PRESSURE,       //!< hPa.
+   TELEMETRY_VOLTAGE,        //!< Supply voltage.
+   TELEMETRY_MAH,            //!< Power consumption.
+   TELEMETRY_ALIVE,          //!< Awake seconds.
+   TELEMETRY_RSSI,           //!< dBm.
+   TELEMETRY_CONN_ERRORS,    //!< mqttConnErrorCount.
+   TELEMETRY_SEND_ERRORS,    //!< mqttSendErrorCount.
+   TELEMETRY_OVERRUN_WIFI,   //!< Awake budget overruns per AwakePhase.
+   TELEMETRY_OVERRUN_TIME,
+   TELEMETRY_OVERRUN_MQTT,
+   TELEMETRY_OVERRUN_WEB,
+   TELEMETRY_HEAP_FREE,      //!< Byte.
+   TELEMETRY_HEAP_MAX_BLOCK, //!< Byte.
+   TELEMETRY_HEAP_FRAG,      //!< Percent.
+   TELEMETRY_HEAP_LOW_WATER, //!< Byte.
+   TELEMETRY_TLS_HANDSHAKE,  //!< ms of the last TLS connect.
+   TELEMETRY_TLS_RESUMED,    //!< 1 = the TLS session was resumed.
+   TELEMETRY_FIELD_COUNT     //!< Number of fields
+};
+
+/** Fields of the stored samples. */
+#define TELEMETRY_SAMPLE_MASK ((1u << TELEMETRY_TEMPERATURE) | (1u << TELEMETRY_HUMIDITY) | \
+                               (1u << TELEMETRY_PRESSURE)    | (1u << TELEMETRY_VOLTAGE))
+
+/** Longest record of this version. */
+#define TELEMETRY_MAX_SIZE (TELEMETRY_VARINT_SIZE * (3 + TELEMETRY_FIELD_COUNT + 2 + TELEMETRY_BACKLOG * 5))
+
+/** Text topic and fixed point scale of a field. */
+struct TelemetryFieldInfo
+{
+   const char *topic; //!< Sub topic of the same value as text.
+   int32_t     scale; //!< Fixed point factor.
+};
+
+static const TelemetryFieldInfo telemetryTable[TELEMETRY_FIELD_COUNT] = {
+   { topic_temperature,      100  },
+   { topic_humidity,         100  },
+   { topic_pressure,         100  },
+   { topic_voltage,          1000 },
+   { topic_mAh,              100  },
+   { topic_alive,            1    },
+   { topic_rssi,             1    },
+   { topic_conn_error_count, 1    },
+   { topic_send_error_count, 1    },
+   { topic_overrun "WiFi",   1    },
+   { topic_overrun "Time",   1    },
+   { topic_overrun "Mqtt",   1    },
+   { topic_overrun "Web",    1    },
+   { topic_heap_free,        1    },
+   { topic_heap_max_block,   1    },
+   { topic_heap_frag,        1    },
+   { topic_heap_low_water,   1    },
+   { topic_tls_handshake,    1    },
+   { topic_tls_resumed,      1    },
+};
+
+/**
+  * One stored BME280 reading in the RTC memory.
+  */
+struct TelemetrySample
+{
+   uint32_t timeSec;     //!< Unix time of the reading.
+   int16_t  temperature; //!< 0.01 degree.
+   uint16_t humidity;    //!< 0.01 percent.
+   uint16_t pressure;    //!< 0.1 hPa.
+   uint16_t voltage;     //!< mV.
+};
+
+/**
+  * Builds a record into a buffer of the caller, nothing is allocated.
+  */
+class TelemetryEncoder
+{
+protected:
+   uint32_t               timeSec;                       //!< Unix time of the values.
+   uint32_t               fieldMask;                     //!< Set fields.
+   int32_t                values[TELEMETRY_FIELD_COUNT]; //!< Fixed point values.
+   const TelemetrySample *samples;                       //!< Backlog, oldest first.
+   int                    sampleCount;                   //!< Entries of samples.
+
+   bool encodeSamples(uint8_t *&p, const uint8_t *end, int count) const;
+
+public:
+   explicit TelemetryEncoder(uint32_t time);
+
+   void   set(int field, double value);
+   void   setSamples(const TelemetrySample *s, int count) { samples = s; sampleCount = count; }
+   size_t encode(uint8_t *buffer, size_t size, int *sent = NULL) const;
+};
+
+/* ******************************************** */
+
+/** Fixed point value of a field, rounded and saturated. */
+inline int32_t telemetryFixed(int field, double value)
+{
+   double fixed = value * telemetryTable[field].scale;
+
+   if (!(fixed > -2147483647.0)) {
+      return fixed != fixed ? 0 : -2147483647;
+   }
+   return fixed >= 2147483647.0 ? 2147483647 : (int32_t) lround(fixed);
+}
+
+inline uint32_t telemetryZigzag(int32_t value)
+{
+   return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline int32_t telemetryUnzigzag(uint32_t value)
+{
+   return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+/** Appends a varint, false if the buffer is full. */
+inline bool telemetryPutVarint(uint8_t *&p, const uint8_t *end, uint32_t value)
+{
+   do {
+      if (p >= end) {
+         return false;
+      }
+      *p++ = (value & 0x7F) | (value >= 0x80 ? 0x80 : 0);
+      value >>= 7;
+   } while (value);
+   return true;
+}
+
+/** A stored sample of one reading, saturated to the ranges of the fields. */
+inline TelemetrySample telemetrySample(uint32_t timeSec, double temperature, double humidity, double pressure, double voltage)
+{
+   TelemetrySample sample;
+
+   sample.timeSec     = timeSec;
+   sample.temperature = (int16_t)  fmax(-32767.0, fmin(32767.0, round(temperature * 100.0)));
+   sample.humidity    = (uint16_t) fmax(0.0,      fmin(65535.0, round(humidity * 100.0)));
+   sample.pressure    = (uint16_t) fmax(0.0,      fmin(65535.0, round(pressure * 10.0)));
+   sample.voltage     = (uint16_t) fmax(0.0,      fmin(65535.0, round(voltage * 1000.0)));
+   return sample;
+}
+
+/** Fixed point value of a sample field in the scale of the record. */
+inline int32_t telemetrySampleValue(const TelemetrySample &sample, int field)
+{
+   switch (field) {
+      case TELEMETRY_TEMPERATURE: return sample.temperature;
+      case TELEMETRY_HUMIDITY:    return sample.humidity;
+      case TELEMETRY_PRESSURE:    return sample.pressure * 10;
+      case TELEMETRY_VOLTAGE:     return sample.voltage;
+   }
+   return 0;
+}
+
+inline TelemetryEncoder::TelemetryEncoder(uint32_t time)
+   : timeSec(time)
+   , fieldMask(0)
+   , samples(NULL)
+   , sampleCount(0)
+{
+}
+
+inline void TelemetryEncoder::set(int field, double value)
+{
+   if (field >= 0 && field < TELEMETRY_FIELD_COUNT) {
+      fieldMask     |= 1u << field;
+      values[field]  = telemetryFixed(field, value);
+   }
+}
+
+/** Appends the newest count samples, the older ones of the backlog are left out. */
+inline bool TelemetryEncoder::encodeSamples(uint8_t *&p, const uint8_t *end, int count) const
+{
+   int32_t  previous[TELEMETRY_FIELD_COUNT];
+   uint32_t previousSec = timeSec;
+
+   if (!telemetryPutVarint(p, end, count)) {
+      return false;
+   }
+   if (!count) {
+      return true;
+   }
+   for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+      previous[field] = fieldMask & (1u << field) ? values[field] : 0;
+   }
+   if (!telemetryPutVarint(p, end, TELEMETRY_SAMPLE_MASK)) {
+      return false;
+   }
+   for (int i = sampleCount - count; i < sampleCount; i++) {
+      const TelemetrySample &sample = samples[i];
+      uint32_t               delta  = i == sampleCount - count ? timeSec - sample.timeSec : sample.timeSec - previousSec;
+
+      if (!telemetryPutVarint(p, end, delta)) {
+         return false;
+      }
+      previousSec = sample.timeSec;
+      for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+         if (TELEMETRY_SAMPLE_MASK & (1u << field)) {
+            int32_t value = telemetrySampleValue(sample, field);
+
+            if (!telemetryPutVarint(p, end, telemetryZigzag((int32_t) ((uint32_t) value - (uint32_t) previous[field])))) {
+               return false;
+            }
+            previous[field] = value;
+         }
+      }
+   }
+   return true;
+}
+
+/** Writes the record. Leaves out the oldest samples if the buffer is too small.
+  * Returns the length (0 = does not fit at all), sent = the encoded samples.
+  */
+inline size_t TelemetryEncoder::encode(uint8_t *buffer, size_t size, int *sent) const
+{
+   // Samples only with a time to count from, in time order.
+   int count = timeSec ? sampleCount : 0;
+
+   for (int i = 0; i < count; i++) {
+      if (samples[i].timeSec > timeSec || (i && samples[i].timeSec < samples[i - 1].timeSec)) {
+         count = 0;
+      }
+   }
+   for (; count >= 0; count--) {
+      uint8_t       *p   = buffer;
+      const uint8_t *end = buffer + size;
+      bool           ok  = telemetryPutVarint(p, end, TELEMETRY_VERSION) &&
+                           telemetryPutVarint(p, end, fieldMask) &&
+                           telemetryPutVarint(p, end, timeSec);
+
+      for (int field = 0; ok && field < TELEMETRY_FIELD_COUNT; field++) {
+         if (fieldMask & (1u << field)) {
+            ok = telemetryPutVarint(p, end, telemetryZigzag(values[field]));
+         }
+      }
+      if (ok && encodeSamples(p, end, count)) {
+         if (sent) {
+            *sent = count;
+         }
+         return p - buffer;
+      }
+   }
+   return 0;
+}
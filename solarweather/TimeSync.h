@@ -0,0 +1,86 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimeSync.h
+  *
+  * Wall-clock time via SNTP.
+  */
+
+#include <time.h>
+
+#define TIME_SYNC_TIMEOUT_MS 5000       //!< Maximum wait for the SNTP answer.
+#define TIME_SYNC_MIN_EPOCH  1600000000 //!< Every valid SNTP time is after 2020.
+
+
+/**
+  * Synchronizes the wall-clock time with a SNTP server at the start of
+  * every radio session. Between the syncs the time is kept as an offset in
+  * the RTC memory (see MyData::getEpochTime).
+  */
+class MyTimeSync
+{
+protected:
+   MyOptions &myOptions;     //!< Reference to the options
+   MyData    &myData;        //!< Reference to the data
+
+public:
+   MyTimeSync(MyOptions &options, MyData &data);
+
+   bool begin();
+};
+
+/* ******************************************** */
+
+/** Constructor */
+MyTimeSync::MyTimeSync(MyOptions &options, MyData &data)
+   : myOptions(options)
+   , myData(data)
+{
+}
+
+/** Start the SNTP request and wait a short time for the answer. 
+  * Needs the station connection. 
+  */
+bool MyTimeSync::begin()
+{
+   if (WiFi.status() != WL_CONNECTED) {
+      return false;
+   }
+
+   MyDbg(F("MyTimeSync::begin"));
+   MyTrace trace(TRACE_TIME);
+   configTime(0, 0, NTP_SERVER);
+
+   long start = millis();
+   long now   = time(NULL);
+
+   while (now < TIME_SYNC_MIN_EPOCH && millis() - start < TIME_SYNC_TIMEOUT_MS) {
+      myCheckAwakeBudget(AWAKE_PHASE_TIME);
+      MyDelay(100);
+      now = time(NULL);
+   }
+   if (now < TIME_SYNC_MIN_EPOCH) {
+      MyDbg(F("No SNTP answer"));
+      return false;
+   }
+   if (myData.isTimeValid()) {
+      MyDbg((String) F("Time drift: ") + String(now - myData.getEpochTime()) + F(" sec"));
+   }
+   myData.setEpochTime(now);
+   MyDbg((String) F("Time: ") + formatDateTime(now));
+   return true;
+}
@@ -21,29 +21,192 @@
   */
 
 
+#define TRACE_SPAN_COUNT 32 //!< Spans of the current boot in the trace ring.
+#define TRACE_BOOT_SPANS 10 //!< Spans of one boot timeline in the RTC memory.
+#define TRACE_BOOT_COUNT  3 //!< Boot timelines in the RTC memory.
+
+/**
+  * Traced phases of the setup() and loop() functions.
+  */
+enum TracePhase
+{
+   TRACE_SETUP,        //!< Complete setup()
+   TRACE_SPIFFS,       //!< SPIFFS mount
+   TRACE_OPTIONS,      //!< Options load
+   TRACE_RTC,          //!< RTC memory read
+   TRACE_WEB,          //!< Webserver start
+   TRACE_WIFI,         //!< WiFi association
+   TRACE_DNS,          //!< DNS server start
+   TRACE_TIME,         //!< SNTP sync
+   TRACE_MQTT_CONNECT, //!< MQTT connect
+   TRACE_MQTT_PUBLISH, //!< MQTT publish
+   TRACE_BME280,       //!< BME280 read
+   TRACE_PHASE_COUNT   //!< Number of phases
+};
+
+/** Name of a traced phase. */
+String tracePhaseName(int phase)
+{
+   switch (phase) {
+      case TRACE_SETUP:        return F("Setup");
+      case TRACE_SPIFFS:       return F("Spiffs");
+      case TRACE_OPTIONS:      return F("Options");
+      case TRACE_RTC:          return F("Rtc");
+      case TRACE_WEB:          return F("Web");
+      case TRACE_WIFI:         return F("WiFi");
+      case TRACE_DNS:          return F("Dns");
+      case TRACE_TIME:         return F("Time");
+      case TRACE_MQTT_CONNECT: return F("MqttConnect");
+      case TRACE_MQTT_PUBLISH: return F("MqttPublish");
+      case TRACE_BME280:       return F("Bme280");
+   }
+   return "";
+}
+
 /**
-  * Helper class for debugging via Serial.println 
+  * Compact span of a boot timeline in the RTC memory.
+  * The times are milliseconds after the boot, saturated at 65535.
   */
-class SerialOut
+struct TraceBootSpan
 {
+   uint8_t  phase;      //!< TracePhase
+   uint8_t  depth;      //!< Nesting depth
+   uint16_t beginMs;    //!< Begin after boot
+   uint16_t durationMs; //!< Duration
+};
+
+/**
+  * Timeline of one boot in the RTC memory.
+  */
+struct TraceBoot
+{
+   long          bootTimeSec;              //!< getAllTimeSumSec() at the boot.
+   uint16_t      count;                    //!< Used spans.
+   TraceBootSpan spans[TRACE_BOOT_SPANS];  //!< The first spans of the boot.
+};
+
+/**
+  * Lightweight tracing of the boot and loop phases. 
+  * Works with the scope of the instances like SerialOut before:
+  * {
+  *    MyTrace trace(TRACE_WIFI);
+  *    xyz;
+  * }
+  * records the begin and end millis() of xyz into a fixed ring.
+  */
+class MyTrace
+{
+public:
+   /** One span of the current boot. */
+   struct Span {
+      uint8_t  phase;   //!< TracePhase
+      uint8_t  depth;   //!< Nesting depth
+      uint32_t beginMs; //!< millis() on begin
+      uint32_t endMs;   //!< millis() on end, 0 while open.
+   };
+
+   static Span ring[TRACE_SPAN_COUNT]; //!< The last spans of the current boot.
+   static long spanCount;              //!< All spans of the current boot.
+   static int  depth;                  //!< Current nesting depth.
+   static bool isSerialOut;            //!< Print the spans also via Serial.
+
 protected:
-   String message; //!< Mesage on contructor and destructor.
+   long index; //!< Span index of this instance.
 
 public:
-   /** Print out the start millis() and the message */
-   SerialOut(String msg)
-      : message(msg)
-   {
-      String m = ":" + String(millis()) + "[" + message;
-      Serial.println(m.c_str());
+   MyTrace(TracePhase phase);
+   ~MyTrace();
+
+   static int   count();
+   static Span &getAt(int idx);
+   static void  toBoot(TraceBoot &boot, long bootTimeSec);
+   static String summary();
+};
+
+MyTrace::Span MyTrace::ring[TRACE_SPAN_COUNT];
+long          MyTrace::spanCount   = 0;
+int           MyTrace::depth       = 0;
+bool          MyTrace::isSerialOut = false;
+
+/** Record the begin of the span. */
+MyTrace::MyTrace(TracePhase phase)
+   : index(spanCount++)
+{
+   Span &span = ring[index % TRACE_SPAN_COUNT];
+
+   span.phase   = phase;
+   span.depth   = depth++;
+   span.beginMs = millis();
+   span.endMs   = 0;
+   if (isSerialOut) {
+      Serial.println(":" + String(span.beginMs) + "[" + tracePhaseName(phase));
    }
-   /** Print out the end millis() and the message */
-   ~SerialOut()
-   {
-      String m = message + ":" + String(millis()) + "]";
-      Serial.println(m.c_str());
+}
+
+/** Record the end of the span if it is still in the ring. */
+MyTrace::~MyTrace()
+{
+   depth--;
+   if (spanCount - index <= TRACE_SPAN_COUNT) {
+      Span &span = ring[index % TRACE_SPAN_COUNT];
+
+      span.endMs = max((uint32_t) millis(), span.beginMs + 1); // 0 marks an open span
+      if (isSerialOut) {
+         Serial.println(tracePhaseName(span.phase) + ":" + String(span.endMs) + "]");
+      }
    }
-};
+}
+
+/** Number of spans in the ring. */
+int MyTrace::count()
+{
+   return min(spanCount, (long) TRACE_SPAN_COUNT);
+}
+
+/** Returns the n'th span of the ring, the oldest first. */
+MyTrace::Span &MyTrace::getAt(int idx)
+{
+   return ring[(spanCount - count() + idx) % TRACE_SPAN_COUNT];
+}
+
+/** Copy the first spans of the current boot into the compact RTC format. 
+  * Open spans end now.
+  */
+void MyTrace::toBoot(TraceBoot &boot, long bootTimeSec)
+{
+   uint32_t now = millis();
+
+   boot.bootTimeSec = bootTimeSec;
+   boot.count       = 0;
+   for (int i = 0; i < count() && boot.count < TRACE_BOOT_SPANS; i++) {
+      Span          &span = getAt(i);
+      TraceBootSpan &dst  = boot.spans[boot.count++];
+      uint32_t       end  = span.endMs ? span.endMs : now;
+
+      dst.phase      = span.phase;
+      dst.depth      = span.depth;
+      dst.beginMs    = min(span.beginMs,       (uint32_t) 0xFFFF);
+      dst.durationMs = min(end - span.beginMs, (uint32_t) 0xFFFF);
+   }
+}
+
+/** Compact 'Name=ms' list of the finished spans for the MQTT server. */
+String MyTrace::summary()
+{
+   String ret;
+
+   for (int i = 0; i < count(); i++) {
+      Span &span = getAt(i);
+
+      if (span.endMs) {
+         if (ret.length()) {
+            ret += ' ';
+         }
+         ret += tracePhaseName(span.phase) + "=" + String(span.endMs - span.beginMs);
+      }
+   }
+   return ret;
+}
 
 /** Checks if the intervalSec is from the last checkIntervalSec elapsed */
 bool secondsElapsed(long allTimeSumSec, long &lastCheckSec, const long &intervalSec)
@@ -90,6 +253,35 @@ void MyDbg(String info, bool fromWebServer = false, bool newline = true)
 }
 
 
+/** 
+  * Blocking phases of one wake which are checked against the awake budget.
+  */
+enum AwakePhase 
+{
+   AWAKE_PHASE_WIFI,  //!< WiFi association
+   AWAKE_PHASE_TIME,  //!< Waiting for the SNTP answer
+   AWAKE_PHASE_MQTT,  //!< MQTT connect and publish
+   AWAKE_PHASE_WEB,   //!< Web sessions in the main loop
+   AWAKE_PHASE_COUNT  //!< Number of phases
+};
+
+/** Name of an awake phase for the web interface and the mqtt topics. */
+String awakePhaseName(int phase)
+{
+   switch (phase) {
+      case AWAKE_PHASE_WIFI: return F("WiFi");
+      case AWAKE_PHASE_TIME: return F("Time");
+      case AWAKE_PHASE_MQTT: return F("Mqtt");
+      case AWAKE_PHASE_WEB:  return F("Web");
+   }
+   return "";
+}
+
+/** This function has to be overwritten to implement the awake budget check. 
+  * It does not return if the budget of the current wake is exhausted. 
+  */
+void myCheckAwakeBudget(AwakePhase phase);
+
 /** This function has to be overwritten to implement background delay calls. */
 void myDelayLoop();
 
@@ -98,7 +290,7 @@ void MyDelay(long millisDelay)
 {
    long m = millis();
 
-   while (millis() - m < millisDelay) {
+   while (millis() - m < (unsigned long) millisDelay) {
       myDelayLoop();
       // yield();
       delay(1);
@@ -106,149 +298,351 @@ void MyDelay(long millisDelay)
 }
 
 
+#define LONG_SIZE      21              //!< Buffer size for formatLong: '-9223372036854775808' of a 64 bit long.
+#define INTERVAL_SIZE  (LONG_SIZE + 8) //!< Buffer size for formatInterval: the days of any long and ' hh:mm:ss'.
+#define DATE_TIME_SIZE 24              //!< Buffer size for formatDateTime: 'YYYY-MM-DD hh:mm:ss'.
+
+/**
+  * Conversion of the RSSI value to a quality value in percent.
+  */
+int WifiGetRssiQuality(int rssi)
+{
+   if (rssi <= -100) {
+      return 0;
+   } else if (rssi >= -50) {
+      return 100;
+   }
+   return 2 * (rssi + 100);
+}
+
 /**
   * Conversion of the RSSI value to a quality value.
   */
 String WifiGetRssiAsQuality(int rssi)
 {
-   int quality = 0;
+   return String(WifiGetRssiQuality(rssi));
+}
 
-   if (rssi <= -100) {
-      quality = 0;
-   } else if (rssi >= -50) {
-      quality = 100;
-   } else {
-      quality = 2 * (rssi + 100);
+/** Writes the decimal digits of value into buff (at least LONG_SIZE bytes).
+  * Returns the length without the terminating zero.
+  */
+size_t formatLong(char *buff, long value)
+{
+   char          digits[LONG_SIZE];
+   int           count = 0;
+   size_t        len   = 0;
+   unsigned long rest  = value < 0 ? 0UL - (unsigned long) value : (unsigned long) value;
+
+   do {
+      digits[count++] = '0' + rest % 10;
+      rest /= 10;
+   } while (rest);
+   if (value < 0) {
+      buff[len++] = '-';
    }
-   return String(quality);
+   while (count) {
+      buff[len++] = digits[--count];
+   }
+   buff[len] = '\0';
+   return len;
+}
+
+/** Writes a value between 0 and 99 with two digits. */
+static char *formatTwoDigits(char *buff, int value)
+{
+   *buff++ = '0' + value / 10;
+   *buff++ = '0' + value % 10;
+   return buff;
+}
+
+/** Helper function to format seconds to x days hours:minutes:seconds
+  * into buff (at least INTERVAL_SIZE bytes). Negative values are shown as 00:00:00.
+  * Returns the length without the terminating zero.
+  */
+size_t formatInterval(char *buff, size_t size, long secs)
+{
+   char *p = buff;
+
+   if (size < INTERVAL_SIZE) {
+      if (size) buff[0] = '\0';
+      return 0;
+   }
+   if (secs < 0) {
+      secs = 0;
+   }
+   if (secs >= 24 * 60 * 60) {
+      p += formatLong(p, secs / 60 / 60 / 24);
+      *p++ = ' ';
+   }
+   p = formatTwoDigits(p, (secs / 60 / 60) % 24);
+   *p++ = ':';
+   p = formatTwoDigits(p, (secs / 60) % 60);
+   *p++ = ':';
+   p = formatTwoDigits(p, secs % 60);
+   *p = '\0';
+   return p - buff;
+}
+
+/** Helper function to format seconds to x days hours:minutes:seconds */
+String formatInterval(long secs)
+{
+   char buff[INTERVAL_SIZE];
+
+   formatInterval(buff, sizeof(buff), secs);
+   return buff;
+}
+
+/** Helper function to format a unix time to 'YYYY-MM-DD hh:mm:ss' (UTC)
+  * into buff (at least DATE_TIME_SIZE bytes).
+  * Returns the length without the terminating zero.
+  */
+size_t formatDateTime(char *buff, size_t size, long epoch)
+{
+   char     *p = buff;
+   time_t    t = epoch;
+   struct tm tm;
+
+   if (size < DATE_TIME_SIZE) {
+      if (size) buff[0] = '\0';
+      return 0;
+   }
+   gmtime_r(&t, &tm);
+   p  = formatTwoDigits(p, (tm.tm_year + 1900) / 100 % 100);
+   p  = formatTwoDigits(p, (tm.tm_year + 1900) % 100);
+   *p++ = '-';
+   p  = formatTwoDigits(p, tm.tm_mon + 1);
+   *p++ = '-';
+   p  = formatTwoDigits(p, tm.tm_mday);
+   *p++ = ' ';
+   p  = formatTwoDigits(p, tm.tm_hour);
+   *p++ = ':';
+   p  = formatTwoDigits(p, tm.tm_min);
+   *p++ = ':';
+   p  = formatTwoDigits(p, tm.tm_sec);
+   *p = '\0';
+   return p - buff;
+}
+
+/** Helper function to format a unix time to 'YYYY-MM-DD hh:mm:ss' (UTC) */
+String formatDateTime(long epoch)
+{
+   char buff[DATE_TIME_SIZE];
+
+   formatDateTime(buff, sizeof(buff), epoch);
+   return buff;
+}
+
+/** Returns the escape sequence of a special xml character or NULL, also for ChunkedWriter::addXml. */
+static PGM_P xmlEscape(char c)
+{
+   switch (c) {
+      case '&':  return PSTR("&amp;");
+      case '<':  return PSTR("&lt;");
+      case '>':  return PSTR("&gt;");
+      case '"':  return PSTR("&quot;");
+   }
+   return NULL;
+}
+
+/** Returns the escape sequence of a special url character or NULL, also for ChunkedWriter::addUrl. */
+static PGM_P urlEscape(char c)
+{
+   switch (c) {
+      case '%':  return PSTR("%25");
+      case '&':  return PSTR("%26");
+      case '<':  return PSTR("%3C");
+      case '>':  return PSTR("%3E");
+   }
+   return NULL;
+}
+
+/** Is c passed unchanged into an url? Like the original String version,
+  * which compared a signed char, the bytes from 0x80 are replaced as well.
+  */
+static bool isValidUrlChar(char c)
+{
+   return c == 0x09 || c == 0x0A || c == 0x0D || (c >= 0x20 && (unsigned char) c < 0x80);
+}
+
+/** Escapes text in one pass into out (size bytes incl. the terminating zero).
+  * A character whose escape sequence does not fit any more ends the output.
+  * Returns the length without the terminating zero.
+  */
+static size_t escapeText(char *out, size_t size, const char *text, PGM_P (*escape)(char), bool validate)
+{
+   size_t len = 0;
+
+   if (size == 0) {
+      return 0;
+   }
+   for (; *text; text++) {
+      PGM_P  seq    = escape(*text);
+      size_t seqLen = seq ? strlen_P(seq) : 1;
+
+      if (len + seqLen >= size) {
+         break;
+      }
+      if (seq) {
+         memcpy_P(out + len, seq, seqLen);
+      } else {
+         out[len] = (validate && !isValidUrlChar(*text)) ? '?' : *text;
+      }
+      len += seqLen;
+   }
+   out[len] = '\0';
+   return len;
+}
+
+/** Length of text after the escaping. */
+static size_t escapedLength(const char *text, PGM_P (*escape)(char))
+{
+   size_t len = 0;
+
+   for (; *text; text++) {
+      PGM_P seq = escape(*text);
+
+      len += seq ? strlen_P(seq) : 1;
+   }
+   return len;
+}
+
+/** Convert Text to html - URL into out (size bytes).
+  * Should be decoded with encodeURIComponent() in JavaScript
+  * And replace every control and non ASCII char with '?'.
+  */
+size_t TextToUrl(char *out, size_t size, const char *text)
+{
+   return escapeText(out, size, text, urlEscape, true);
 }
 
 /** Convert Text to html - URL.
   * Should be decoded with encodeURIComponent() in JavaScript
-  * And replace every invalid xml char with '?'.
+  * And replace every control and non ASCII char with '?'.
   */
-String TextToUrl(String data)
+String TextToUrl(const String &data)
 {
-   data.replace(F("%"), F("%25"));
-   data.replace(F("&"), F("%26"));
-   data.replace(F("<"), F("%3C"));
-   data.replace(F(">"), F("%3E"));
+   String ret;
 
-   for (int i = 0; i < data.length(); i++) {
-      bool validChar = (data[i] == 0x09 || data[i] == 0x0A || data[i] == 0x0D || (data[i] >= 0x20 && data[i] <= 0xFF));
+   ret.reserve(escapedLength(data.c_str(), urlEscape));
+   for (const char *text = data.c_str(); *text; text++) {
+      PGM_P seq = urlEscape(*text);
 
-      if (!validChar) {
-         data[i] = '?';
+      if (seq) {
+         ret += FPSTR(seq);
+      } else {
+         ret += isValidUrlChar(*text) ? *text : '?';
       }
    }
-   return data;
+   return ret;
+}
+
+/** Helper HTML text conversation function for special character into out (size bytes).
+  */
+size_t TextToXml(char *out, size_t size, const char *text)
+{
+   return escapeText(out, size, text, xmlEscape, false);
 }
 
 /** Helper HTML text conversation function for special character.
   */
-String TextToXml(String data)
+String TextToXml(const String &data)
 {
-   data.replace(F("&"),  F("&amp;"));
-   data.replace(F("<"),  F("&lt;"));
-   data.replace(F(">"),  F("&gt;"));
-   data.replace(F("\""), F("&quot;"));
-   return data;
+   String ret;
+
+   ret.reserve(escapedLength(data.c_str(), xmlEscape));
+   for (const char *text = data.c_str(); *text; text++) {
+      PGM_P seq = xmlEscape(*text);
+
+      if (seq) {
+         ret += FPSTR(seq);
+      } else {
+         ret += *text;
+      }
+   }
+   return ret;
 }
 
 /**
-  * Trims the data string on the left and right side every occurrence of a char from chars.
+  * Finds the part of text without every leading and trailing char from chars.
+  * Returns the start of the part and its length in len.
   */
-String Trim(const String &data, const String &chars)
+const char *Trim(const char *text, const char *chars, size_t &len)
 {
-   String ret = data;
-   
-   for (int i = 0; i < ret.length(); i++) {
-      if (chars.indexOf(ret[i]) != -1) {
-         ret.remove(i, 1);
-         i--;
-         continue;
-      }
-      break;
+   const char *end;
+
+   while (*text && strchr(chars, *text)) {
+      text++;
    }
-   for (int i = data.length() - 1; i >= 0; i--) {
-      if (chars.indexOf(ret[i]) != -1) {
-         ret.remove(i, 1);
-         continue;
-      }
-      break;
+   end = text + strlen(text);
+   while (end > text && strchr(chars, end[-1])) {
+      end--;
    }
-   return ret;
+   len = end - text;
+   return text;
 }
 
-/** Helper function to format seconds to x days hours:minutes:seconds */
-String formatInterval(long secs)
+/**
+  * Trims the data string on the left and right side every occurrence of a char from chars.
+  */
+String Trim(const String &data, const String &chars)
 {
-   char buff[255];
+   size_t      len   = 0;
+   const char *start = Trim(data.c_str(), chars.c_str(), len);
+   size_t      first = start - data.c_str();
 
-   int days    =  secs / 60 / 60 / 24;
-   int hours   = (secs / 60 / 60) % 24;
-   int minutes = (secs / 60) % 60;
-   int seconds =  secs % 60;
+   return data.substring(first, first + len);
+}
 
-   buff[0] = '\0';
-   if (days <= 0) {
-      sprintf(buff, "%02d:%02d:%02d", hours, minutes, seconds);
+/** Helper function to scan a interval information '[days] hours:minutes:seconds' */
+bool scanInterval(const char *interval, long &secs)
+{
+   const char *first  = NULL;
+   const char *second = NULL;
+   const char *space  = NULL;
+   long        days    = 0;
+   long        hours   = 0;
+   long        minutes = 0;
+   long        seconds = 0;
+
+   while (*interval == ' ') {
+      interval++;
+   }
+   first = strchr(interval, ':');
+   if (first == NULL) {
+      return false;
+   }
+   second = strchr(first + 1, ':');
+   if (second == NULL) {
+      return false;
+   }
+   space = (const char *) memchr(interval, ' ', first - interval);
+   if (space) {
+      days  = atol(interval);
+      hours = atol(space + 1);
    } else {
-      sprintf(buff, "%d %02d:%02d:%02d", days, hours, minutes, seconds);
+      hours = atol(interval);
    }
-   return buff;
+   minutes = atol(first + 1);
+   seconds = atol(second + 1);
+
+   if (days    >= 0 && 
+       hours   >= 0 && hours   <= 23 && 
+       minutes >= 0 && minutes <= 59 && 
+       seconds >= 0 && seconds <= 59) {
+      secs = 0;
+      secs += days    * 24 * 60 * 60;
+      secs += hours   * 60 * 60;
+      secs += minutes * 60;
+      secs += seconds;
+      return true;
+   }
+   return false;
 }
 
 /** Helper function to scan a interval information '[days] hours:minutes:seconds' */
-bool scanInterval(String interval, long &secs)
-{
-   int first = -1;
-
-   interval = Trim(interval, F(" "));
-   first    = interval.indexOf(F(":"));
-   if (first != -1) {
-      String daysString;
-      String hoursString;
-      String minutesString;
-      String secondsString;
-      long   days    = 0;
-      long   hours   = 0;
-      long   minutes = 0;
-      long   seconds = 0;
-
-      int second = interval.indexOf(F(":"), first + 1);
-
-      if (second != -1) {
-         int space = interval.indexOf(F(" "));
-
-         if (space != -1 && space < first) {
-            daysString  = interval.substring(0, space);
-            hoursString = interval.substring(space + 1, first);
-         } else {
-            hoursString = interval.substring(0, first);
-         }
-         minutesString = interval.substring(first + 1, second);
-         secondsString = interval.substring(second + 1);
-
-         days    = atol(daysString.c_str());
-         hours   = atol(hoursString.c_str());
-         minutes = atol(minutesString.c_str());
-         seconds = atol(secondsString.c_str());
-
-         if (days    >= 0 && 
-             hours   >= 0 && hours   <= 23 && 
-             minutes >= 0 && minutes <= 59 && 
-             seconds >= 0 && seconds <= 59) {
-            secs = 0;
-            secs += days    * 24 * 60 * 60;
-            secs += hours   * 60 * 60;
-            secs += minutes * 60;
-            secs += seconds;
-            return true;
-         }
-      }
-   }
-   return false;
+bool scanInterval(const String &interval, long &secs)
+{
+   return scanInterval(interval.c_str(), secs);
 }
 
 /**
@@ -54,6 +54,7 @@ bool MyVoltage::begin()
    MyDbg(F("MyVoltage::begin"));
    pinMode(A0, INPUT);
    readVoltage();
+   return true;
 }
 
 /** Reads the power supply voltage and save the value in the data class. 
@@ -61,5 +62,10 @@ bool MyVoltage::begin()
   */
 void MyVoltage::readVoltage()
 {
-   myData.voltage = ANALOG_FACTOR * analogRead(A0); // Volt
+   double voltage = ANALOG_FACTOR * analogRead(A0); // Volt
+
+   if (round(voltage * 100.0) != round(myData.voltage * 100.0)) { // Displayed with two decimals
+      myData.changed();
+   }
+   myData.voltage = voltage;
 }
@@ -23,23 +23,68 @@
 
 
 #include <ESP8266WiFi.h>
-#include <ESP8266WebServer.h>
 #include <DNSServer.h>
 #include "Spiffs.h"
+
+#ifdef USE_ASYNC_WEB_SERVER
+#include "AsyncWebServer.h"
+typedef MyAsyncWebServer WebServerBase; //!< Non blocking server with several connections.
+#else
+#include <ESP8266WebServer.h>
+typedef ESP8266WebServer WebServerBase; //!< Synchronous server of the esp8266 core.
+#endif
+
+#include "ChunkedWriter.h"
 #include "HtmlTag.h"
 
 /**
   * MyESPWebServer helper class for accessing the internal _currentClient.
   */
-class MyESPWebServer : public ESP8266WebServer
+class MyESPWebServer : public WebServerBase
 {
 public:
    MyESPWebServer(int port = 80)
-      : ESP8266WebServer(port) { }
+      : WebServerBase(port) { }
 
    WiFiClient &wifiClient() { return _currentClient; }
 };
 
+#ifdef USE_EMBEDDED_WEB_ASSETS
+/** One gzipped file of the data folder in the flash. */
+struct WebAsset
+{
+   PGM_P          path;     //!< Url path like /Main.html
+   PGM_P          mimeType; //!< Content type
+   PGM_P          etag;     //!< Quoted content hash
+   const uint8_t *data;     //!< Gzipped content
+   uint32_t       size;     //!< Size of the gzipped content
+};
+
+#include "WebAssets.h" // Generated with tools/compress_data.py --embed
+#endif
+
+#define EVENT_CLIENT_COUNT     3     //!< Maximum parallel event streams (/Events).
+#define EVENT_MAIN_CHECK_MS    1000  //!< Change check interval of the main values.
+#define EVENT_INFO_CHECK_MS    5000  //!< Change check interval of the info values.
+#define EVENT_KEEP_ALIVE_MS    15000 //!< Keep alive comment interval to detect closed streams.
+
+/** Channels of the server-sent events. */
+enum EventChannel
+{
+   EVENT_MAIN, //!< Values of the Main.html
+   EVENT_INFO, //!< Values of the Infos.html
+   EVENT_LOG   //!< New console lines
+};
+
+/** One server-sent event stream. */
+struct EventClient
+{
+   WiFiClient client;         //!< The open connection.
+   uint8_t    channels;       //!< Bit mask of the subscribed channels.
+   long       crc[EVENT_LOG]; //!< Crc of the last sent main and info values.
+   long       logIdx;         //!< Index of the next console line to send.
+};
+
 /**
   * My Webserver interface. Works together with .html, .css and .js files from the SPIFFS.
   * Works mostly with static functions because of the server callback functions.
@@ -52,35 +97,61 @@ public:
    static DNSServer      dnsServer; //!< Dns server
    static MyOptions     *myOptions; //!< Reference to the options.
    static MyData        *myData;    //!< Reference to the data.
+   static String         etags;     //!< Content of the etags.txt manifest from the SPIFFS.
+
+   static EventClient    eventClients[EVENT_CLIENT_COUNT]; //!< Connected server-sent event streams.
+   static unsigned long  eventCheckMs[EVENT_LOG];          //!< Last change check of the main and info values.
+   static unsigned long  eventKeepAliveMs;                 //!< Last keep alive comment to all streams.
 
 protected:
+   static void loadETags       ();
+   static String GetETag       (String path);
+   static bool loadFromFlash   (const String &path);
    static bool loadFromSpiffs  (String path);
-   static void AddTableBegin   (String &info);
-   static void AddTableTr      (String &info);
-   static void AddTableTr      (String &info, String name, String value);
-   static void AddTableEnd     (String &info);
-   static bool GetOption       (String id, String &option);
-   static bool GetOption       (String id, long   &option);
-   static bool GetOption       (String id, double &option);
-   static bool GetOption       (String id, bool   &option);
-   static void AddBr           (String &info);
-   static void AddOption       (String &info, String id, String name, bool value, bool addBr = true);
-   static void AddOption       (String &info, String id, String name, String value, bool addBr = true, bool isPassword = false);
-   static void AddIntervalInfo (String &info);
+   static String GetMainETag   ();
+   static String GetInfoETag   ();
+   static bool IsNotModified   (const String &etag);
+   static void AddTableBegin   (ChunkedWriter &info);
+   static void AddTableTr      (ChunkedWriter &info);
+   static void AddTableTr      (ChunkedWriter &info, const String &name, const String &value);
+   static void AddTableTr      (ChunkedWriter &info, const __FlashStringHelper *name, const char *value);
+   static void AddTableTr      (ChunkedWriter &info, const __FlashStringHelper *name, long value, const __FlashStringHelper *unit = NULL);
+   static void AddTableEnd     (ChunkedWriter &info);
+   static bool GetOption       (const OptionInfo &option);
+   static void AddBr           (ChunkedWriter &info);
+   static void AddOption       (ChunkedWriter &info, const char *id, const String &name, bool value, bool addBr = true);
+   static void AddOption       (ChunkedWriter &info, const char *id, const String &name, const String &value, bool addBr = true, bool isPassword = false);
+   static void AddIntervalInfo (ChunkedWriter &info);
+   static void AddJsonKey      (ChunkedWriter &json, const __FlashStringHelper *name);
+   static void AddJsonText     (ChunkedWriter &json, const __FlashStringHelper *name, const String &value);
+   static void AddJsonNumber   (ChunkedWriter &json, const __FlashStringHelper *name, long value);
+   static void AddJsonNumber   (ChunkedWriter &json, const __FlashStringHelper *name, double value, int digits);
+   static void AddJsonBool     (ChunkedWriter &json, const __FlashStringHelper *name, bool value);
+   static void AddMainData     (ChunkedWriter &json);
+   static void AddInfoData     (ChunkedWriter &json);
+   static void sendEvent       (int channel, const __FlashStringHelper *name, void (*addData)(ChunkedWriter &json), String (*getETag)());
+   static void sendLogEvents   ();
+   static void sendEvents      ();
 
 public:
    static void handleRoot();
    static void loadMain();
    static void handleLoadMainInfo();
+   static void handleLoadMainData();
    static void loadUpdate();
    static void loadSettings();
    static void handleLoadSettingsInfo();
+   static void handleLoadSettingsData();
    static void handleSaveSettings();
    static void handleLoadInfoInfo();
+   static void handleLoadInfoData();
    static void loadConsole();
    static void handleLoadConsoleInfo();
    static void loadRestart();
    static void handleLoadRestartInfo();
+   static void handleTrace();
+   static void handleEvents();
+   static void handleLoadPerfInfo();
    static void handleNotFound();
    static void handleWebRequests();
 
@@ -102,6 +173,10 @@ DNSServer      MyWebServer::dnsServer;
 MyESPWebServer MyWebServer::server(80);
 MyOptions     *MyWebServer::myOptions = NULL;
 MyData        *MyWebServer::myData    = NULL;
+String         MyWebServer::etags;
+EventClient    MyWebServer::eventClients[EVENT_CLIENT_COUNT];
+unsigned long  MyWebServer::eventCheckMs[EVENT_LOG];
+unsigned long  MyWebServer::eventKeepAliveMs = 0;
 
 
 /** Constructor/Destructor */
@@ -128,6 +203,7 @@ bool MyWebServer::begin()
    }
 
    MyDbg(F("MyWebServer::begin"));
+   MyTrace trace(TRACE_WEB);
    WiFi.forceSleepWake();
    WiFi.mode(WIFI_OFF); // workaround connection problem after deep sleep
    delay(100);
@@ -135,25 +211,34 @@ bool MyWebServer::begin()
    WiFi.softAP(SOFT_AP_NAME, SOFT_AP_PW);
    WiFi.softAPConfig(ip, ip, IPAddress(255, 255, 255, 0));  
    
-   dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
-   dnsServer.start(53, F("*"), ip);
+   {
+      MyTrace trace(TRACE_DNS);
+
+      dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+      dnsServer.start(53, F("*"), ip);
+   }
    myData->softAPIP         = WiFi.softAPIP().toString();
    myData->softAPmacAddress = WiFi.softAPmacAddress();
+   myData->changed();
    MyDbg((String) F("SoftAPIP address: ")     + myData->softAPIP, true);
    MyDbg((String) F("SoftAPIP mac address: ") + myData->softAPmacAddress, true);
 
    if (myOptions->connectWifiAP) {
+      MyTrace trace(TRACE_WIFI);
+
       WiFi.begin(myOptions->wifiAP.c_str(), myOptions->wifiPassword.c_str());
       for (int i = 0; i < 30 && WiFi.status() != WL_CONNECTED; i++) { // 30 Sec versuchen
+         myCheckAwakeBudget(AWAKE_PHASE_WIFI);
          MyDbg(F("."), true, false);
          MyDelay(1000);
       }
    }
    if (WiFi.status() == WL_CONNECTED) {
       myData->stationIP = WiFi.localIP().toString();
+      myData->changed();
       MyDbg((String) F("Connected to ")        + myOptions->wifiAP, true);
       MyDbg((String) F("Station IP address: ") + myData->stationIP, true);
-      MyDbg((String) F("AP1 SSID (RSSI): ")    + String(myOptions->wifiAP + F(" (") + WifiGetRssiAsQuality(WiFi.RSSI()) + F("%)")));
+      MyDbg((String) F("AP1 SSID (RSSI): ")    + String(myOptions->wifiAP + F(" (") + WifiGetRssiQuality(WiFi.RSSI()) + F("%)")));
    } else { // switch to AP Mode only
       if (myOptions->connectWifiAP) {
          MyDbg((String) F("No connection to ") + myOptions->wifiAP, true);
@@ -165,17 +250,28 @@ bool MyWebServer::begin()
    server.on(F("/"),              handleRoot);
    server.on(F("/Main.html"),     loadMain);
    server.on(F("/MainInfo"),      handleLoadMainInfo);
+   server.on(F("/MainData"),      handleLoadMainData);
    server.on(F("/Update.html"),   loadUpdate);
    server.on(F("/Settings.html"), loadSettings);
    server.on(F("/SettingsInfo"),  handleLoadSettingsInfo);
+   server.on(F("/SettingsData"),  handleLoadSettingsData);
    server.on(F("/SaveSettings"),  handleSaveSettings);
    server.on(F("/InfoInfo"),      handleLoadInfoInfo);
+   server.on(F("/InfoData"),      handleLoadInfoData);
    server.on(F("/Console.html"),  loadConsole);
    server.on(F("/ConsoleInfo"),   handleLoadConsoleInfo);
    server.on(F("/Restart.html"),  loadRestart);
    server.on(F("/RestartInfo"),   handleLoadRestartInfo);
+   server.on(F("/Trace"),         handleTrace);
+   server.on(F("/Events"),        handleEvents);
+   server.on(F("/PerfInfo"),      handleLoadPerfInfo);
    server.onNotFound(handleWebRequests);
 
+   const char *headerKeys[] = { "Accept-Encoding", "If-None-Match" };
+
+   server.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
+   loadETags();
+
    server.begin(); 
    MyDbg(F("Server listening"), true);
 
@@ -189,118 +285,116 @@ void MyWebServer::handleClient()
    if (isWebServerActive) {
       server.handleClient();
       dnsServer.processNextRequest();  
+      sendEvents();
    }
 }
 
 /** Helper function to start a HTML table. */
-void MyWebServer::AddTableBegin(String &info)
+void MyWebServer::AddTableBegin(ChunkedWriter &info)
 {
    info += F("<table style='width:100%'>");
 }
 
 /** Helper function to write one HTML row with no data. */
-void MyWebServer::AddTableTr(String &info)
+void MyWebServer::AddTableTr(ChunkedWriter &info)
 {
    info += F("<tr><th></th><td>&nbsp;</td></tr>");
 }
 
 /** Helper function to add one HTML table row line with data. */
-void MyWebServer::AddTableTr(String &info, String name, String value)
+void MyWebServer::AddTableTr(ChunkedWriter &info, const String &name, const String &value)
 {
    if (value != "") {
-      info += F("<tr>");
-      info += (String) F("<th>") + TextToXml(name)  + F("</th>");
-      info += (String) F("<td>") + TextToXml(value) + F("</td>");
-      info += F("</tr>");
+      info += F("<tr><th>");
+      info.addXml(name);
+      info += F("</th><td>");
+      info.addXml(value);
+      info += F("</td></tr>");
    }
 }
-  
-/** Helper function to add one HTML table end element. */
-void MyWebServer::AddTableEnd(String &info)
-{
-   info += F("</table>");
-}
 
-/** Reads one string option from the url args. */
-bool MyWebServer::GetOption(String id, String &option)
+/** Helper function to add one HTML table row line with a text from a buffer. */
+void MyWebServer::AddTableTr(ChunkedWriter &info, const __FlashStringHelper *name, const char *value)
 {
-   if (server.hasArg(id)) {
-      option = server.arg(id);
-      if (myOptions->isDebugActive) {
-         MyDbg((String) "GetOption[" + id + "]: " + option);
-      }
-      return true;
+   if (*value) {
+      info += F("<tr><th>");
+      info.addXml(name);
+      info += F("</th><td>");
+      info.addXml(value);
+      info += F("</td></tr>");
    }
-   if (myOptions->isDebugActive) {
-      MyDbg((String) "GetOption[" + id + "]: fail");
-   }
-   return false;
 }
 
-/** Reads one long option from the URL args. */
-bool MyWebServer::GetOption(String id, long &option)
+/** Helper function to add one HTML table row line with a number and an optional unit. */
+void MyWebServer::AddTableTr(ChunkedWriter &info, const __FlashStringHelper *name, long value, const __FlashStringHelper *unit /* = NULL */)
 {
-   bool   ret = false;
-   String opt = server.arg(id);
-
-   if (myOptions->isDebugActive) {
-      MyDbg((String) "GetOption[" + id + "]: " + opt);
-   }
-   if (opt != "") {
-      if (opt.indexOf(F(":")) != -1) {
-         ret = scanInterval(opt, option);
-      }  else {
-         option = atoi(opt.c_str());
-         ret    = true;
-      }
+   info += F("<tr><th>");
+   info.addXml(name);
+   info += F("</th><td>");
+   info += value;
+   if (unit) {
+      info.addXml(unit);
    }
-   return ret;
+   info += F("</td></tr>");
 }
-
-/** Reads one double option from the URL args. */
-bool MyWebServer::GetOption(String id, double &option)
+  
+/** Helper function to add one HTML table end element. */
+void MyWebServer::AddTableEnd(ChunkedWriter &info)
 {
-   String opt = server.arg(id);
-
-   if (opt != "") {
-      if (myOptions->isDebugActive) {
-         MyDbg((String) "GetOption[" + id + "]: " + option);
-      }
-      option = atof(opt.c_str());
-      return true;
-   }
-   return false;
+   info += F("</table>");
 }
 
-/** Reads one bool option from the URL args. */
-bool MyWebServer::GetOption(String id, bool &option)
+/** Reads one option from the url args into the options.
+  * Intervals are accepted as '[days] hours:minutes:seconds' or seconds,
+  * a missing checkbox is a false bool option.
+  */
+bool MyWebServer::GetOption(const OptionInfo &option)
 {
-   String opt = server.arg(id);
+   String opt = server.arg(option.key);
+   bool   ret = opt != "" || option.type == OPTION_BOOL;
 
-   option = false;
-   if (opt != "") {
-      if (myOptions->isDebugActive) {
-         MyDbg((String) "GetOption[" + id + "]: " + opt);
+   if (myOptions->isDebugActive) {
+      MyDbg((String) "GetOption[" + option.key + "]: " + opt);
+   }
+   if (option.type == OPTION_BOOL) {
+      myOptions->setValue(option, opt == F("on") ? 1L : 0L);
+   } else if (option.type == OPTION_TEXT || option.type == OPTION_PASSWORD) {
+      if (server.hasArg(option.key)) {
+         myOptions->setValue(option, opt);
+         ret = true;
       }
-      if (opt == F("on")) {
-         option = true;
+   } else if (ret) {
+      long value = 0;
+
+      if (strchr(opt.c_str(), ':')) {
+         ret = scanInterval(opt.c_str(), value);
+      } else {
+         value = atol(opt.c_str());
+      }
+      if (ret) {
+         myOptions->setValue(option, value);
       }
-      return true;
    }
-   return false;
+   return ret;
 }
 
 /** Add a HTML br element. */
-void MyWebServer::AddBr(String &info)
+void MyWebServer::AddBr(ChunkedWriter &info)
 {
    info += F("<br />");
 }
 
 /** Add one string input option field to the HTML source. */
-void MyWebServer::AddOption(String &info, String id, String name, String value, bool addBr /* = true */, bool isPassword /* = false */)
+void MyWebServer::AddOption(ChunkedWriter &info, const char *id, const String &name, const String &value, bool addBr /* = true */, bool isPassword /* = false */)
 {
-   info += (String) F("<b>") + TextToXml(name) + F("</b>");
-   info += (String) F("<input id='") + id + F("' name='") + id + F("' ");
+   info += F("<b>");
+   info.addXml(name);
+   info += F("</b><input id='");
+   info += id;
+   info += F("' name='");
+   info += id;
+   info += F("' ");
+   (void) isPassword; // Only for the disabled password type below.
    /*
     * Autocomplete overwrites our password if the type is password :(
     * So we show it actually in clear text.
@@ -308,14 +402,16 @@ void MyWebServer::AddOption(String &info, String id, String name, String value,
       info += " type='password' autocomplete='new-password' ";
    }
    */
-   info += (String) F("value='") + TextToXml(value) + F("'>");
+   info += F("value='");
+   info.addXml(value);
+   info += F("'>");
    if (addBr) {
       info += F("<br />");
    }
 }
 
 /** Add one bool input option field to the HTML source. */
-void MyWebServer::AddOption(String &info, String id, String name, bool value, bool addBr /* = true */)
+void MyWebServer::AddOption(ChunkedWriter &info, const char *id, const String &name, bool value, bool addBr /* = true */)
 {
    info += F("<input style='width:auto;' id='");
    info += id;
@@ -324,7 +420,7 @@ void MyWebServer::AddOption(String &info, String id, String name, bool value, bo
    info += F("' type='checkbox' ");
    info += value ? F(" checked") : F("");
    info += F("><b>");
-   info += TextToXml(name);
+   info.addXml(name);
    info += F("</b>");
    if (addBr) {
       info += F("<br />");
@@ -332,17 +428,138 @@ void MyWebServer::AddOption(String &info, String id, String name, bool value, bo
 }
 
 /** Add the format information of the intervall in 'dd hh:mm:ss' */
-void MyWebServer::AddIntervalInfo(String &info)
+void MyWebServer::AddIntervalInfo(ChunkedWriter &info)
 {
-   info += (String) F("<p>") + TextToXml(F("Interval in '[days] hours:minutes:seconds' or just 'seconds'")) + F("</p>");
+   info += F("<p>");
+   info.addXml(F("Interval in '[days] hours:minutes:seconds' or just 'seconds'"));
+   info += F("</p>");
    info += F("<br />");
 }
 
-/** Helper function to load a file from the SPIFFS. */
+/** Helper function to add the separator and the name of one JSON member. */
+void MyWebServer::AddJsonKey(ChunkedWriter &json, const __FlashStringHelper *name)
+{
+   if (json.lastChar() != '{' && json.lastChar() != '[') {
+      json += ',';
+   }
+   json += '"';
+   json += name;
+   json += F("\":");
+}
+
+/** Helper function to add one JSON string member. */
+void MyWebServer::AddJsonText(ChunkedWriter &json, const __FlashStringHelper *name, const String &value)
+{
+   AddJsonKey(json, name);
+   json += '"';
+   json.addJson(value);
+   json += '"';
+}
+
+/** Helper function to add one JSON integer member. */
+void MyWebServer::AddJsonNumber(ChunkedWriter &json, const __FlashStringHelper *name, long value)
+{
+   AddJsonKey(json, name);
+   json += value;
+}
+
+/** Helper function to add one JSON float member. Invalid values are null. */
+void MyWebServer::AddJsonNumber(ChunkedWriter &json, const __FlashStringHelper *name, double value, int digits)
+{
+   AddJsonKey(json, name);
+   if (isnan(value) || isinf(value)) {
+      json += F("null");
+   } else {
+      json += String(value, digits);
+   }
+}
+
+/** Helper function to add one JSON boolean member. */
+void MyWebServer::AddJsonBool(ChunkedWriter &json, const __FlashStringHelper *name, bool value)
+{
+   AddJsonKey(json, name);
+   json += value ? F("true") : F("false");
+}
+
+/** Reads the etags.txt manifest of tools/compress_data.py with one '/path hash' line per file. */
+void MyWebServer::loadETags()
+{
+   File file = SPIFFS.open("/etags.txt", "r");
+
+   etags = "";
+   if (file) {
+      etags = file.readString();
+      file.close();
+   }
+}
+
+/** Returns the content hash of the file from the manifest or an empty string. */
+String MyWebServer::GetETag(String path)
+{
+   int idx = etags.indexOf(path + ' ');
+
+   if (idx < 0 || (idx > 0 && etags[idx - 1] != '\n')) {
+      return "";
+   }
+   idx += path.length() + 1;
+
+   int end = etags.indexOf('\n', idx);
+
+   return etags.substring(idx, end < 0 ? etags.length() : end);
+}
+
+/** Sends a file of the USE_EMBEDDED_WEB_ASSETS build directly from the flash.
+  * The assets are only stored gzipped: a client without gzip gets the SPIFFS
+  * file if there is one, else 406.
+  */
+bool MyWebServer::loadFromFlash(const String &path)
+{
+#ifdef USE_EMBEDDED_WEB_ASSETS
+   for (int i = 0; i < WEB_ASSET_COUNT; i++) {
+      WebAsset asset;
+
+      memcpy_P(&asset, &webAssets[i], sizeof(WebAsset));
+      if (strcmp_P(path.c_str(), asset.path) == 0) {
+         String etag = FPSTR(asset.etag);
+
+         if (server.header(F("Accept-Encoding")).indexOf(F("gzip")) < 0) {
+            if (SPIFFS.exists(path)) {
+               return false;
+            }
+            server.sendHeader(F("Vary"), F("Accept-Encoding"));
+            server.send(406, F("text/plain"), F("Only available gzip encoded"));
+            return true;
+         }
+         server.sendHeader(F("ETag"),          etag);
+         server.sendHeader(F("Cache-Control"), F("no-cache"));
+         server.sendHeader(F("Vary"),          F("Accept-Encoding"));
+         if (server.header(F("If-None-Match")).indexOf(etag) >= 0) {
+            server.send(304);
+         } else {
+            server.sendHeader(F("Content-Encoding"), F("gzip"));
+            server.send_P(200, asset.mimeType, (PGM_P) asset.data, asset.size);
+         }
+         return true;
+      }
+   }
+#else
+   (void) path;
+#endif
+   return false;
+}
+
+/** Helper function to load a file from the SPIFFS. 
+  * Sends the precompressed .gz variant if the client accepts it and answers
+  * with 304 if the ETag of the manifest still matches.
+  */
 bool MyWebServer::loadFromSpiffs(String path)
 {
    bool ret = false;
    
+   if (loadFromFlash(path)) {
+      return true;
+   }
+
    String dataType = F("text/plain");
    if(path.endsWith("/")) path += F("index.htm");
    
@@ -359,9 +576,25 @@ bool MyWebServer::loadFromSpiffs(String path)
    else if(path.endsWith(F(".pdf")))  dataType = F("application/pdf");
    else if(path.endsWith(F(".zip")))  dataType = F("application/zip");
    
-   File dataFile = SPIFFS.open(path.c_str(), "r");
+   bool isDownload = server.hasArg(F("download"));
+   bool isGzip     = !isDownload && server.header(F("Accept-Encoding")).indexOf(F("gzip")) >= 0 && SPIFFS.exists(path + F(".gz"));
+
+   File dataFile = SPIFFS.open(isGzip ? (path + F(".gz")).c_str() : path.c_str(), "r");
    if (dataFile) {
-      if (server.hasArg(F("download"))) {
+      String etag = GetETag(path);
+
+      if (etag != "") {
+         etag = (String) '"' + etag + (isGzip ? F("-gz\"") : F("\""));
+         server.sendHeader(F("ETag"), etag);
+      }
+      server.sendHeader(F("Cache-Control"), F("no-cache"));
+      server.sendHeader(F("Vary"),          F("Accept-Encoding"));
+      if (etag != "" && server.header(F("If-None-Match")).indexOf(etag) >= 0) {
+         server.send(304);
+         dataFile.close();
+         return true;
+      }
+      if (isDownload) {
          dataType = F("application/octet-stream");
       }
       if (server.streamFile(dataFile, dataType) == dataFile.size()) {
@@ -372,6 +605,58 @@ bool MyWebServer::loadFromSpiffs(String path)
    return ret;
 }
 
+/** ETag of the Main page values: the data version and the signal quality in 10% steps.
+  * The running times are not part of it, JavaScript.js advances them from the last answer.
+  */
+String MyWebServer::GetMainETag()
+{
+   String etag;
+
+   etag.reserve(32);
+   etag  = F("\"m");
+   etag += String(myData->version, HEX);
+   if (WiFi.status() == WL_CONNECTED) {
+      etag += '-';
+      etag += WifiGetRssiQuality(WiFi.RSSI()) / 10;
+   }
+   etag += '"';
+   return etag;
+}
+
+/** ETag of the Infos page values: the data version, the signal quality in 10% steps and the heap readings in KB.
+  * The counted handler calls are left out, the page itself counts with every request.
+  */
+String MyWebServer::GetInfoETag()
+{
+   String etag;
+
+   etag.reserve(48);
+   etag  = F("\"i");
+   etag += String(myData->version, HEX);
+   etag += '-';
+   etag += WifiGetRssiQuality(WiFi.RSSI()) / 10;
+   etag += '-';
+   etag += String(ESP.getFreeHeap() >> 10, HEX);
+   etag += '-';
+   etag += String(ESP.getMaxFreeBlockSize() >> 10, HEX);
+   etag += '-';
+   etag += String(MyHeap::lowWater >> 10, HEX);
+   etag += '"';
+   return etag;
+}
+
+/** Sets the ETag of the next response and answers with 304 if the client already has this version. */
+bool MyWebServer::IsNotModified(const String &etag)
+{
+   server.sendHeader(F("ETag"),          etag);
+   server.sendHeader(F("Cache-Control"), F("no-cache"));
+   if (server.header(F("If-None-Match")) == etag) {
+      server.send(304);
+      return true;
+   }
+   return false;
+}
+
 /** Redirect a root call to the Main.html site. */
 void MyWebServer::handleRoot()
 {
@@ -394,8 +679,11 @@ void MyWebServer::handleLoadMainInfo()
    if (!myOptions || !myData) {
       return;
    }
+   // No ETag, the table shows the running times as text.
+   MyHeapScope heapScope(HEAP_SITE_MAIN_INFO);
    
-   String info;
+   ChunkedWriter info(server, 200, F("text/html"));
+   char          buff[DATE_TIME_SIZE];
 
    AddTableBegin(info);
    if (myData->status != "") {
@@ -404,29 +692,79 @@ void MyWebServer::handleLoadMainInfo()
    if (WiFi.status() != WL_CONNECTED) {
       AddTableTr(info, F("AP SSID"), String(SOFT_AP_NAME));
    } else {
-      AddTableTr(info, F("AP SSID (RSSI)"), String(myOptions->wifiAP + F(" (") + WifiGetRssiAsQuality(WiFi.RSSI()) + F("%)")));
+      AddTableTr(info, F("AP SSID (RSSI)"), String(myOptions->wifiAP + F(" (") + WifiGetRssiQuality(WiFi.RSSI()) + F("%)")));
    }
 
    AddTableTr(info, F("Battery"),         String(myData->voltage,     2) + F(" V"));
    AddTableTr(info, F("Temperature"),     String(myData->temperature, 1) + F(" °C"));
    AddTableTr(info, F("Humidity"),        String(myData->humidity,    1) + F(" %"));
    AddTableTr(info, F("Pressure"),        String(myData->pressure,    1) + F(" hPa"));
-   AddTableTr(info, F("Power up time"),   formatInterval(myData->getActiveTimeSec()));
-   AddTableTr(info, F("Active time"),     formatInterval(myData->getActiveTimeSumSec()));
-   AddTableTr(info, F("Deep sleep time"), formatInterval(myData->getDeepSleepTimeSumSec()));
+   if (myData->isTimeValid()) {
+      formatDateTime(buff, sizeof(buff), myData->getEpochTime());
+      AddTableTr(info, F("Time (UTC)"),    buff);
+   }
+   formatInterval(buff, sizeof(buff), myData->getActiveTimeSec());
+   AddTableTr(info, F("Power up time"),   buff);
+   formatInterval(buff, sizeof(buff), myData->getActiveTimeSumSec());
+   AddTableTr(info, F("Active time"),     buff);
+   formatInterval(buff, sizeof(buff), myData->getDeepSleepTimeSumSec());
+   AddTableTr(info, F("Deep sleep time"), buff);
    AddTableTr(info, F("mAh"),             String(myData->getPowerConsumption(), 2));
 
    if (myOptions->isMqttEnabled) {
-      AddTableTr(info, F("MQTT sent"), String(myData->rtcData.mqttSendCount));
+      AddTableTr(info, F("MQTT sent"), (long) myData->rtcData.mqttSendCount);
    }
 
    if (myData->secondsToDeepSleep >= 0) {
-      AddTableTr(info, F("Power saving in "), String(myData->secondsToDeepSleep) + F(" Seconds"));
+      AddTableTr(info, F("Power saving in "), (long) myData->secondsToDeepSleep, F(" Seconds"));
    }
    AddTableTr(info);
    AddTableEnd(info);
+}
+
+/** Writes the values of the Main.html as JSON for /MainData and the main event. */
+void MyWebServer::AddMainData(ChunkedWriter &json)
+{
+   json += '{';
+
+   AddJsonText  (json, F("status"),      myData->status);
+   if (WiFi.status() != WL_CONNECTED) {
+      AddJsonText  (json, F("ssid"),     String(SOFT_AP_NAME));
+   } else {
+      AddJsonText  (json, F("ssid"),     myOptions->wifiAP);
+      AddJsonNumber(json, F("rssi"),     (long) WifiGetRssiQuality(WiFi.RSSI()));
+   }
+   AddJsonNumber(json, F("voltage"),     myData->voltage,     2);
+   AddJsonNumber(json, F("temperature"), myData->temperature, 1);
+   AddJsonNumber(json, F("humidity"),    myData->humidity,    1);
+   AddJsonNumber(json, F("pressure"),    myData->pressure,    1);
+   AddJsonNumber(json, F("time"),        myData->isTimeValid() ? myData->getEpochTime() : 0L);
+   AddJsonNumber(json, F("powerUp"),     myData->getActiveTimeSec());
+   AddJsonNumber(json, F("active"),      myData->getActiveTimeSumSec());
+   AddJsonNumber(json, F("deepSleep"),   myData->getDeepSleepTimeSumSec());
+   AddJsonNumber(json, F("mAh"),         myData->getPowerConsumption(), 2);
+   AddJsonNumber(json, F("mA"),          POWER_CONSUMPTION_ACTIVE, 1);
+   if (myOptions->isMqttEnabled) {
+      AddJsonNumber(json, F("mqttSent"), myData->rtcData.mqttSendCount);
+   }
+   AddJsonNumber(json, F("sleepIn"),     myData->secondsToDeepSleep);
+   json += '}';
+}
+
+/** Only the values of the Main.html as JSON. The page renders them with JavaScript.js. */
+void MyWebServer::handleLoadMainData()
+{
+   if (!myOptions || !myData) {
+      return;
+   }
+   if (IsNotModified(GetMainETag())) {
+      return;
+   }
+   MyHeapScope heapScope(HEAP_SITE_MAIN_INFO);
    
-   server.send(200, F("text/html"), info);
+   ChunkedWriter json(server, 200, F("application/json"));
+
+   AddMainData(json);
 }
 
 /** Load the firmware update page after starting OTA. */
@@ -439,6 +777,7 @@ void MyWebServer::loadUpdate()
       SetupOTA();
       ArduinoOTA.begin();
       myData->isOtaActive = true;
+      myData->changed();
    }
 
    if (loadFromSpiffs(F("/Update.html"))) {
@@ -462,63 +801,80 @@ void MyWebServer::handleLoadSettingsInfo()
    if (!myOptions || !myData) {
       return;
    }
+   MyHeapScope heapScope(HEAP_SITE_SETTINGS_INFO);
    
-   String info;
+   ChunkedWriter info(server, 200, F("text/html"));
 
    MyDbg(F("LoadSettings"), true);
 
-   AddOption(info, F("isDebugActive"), F("Debug Active"), myOptions->isDebugActive);
-
-   AddOption(info, F("bme280CheckIntervalSec"), F("Temperature check every (Interval)"), formatInterval(myOptions->bme280CheckIntervalSec));
-
-   AddBr(info);
-   {
-      HtmlTag fieldset(info, F("fieldset"));
-      {
-         HtmlTag legend(info, F("legend"));
-
-         AddOption(info, F("connectWifiAP"), F("WiFi connect"), myOptions->connectWifiAP, false);
+   bool inFieldset = false;
+
+   for (int i = 0; i < MyOptions::count(); i++) {
+      OptionInfo option;
+
+      MyOptions::getInfo(i, option);
+      if (option.flags & OPTION_LEGEND) {
+         info += inFieldset ? F("</fieldset>") : F("");
+         AddBr(info);
+         info += F("<fieldset><legend>");
+         AddOption(info, option.key, option.label, myOptions->*option.boolValue, false);
+         info += F("</legend>");
+         inFieldset = true;
+      } else if (option.type == OPTION_BOOL) {
+         AddOption(info, option.key, option.label, myOptions->*option.boolValue);
+      } else if (option.type == OPTION_INTERVAL) {
+         AddOption(info, option.key, option.label, formatInterval(myOptions->*option.longValue));
+      } else {
+         AddOption(info, option.key, option.label, myOptions->getValue(option), true, option.type == OPTION_PASSWORD);
       }
-
-      AddOption(info, F("wifiAP"), F("WiFi SSID"), myOptions->wifiAP, true);
-      AddOption(info, F("wifiPassword"), F("WiFi Password"), myOptions->wifiPassword, false, true);
+   }
+   if (inFieldset) {
+      info += F("</fieldset>");
    }
 
-   AddBr(info);
-   {
-      HtmlTag fieldset(info, F("fieldset"));
-      {
-         HtmlTag legend(info, F("legend"));
-         
-         AddOption(info, F("isMqttEnabled"), F("MQTT Active"), myOptions->isMqttEnabled, false);
-      }
-
-      AddOption(info, F("mqttName"),         F("MQTT Name"),                              myOptions->mqttName);
-      AddOption(info, F("mqttId"),           F("MQTT Id"),                                myOptions->mqttId);
+   AddIntervalInfo(info);
+}
 
-      AddOption(info, F("mqttServer"),       F("MQTT Server"),                            myOptions->mqttServer);
-      AddOption(info, F("mqttPort"),         F("MQTT Port"),                              String(myOptions->mqttPort));
-      AddOption(info, F("mqttUser"),         F("MQTT User"),                              myOptions->mqttUser);
-      AddOption(info, F("mqttPassword"),     F("MQTT Password"),                          myOptions->mqttPassword, true, true);
-      AddOption(info, F("mqttSendEverySec"), F("MQTT Send every (Interval)"),             formatInterval(myOptions->mqttSendEverySec), false);
+/** Only the option values of the Settings.html as JSON. The form is rendered by JavaScript.js. */
+void MyWebServer::handleLoadSettingsData()
+{
+   if (!myOptions || !myData) {
+      return;
    }
+   MyHeapScope heapScope(HEAP_SITE_SETTINGS_INFO);
+   
+   ChunkedWriter json(server, 200, F("application/json"));
 
-   AddBr(info);
-   {
-      HtmlTag fieldset(info, F("fieldset"));
-      {
-         HtmlTag legend(info, F("legend"));
+   json += '{';
 
-         AddOption(info, F("isDeepSleepEnabled"), F("Power saving mode active"), myOptions->isDeepSleepEnabled, false);
-      }
+   MyDbg(F("LoadSettings"), true);
 
-      AddOption(info, F("activeTimeSec"),    F("Active time (Interval)"),    formatInterval(myOptions->activeTimeSec));
-      AddOption(info, F("deepSleepTimeSec"), F("DeepSleep time (Interval)"), formatInterval(myOptions->deepSleepTimeSec), false);
+   AddJsonKey(json, F("options"));
+   json += '[';
+   for (int i = 0; i < MyOptions::count(); i++) {
+      OptionInfo option;
+
+      MyOptions::getInfo(i, option);
+      json += i ? F(",[\"") : F("[\"");
+      json += option.key;
+      json += F("\",\"");
+      json += (option.flags & OPTION_LEGEND) ? 'g' : "bnisp"[option.type];
+      json += F("\",\"");
+      json.addJson(option.label);
+      json += F("\",");
+      if (option.boolValue) {
+         json += (myOptions->*option.boolValue) ? F("true") : F("false");
+      } else if (option.longValue) {
+         json += myOptions->*option.longValue;
+      } else {
+         json += '"';
+         json.addJson(myOptions->*option.textValue);
+         json += '"';
+      }
+      json += ']';
    }
-
-   AddIntervalInfo(info);
-
-   server.send(200, F("text/html"), info);
+   json += ']';
+   json += '}';
 }
 
 /** Reads all the options from the url and save them to the SPIFFS. */
@@ -527,24 +883,15 @@ void MyWebServer::handleSaveSettings()
    if (!myOptions || !myData) {
       return;
    }
+   MyHeapScope heapScope(HEAP_SITE_SAVE_SETTINGS);
    
    MyDbg(F("SaveSettings"), true);
-   GetOption(F("connectWifiAP"),             myOptions->connectWifiAP);
-   GetOption(F("wifiAP"),                    myOptions->wifiAP);
-   GetOption(F("wifiPassword"),              myOptions->wifiPassword);
-   GetOption(F("isDebugActive"),             myOptions->isDebugActive);
-   GetOption(F("bme280CheckIntervalSec"),    myOptions->bme280CheckIntervalSec);
-   GetOption(F("isMqttEnabled"),             myOptions->isMqttEnabled);
-   GetOption(F("mqttName"),                  myOptions->mqttName);
-   GetOption(F("mqttId"),                    myOptions->mqttId);
-   GetOption(F("mqttServer"),                myOptions->mqttServer);
-   GetOption(F("mqttPort"),                  myOptions->mqttPort);
-   GetOption(F("mqttUser"),                  myOptions->mqttUser);
-   GetOption(F("mqttPassword"),              myOptions->mqttPassword);
-   GetOption(F("mqttSendEverySec"),          myOptions->mqttSendEverySec);
-   GetOption(F("isDeepSleepEnabled"),        myOptions->isDeepSleepEnabled);
-   GetOption(F("activeTimeSec"),             myOptions->activeTimeSec);
-   GetOption(F("deepSleepTimeSec"),          myOptions->deepSleepTimeSec);
+   for (int i = 0; i < MyOptions::count(); i++) {
+      OptionInfo option;
+
+      MyOptions::getInfo(i, option);
+      GetOption(option);
+   }
 
    // Reset the last mqtt time so the mqtt is not direct starting afer save settings.
    myData->rtcData.lastMqttPublishSec = myData->getActiveTimeSec();
@@ -553,6 +900,7 @@ void MyWebServer::handleSaveSettings()
    myData->awakeTimeOffsetSec = myData->getActiveTimeSec();
    
    myOptions->save();
+   myData->changed();
 
    if (false /* reboot */) {
       myData->restartInfo = 
@@ -568,9 +916,13 @@ void MyWebServer::handleLoadInfoInfo()
    if (!myOptions || !myData) {
       return;
    }
+   if (IsNotModified(GetInfoETag())) {
+      return;
+   }
+   MyHeapScope heapScope(HEAP_SITE_INFO_INFO);
    
-   String info;
-   String ssidRssi = (String) myOptions->wifiAP + F(" (") + WifiGetRssiAsQuality(WiFi.RSSI()) + F("%)");
+   ChunkedWriter info(server, 200, F("text/html"));
+   String ssidRssi = (String) myOptions->wifiAP + F(" (") + WifiGetRssiQuality(WiFi.RSSI()) + F("%)");
 
    AddTableBegin(info);
    if (myData->status != "") {
@@ -588,17 +940,110 @@ void MyWebServer::handleLoadInfoInfo()
       AddTableTr(info, F("MAC Address"),       myData->softAPmacAddress);
       AddTableTr(info);
    }
-   AddTableTr(info, F("ESP Chip ID"),          String(ESP.getChipId()));
-   AddTableTr(info, F("Flash Chip ID"),        String(ESP.getFlashChipId()));
-   AddTableTr(info, F("Real Flash Memory"),    String(ESP.getFlashChipRealSize()) + F(" Byte"));
-   AddTableTr(info, F("Total Flash Memory"),   String(ESP.getFlashChipSize())     + F(" Byte"));
-   AddTableTr(info, F("Used Flash Memory"),    String(ESP.getSketchSize())        + F(" Byte"));
-   AddTableTr(info, F("Free Sketch Memory"),   String(ESP.getFreeSketchSpace())   + F(" Byte"));
-   AddTableTr(info, F("Free Heap Memory"),     String(ESP.getFreeHeap())          + F(" Byte"));
+   AddTableTr(info, F("ESP Chip ID"),          (long) ESP.getChipId());
+   AddTableTr(info, F("Flash Chip ID"),        (long) ESP.getFlashChipId());
+   AddTableTr(info, F("Real Flash Memory"),    (long) ESP.getFlashChipRealSize(), F(" Byte"));
+   AddTableTr(info, F("Total Flash Memory"),   (long) ESP.getFlashChipSize(),     F(" Byte"));
+   AddTableTr(info, F("Used Flash Memory"),    (long) ESP.getSketchSize(),        F(" Byte"));
+   AddTableTr(info, F("Free Sketch Memory"),   (long) ESP.getFreeSketchSpace(),   F(" Byte"));
+   AddTableTr(info, F("Free Heap Memory"),     (long) ESP.getFreeHeap(),          F(" Byte"));
+   AddTableTr(info, F("Max Free Block"),       (long) ESP.getMaxFreeBlockSize(),  F(" Byte"));
+   AddTableTr(info, F("Heap Fragmentation"),   (long) ESP.getHeapFragmentation(), F(" %"));
+   AddTableTr(info, F("Heap Low Water"),       (long) MyHeap::lowWater,           F(" Byte"));
+
+   if (MyHeap::isCounting()) {
+      AddTableTr(info);
+      for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+         MyHeap::Site &site = MyHeap::sites[i];
+
+         if (site.calls) {
+            AddTableTr(info, heapSiteName(i) + F(" allocs (avg/max)"), 
+                       String(site.allocs / site.calls) + F(" / ") + String(site.maxAllocs) + F(" (") + 
+                       String(site.bytes / site.calls) + F(" Byte)"));
+         }
+      }
+   }
+
+   AddTableTr(info);
+   for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+      AddTableTr(info, awakePhaseName(i) + F(" budget overruns"), String(myData->rtcData.overrunCount[i]));
+   }
 
    AddTableEnd(info);
+}
+
+/** Writes the values of the Infos.html as JSON for /InfoData and the info event. */
+void MyWebServer::AddInfoData(ChunkedWriter &json)
+{
+   json += '{';
+
+   AddJsonText  (json, F("status"),        myData->status);
+   AddJsonBool  (json, F("ota"),           myData->isOtaActive);
+   AddJsonText  (json, F("ssid"),          myOptions->wifiAP);
+   AddJsonNumber(json, F("rssi"),          (long) WifiGetRssiQuality(WiFi.RSSI()));
+   AddJsonText  (json, F("apIp"),          myData->softAPIP);
+   AddJsonText  (json, F("localIp"),       myData->stationIP);
+   AddJsonText  (json, F("mac"),           myData->softAPmacAddress);
+   AddJsonNumber(json, F("chipId"),        (long) ESP.getChipId());
+   AddJsonNumber(json, F("flashId"),       (long) ESP.getFlashChipId());
+   AddJsonNumber(json, F("flashReal"),     (long) ESP.getFlashChipRealSize());
+   AddJsonNumber(json, F("flashSize"),     (long) ESP.getFlashChipSize());
+   AddJsonNumber(json, F("sketchSize"),    (long) ESP.getSketchSize());
+   AddJsonNumber(json, F("freeSketch"),    (long) ESP.getFreeSketchSpace());
+   AddJsonNumber(json, F("freeHeap"),      (long) ESP.getFreeHeap());
+   AddJsonNumber(json, F("maxFreeBlock"),  (long) ESP.getMaxFreeBlockSize());
+   AddJsonNumber(json, F("fragmentation"), (long) ESP.getHeapFragmentation());
+   AddJsonNumber(json, F("lowWater"),      (long) MyHeap::lowWater);
+
+   AddJsonKey(json, F("allocs"));
+   json += '[';
+   if (MyHeap::isCounting()) {
+      for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+         MyHeap::Site &site = MyHeap::sites[i];
+
+         if (site.calls) {
+            json += json.lastChar() == '[' ? F("[\"") : F(",[\"");
+            json += heapSiteName(i);
+            json += F("\",");
+            json += (long) site.calls;
+            json += ',';
+            json += (long) site.allocs;
+            json += ',';
+            json += (long) site.maxAllocs;
+            json += ',';
+            json += (long) site.bytes;
+            json += ']';
+         }
+      }
+   }
+   json += ']';
+
+   AddJsonKey(json, F("overruns"));
+   json += '[';
+   for (int i = 0; i < AWAKE_PHASE_COUNT; i++) {
+      json += i ? F(",[\"") : F("[\"");
+      json += awakePhaseName(i);
+      json += F("\",");
+      json += myData->rtcData.overrunCount[i];
+      json += ']';
+   }
+   json += F("]}");
+}
+
+/** Only the values of the Infos.html as JSON. The page renders them with JavaScript.js. */
+void MyWebServer::handleLoadInfoData()
+{
+   if (!myOptions || !myData) {
+      return;
+   }
+   if (IsNotModified(GetInfoETag())) {
+      return;
+   }
+   MyHeapScope heapScope(HEAP_SITE_INFO_INFO);
    
-   server.send(200, F("text/html"), info);
+   ChunkedWriter json(server, 200, F("application/json"));
+
+   AddInfoData(json);
 }
 
 /** Load the console page */
@@ -619,8 +1064,8 @@ void MyWebServer::handleLoadConsoleInfo()
    if (!myOptions || !myData) {
       return;
    }
+   MyHeapScope heapScope(HEAP_SITE_CONSOLE_INFO);
    
-   String sendData;
    String cmd      = server.arg(F("c1"));
    String startIdx = server.arg(F("c2"));
 
@@ -631,22 +1076,22 @@ void MyWebServer::handleLoadConsoleInfo()
 
    int indexFrom = atoi(startIdx.c_str()) - myData->logInfos.rolledOut();
 
-   sendData = (String) 
-      F("<r>"
-         "<i>") + String(myData->logInfos.count() + myData->logInfos.rolledOut()) + F("</i>"
-         "<j>1</j>"
-         "<l>");
+   ChunkedWriter sendData(server, 200, F("text/xml"));
+
+   sendData += F("<r>"
+                   "<i>");
+   sendData += myData->logInfos.count() + myData->logInfos.rolledOut();
+   sendData += F("</i>"
+                   "<j>1</j>"
+                   "<l>");
             for (int i = indexFrom; i < myData->logInfos.count(); i++) {
                if (i >= 0 && i < myData->logInfos.count()) {
-                  sendData += TextToUrl(myData->logInfos.getAt(i));
+                  sendData.addUrl(myData->logInfos.getAt(i));
                   sendData += '\n';
                }
             }
-   sendData += (String)
-         F("</l>"
-      "</r>");
-      
-   server.send(200, F("text/xml"), sendData.c_str());
+   sendData += F("</l>"
+                 "</r>");
 }
 
 /** Load the restart page. */
@@ -668,11 +1113,213 @@ void MyWebServer::handleLoadRestartInfo()
    if (!myOptions || !myData) {
       return;
    }
+   MyHeapScope heapScope(HEAP_SITE_RESTART_INFO);
    
    server.send(200, F("text/html"), myData->restartInfo);
    myData->restartInfo = "";
 }
 
+/** Load the loop profiler statistics via ajax call. Durations are shown in us. */
+void MyWebServer::handleLoadPerfInfo()
+{
+   if (!myOptions || !myData) {
+      return;
+   }
+   MyHeapScope heapScope(HEAP_SITE_PERF_INFO);
+
+   if (server.hasArg(F("reset"))) {
+      MyPerf::reset();
+   }
+
+   ChunkedWriter info(server, 200, F("text/html"));
+   uint32_t      mhz = ESP.getCpuFreqMHz();
+
+   AddTableBegin(info);
+   for (int i = 0; i < PERF_SLOT_COUNT; i++) {
+      MyPerf::Stats &stat = MyPerf::get(i);
+
+      if (stat.count == 0) {
+         continue;
+      }
+      AddTableTr(info, perfSlotName(i), String(stat.count) + F(" calls"));
+      AddTableTr(info, F("min / mean / max"), String(stat.minCycles / mhz) + F(" / ") + 
+                                              String((uint32_t) (stat.sumCycles / stat.count / mhz)) + F(" / ") + 
+                                              String(stat.maxCycles / mhz) + F(" us"));
+      for (int b = 0; b < PERF_BUCKET_COUNT; b++) {
+         if (stat.histogram[b]) {
+            String limit = b < PERF_BUCKET_COUNT - 1 ? (String) F("< ") + String(1UL << (b + 1)) : (String) F(">= ") + String(1UL << b);
+
+            AddTableTr(info, limit + F(" us"), String(stat.histogram[b]));
+         }
+      }
+      AddTableTr(info);
+   }
+   AddTableEnd(info);
+}
+
+/** Helper function to add one complete span as chrome trace event. */
+static void AddTraceEvent(ChunkedWriter &info, int pid, int phase, long beginMs, long durationMs)
+{
+   if (info.lastChar() != '[') {
+      info += ',';
+   }
+   info += F("{\"name\":\"");
+   info += tracePhaseName(phase);
+   info += F("\",\"ph\":\"X\",\"pid\":");
+   info += pid;
+   info += F(",\"tid\":0,\"ts\":");
+   info += beginMs;
+   info += F("000,\"dur\":");
+   info += durationMs;
+   info += F("000}");
+}
+
+/** Sends the timeline of the current and the last boots in the chrome trace format (chrome://tracing). 
+  * pid 0 is the current boot, pid 1.. are the boots from the RTC memory.
+  */
+void MyWebServer::handleTrace()
+{
+   if (!myOptions || !myData) {
+      return;
+   }
+   MyHeapScope heapScope(HEAP_SITE_TRACE);
+   
+   ChunkedWriter info(server, 200, F("application/json"));
+   long          now = millis();
+
+   info += F("{\"traceEvents\":[");
+
+   for (int i = 0; i < MyTrace::count(); i++) {
+      MyTrace::Span &span = MyTrace::getAt(i);
+
+      AddTraceEvent(info, 0, span.phase, span.beginMs, (span.endMs ? span.endMs : now) - span.beginMs);
+   }
+   for (int b = 0; b < TRACE_BOOT_COUNT; b++) {
+      TraceBoot &boot = myData->rtcData.traceBoots[b];
+
+      for (int i = 0; i < boot.count; i++) {
+         AddTraceEvent(info, b + 1, boot.spans[i].phase, boot.spans[i].beginMs, boot.spans[i].durationMs);
+      }
+   }
+   info += F("]}");
+}
+
+/** Starts a server-sent event stream for the channels of the 'e' argument (main, info, log).
+  * The connection stays open after the handler and gets the changes from sendEvents.
+  */
+void MyWebServer::handleEvents()
+{
+   String  e        = server.arg(F("e"));
+   uint8_t channels = (e.indexOf(F("main")) >= 0 ? 1 << EVENT_MAIN : 0) |
+                      (e.indexOf(F("info")) >= 0 ? 1 << EVENT_INFO : 0) |
+                      (e.indexOf(F("log"))  >= 0 ? 1 << EVENT_LOG  : 0);
+
+   for (int i = 0; i < EVENT_CLIENT_COUNT; i++) {
+      EventClient &ec = eventClients[i];
+
+      if (!ec.client.connected() && channels) {
+         ec.client          = server.client();
+         ec.channels        = channels;
+         ec.crc[EVENT_MAIN] = 0;
+         ec.crc[EVENT_INFO] = 0;
+         ec.logIdx          = 0;
+         ec.client.setNoDelay(true);
+         ec.client.print(F("HTTP/1.1 200 OK\r\n"
+                           "Content-Type: text/event-stream\r\n"
+                           "Cache-Control: no-cache\r\n"
+                           "Connection: keep-alive\r\n\r\n"));
+         // Send the current values at once
+         eventCheckMs[EVENT_MAIN] = millis() - EVENT_MAIN_CHECK_MS;
+         eventCheckMs[EVENT_INFO] = millis() - EVENT_INFO_CHECK_MS;
+         return;
+      }
+   }
+   // The page falls back to polling
+   server.send(503, F("text/plain"), F("No free event stream"));
+}
+
+/** Sends the values to every subscribed stream whose last sent crc differs.
+  * The crc is taken from the ETag and not from the values, the running times and
+  * heap bytes change every second and the page advances the times itself.
+  */
+void MyWebServer::sendEvent(int channel, const __FlashStringHelper *name, void (*addData)(ChunkedWriter &json), String (*getETag)())
+{
+   String etag = getETag();
+   long   crc  = crc32(0, (unsigned char *) etag.c_str(), etag.length());
+
+   for (int i = 0; i < EVENT_CLIENT_COUNT; i++) {
+      EventClient &ec = eventClients[i];
+
+      if ((ec.channels & (1 << channel)) && ec.client.connected() && ec.crc[channel] != crc) {
+         EventWriter writer(ec.client, name);
+
+         addData(writer);
+         ec.crc[channel] = crc;
+      }
+   }
+}
+
+/** Sends the new console lines as JSON string array to every log stream. */
+void MyWebServer::sendLogEvents()
+{
+   long total = myData->logInfos.count() + myData->logInfos.rolledOut();
+
+   for (int i = 0; i < EVENT_CLIENT_COUNT; i++) {
+      EventClient &ec = eventClients[i];
+
+      if ((ec.channels & (1 << EVENT_LOG)) && ec.client.connected() && ec.logIdx < total) {
+         EventWriter writer(ec.client, F("log"));
+
+         writer += '[';
+         for (int idx = max(ec.logIdx - myData->logInfos.rolledOut(), 0L); idx < myData->logInfos.count(); idx++) {
+            if (writer.lastChar() != '[') {
+               writer += ',';
+            }
+            writer += '"';
+            writer.addJson(myData->logInfos.getAt(idx));
+            writer += '"';
+         }
+         writer += ']';
+         ec.logIdx = total;
+      }
+   }
+}
+
+/** Pushes the changed values and new console lines to the open event streams. */
+void MyWebServer::sendEvents()
+{
+   uint8_t       channels = 0;
+   unsigned long now      = millis();
+
+   for (int i = 0; i < EVENT_CLIENT_COUNT; i++) {
+      if (eventClients[i].client.connected()) {
+         channels |= eventClients[i].channels;
+      }
+   }
+   if (!channels || !myOptions || !myData) {
+      return;
+   }
+   if ((channels & (1 << EVENT_MAIN)) && now - eventCheckMs[EVENT_MAIN] >= EVENT_MAIN_CHECK_MS) {
+      eventCheckMs[EVENT_MAIN] = now;
+      sendEvent(EVENT_MAIN, F("main"), AddMainData, GetMainETag);
+   }
+   if ((channels & (1 << EVENT_INFO)) && now - eventCheckMs[EVENT_INFO] >= EVENT_INFO_CHECK_MS) {
+      eventCheckMs[EVENT_INFO] = now;
+      sendEvent(EVENT_INFO, F("info"), AddInfoData, GetInfoETag);
+   }
+   if (channels & (1 << EVENT_LOG)) {
+      sendLogEvents();
+   }
+   if (now - eventKeepAliveMs >= EVENT_KEEP_ALIVE_MS) {
+      eventKeepAliveMs = now;
+      for (int i = 0; i < EVENT_CLIENT_COUNT; i++) {
+         if (eventClients[i].client.connected()) {
+            eventClients[i].client.print(F(":\n\n"));
+         }
+      }
+   }
+}
+
 /** Handle if the url could not be found. */
 void MyWebServer::handleNotFound()
 {
@@ -700,6 +1347,8 @@ void MyWebServer::handleNotFound()
 /** Default for an unknown web request on not found. */
 void MyWebServer::handleWebRequests()
 {
+   MyHeapScope heapScope(HEAP_SITE_FILE);
+
    if (loadFromSpiffs(server.uri())) {
       return;
    }
@@ -57,6 +57,249 @@ function loadInfoInfo(p)
     lt = setTimeout(loadInfoInfo, 5000);
 }
 
+function esc(t)
+{
+    return String(t).replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;').replace(/"/g, '&quot;').replace(/'/g, '&#39;');
+}
+
+function pad(n)
+{
+    return (n < 10 ? '0' : '') + n;
+}
+
+function fmtInterval(s)
+{
+    var d = Math.floor(s / 86400);
+    var t = pad(Math.floor(s / 3600) % 24) + ':' + pad(Math.floor(s / 60) % 60) + ':' + pad(s % 60);
+
+    return d > 0 ? d + ' ' + t : t;
+}
+
+function fmtDateTime(e)
+{
+    return new Date(e * 1000).toISOString().replace('T', ' ').substring(0, 19);
+}
+
+function tr(n, v)
+{
+    if (n == null) {
+        return '<tr><th></th><td>&nbsp;</td></tr>';
+    }
+    if (v == null || v === '') {
+        return '';
+    }
+    return '<tr><th>' + esc(n) + '</th><td>' + esc(v) + '</td></tr>';
+}
+
+var et = {};
+
+function loadJson(u, f, r)
+{
+    if (x != null) {
+        x.abort();
+    }
+    clearTimeout(lt);
+    x = new XMLHttpRequest();
+    x.onreadystatechange = function () {
+        if (x.readyState == 4 && x.status == 200) {
+            et[u] = x.getResponseHeader('ETag');
+            document.getElementById('info').innerHTML = f(JSON.parse(x.responseText));
+        }
+    };
+    x.open('GET', u, true);
+    // Set here, so the 304 reaches this page instead of the browser cache.
+    if (et[u]) {
+        x.setRequestHeader('If-None-Match', et[u]);
+    }
+    x.send();
+    if (r) {
+        lt = setTimeout(r, 5000);
+    }
+}
+
+var md = null, mt = 0;
+
+/** Main values of the last answer or event, the running times advance with the local clock. */
+function mainHtml(d)
+{
+    var h = '<table style=\'width:100%\'>', e;
+
+    if (d != null) {
+        if (md == null) {
+            setInterval(function () { document.getElementById('info').innerHTML = mainHtml(); }, 1000);
+        }
+        md = d;
+        mt = Date.now();
+    }
+    d = md;
+    e = Math.floor((Date.now() - mt) / 1000);
+
+    h += tr('Status', d.status);
+    if (d.rssi == null) {
+        h += tr('AP SSID', d.ssid);
+    } else {
+        h += tr('AP SSID (RSSI)', d.ssid + ' (' + d.rssi + '%)');
+    }
+    h += tr('Battery',     d.voltage     == null ? '' : d.voltage.toFixed(2)     + ' V');
+    h += tr('Temperature', d.temperature == null ? '' : d.temperature.toFixed(1) + ' °C');
+    h += tr('Humidity',    d.humidity    == null ? '' : d.humidity.toFixed(1)    + ' %');
+    h += tr('Pressure',    d.pressure    == null ? '' : d.pressure.toFixed(1)    + ' hPa');
+    if (d.time > 0) {
+        h += tr('Time (UTC)', fmtDateTime(d.time + e));
+    }
+    h += tr('Power up time',   fmtInterval(d.powerUp + e));
+    h += tr('Active time',     fmtInterval(d.active + e));
+    h += tr('Deep sleep time', fmtInterval(d.deepSleep));
+    h += tr('mAh',             (d.mAh + d.mA * e / 3600).toFixed(2));
+    if (d.mqttSent != null) {
+        h += tr('MQTT sent', d.mqttSent);
+    }
+    if (d.sleepIn >= 0) {
+        h += tr('Power saving in ', Math.max(d.sleepIn - e, 0) + ' Seconds');
+    }
+    return h + tr() + '</table>';
+}
+
+function loadMainData()
+{
+    loadJson('MainData', mainHtml, loadMainData);
+}
+
+function option(t, i, n, v)
+{
+    if (t != 'b' && t != 'g') {
+        return '<b>' + esc(n) + '</b><input id=\'' + i + '\' name=\'' + i + '\' value=\'' + esc(t == 'i' ? fmtInterval(v) : v) + '\'>';
+    }
+    return '<input style=\'width:auto;\' id=\'' + i + '\' name=\'' + i + '\' type=\'checkbox\'' + (v ? ' checked' : '') + '><b>' + esc(n) + '</b>';
+}
+
+function loadSettingsData()
+{
+    loadJson('SettingsData', function (d) {
+        var h = '', g = false;
+
+        for (var k = 0; k < d.options.length; k++) {
+            var s = d.options[k];
+
+            if (s[1] == 'g') {
+                h += (g ? '</fieldset>' : '') + '<br /><fieldset><legend>' + option('b', s[0], s[2], s[3]) + '</legend>';
+                g = true;
+            } else {
+                h += option(s[1], s[0], s[2], s[3]) + '<br />';
+            }
+        }
+        if (g) {
+            h += '</fieldset>';
+        }
+        return h + '<p>' + esc('Interval in \'[days] hours:minutes:seconds\' or just \'seconds\'') + '</p><br />';
+    });
+}
+
+function infoHtml(d)
+{
+    var h = '<table style=\'width:100%\'>';
+
+    if (d.status != '') {
+        h += tr('Status', d.status) + tr();
+    }
+    if (d.ota) {
+        h += tr('OTA', 'Active') + tr();
+    }
+    h += tr('AP1 SSID (RSSI)',    d.ssid + ' (' + d.rssi + '%)');
+    h += tr('AP IP',              d.apIp);
+    h += tr('Locale IP',          d.localIp);
+    h += tr('MAC Address',        d.mac);
+    h += tr();
+    h += tr('ESP Chip ID',        d.chipId);
+    h += tr('Flash Chip ID',      d.flashId);
+    h += tr('Real Flash Memory',  d.flashReal    + ' Byte');
+    h += tr('Total Flash Memory', d.flashSize    + ' Byte');
+    h += tr('Used Flash Memory',  d.sketchSize   + ' Byte');
+    h += tr('Free Sketch Memory', d.freeSketch   + ' Byte');
+    h += tr('Free Heap Memory',   d.freeHeap     + ' Byte');
+    h += tr('Max Free Block',     d.maxFreeBlock + ' Byte');
+    h += tr('Heap Fragmentation', d.fragmentation + ' %');
+    h += tr('Heap Low Water',     d.lowWater     + ' Byte');
+    if (d.allocs.length > 0) {
+        h += tr();
+        for (var i = 0; i < d.allocs.length; i++) {
+            var a = d.allocs[i];
+
+            h += tr(a[0] + ' allocs (avg/max)', Math.floor(a[2] / a[1]) + ' / ' + a[3] + ' (' + Math.floor(a[4] / a[1]) + ' Byte)');
+        }
+    }
+    h += tr();
+    for (var i = 0; i < d.overruns.length; i++) {
+        h += tr(d.overruns[i][0] + ' budget overruns', d.overruns[i][1]);
+    }
+    return h + '</table>';
+}
+
+function loadInfoData()
+{
+    loadJson('InfoData', infoHtml, loadInfoData);
+}
+
+var es = null;
+
+function loadEvents(e, f, p)
+{
+    if (typeof EventSource == 'undefined') {
+        p();
+        return;
+    }
+    es = new EventSource('Events?e=' + e);
+    es.addEventListener(e, function (m) {
+        var h = f(JSON.parse(m.data));
+
+        if (h != null) {
+            document.getElementById('info').innerHTML = h;
+        }
+    });
+    es.onerror = function () {
+        if (es.readyState == EventSource.CLOSED) {
+            es = null;
+            p();
+        }
+    };
+}
+
+function addLog(d)
+{
+    var t = document.getElementById('t1');
+    var b = t.scrollTop >= t.scrollHeight - t.clientHeight - 10;
+
+    for (var i = 0; i < d.length; i++) {
+        t.value += d[i] + '\n';
+    }
+    if (b) {
+        t.scrollTop = 99999;
+    }
+    return null;
+}
+
+function loadPerfInfo(p)
+{
+    var a = '';
+
+    if (loadPerfInfo.arguments.length == 1) {
+        a = p;
+    }
+    if (x != null) {
+        x.abort();
+    }
+    clearTimeout(lt);
+    x = new XMLHttpRequest();
+    x.onreadystatechange = function () {
+        if (x.readyState == 4 && x.status == 200) {
+            document.getElementById('info').innerHTML = x.responseText;
+        }
+    };
+    x.open('GET', 'PerfInfo' + a, true);
+    x.send();
+    lt = setTimeout(loadPerfInfo, 5000);
+}
+
 var sn = 0;
 var id = 0;
 
@@ -65,6 +308,16 @@ function loadConsoleInfo(p)
 	var c, o, t;
 
 	clearTimeout(lt); o = '';
+	if (es != null) {
+		if (p == 1) {
+			c = document.getElementById('c1');
+			x = new XMLHttpRequest();
+			x.open('GET', 'ConsoleInfo?c2=2147483647&c1=' + encodeURIComponent(c.value), true);
+			x.send();
+			c.value = '';
+		}
+		return false;
+	}
 	t = document.getElementById('t1');
 	if (p == 1) {
 	    c = document.getElementById('c1');
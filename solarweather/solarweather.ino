@@ -34,10 +34,15 @@
 #include "Utils.h"
 #include "StringList.h"
 #include "Options.h"
+#include "Telemetry.h"
+#include "MqttTls.h"
 #include "Data.h"
 #include "Voltage.h"
 #include "DeepSleep.h"
+#include "Perf.h"
+#include "HeapStats.h"
 #include "WebServer.h"
+#include "TimeSync.h"
 #include "Mqtt.h"
 #include "BME280.h"
 
@@ -47,6 +52,7 @@ MyData      myData;                          //!< The global collected data.
 MyVoltage   myVoltage   (myOptions, myData); //!< Helper class for deep sleeps.
 MyDeepSleep myDeepSleep (myOptions, myData); //!< Helper class for deep sleeps.
 MyWebServer myWebServer (myOptions, myData); //!< The Webserver
+MyTimeSync  myTimeSync  (myOptions, myData); //!< SNTP wall-clock time
 MyBME280    myBME280    (myOptions, myData); //!< Helper class for the BME280 sensor communication.
 
 MyMqtt      myMqtt(MyWebServer::server.wifiClient(), myOptions, myData); 
@@ -74,19 +80,24 @@ void myDebugInfo(String info, bool fromWebserver, bool newline)
 {
    static bool lastNewLine = true;
    
-   if (newline || lastNewLine != newline) {
-      String secs = String(myData.getActiveTimeSec()) + F(": ");
-
-      myData.logInfos.addTail(secs + info);
-      if (!lastNewLine) {
-         Serial.println("");
+   // Only the console lines, the web server calls below count for their own sites.
+   {
+      MyHeapScope heapScope(HEAP_SITE_LOG_APPEND);
+
+      if (newline || lastNewLine != newline) {
+         String secs = String(myData.getActiveTimeSec()) + F(": ");
+
+         myData.logInfos.addTail(secs + info);
+         if (!lastNewLine) {
+            Serial.println("");
+         }
+         Serial.println(secs + info);
+      } else {
+         String tmp = myData.logInfos.removeTail();
+
+         Serial.print(tmp + info);
+         myData.logInfos.addTail(tmp + info);
       }
-      Serial.println(secs + info);
-   } else {
-      String tmp = myData.logInfos.removeTail();
-
-      Serial.print(tmp + info);
-      myData.logInfos.addTail(tmp + info);
    }
    lastNewLine = newline;
 
@@ -109,6 +120,14 @@ void myDelayLoop()
    yield();
 }
 
+/** Overwritten awake budget check of the blocking phases.
+  * Forces the deep sleep if the time budget of this wake is exhausted.
+  */
+void myCheckAwakeBudget(AwakePhase phase)
+{
+   myDeepSleep.checkBudget(phase);
+}
+
 /** Main setup function. This is also called after every deep sleep. 
   * Do the initialization of every sub-component. */
 void setup() 
@@ -117,17 +136,30 @@ void setup()
    delay(1000);
 
    MyDbg(F("Start SolarWeather ..."));
+   MyTrace trace(TRACE_SETUP);
 
-   SPIFFS.begin();
-   myOptions.load();
+   // Intermediate timer wake of a long deep sleep? Back to sleep without the file system.
+   myDeepSleep.begin();
+   if (myData.rtcData.deepSleepTimeRestSec > 0) {
+      myDeepSleep.sleep();
+   }
+
+   {
+      MyTrace trace(TRACE_SPIFFS);
+      SPIFFS.begin();
+   }
+   {
+      MyTrace trace(TRACE_OPTIONS);
+      myOptions.load();
+   }
 
    // Back to deep sleep?
-   myDeepSleep.begin();
    if (myDeepSleep.haveToSleep()) {
       myDeepSleep.sleep();
    } else { // no deep sleep!
       myVoltage.begin();
       myWebServer.begin();
+      myTimeSync.begin();
       myMqtt.begin();
       myBME280.begin();
    }
@@ -140,17 +172,32 @@ void setup()
   */
 void loop() 
 {
-   myVoltage.readVoltage();
-   myBME280.readValues();
-   myDeepSleep.updateTimeToSleep();
+   MyPerf perf(PERF_LOOP);
 
-   myWebServer.handleClient();
+   {
+      MyPerf perf(PERF_VOLTAGE);
+      myVoltage.readVoltage();
+   }
+   {
+      MyPerf perf(PERF_BME280);
+      myBME280.readValues();
+   }
+   {
+      MyPerf perf(PERF_DEEP_SLEEP);
+      myDeepSleep.updateTimeToSleep();
+   }
+   {
+      MyPerf perf(PERF_WEB);
+      myWebServer.handleClient();
+   }
    
    if (myData.isOtaActive) {
+      MyPerf perf(PERF_OTA);
       ArduinoOTA.handle();    
    }
 
    if (myOptions.isMqttEnabled) {
+      MyPerf perf(PERF_MQTT);
       myMqtt.handleClient();
    }
 
@@ -158,8 +205,12 @@ void loop()
       if (myDeepSleep.haveToSleep()) {
          myDeepSleep.sleep();
       }
+      myCheckAwakeBudget(AWAKE_PHASE_WEB);
+   } else {
+      myCheckAwakeBudget(AWAKE_PHASE_MQTT);
    }
 
+   MyHeap::sample();
    yield();
    delay(10); 
 }
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Prepares the SPIFFS data folder before the upload:
+writes a gzip variant of every compressible file and the etags.txt manifest
+with a content hash per file for the ETag of MyWebServer::loadFromSpiffs.
+
+With --embed it writes solarweather/WebAssets.h instead, with every file as
+precompressed PROGMEM array for the USE_EMBEDDED_WEB_ASSETS build.
+
+Usage: python3 tools/compress_data.py [--embed] [data folder]
+"""
+
+import gzip
+import hashlib
+import os
+import sys
+
+MANIFEST     = 'etags.txt'
+HEADER       = 'WebAssets.h'
+UNCOMPRESSED = ('.gz', '.png', '.jpg', '.gif', '.zip')
+MIME_TYPES   = {
+    '.html': 'text/html',
+    '.htm':  'text/html',
+    '.css':  'text/css',
+    '.js':   'application/javascript',
+    '.png':  'image/png',
+    '.gif':  'image/gif',
+    '.jpg':  'image/jpeg',
+    '.ico':  'image/x-icon',
+    '.xml':  'text/xml',
+}
+
+
+def content_hash(content):
+    return hashlib.sha1(content).hexdigest()[:16]
+
+
+def embed(data, header):
+    """Writes all files of the data folder gzipped as PROGMEM arrays with a lookup table."""
+    out     = ['// Generated by tools/compress_data.py --embed. Do not edit.\n\n']
+    entries = []
+    names   = sorted(n for n in os.listdir(data) if os.path.splitext(n)[1] in MIME_TYPES)
+
+    for idx, name in enumerate(names):
+        with open(os.path.join(data, name), 'rb') as f:
+            content = f.read()
+        packed = gzip.compress(content, 9, mtime=0)
+        mime   = MIME_TYPES[os.path.splitext(name)[1]]
+
+        out.append('static const char    webAssetPath%d[] PROGMEM = "/%s";\n' % (idx, name))
+        out.append('static const char    webAssetMime%d[] PROGMEM = "%s";\n' % (idx, mime))
+        out.append('static const char    webAssetETag%d[] PROGMEM = "\\"%s-gz\\"";\n' % (idx, content_hash(content)))
+        out.append('static const uint8_t webAssetData%d[] PROGMEM = {\n' % idx)
+        for i in range(0, len(packed), 16):
+            out.append('   ' + ', '.join('0x%02x' % b for b in packed[i:i + 16]) + ',\n')
+        out.append('};\n\n')
+        entries.append('   { webAssetPath%d, webAssetMime%d, webAssetETag%d, webAssetData%d, sizeof(webAssetData%d) },\n' % ((idx,) * 5))
+        print('%-20s %6d -> %6d bytes' % (name, len(content), len(packed)))
+
+    out.append('#define WEB_ASSET_COUNT %d //!< Number of entries in webAssets\n\n' % len(entries))
+    out.append('static const WebAsset webAssets[WEB_ASSET_COUNT] PROGMEM = {\n')
+    out.extend(entries)
+    out.append('};\n')
+
+    with open(header, 'w', newline='\n') as f:
+        f.writelines(out)
+
+
+def main():
+    args   = [a for a in sys.argv[1:] if a != '--embed']
+    sketch = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'solarweather')
+    data   = args[0] if args else os.path.join(sketch, 'data')
+    lines  = []
+
+    if '--embed' in sys.argv:
+        embed(data, os.path.join(sketch, HEADER))
+        return
+
+    for name in sorted(os.listdir(data)):
+        path = os.path.join(data, name)
+        if name == MANIFEST or not os.path.isfile(path) or name.endswith('.gz'):
+            continue
+        with open(path, 'rb') as f:
+            content = f.read()
+
+        lines.append('/%s %s\n' % (name, content_hash(content)))
+
+        if not name.endswith(UNCOMPRESSED):
+            # mtime=0 keeps the output reproducible
+            packed = gzip.compress(content, 9, mtime=0)
+            with open(path + '.gz', 'wb') as f:
+                f.write(packed)
+            print('%-20s %6d -> %6d bytes' % (name, len(content), len(packed)))
+
+    with open(os.path.join(data, MANIFEST), 'w', newline='\n') as f:
+        f.writelines(lines)
+
+
+if __name__ == '__main__':
+    main()